@@ -419,22 +419,22 @@ void RefineDefMap::OnAddDefect(wxCommandEvent& evt)
 
         bool needLoadPreview = false;
 
-        { // lock around changes to defect map
-            wxCriticalSectionLocker lck(pCamera->DarkFrameLock);
-            DefectMap *pCurrMap = pCamera->CurrentDefectMap;
-            if (pCurrMap)
+        // the camera thread may be using the current map, so the defect is added to a copy
+        wxSharedPtr<DefectMap> pCurrMap = pCamera->GetDefectMap();
+        if (pCurrMap)
+        {
+            if (!pCurrMap->FindDefect(badspot))
             {
-                if (!pCurrMap->FindDefect(badspot))
-                {
-                    pCurrMap->AddDefect(badspot);           // Changes both in-memory instance and disk file
-                    manualPixelCount++;
-                    pStatsGrid->SetCellValue(manualPixelLoc, wxString::Format("%d", manualPixelCount));
-                    needLoadPreview = true;
-                }
+                DefectMap *pNewMap = new DefectMap(*pCurrMap);
+                pNewMap->AddDefect(badspot);           // Changes both in-memory instance and disk file
+                pCamera->SetDefectMap(pNewMap);
+                manualPixelCount++;
+                pStatsGrid->SetCellValue(manualPixelLoc, wxString::Format("%d", manualPixelCount));
+                needLoadPreview = true;
             }
-            else
-                ShowStatus(_("You must first load a bad-pixel map"), false);
-        } // lock defect map
+        }
+        else
+            ShowStatus(_("You must first load a bad-pixel map"), false);
 
         if (needLoadPreview)
         {
@@ -461,8 +461,7 @@ void RefineDefMap::LoadPreview()
 {
     m_defectMap.clear();
 
-    wxCriticalSectionLocker lck(pCamera->DarkFrameLock);
-    DefectMap *curMap = pCamera->CurrentDefectMap;
+    wxSharedPtr<DefectMap> curMap = pCamera->GetDefectMap();
     if (curMap)
     {
         m_defectMap = *curMap;
@@ -1,70 +0,0 @@
-//
-//  matlab_interaction.h
-//  PHD
-//
-//  Created by Stephan Wenninger
-//  Copyright 2014, Max Planck Society.
-
-/*
- *  This source code is distributed under the following "BSD" license
- *  Redistribution and use in source and binary forms, with or without
- *  modification, are permitted provided that the following conditions are met:
- *    Redistributions of source code must retain the above copyright notice,
- *     this list of conditions and the following disclaimer.
- *    Redistributions in binary form must reproduce the above copyright notice,
- *     this list of conditions and the following disclaimer in the
- *     documentation and/or other materials provided with the distribution.
- *    Neither the name of Bret McKee, Dad Dog Development, nor the names of its
- *     Craig Stark, Stark Labs nor the names of its
- *     contributors may be used to endorse or promote products derived from
- *     this software without specific prior written permission.
- *
- *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
- *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
- *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
- *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
- *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
- *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
- *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
- *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
- *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
- *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
- *  POSSIBILITY OF SUCH DAMAGE.
- */
-
-#ifndef UDP_GUIDING_INTERACTION
-#define UDP_GUIDING_INTERACTION
-
-#include <wx/defs.h>
-#include <wx/string.h>
-#include <wx/socket.h>
-
-
-
-class UDPGuidingInteraction {
-private:
-    wxString host;
-    wxString sendPort;
-    wxString rcvPort;
-
-    wxIPV4address server;
-    wxIPV4address sendClient;
-    wxIPV4address receiveClient;
-
-    wxDatagramSocket* sendSocket;
-    wxDatagramSocket* receiveSocket;
-
-
-    void* last_sent_buffer;
-    wxUint32 last_sent_buffer_length;
-
-
-public:
-    UDPGuidingInteraction(wxString host, wxString sendPort, wxString rcvPort);
-    ~UDPGuidingInteraction();
-
-    bool SendToUDPPort(void * buf, wxUint32 len);
-	bool ReceiveFromUDPPort(void * buf, wxUint32 len);
-};
-
-#endif /* defined(UDP_GUIDING_INTERACTION) */
@@ -472,6 +472,46 @@ bool Camera_ZWO::ST4PulseGuideScope(int direction, int duration)
     return false;
 }
 
+bool Camera_ZWO::ST4PulseGuideScopeDual(int raDirection, int raDuration, int decDirection, int decDuration)
+{
+    // the guide port lines are independent, so turn both on and each one off
+    // when its pulse is done
+    ASI_GUIDE_DIRECTION ra = GetASIDirection(raDirection);
+    ASI_GUIDE_DIRECTION dec = GetASIDirection(decDirection);
+
+    if (raDuration > 0)
+        ASIPulseGuideOn(m_cameraId, ra);
+    if (decDuration > 0)
+        ASIPulseGuideOn(m_cameraId, dec);
+
+    ASI_GUIDE_DIRECTION first = ra, second = dec;
+    int firstDuration = raDuration, secondDuration = decDuration;
+    if (decDuration < raDuration)
+    {
+        first = dec;
+        second = ra;
+        firstDuration = decDuration;
+        secondDuration = raDuration;
+    }
+
+    bool interrupted = false;
+
+    if (firstDuration > 0)
+    {
+        interrupted = WorkerThread::MilliSleep(firstDuration, WorkerThread::INT_ANY) != 0;
+        ASIPulseGuideOff(m_cameraId, first);
+    }
+
+    if (secondDuration > 0)
+    {
+        if (!interrupted)
+            WorkerThread::MilliSleep(secondDuration - firstDuration, WorkerThread::INT_ANY);
+        ASIPulseGuideOff(m_cameraId, second);
+    }
+
+    return false;
+}
+
 void  Camera_ZWO::ClearGuidePort()
 {
     ASIPulseGuideOff(m_cameraId, ASI_GUIDE_NORTH);
@@ -54,10 +54,12 @@ public:
     bool    Disconnect();
 
     bool    ST4PulseGuideScope(int direction, int duration);
+    bool    ST4PulseGuideScopeDual(int raDirection, int raDuration, int decDirection, int decDuration);
     void    ClearGuidePort();
 
     virtual bool HasNonGuiCapture(void) { return true; }
     virtual bool ST4HasNonGuiMove(void) { return true; }
+    virtual bool ST4HasDualAxisPulse(void) { return true; }
 
 private:
     bool StopCapture(void);
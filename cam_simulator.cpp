@@ -1130,7 +1130,8 @@ bool Camera_SimClass::Capture(int duration, usImage& img, int options, const wxR
     return false;
 }
 
-bool Camera_SimClass::ST4PulseGuideScope(int direction, int duration)
+// moves the simulated star by the full amount of a guide pulse
+bool Camera_SimClass::ApplyGuidePulse(int direction, int duration)
 {
     double d = (SimCamParams::guide_rate * duration / 1000.0) * SimCamParams::inverse_imagescale;
 
@@ -1150,10 +1151,28 @@ bool Camera_SimClass::ST4PulseGuideScope(int direction, int duration)
     case SOUTH:   sim->dec_ofs.incr(-d); break;
     default: return true;
     }
+    return false;
+}
+
+bool Camera_SimClass::ST4PulseGuideScope(int direction, int duration)
+{
+    if (ApplyGuidePulse(direction, duration))
+        return true;
     WorkerThread::MilliSleep(duration, WorkerThread::INT_ANY);
     return false;
 }
 
+bool Camera_SimClass::ST4PulseGuideScopeDual(int raDirection, int raDuration, int decDirection, int decDuration)
+{
+    if ((raDuration > 0 && ApplyGuidePulse(raDirection, raDuration)) ||
+        (decDuration > 0 && ApplyGuidePulse(decDirection, decDuration)))
+    {
+        return true;
+    }
+    WorkerThread::MilliSleep(wxMax(raDuration, decDuration), WorkerThread::INT_ANY);
+    return false;
+}
+
 PierSide Camera_SimClass::SideOfPier(void) const
 {
     return SimCamParams::pier_side;
@@ -41,6 +41,7 @@ struct SimCamState;
 class Camera_SimClass : public GuideCamera
 {
     SimCamState *sim;
+    bool         ApplyGuidePulse(int direction, int duration);
 public:
     Camera_SimClass();
     ~Camera_SimClass();
@@ -52,6 +53,8 @@ public:
     bool         HasNonGuiCapture(void) { return true; }
     bool         ST4HasNonGuiMove(void) { return true; }
     bool         ST4PulseGuideScope (int direction, int duration);
+    bool         ST4HasDualAxisPulse(void) { return true; }
+    bool         ST4PulseGuideScopeDual(int raDirection, int raDuration, int decDirection, int decDuration);
     PierSide     SideOfPier(void) const;
     void         FlipPierSide(void);
 };
@@ -191,8 +191,9 @@ GuideCamera::GuideCamera(void)
     UseSubframes = pConfig->Profile.GetBoolean("/camera/UseSubframes", DefaultUseSubframes);
     ReadDelay = pConfig->Profile.GetInt("/camera/ReadDelay", DefaultReadDelay);
 
-    CurrentDarkFrame = NULL;
-    CurrentDefectMap = NULL;
+    m_darkGeneration = 1;
+    m_pedestalGeneration = 0;
+    m_darkPedestal = 0;
 
     GuideCameraGain = pConfig->Profile.GetInt("/camera/gain", DefaultGuideCameraGain);
     m_timeoutMs = pConfig->Profile.GetInt("/camera/TimeoutMs", DefaultGuideCameraTimeoutMs);
@@ -939,23 +940,20 @@ wxString GuideCamera::GetSettingsSummary()
 void GuideCamera::AddDark(usImage *dark)
 {
     int const expdur = dark->ImgExpDur;
+    wxSharedPtr<usImage> newDark(dark);
 
-    { // lock scope
-        wxCriticalSectionLocker lck(DarkFrameLock);
-
-        // free the prior dark with this exposure duration
-        ExposureImgMap::iterator pos = Darks.find(expdur);
-        if (pos != Darks.end())
-        {
-            usImage *prior = pos->second;
-            if (prior == CurrentDarkFrame)
-                CurrentDarkFrame = dark;
-            delete prior;
-        }
+    wxCriticalSectionLocker lck(DarkFrameLock);
 
-    } // lock scope
+    // replace the prior dark with this exposure duration; it is freed when the
+    // worker thread is done with it
+    ExposureImgMap::iterator pos = Darks.find(expdur);
+    if (pos != Darks.end() && pos->second.get() == CurrentDarkFrame.get())
+    {
+        CurrentDarkFrame = newDark;
+        ++m_darkGeneration;
+    }
 
-    Darks[expdur] = dark;
+    Darks[expdur] = newDark;
 }
 
 void GuideCamera::SelectDark(int exposureDuration)
@@ -965,13 +963,18 @@ void GuideCamera::SelectDark(int exposureDuration)
 
     wxCriticalSectionLocker lck(DarkFrameLock);
 
-    CurrentDarkFrame = 0;
+    wxSharedPtr<usImage> prior = CurrentDarkFrame;
+
+    CurrentDarkFrame.reset();
     for (ExposureImgMap::const_iterator it = Darks.begin(); it != Darks.end(); ++it)
     {
         CurrentDarkFrame = it->second;
         if (it->first >= exposureDuration)
             break;
     }
+
+    if (CurrentDarkFrame.get() != prior.get())
+        ++m_darkGeneration;
 }
 
 void GuideCamera::ClearDefectMap()
@@ -981,45 +984,67 @@ void GuideCamera::ClearDefectMap()
     if (CurrentDefectMap)
     {
         Debug.AddLine("Clearing defect map...");
-        delete CurrentDefectMap;
-        CurrentDefectMap = NULL;
+        CurrentDefectMap.reset();
     }
 }
 
 void GuideCamera::SetDefectMap(DefectMap *defectMap)
 {
+    wxSharedPtr<DefectMap> newMap(defectMap);
     wxCriticalSectionLocker lck(DarkFrameLock);
-    delete CurrentDefectMap;
-    CurrentDefectMap = defectMap;
+    CurrentDefectMap = newMap;
+}
+
+wxSharedPtr<DefectMap> GuideCamera::GetDefectMap()
+{
+    wxCriticalSectionLocker lck(DarkFrameLock);
+    return CurrentDefectMap;
 }
 
 void GuideCamera::ClearDarks()
 {
     wxCriticalSectionLocker lck(DarkFrameLock);
-    while (!Darks.empty())
-    {
-        ExposureImgMap::iterator it = Darks.begin();
-        delete it->second;
-        Darks.erase(it);
-    }
-    CurrentDarkFrame = NULL;
+    Darks.clear();
+    CurrentDarkFrame.reset();
+    ++m_darkGeneration;
 }
 
 void GuideCamera::SubtractDark(usImage& img)
 {
-    // dark subtraction is done in the camera worker thread, so we need to acquire the
-    // DarkFrameLock to protect against the dark frame disappearing when the main
-    // thread does "Load Darks" or "Clear Darks"
+    TraceScope trace(TRACE_DARK_SUBTRACT);
 
-    wxCriticalSectionLocker lck(DarkFrameLock);
+    // dark subtraction is done in the camera worker thread. Take a reference to the
+    // dark frame or defect map under DarkFrameLock, so that the main thread can do
+    // "Load Darks" or "Clear Darks" while we are subtracting; the old frame is freed
+    // when we drop our reference.
 
-    if (CurrentDefectMap)
+    wxSharedPtr<usImage> dark;
+    wxSharedPtr<DefectMap> defectMap;
+    unsigned int generation;
+
+    { // lock scope
+        wxCriticalSectionLocker lck(DarkFrameLock);
+        dark = CurrentDarkFrame;
+        defectMap = CurrentDefectMap;
+        generation = m_darkGeneration;
+    } // lock scope
+
+    if (defectMap)
     {
-        RemoveDefects(img, *CurrentDefectMap);
+        RemoveDefects(img, *defectMap);
     }
-    else if (CurrentDarkFrame)
+    else if (dark)
     {
-        Subtract(img, *CurrentDarkFrame);
+        if (generation != m_pedestalGeneration)
+        {
+            // a new dark starts over without a pedestal
+            m_darkPedestal = 0;
+            m_pedestalGeneration = generation;
+        }
+
+        // a single pass with the pedestal of the previous frames, which the
+        // subtraction raises before it would clip any pixel at zero
+        SubtractPedestal(img, *dark, &m_darkPedestal);
     }
 }
 
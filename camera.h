@@ -35,7 +35,9 @@
 #ifndef CAMERA_H_INCLUDED
 #define CAMERA_H_INCLUDED
 
-typedef std::map<int, usImage *> ExposureImgMap; // map exposure to image
+#include <wx/sharedptr.h>
+
+typedef std::map<int, wxSharedPtr<usImage> > ExposureImgMap; // map exposure to image
 class DefectMap;
 
 enum PropDlgType
@@ -89,6 +91,15 @@ protected:
     bool            m_hasGuideOutput;
     int             m_timeoutMs;
 
+private:
+    // SubtractDark adds a pedestal carried over from the previous frames with
+    // the same dark. It starts at 0 and is only raised, to 125% of the amount
+    // the dark exceeds the light by, so the background can sit higher than
+    // with the exact per-frame offset of Subtract().
+    unsigned int    m_darkGeneration;     // bumped whenever the current dark frame changes
+    unsigned int    m_pedestalGeneration; // dark frame generation the pedestal was measured for
+    unsigned short  m_darkPedestal;
+
 public:
     int             GuideCameraGain;
     wxString        Name;                   // User-friendly name
@@ -106,10 +117,13 @@ public:
     bool            UseSubframes;
     double          PixelSize;
 
-    wxCriticalSection DarkFrameLock; // dark frames can be accessed in the main thread or the camera worker thread
-    usImage        *CurrentDarkFrame;
+    // Dark frames and defect maps are loaded in the main thread and used in the camera
+    // worker thread. They are reference counted and never modified once installed;
+    // DarkFrameLock only guards swapping the pointers below and taking a reference.
+    wxCriticalSection DarkFrameLock;
+    wxSharedPtr<usImage> CurrentDarkFrame;
     ExposureImgMap  Darks; // map exposure => dark frame
-    DefectMap      *CurrentDefectMap;
+    wxSharedPtr<DefectMap> CurrentDefectMap;
 
     static wxArrayString List(void);
     static GuideCamera *Factory(const wxString& choice);
@@ -143,6 +157,7 @@ public:
     void            ClearDarks(void);
 
     void            SubtractDark(usImage& img);
+    wxSharedPtr<DefectMap> GetDefectMap(void);
 
     virtual const wxSize& DarkFrameSize() { return FullSize; }
 
@@ -0,0 +1,108 @@
+// Copyright (c) 2014-2015 Max Planck Society
+
+#include "bfgs_optimizer.h"
+#include "tools/math_tools.h"
+#include <cmath>
+
+namespace bfgs_optimizer {
+
+// parameters of the backtracking line search (Armijo condition)
+static const double SufficientDecrease = 1e-4;
+static const double StepShrinkage = 0.5;
+static const int MaxLineSearchSteps = 30;
+
+static bool isFinite(double x) {
+  return !math_tools::isNaN(x) && !math_tools::isInf(x);
+}
+
+BFGS::BFGS(const Objective& objective, int max_iterations,
+           double gradient_tolerance)
+  : objective_(objective),
+    abort_(),
+    max_iterations_(max_iterations),
+    gradient_tolerance_(gradient_tolerance),
+    iterations_(0),
+    function_evaluations_(0) {}
+
+void BFGS::setAbortCheck(const AbortCheck& abort) {
+  abort_ = abort;
+}
+
+Eigen::VectorXd BFGS::minimize(const Eigen::VectorXd& x0,
+                               double* function_value) {
+  int n = x0.rows();
+  Eigen::VectorXd x = x0;
+  Eigen::VectorXd gradient(n);
+  Eigen::MatrixXd inverse_hessian = Eigen::MatrixXd::Identity(n, n);
+
+  iterations_ = 0;
+  function_evaluations_ = 1;
+  double f = objective_(x, &gradient);
+
+  while (iterations_ < max_iterations_ && isFinite(f) &&
+         gradient.norm() > gradient_tolerance_) {
+    if (abort_ && abort_()) {
+      break;
+    }
+    ++iterations_;
+
+    Eigen::VectorXd direction = -inverse_hessian * gradient;
+    double slope = gradient.dot(direction);
+    if (slope >= 0) {
+      // not a descent direction, restart from steepest descent
+      inverse_hessian.setIdentity();
+      direction = -gradient;
+      slope = -gradient.squaredNorm();
+    }
+
+    // backtracking line search
+    double step = 1.0;
+    Eigen::VectorXd x_new(n);
+    Eigen::VectorXd gradient_new(n);
+    double f_new = f;
+    bool accepted = false;
+    for (int i = 0; i < MaxLineSearchSteps; ++i) {
+      x_new = x + step * direction;
+      f_new = objective_(x_new, &gradient_new);
+      ++function_evaluations_;
+      if (isFinite(f_new) && f_new <= f + SufficientDecrease * step * slope) {
+        accepted = true;
+        break;
+      }
+      step *= StepShrinkage;
+    }
+    if (!accepted) {
+      break;
+    }
+
+    Eigen::VectorXd s = x_new - x;
+    Eigen::VectorXd y = gradient_new - gradient;
+    double sy = s.dot(y);
+
+    x = x_new;
+    f = f_new;
+    gradient = gradient_new;
+
+    // skip the update if the curvature condition does not hold
+    if (sy <= 1e-10) {
+      continue;
+    }
+
+    if (iterations_ == 1) {
+      // scale the initial inverse Hessian to the curvature seen so far
+      inverse_hessian *= sy / y.squaredNorm();
+    }
+
+    Eigen::VectorXd Hy = inverse_hessian * y;
+    double yHy = y.dot(Hy);
+    inverse_hessian += ((sy + yHy) / (sy * sy)) * s * s.transpose()
+                       - (Hy * s.transpose() + s * Hy.transpose()) / sy;
+  }
+
+  if (function_value) {
+    *function_value = f;
+  }
+  return x;
+}
+
+}  // namespace bfgs_optimizer
@@ -0,0 +1,76 @@
+// Copyright (c) 2014-2015 Max Planck Society
+
+/*!@file
+ * @author  Edgar Klenske <eklenske@tuebingen.mpg.de>
+ *
+ * @date    2015-02-10
+ *
+ * @brief
+ * A small BFGS minimizer, used to fit the hyperparameters of the GP to the
+ * data by minimizing the negative log marginal likelihood.
+ */
+
+#ifndef BFGS_OPTIMIZER_H
+#define BFGS_OPTIMIZER_H
+
+#include <Eigen/Dense>
+#include <functional>
+
+namespace bfgs_optimizer {
+
+class BFGS {
+ public:
+  /*!
+   * The objective returns the function value at x and writes the gradient
+   * to the second argument.
+   */
+  typedef std::function<double(const Eigen::VectorXd&, Eigen::VectorXd*)>
+      Objective;
+
+  /*!
+   * Called once per iteration; returning true stops the minimization with
+   * the best point found so far.
+   */
+  typedef std::function<bool()> AbortCheck;
+
+ private:
+  Objective objective_;
+  AbortCheck abort_;
+  int max_iterations_;
+  double gradient_tolerance_;
+  int iterations_;
+  int function_evaluations_;
+
+ public:
+  /*!
+   * @param objective The function to minimize
+   * @param max_iterations The maximum number of BFGS iterations
+   * @param gradient_tolerance Stops when the gradient norm falls below this
+   */
+  BFGS(const Objective& objective, int max_iterations,
+       double gradient_tolerance = 1e-5);
+
+  //! Sets a check that allows to abort a running minimization.
+  void setAbortCheck(const AbortCheck& abort);
+
+  /*!
+   * Minimizes the objective starting at x0.
+   *
+   * @param x0 The starting point
+   * @param function_value Receives the function value at the minimum, if
+   *  not null
+   * @return The location of the minimum
+   */
+  Eigen::VectorXd minimize(const Eigen::VectorXd& x0,
+                           double* function_value = 0);
+
+  //! Number of iterations of the last minimization.
+  int getIterations() const { return iterations_; }
+
+  //! Number of objective evaluations of the last minimization.
+  int getFunctionEvaluations() const { return function_evaluations_; }
+};
+
+}  // namespace bfgs_optimizer
+
+#endif  // BFGS_OPTIMIZER_H
@@ -0,0 +1,88 @@
+// Copyright (c) 2014-2015 Max Planck Society
+
+#include "covariance_functions.h"
+#include <cmath>
+
+namespace covariance_functions {
+
+/*
+ * Signed distance matrix between two sets of locations: D(i,j) = x1(i) - x2(j).
+ * The kernels in this file are stationary, so everything is a function of D.
+ */
+static Eigen::MatrixXd signedDistance(const Eigen::VectorXd& x1,
+                                      const Eigen::VectorXd& x2) {
+  return x1.replicate(1, x2.rows()) - x2.transpose().replicate(x1.rows(), 1);
+}
+
+PeriodicSquareExponential::PeriodicSquareExponential()
+  : hyper_parameters_(Eigen::VectorXd::Zero(5)) {}
+
+PeriodicSquareExponential::PeriodicSquareExponential(
+    const Eigen::VectorXd& hyper_parameters)
+  : hyper_parameters_(hyper_parameters) {}
+
+Eigen::MatrixXd PeriodicSquareExponential::covariance(
+    const Eigen::VectorXd& x1,
+    const Eigen::VectorXd& x2) {
+  double lsSE = std::exp(hyper_parameters_(0));
+  double svSE = std::exp(2 * hyper_parameters_(1));
+  double lsP  = std::exp(hyper_parameters_(2));
+  double svP  = std::exp(2 * hyper_parameters_(3));
+  double plP  = std::exp(hyper_parameters_(4));
+
+  Eigen::ArrayXXd distance = signedDistance(x1, x2).array();
+
+  Eigen::ArrayXXd se = svSE * (-0.5 * (distance / lsSE).square()).exp();
+  Eigen::ArrayXXd sine = (M_PI * distance / plP).sin();
+  Eigen::ArrayXXd p = svP * (-2 * (sine / lsP).square()).exp();
+
+  return (se + p).matrix();
+}
+
+MatrixStdVecPair PeriodicSquareExponential::evaluate(
+    const Eigen::VectorXd& x1,
+    const Eigen::VectorXd& x2) {
+  double lsSE = std::exp(hyper_parameters_(0));
+  double svSE = std::exp(2 * hyper_parameters_(1));
+  double lsP  = std::exp(hyper_parameters_(2));
+  double svP  = std::exp(2 * hyper_parameters_(3));
+  double plP  = std::exp(hyper_parameters_(4));
+
+  Eigen::ArrayXXd distance = signedDistance(x1, x2).array();
+
+  // Squared exponential part
+  Eigen::ArrayXXd scaled_square = (distance / lsSE).square();
+  Eigen::ArrayXXd se = svSE * (-0.5 * scaled_square).exp();
+
+  // Periodic part
+  Eigen::ArrayXXd phase = M_PI * distance / plP;
+  Eigen::ArrayXXd sine_square = (phase.sin() / lsP).square();
+  Eigen::ArrayXXd p = svP * (-2 * sine_square).exp();
+
+  std::vector<Eigen::MatrixXd> derivatives(5);
+
+  // d/d log(ell_SE) and d/d log(sigma_SE)
+  derivatives[0] = (se * scaled_square).matrix();
+  derivatives[1] = (2 * se).matrix();
+
+  // d/d log(ell_P), d/d log(sigma_P) and d/d log(lambda)
+  derivatives[2] = (4 * p * sine_square).matrix();
+  derivatives[3] = (2 * p).matrix();
+  derivatives[4] = (2 / (lsP * lsP) * p * phase * (2 * phase).sin()).matrix();
+
+  return MatrixStdVecPair((se + p).matrix(), derivatives);
+}
+
+void PeriodicSquareExponential::setParameters(const Eigen::VectorXd& params) {
+  hyper_parameters_ = params;
+}
+
+const Eigen::VectorXd& PeriodicSquareExponential::getParameters() const {
+  return hyper_parameters_;
+}
+
+int PeriodicSquareExponential::getParameterCount() const {
+  return 5;
+}
+
+}  // namespace covariance_functions
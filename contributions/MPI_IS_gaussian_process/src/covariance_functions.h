@@ -0,0 +1,118 @@
+// Copyright (c) 2014-2015 Max Planck Society
+
+/*!@file
+ * @author  Edgar Klenske <eklenske@tuebingen.mpg.de>
+ * @author  Stephan Wenninger <swenninger@tuebingen.mpg.de>
+ *
+ * @date    2015-02-10
+ *
+ * @brief
+ * The file holds the covariance functions that can be used with the GP class.
+ *
+ * All hyperparameters are stored and passed in log space, which keeps them
+ * positive and makes the marginal likelihood better behaved for the
+ * optimizer. The order of the hyperparameters is given by the documentation
+ * of each covariance function.
+ */
+
+#ifndef GP_COVARIANCE_FUNCTIONS_H
+#define GP_COVARIANCE_FUNCTIONS_H
+
+#include <Eigen/Dense>
+#include <vector>
+#include <utility>
+
+namespace covariance_functions {
+
+/*!
+ * A covariance matrix together with its derivatives with respect to each
+ * (log) hyperparameter, in the order of the hyperparameter vector.
+ */
+typedef std::pair<Eigen::MatrixXd, std::vector<Eigen::MatrixXd> >
+    MatrixStdVecPair;
+
+/*!
+ * Base class definition for covariance functions
+ */
+class CovFunc {
+ public:
+  CovFunc() {}
+  virtual ~CovFunc() {}
+
+  /*!
+   * Evaluates the covariance function between two sets of one-dimensional
+   * locations.
+   *
+   * @param x1 Locations of size n
+   * @param x2 Locations of size m
+   * @return The nxm covariance matrix and its derivatives with respect to the
+   *  hyperparameters
+   */
+  virtual MatrixStdVecPair evaluate(const Eigen::VectorXd& x1,
+                                    const Eigen::VectorXd& x2) = 0;
+
+  /*!
+   * Evaluates only the covariance matrix, skipping the derivatives. This is
+   * what inference and prediction need on every guide step.
+   */
+  virtual Eigen::MatrixXd covariance(const Eigen::VectorXd& x1,
+                                     const Eigen::VectorXd& x2) = 0;
+
+  //! Sets the (log) hyperparameters.
+  virtual void setParameters(const Eigen::VectorXd& params) = 0;
+
+  //! Returns the (log) hyperparameters.
+  virtual const Eigen::VectorXd& getParameters() const = 0;
+
+  //! Returns the number of hyperparameters.
+  virtual int getParameterCount() const = 0;
+
+  //! Produces a copy of the covariance function, including its parameters.
+  virtual CovFunc* clone() const = 0;
+};
+
+/*!
+ * The sum of a squared exponential and a periodic kernel. The squared
+ * exponential part models slow drifts, the periodic part models the
+ * periodic error of the mount gear.
+ *
+ * @f[
+ *  k(t,t') = \sigma_{SE}^2 \exp\left(-\frac{(t-t')^2}{2\ell_{SE}^2}\right)
+ *          + \sigma_P^2 \exp\left(-\frac{2\sin^2(\pi(t-t')/\lambda)}{\ell_P^2}\right)
+ * @f]
+ *
+ * The hyperparameters are, in this order:
+ * - log(ell_SE), the length scale of the squared exponential
+ * - log(sigma_SE), the signal standard deviation of the squared exponential
+ * - log(ell_P), the length scale of the periodic kernel
+ * - log(sigma_P), the signal standard deviation of the periodic kernel
+ * - log(lambda), the period length
+ */
+class PeriodicSquareExponential : public CovFunc {
+ private:
+  Eigen::VectorXd hyper_parameters_;
+
+ public:
+  PeriodicSquareExponential();
+  explicit PeriodicSquareExponential(const Eigen::VectorXd& hyper_parameters);
+
+  MatrixStdVecPair evaluate(const Eigen::VectorXd& x1,
+                            const Eigen::VectorXd& x2);
+
+  Eigen::MatrixXd covariance(const Eigen::VectorXd& x1,
+                             const Eigen::VectorXd& x2);
+
+  void setParameters(const Eigen::VectorXd& params);
+
+  const Eigen::VectorXd& getParameters() const;
+
+  int getParameterCount() const;
+
+  virtual CovFunc* clone() const {
+    return new PeriodicSquareExponential(*this);
+  }
+};
+
+}  // namespace covariance_functions
+
+#endif  // GP_COVARIANCE_FUNCTIONS_H
@@ -0,0 +1,267 @@
+// Copyright (c) 2014-2015 Max Planck Society
+
+#include "gaussian_process.h"
+#include <algorithm>
+#include <cmath>
+
+// Default noise standard deviation (pixels), in log space
+static const double DefaultLogNoiseSd = std::log(0.25);
+
+GP::GP()
+  : covFunc_(new covariance_functions::PeriodicSquareExponential()),
+    log_noise_sd_(DefaultLogNoiseSd) {}
+
+GP::GP(const covariance_functions::CovFunc& covFunc)
+  : covFunc_(covFunc.clone()),
+    log_noise_sd_(DefaultLogNoiseSd) {}
+
+GP::GP(double noise_variance, const covariance_functions::CovFunc& covFunc)
+  : covFunc_(covFunc.clone()),
+    log_noise_sd_(0.5 * std::log(noise_variance)) {}
+
+GP::GP(const GP& that)
+  : covFunc_(that.covFunc_->clone()),
+    data_loc_(that.data_loc_),
+    data_out_(that.data_out_),
+    alpha_(that.alpha_),
+    chol_gram_matrix_(that.chol_gram_matrix_),
+    log_noise_sd_(that.log_noise_sd_) {}
+
+GP::~GP() {
+  delete covFunc_;
+}
+
+GP& GP::operator=(const GP& that) {
+  if (this != &that) {
+    covariance_functions::CovFunc* temp = covFunc_;
+    covFunc_ = that.covFunc_->clone();
+    delete temp;
+
+    data_loc_ = that.data_loc_;
+    data_out_ = that.data_out_;
+    alpha_ = that.alpha_;
+    chol_gram_matrix_ = that.chol_gram_matrix_;
+    log_noise_sd_ = that.log_noise_sd_;
+  }
+  return *this;
+}
+
+bool GP::setCovarianceFunction(const covariance_functions::CovFunc& covFunc) {
+  // can only set the covariance function if there is no data yet
+  if (data_loc_.size() != 0) {
+    return false;
+  }
+
+  delete covFunc_;
+  covFunc_ = covFunc.clone();
+  return true;
+}
+
+void GP::infer(const Eigen::VectorXd& data_loc,
+               const Eigen::VectorXd& data_out) {
+  data_loc_ = data_loc;
+  data_out_ = data_out;
+  infer();
+}
+
+void GP::infer() {
+  int n = data_loc_.rows();
+  if (n == 0) {
+    return;
+  }
+
+  double noise_variance = std::exp(2 * log_noise_sd_);
+
+  Eigen::MatrixXd gram_matrix = covFunc_->covariance(data_loc_, data_loc_);
+  gram_matrix.diagonal().array() += noise_variance;
+
+  chol_gram_matrix_ = gram_matrix.llt().matrixL();
+  updateAlpha();
+}
+
+void GP::updateAlpha() {
+  int n = data_loc_.rows();
+  alpha_ = data_out_;
+  chol_gram_matrix_.topLeftCorner(n, n).triangularView<Eigen::Lower>()
+    .solveInPlace(alpha_);
+  chol_gram_matrix_.topLeftCorner(n, n).triangularView<Eigen::Lower>()
+    .transpose().solveInPlace(alpha_);
+}
+
+void GP::appendData(double location, double output) {
+  int n = data_loc_.rows();
+
+  Eigen::VectorXd new_loc(1);
+  new_loc << location;
+
+  double self_cov = covFunc_->covariance(new_loc, new_loc)(0, 0) +
+                    std::exp(2 * log_noise_sd_);
+
+  data_loc_.conservativeResize(n + 1);
+  data_out_.conservativeResize(n + 1);
+  data_loc_(n) = location;
+  data_out_(n) = output;
+
+  // the factor is stored with spare capacity so that the window can slide
+  // without reallocating it on every step
+  if (chol_gram_matrix_.rows() < n + 1) {
+    int capacity = std::max(2 * n, 16);
+    Eigen::MatrixXd grown = Eigen::MatrixXd::Zero(capacity, capacity);
+    grown.topLeftCorner(n, n) = chol_gram_matrix_.topLeftCorner(n, n);
+    chol_gram_matrix_.swap(grown);
+  }
+
+  // new row of the factor: L * l = k, d = sqrt(k** - l^T * l)
+  Eigen::VectorXd new_row =
+    covFunc_->covariance(data_loc_.head(n), new_loc).col(0);
+  chol_gram_matrix_.topLeftCorner(n, n).triangularView<Eigen::Lower>()
+    .solveInPlace(new_row);
+  double diagonal_square = self_cov - new_row.squaredNorm();
+
+  if (diagonal_square <= 0) {
+    // lost positive definiteness to rounding, fall back to a full
+    // factorization
+    infer();
+    return;
+  }
+
+  chol_gram_matrix_.col(n).head(n + 1).setZero();
+  chol_gram_matrix_.row(n).head(n) = new_row.transpose();
+  chol_gram_matrix_(n, n) = std::sqrt(diagonal_square);
+
+  updateAlpha();
+}
+
+void GP::removeOldestData() {
+  int n = data_loc_.rows();
+  if (n <= 1) {
+    clearData();
+    return;
+  }
+
+  /*
+   * With L = [l11 0; l21 L22], the Gram matrix without the first point is
+   * L22 * L22^T + l21 * l21^T, so its factor is a rank-1 update of L22.
+   * The update is done in place, column by column, and each finished column
+   * is moved one up and one to the left.
+   */
+  Eigen::VectorXd x = chol_gram_matrix_.col(0).segment(1, n - 1);
+  Eigen::MatrixXd& L = chol_gram_matrix_;
+
+  for (int k = 0; k < n - 1; ++k) {
+    int rest = n - 2 - k;
+    double diagonal = L(k + 1, k + 1);
+    double r = std::sqrt(diagonal * diagonal + x(k) * x(k));
+    double c = r / diagonal;
+    double s = x(k) / diagonal;
+
+    L(k, k) = r;
+    if (rest > 0) {
+      L.col(k).segment(k + 1, rest) =
+        (L.col(k + 1).segment(k + 2, rest) + s * x.tail(rest)) / c;
+      x.tail(rest) = c * x.tail(rest) - s * L.col(k).segment(k + 1, rest);
+    }
+  }
+  L.row(n - 1).head(n).setZero();
+  L.col(n - 1).head(n).setZero();
+
+  data_loc_.head(n - 1) = data_loc_.tail(n - 1).eval();
+  data_out_.head(n - 1) = data_out_.tail(n - 1).eval();
+  data_loc_.conservativeResize(n - 1);
+  data_out_.conservativeResize(n - 1);
+
+  updateAlpha();
+}
+
+void GP::clearData() {
+  chol_gram_matrix_ = Eigen::MatrixXd();
+  data_loc_ = Eigen::VectorXd();
+  data_out_ = Eigen::VectorXd();
+  alpha_ = Eigen::VectorXd();
+}
+
+int GP::getDataCount() const {
+  return data_loc_.rows();
+}
+
+GP::VectorMatrixPair GP::predict(const Eigen::VectorXd& locations) const {
+  Eigen::MatrixXd prior_cov = covFunc_->covariance(locations, locations);
+
+  // without data, the prediction is the prior
+  if (data_loc_.rows() == 0) {
+    return VectorMatrixPair(Eigen::VectorXd::Zero(locations.rows()),
+                            prior_cov);
+  }
+
+  Eigen::MatrixXd mixed_cov = covFunc_->covariance(locations, data_loc_);
+
+  Eigen::VectorXd mean = mixed_cov * alpha_;
+
+  int n = data_loc_.rows();
+  Eigen::MatrixXd gamma = chol_gram_matrix_.topLeftCorner(n, n)
+    .triangularView<Eigen::Lower>().solve(mixed_cov.transpose());
+  Eigen::MatrixXd covariance = prior_cov - gamma.transpose() * gamma;
+
+  return VectorMatrixPair(mean, covariance);
+}
+
+Eigen::VectorXd GP::predictMean(const Eigen::VectorXd& locations) const {
+  if (data_loc_.rows() == 0) {
+    return Eigen::VectorXd::Zero(locations.rows());
+  }
+  return covFunc_->covariance(locations, data_loc_) * alpha_;
+}
+
+void GP::setHyperParameters(const Eigen::VectorXd& hyperParameters) {
+  log_noise_sd_ = hyperParameters(0);
+  covFunc_->setParameters(hyperParameters.tail(hyperParameters.rows() - 1));
+
+  infer();
+}
+
+Eigen::VectorXd GP::getHyperParameters() const {
+  Eigen::VectorXd hyperParameters(covFunc_->getParameterCount() + 1);
+  hyperParameters << log_noise_sd_, covFunc_->getParameters();
+  return hyperParameters;
+}
+
+double GP::neg_log_likelihood() const {
+  int n = data_loc_.rows();
+  if (n == 0) {
+    return 0;
+  }
+
+  double data_fit = 0.5 * data_out_.dot(alpha_);
+  double complexity =
+    chol_gram_matrix_.topLeftCorner(n, n).diagonal().array().log().sum();
+  double normalization = 0.5 * n * std::log(2 * M_PI);
+
+  return data_fit + complexity + normalization;
+}
+
+Eigen::VectorXd GP::neg_log_likelihood_gradient() const {
+  int n = data_loc_.rows();
+  Eigen::VectorXd gradient =
+    Eigen::VectorXd::Zero(covFunc_->getParameterCount() + 1);
+  if (n == 0) {
+    return gradient;
+  }
+
+  covariance_functions::MatrixStdVecPair cov =
+    covFunc_->evaluate(data_loc_, data_loc_);
+
+  // W = K^-1 - alpha * alpha^T, the gradient is 0.5 * tr(W * dK/dtheta)
+  Eigen::MatrixXd W = chol_gram_matrix_.topLeftCorner(n, n)
+    .triangularView<Eigen::Lower>().solve(Eigen::MatrixXd::Identity(n, n));
+  W = W.transpose() * W - alpha_ * alpha_.transpose();
+
+  // noise: dK/dlog(sd) = 2 * sd^2 * I
+  gradient(0) = std::exp(2 * log_noise_sd_) * W.trace();
+
+  for (size_t i = 0; i < cov.second.size(); ++i) {
+    // tr(W * D) for symmetric W and D is the sum of the elementwise product
+    gradient(i + 1) = 0.5 * W.cwiseProduct(cov.second[i]).sum();
+  }
+
+  return gradient;
+}
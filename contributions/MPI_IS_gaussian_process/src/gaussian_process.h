@@ -0,0 +1,129 @@
+// Copyright (c) 2014-2015 Max Planck Society
+
+/*!@file
+ * @author  Edgar Klenske <eklenske@tuebingen.mpg.de>
+ * @author  Stephan Wenninger <swenninger@tuebingen.mpg.de>
+ *
+ * @date    2015-02-10
+ *
+ * @brief
+ * The file holds the Gaussian process regression used by the GP guider.
+ *
+ * The GP is one-dimensional in its input (time) and output (gear error). It
+ * is meant to run in-process on every guide step, so inference keeps the
+ * Cholesky factor of the Gram matrix and prediction only needs a
+ * matrix-vector product per test location.
+ *
+ * For a sliding window of measurements, appendData() and removeOldestData()
+ * update the Cholesky factor with rank-1 operations in O(n^2), instead of
+ * the O(n^3) refactorization done by infer().
+ */
+
+#ifndef GAUSSIAN_PROCESS_H
+#define GAUSSIAN_PROCESS_H
+
+#include <Eigen/Dense>
+#include "covariance_functions.h"
+
+class GP {
+ private:
+  covariance_functions::CovFunc* covFunc_;
+  Eigen::VectorXd data_loc_;
+  Eigen::VectorXd data_out_;
+  Eigen::VectorXd alpha_;
+  // lower triangular Cholesky factor, the top left n x n block is in use
+  Eigen::MatrixXd chol_gram_matrix_;
+  double log_noise_sd_;
+
+  //! Solves K * alpha = data_out_ with the current Cholesky factor.
+  void updateAlpha();
+
+ public:
+  typedef std::pair<Eigen::VectorXd, Eigen::MatrixXd> VectorMatrixPair;
+
+  GP();
+  explicit GP(const covariance_functions::CovFunc& covFunc);
+  GP(double noise_variance, const covariance_functions::CovFunc& covFunc);
+  GP(const GP& that);
+  ~GP();
+
+  GP& operator=(const GP& that);
+
+  /*!
+   * Sets the covariance function. The GP keeps its own copy.
+   */
+  bool setCovarianceFunction(const covariance_functions::CovFunc& covFunc);
+
+  /*!
+   * Builds the Gram matrix of the given data and factorizes it, so that
+   * predict() can be called afterwards.
+   *
+   * @param data_loc The locations (timestamps) of the data points
+   * @param data_out The measured values at these locations
+   */
+  void infer(const Eigen::VectorXd& data_loc,
+             const Eigen::VectorXd& data_out);
+
+  /*!
+   * Re-runs inference on the data that was passed last, e.g. after the
+   * hyperparameters have changed.
+   */
+  void infer();
+
+  /*!
+   * Adds a single data point and extends the Cholesky factor by one row,
+   * which costs O(n^2). The data point is assumed to be the newest one, so
+   * that removeOldestData() can be used to slide the window.
+   */
+  void appendData(double location, double output);
+
+  /*!
+   * Removes the oldest (first) data point. The remaining factor is obtained
+   * with a rank-1 update of the trailing block of the Cholesky factor, which
+   * costs O(n^2).
+   */
+  void removeOldestData();
+
+  //! Removes all data from the GP, which then falls back to the prior.
+  void clearData();
+
+  //! Returns the number of data points the GP is conditioned on.
+  int getDataCount() const;
+
+  /*!
+   * Predicts the mean and covariance at the given locations.
+   *
+   * @return The predictive mean (size m) and covariance (size mxm)
+   */
+  VectorMatrixPair predict(const Eigen::VectorXd& locations) const;
+
+  /*!
+   * Predicts only the mean at the given locations. This is the cheap path
+   * used by the guider on every step.
+   */
+  Eigen::VectorXd predictMean(const Eigen::VectorXd& locations) const;
+
+  /*!
+   * Sets the hyperparameters. The first element is the log of the noise
+   * standard deviation, the remaining ones are passed to the covariance
+   * function. Data that was already inferred is re-inferred.
+   */
+  void setHyperParameters(const Eigen::VectorXd& hyperParameters);
+
+  //! Returns the hyperparameters in the order expected by setHyperParameters.
+  Eigen::VectorXd getHyperParameters() const;
+
+  /*!
+   * Returns the negative log marginal likelihood of the inferred data under
+   * the current hyperparameters.
+   */
+  double neg_log_likelihood() const;
+
+  /*!
+   * Returns the gradient of neg_log_likelihood() with respect to the
+   * hyperparameters, in the order of getHyperParameters().
+   */
+  Eigen::VectorXd neg_log_likelihood_gradient() const;
+};
+
+#endif  // GAUSSIAN_PROCESS_H
@@ -0,0 +1,80 @@
+// Copyright (c) 2014-2015 Max Planck Society
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include "bfgs_optimizer.h"
+#include "gaussian_process.h"
+
+static double rosenbrock(const Eigen::VectorXd& x, Eigen::VectorXd* gradient) {
+  double a = 1 - x(0);
+  double b = x(1) - x(0) * x(0);
+  (*gradient)(0) = -2 * a - 400 * x(0) * b;
+  (*gradient)(1) = 200 * b;
+  return a * a + 100 * b * b;
+}
+
+TEST(BFGSTest, quadraticTest) {
+  Eigen::VectorXd center(3);
+  center << 1, -2, 3;
+  bfgs_optimizer::BFGS bfgs(
+    [&center](const Eigen::VectorXd& x, Eigen::VectorXd* gradient) {
+      *gradient = 2 * (x - center);
+      return (x - center).squaredNorm();
+    }, 100);
+
+  double f = -1;
+  Eigen::VectorXd minimum = bfgs.minimize(Eigen::VectorXd::Zero(3), &f);
+  EXPECT_NEAR((minimum - center).norm(), 0, 1e-6);
+  EXPECT_NEAR(f, 0, 1e-10);
+}
+
+TEST(BFGSTest, rosenbrockTest) {
+  bfgs_optimizer::BFGS bfgs(rosenbrock, 200, 1e-8);
+
+  Eigen::VectorXd x0(2);
+  x0 << -1.2, 1;
+  Eigen::VectorXd minimum = bfgs.minimize(x0);
+  EXPECT_NEAR(minimum(0), 1, 1e-4);
+  EXPECT_NEAR(minimum(1), 1, 1e-4);
+  EXPECT_LT(bfgs.getIterations(), 200);
+}
+
+TEST(BFGSTest, abortTest) {
+  bfgs_optimizer::BFGS bfgs(rosenbrock, 200, 1e-8);
+  bfgs.setAbortCheck([]() { return true; });
+
+  Eigen::VectorXd x0(2);
+  x0 << -1.2, 1;
+  Eigen::VectorXd result = bfgs.minimize(x0);
+  EXPECT_EQ(bfgs.getIterations(), 0);
+  EXPECT_EQ(result, x0);
+}
+
+TEST(BFGSTest, gaussianProcessLikelihoodTest) {
+  Eigen::VectorXd locations = Eigen::VectorXd::LinSpaced(60, 0, 590);
+  Eigen::VectorXd outputs = (2 * M_PI * locations.array() / 100).sin();
+
+  GP gp;
+  Eigen::VectorXd x0(6);
+  x0 << std::log(0.3), std::log(500), std::log(0.5),
+        std::log(1), std::log(0.5), std::log(100);
+  gp.setHyperParameters(x0);
+  gp.infer(locations, outputs);
+  double initial = gp.neg_log_likelihood();
+
+  bfgs_optimizer::BFGS bfgs(
+    [&gp](const Eigen::VectorXd& x, Eigen::VectorXd* gradient) {
+      gp.setHyperParameters(x);
+      *gradient = gp.neg_log_likelihood_gradient();
+      return gp.neg_log_likelihood();
+    }, 30);
+
+  double f = 0;
+  bfgs.minimize(x0, &f);
+  EXPECT_LT(f, initial);
+}
+
+int main(int argc, char ** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,153 @@
+// Copyright (c) 2014-2015 Max Planck Society
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include "gaussian_process.h"
+#include "covariance_functions.h"
+
+class GPTest : public ::testing::Test {
+ public:
+  GPTest()
+    : hyper_parameters(6),
+      locations(Eigen::VectorXd::LinSpaced(40, 0, 390)),
+      outputs(40) {
+    // log(noise sd), log(ell_SE), log(sigma_SE), log(ell_P), log(sigma_P),
+    // log(lambda)
+    hyper_parameters << std::log(0.1), std::log(500), std::log(1),
+                        std::log(1), std::log(2), std::log(120);
+    outputs = 2 * (2 * M_PI * locations.array() / 120).sin();
+  }
+
+  Eigen::VectorXd hyper_parameters;
+  Eigen::VectorXd locations;
+  Eigen::VectorXd outputs;
+  GP gp;
+};
+
+TEST_F(GPTest, covarianceDerivativesTest) {
+  covariance_functions::PeriodicSquareExponential covFunc(
+    hyper_parameters.tail(5));
+  Eigen::VectorXd x = Eigen::VectorXd::LinSpaced(7, -30, 100);
+
+  covariance_functions::MatrixStdVecPair result = covFunc.evaluate(x, x);
+  EXPECT_TRUE(result.first.isApprox(covFunc.covariance(x, x)));
+  EXPECT_TRUE(result.first.isApprox(result.first.transpose()));
+
+  // compare the analytic derivatives with central differences
+  double eps = 1e-6;
+  for (int i = 0; i < 5; ++i) {
+    Eigen::VectorXd params = hyper_parameters.tail(5);
+    params(i) += eps;
+    covFunc.setParameters(params);
+    Eigen::MatrixXd upper = covFunc.covariance(x, x);
+    params(i) -= 2 * eps;
+    covFunc.setParameters(params);
+    Eigen::MatrixXd lower = covFunc.covariance(x, x);
+
+    Eigen::MatrixXd numeric = (upper - lower) / (2 * eps);
+    EXPECT_NEAR((numeric - result.second[i]).cwiseAbs().maxCoeff(), 0, 1e-5);
+  }
+}
+
+TEST_F(GPTest, priorPredictionTest) {
+  gp.setHyperParameters(hyper_parameters);
+  Eigen::VectorXd x(1);
+  x << 10;
+
+  GP::VectorMatrixPair prediction = gp.predict(x);
+  EXPECT_EQ(prediction.first(0), 0);
+  // prior variance is sigma_SE^2 + sigma_P^2
+  EXPECT_NEAR(prediction.second(0, 0), 1 + 4, 1e-10);
+}
+
+TEST_F(GPTest, inferPredictTest) {
+  gp.setHyperParameters(hyper_parameters);
+  gp.infer(locations, outputs);
+  EXPECT_EQ(gp.getDataCount(), 40);
+
+  // prediction one period past the data should recover the sine
+  Eigen::VectorXd x = Eigen::VectorXd::LinSpaced(10, 400, 520);
+  Eigen::VectorXd expected = 2 * (2 * M_PI * x.array() / 120).sin();
+
+  GP::VectorMatrixPair prediction = gp.predict(x);
+  for (int i = 0; i < x.rows(); ++i) {
+    EXPECT_NEAR(prediction.first(i), expected(i), 0.1);
+    EXPECT_GT(prediction.second(i, i), 0);
+  }
+  EXPECT_TRUE(prediction.first.isApprox(gp.predictMean(x)));
+
+  gp.clearData();
+  EXPECT_EQ(gp.getDataCount(), 0);
+  EXPECT_EQ(gp.predictMean(x).norm(), 0);
+}
+
+TEST_F(GPTest, likelihoodGradientTest) {
+  gp.setHyperParameters(hyper_parameters);
+  gp.infer(locations, outputs);
+
+  Eigen::VectorXd gradient = gp.neg_log_likelihood_gradient();
+  ASSERT_EQ(gradient.rows(), hyper_parameters.rows());
+
+  double eps = 1e-6;
+  for (int i = 0; i < hyper_parameters.rows(); ++i) {
+    Eigen::VectorXd params = hyper_parameters;
+    params(i) += eps;
+    gp.setHyperParameters(params);
+    double upper = gp.neg_log_likelihood();
+    params(i) -= 2 * eps;
+    gp.setHyperParameters(params);
+    double lower = gp.neg_log_likelihood();
+
+    EXPECT_NEAR((upper - lower) / (2 * eps), gradient(i),
+                1e-4 * std::max(1.0, std::fabs(gradient(i))));
+  }
+}
+
+TEST_F(GPTest, copyTest) {
+  gp.setHyperParameters(hyper_parameters);
+  gp.infer(locations, outputs);
+
+  GP copy(gp);
+  GP assigned;
+  assigned = gp;
+
+  Eigen::VectorXd x = Eigen::VectorXd::LinSpaced(5, 0, 500);
+  EXPECT_TRUE(copy.predictMean(x).isApprox(gp.predictMean(x)));
+  EXPECT_TRUE(assigned.predictMean(x).isApprox(gp.predictMean(x)));
+  EXPECT_TRUE(copy.getHyperParameters().isApprox(hyper_parameters));
+}
+
+TEST_F(GPTest, incrementalInferenceTest) {
+  gp.setHyperParameters(hyper_parameters);
+  GP full(gp);
+
+  // slide a window of 15 points over the data
+  int window = 15;
+  Eigen::VectorXd x = Eigen::VectorXd::LinSpaced(5, 300, 500);
+  for (int i = 0; i < locations.rows(); ++i) {
+    gp.appendData(locations(i), outputs(i));
+    if (gp.getDataCount() > window) {
+      gp.removeOldestData();
+    }
+
+    int start = std::max(0, i + 1 - window);
+    full.infer(locations.segment(start, i + 1 - start),
+               outputs.segment(start, i + 1 - start));
+
+    ASSERT_EQ(gp.getDataCount(), full.getDataCount());
+    EXPECT_NEAR((gp.predictMean(x) - full.predictMean(x)).cwiseAbs().maxCoeff(),
+                0, 1e-8);
+    EXPECT_NEAR(gp.neg_log_likelihood(), full.neg_log_likelihood(), 1e-8);
+  }
+
+  // removing everything falls back to the prior
+  while (gp.getDataCount() > 0) {
+    gp.removeOldestData();
+  }
+  EXPECT_EQ(gp.predictMean(x).norm(), 0);
+}
+
+int main(int argc, char ** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,96 @@
+// Copyright (c) 2014-2015 Max Planck Society
+
+/*
+ * Measures the cost of one guide step of GP inference over a sliding window,
+ * comparing the full refactorization done by GP::infer() with the rank-1
+ * updates of GP::appendData() and GP::removeOldestData().
+ */
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include "gaussian_process.h"
+#include "covariance_functions.h"
+
+class IncrementalInferenceBenchmark : public ::testing::TestWithParam<int> {
+ public:
+  IncrementalInferenceBenchmark()
+    : hyper_parameters(6) {
+    hyper_parameters << std::log(0.25), std::log(500), std::log(0.5),
+                        std::log(1), std::log(0.5), std::log(480);
+  }
+
+  // measurement at step i, with a 2 s cadence
+  static double location(int i) { return 2.0 * i; }
+  static double output(int i) {
+    return 0.5 * std::sin(2 * M_PI * location(i) / 480) + 0.01 * i;
+  }
+
+  Eigen::VectorXd hyper_parameters;
+};
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double elapsedMicroseconds(Clock::time_point start) {
+  return std::chrono::duration<double, std::micro>(Clock::now() - start)
+    .count();
+}
+
+TEST_P(IncrementalInferenceBenchmark, perStepCost) {
+  int window = GetParam();
+  // the full refactorization is O(n^3), keep the number of steps small
+  int steps = window >= 2000 ? 3 : 20;
+
+  GP full;
+  full.setHyperParameters(hyper_parameters);
+  GP incremental(full);
+
+  for (int i = 0; i < window; ++i) {
+    incremental.appendData(location(i), output(i));
+  }
+
+  Eigen::VectorXd data_loc(window);
+  Eigen::VectorXd data_out(window);
+
+  double full_us = 0;
+  double incremental_us = 0;
+  for (int step = 0; step < steps; ++step) {
+    int newest = window + step;
+    for (int i = 0; i < window; ++i) {
+      data_loc(i) = location(newest - window + 1 + i);
+      data_out(i) = output(newest - window + 1 + i);
+    }
+
+    Clock::time_point start = Clock::now();
+    full.infer(data_loc, data_out);
+    full_us += elapsedMicroseconds(start);
+
+    start = Clock::now();
+    incremental.removeOldestData();
+    incremental.appendData(location(newest), output(newest));
+    incremental_us += elapsedMicroseconds(start);
+  }
+
+  Eigen::VectorXd next(1);
+  next << location(window + steps);
+  EXPECT_NEAR(incremental.predictMean(next)(0), full.predictMean(next)(0),
+              1e-6);
+
+  std::cout << "window " << window
+            << ": full " << full_us / steps << " us/step"
+            << ", incremental " << incremental_us / steps << " us/step"
+            << std::endl;
+
+  RecordProperty("full_us_per_step", static_cast<int>(full_us / steps));
+  RecordProperty("incremental_us_per_step",
+                 static_cast<int>(incremental_us / steps));
+}
+
+INSTANTIATE_TEST_CASE_P(WindowSizes, IncrementalInferenceBenchmark,
+                        ::testing::Values(100, 500, 2000));
+
+int main(int argc, char ** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -38,10 +38,86 @@
 #define ALWAYS_FLUSH_DEBUGLOG
 const int RetentionPeriod = 30;
 
+// must be a power of 2 so that the positions can wrap around
+static const unsigned int RING_SIZE = 8192;
+
+// the writer thread wakes up at least this often, even if nobody signals it
+static const int WRITER_IDLE_MS = 1000;
+
+struct DebugLogRecord
+{
+    // equals the enqueue position when the slot is free, and the position + 1
+    // once the record is filled in
+    std::atomic<unsigned int> sequence;
+    wxDateTime time;
+    unsigned long threadId;
+    wxString text;
+};
+
+class DebugLogWriter : public wxThread
+{
+    DebugLog *m_pLog;
+    volatile bool m_stop;
+
+public:
+    DebugLogWriter(DebugLog *pLog) : wxThread(wxTHREAD_JOINABLE), m_pLog(pLog), m_stop(false) { }
+    void Stop(void);
+    ExitCode Entry();
+};
+
+void DebugLogWriter::Stop(void)
+{
+    m_stop = true;
+    m_pLog->m_writerWakeup.Post();
+}
+
+wxThread::ExitCode DebugLogWriter::Entry()
+{
+    while (!m_stop)
+    {
+        bool more;
+
+        {
+            wxCriticalSectionLocker lock(m_pLog->m_criticalSection);
+            m_pLog->WriteQueued();
+
+            // announce that we are going to sleep, then look once more so that
+            // a line queued in between is not left waiting for the timeout
+            m_pLog->m_writerWaiting = true;
+
+            const DebugLogRecord& next = m_pLog->m_ring[m_pLog->m_dequeuePos % RING_SIZE];
+            more = next.sequence.load(std::memory_order_acquire) == m_pLog->m_dequeuePos + 1;
+        }
+
+        if (more)
+        {
+            m_pLog->m_writerWaiting = false;
+            continue;
+        }
+
+        m_pLog->m_writerWakeup.WaitTimeout(WRITER_IDLE_MS);
+    }
+
+    wxCriticalSectionLocker lock(m_pLog->m_criticalSection);
+    m_pLog->WriteQueued();
+
+    return 0;
+}
+
 void DebugLog::InitVars(void)
 {
     m_bEnabled = false;
     m_lastWriteTime = wxDateTime::UNow();
+
+    m_ring = new DebugLogRecord[RING_SIZE];
+    for (unsigned int i = 0; i < RING_SIZE; i++)
+        m_ring[i].sequence = i;
+    m_enqueuePos = 0;
+    m_dequeuePos = 0;
+    m_dropped = 0;
+    m_writerWaiting = false;
+    m_pWriter = 0;
+    m_writerRunning = false;
 }
 
 DebugLog::DebugLog(void)
@@ -58,8 +134,53 @@ DebugLog::DebugLog(const char *pName, bool bEnabled = true)
 
 DebugLog::~DebugLog(void)
 {
+    StopWriter();
+
+    {
+        wxCriticalSectionLocker lock(m_criticalSection);
+        if (m_bEnabled)
+            WriteQueued();
+    }
+
     wxFFile::Flush();
     wxFFile::Close();
+
+    delete[] m_ring;
+}
+
+void DebugLog::StartWriter(void)
+{
+    if (m_pWriter)
+        return;
+
+    DebugLogWriter *writer = new DebugLogWriter(this);
+    if (writer->Create() != wxTHREAD_NO_ERROR || writer->Run() != wxTHREAD_NO_ERROR)
+    {
+        delete writer;
+        AddLine("DebugLog: could not start the writer thread, writing synchronously");
+        return;
+    }
+
+    m_pWriter = writer;
+    m_writerRunning = true;
+}
+
+void DebugLog::StopWriter(void)
+{
+    if (!m_pWriter)
+        return;
+
+    // lines written from now on are written by the caller
+    m_writerRunning = false;
+
+    // drain the ring here rather than relying on the writer to do it on
+    // its way out
+    Flush();
+
+    m_pWriter->Stop();
+    m_pWriter->Wait();
+    delete m_pWriter;
+    m_pWriter = 0;
 }
 
 bool DebugLog::Enable(bool bEnabled)
@@ -77,6 +198,8 @@ bool DebugLog::Init(const char *pName, bool bEnable, bool bForceOpen)
 
     if (m_bEnabled)
     {
+        WriteQueued();
+
         wxFFile::Flush();
         wxFFile::Close();
 
@@ -153,33 +276,120 @@ bool DebugLog::Flush(void)
     {
         wxCriticalSectionLocker lock(m_criticalSection);
 
+        WriteQueued();
         bReturn = wxFFile::Flush();
     }
 
     return bReturn;
 }
 
-wxString DebugLog::Write(const wxString& str)
+// Multiple producer slot claim on the bounded ring (D. Vyukov's algorithm).
+// Returns false if the ring is full.
+bool DebugLog::Enqueue(const wxString& str)
 {
-    if (m_bEnabled)
+    wxDateTime now = wxDateTime::UNow();
+
+    unsigned int pos = m_enqueuePos.load(std::memory_order_relaxed);
+    DebugLogRecord *record;
+
+    while (true)
     {
-        wxCriticalSectionLocker lock(m_criticalSection);
+        record = &m_ring[pos % RING_SIZE];
+        unsigned int sequence = record->sequence.load(std::memory_order_acquire);
+        int diff = (int)(sequence - pos);
+
+        if (diff == 0)
+        {
+            if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            return false;
+        }
+        else
+        {
+            pos = m_enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
 
+    record->time = now;
+    record->threadId = (unsigned long) wxThread::GetCurrentId();
+    record->text = str;
+    record->sequence.store(pos + 1, std::memory_order_release);
+
+    return true;
+}
+
+// Formats everything in the ring and writes it to the file with a single
+// write. Lines from different threads can be queued slightly out of time
+// order, in which case the delta is shown as zero.
+void DebugLog::WriteQueued(void)
+{
+    wxString batch;
+
+    while (true)
+    {
+        DebugLogRecord& record = m_ring[m_dequeuePos % RING_SIZE];
+        if (record.sequence.load(std::memory_order_acquire) != m_dequeuePos + 1)
+            break;
+
+        wxTimeSpan deltaTime = record.time - m_lastWriteTime;
+        if (deltaTime.IsNegative())
+            deltaTime = wxTimeSpan(0);
+        else
+            m_lastWriteTime = record.time;
+
+        wxString outputLine = wxString::Format("%s %s %lu %s", record.time.Format("%H:%M:%S.%l"),
+                                                              deltaTime.Format("%S.%l"),
+                                                              record.threadId,
+                                                              record.text);
+#if defined(__WINDOWS__) && defined(_DEBUG)
+        OutputDebugString(outputLine.c_str());
+#endif
+        batch += outputLine;
+
+        record.text.clear();
+        record.sequence.store(m_dequeuePos + RING_SIZE, std::memory_order_release);
+        ++m_dequeuePos;
+    }
+
+    unsigned long dropped = m_dropped.exchange(0);
+    if (dropped)
+    {
         wxDateTime now = wxDateTime::UNow();
         wxTimeSpan deltaTime = now - m_lastWriteTime;
         m_lastWriteTime = now;
-        wxString outputLine = wxString::Format("%s %s %lu %s", now.Format("%H:%M:%S.%l"),
-                                                              deltaTime.Format("%S.%l"),
-                                                              (unsigned long) wxThread::GetCurrentId(),
-                                                              str);
+        batch += wxString::Format("%s %s %lu DebugLog: %lu lines dropped, the log writer could not keep up\n",
+            now.Format("%H:%M:%S.%l"), deltaTime.Format("%S.%l"), (unsigned long) wxThread::GetCurrentId(), dropped);
+    }
 
-        wxFFile::Write(outputLine);
+    if (batch.IsEmpty())
+        return;
+
+    wxFFile::Write(batch);
 #if defined(ALWAYS_FLUSH_DEBUGLOG)
-        wxFFile::Flush();
-#endif
-#if defined(__WINDOWS__) && defined(_DEBUG)
-        OutputDebugString(outputLine.c_str());
+    wxFFile::Flush();
 #endif
+}
+
+wxString DebugLog::Write(const wxString& str)
+{
+    if (m_bEnabled)
+    {
+        if (!Enqueue(str))
+            ++m_dropped;
+
+        if (m_writerRunning)
+        {
+            if (m_writerWaiting.exchange(false))
+                m_writerWakeup.Post();
+        }
+        else
+        {
+            wxCriticalSectionLocker lock(m_criticalSection);
+            WriteQueued();
+        }
     }
 
     return str;
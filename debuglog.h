@@ -38,15 +38,40 @@
 
 #include "logger.h"
 
+#include <atomic>
+
+struct DebugLogRecord;
+class DebugLogWriter;
+
+/*
+ * Lines are queued in a fixed size lock-free ring and written to the file in
+ * batches by a background thread, so callers do not wait for the disk or for
+ * each other. When the ring is full, lines are dropped and counted, and the
+ * count is written to the log once there is room again. Before the writer
+ * thread is started and after it is stopped, lines are written by the caller.
+ */
 class DebugLog : public wxFFile, public Logger
 {
+    friend class DebugLogWriter;
+
 private:
     bool m_bEnabled;
-    wxCriticalSection m_criticalSection;
+    wxCriticalSection m_criticalSection;    // held while writing to the file
     wxDateTime m_lastWriteTime;
     wxString m_pPathName;
 
+    DebugLogRecord *m_ring;
+    std::atomic<unsigned int> m_enqueuePos;
+    unsigned int m_dequeuePos;              // protected by m_criticalSection
+    std::atomic<unsigned long> m_dropped;
+    std::atomic<bool> m_writerWaiting;
+    wxSemaphore m_writerWakeup;
+    DebugLogWriter *m_pWriter;
+    volatile bool m_writerRunning;
+
     void InitVars(void);
+    bool Enqueue(const wxString& str);
+    void WriteQueued(void);                 // called with m_criticalSection held
 
 public:
     DebugLog(void);
@@ -61,6 +86,9 @@ public:
     wxString Write(const wxString& str);
     bool Flush(void);
 
+    void StartWriter(void);
+    void StopWriter(void);
+
     bool ChangeDirLog(const wxString& newdir);
     void RemoveOldFiles();
 };
@@ -33,16 +33,22 @@
  */
 
 #include "phd.h"
+#include "json_writer.h"
 
 #include <wx/sstream.h>
 #include <wx/sckstrm.h>
 #include <sstream>
+#include <climits>
+#include <deque>
+#include <limits>
 
 EventServer EvtServer;
 
 BEGIN_EVENT_TABLE(EventServer, wxEvtHandler)
     EVT_SOCKET(EVENT_SERVER_ID, EventServer::OnEventServerEvent)
     EVT_SOCKET(EVENT_SERVER_CLIENT_ID, EventServer::OnEventServerClientEvent)
+    EVT_SOCKET(FRAME_SERVER_ID, EventServer::OnFrameServerEvent)
+    EVT_SOCKET(FRAME_SERVER_CLIENT_ID, EventServer::OnFrameServerClientEvent)
 END_EVENT_TABLE()
 
 enum
@@ -50,9 +56,8 @@ enum
     MSG_PROTOCOL_VERSION = 1,
 };
 
-static const wxString literal_null("null");
-static const wxString literal_true("true");
-static const wxString literal_false("false");
+static const int DefaultEventHistorySize = 2000;
+static const int MaxEventHistorySize = 100000;
 
 static wxString state_name(EXPOSED_STATE st)
 {
@@ -69,121 +74,133 @@ static wxString state_name(EXPOSED_STATE st)
     }
 }
 
-static wxString json_escape(const wxString& s)
+// quoted, escaped and in UTF-8
+static void json_append_string(std::string& out, const wxString& s)
 {
-    wxString t(s);
-    static const wxString BACKSLASH("\\");
-    static const wxString BACKSLASHBACKSLASH("\\\\");
-    static const wxString DQUOT("\"");
-    static const wxString BACKSLASHDQUOT("\\\"");
-    t.Replace(BACKSLASH, BACKSLASHBACKSLASH);
-    t.Replace(DQUOT, BACKSLASHDQUOT);
-    return t;
+    const wxCharBuffer buf = s.ToUTF8();
+    JsonWriter::AppendString(out, buf.data(), buf.length());
 }
 
+static void json_string(JsonWriter& w, const wxString& s)
+{
+    const wxCharBuffer buf = s.ToUTF8();
+    w.String(buf.data(), buf.length());
+}
+
+// the JSON text is built in UTF-8 as it is sent, no conversion at the end
 template<char LDELIM, char RDELIM>
 struct JSeq
 {
-    wxString m_s;
+    std::string m_s;
     bool m_first;
     bool m_closed;
-    JSeq() : m_first(true), m_closed(false) { m_s << LDELIM; }
-    void close() { m_s << RDELIM; m_closed = true; }
-    wxString str() { if (!m_closed) close(); return m_s; }
+    JSeq() : m_first(true), m_closed(false) { m_s += LDELIM; }
+    void sep() { if (m_first) m_first = false; else m_s += ','; }
+    void close() { m_s += RDELIM; m_closed = true; }
+    const std::string& str() { if (!m_closed) close(); return m_s; }
 };
 
 typedef JSeq<'[', ']'> JAry;
 typedef JSeq<'{', '}'> JObj;
 
-static JAry& operator<<(JAry& a, const wxString& str)
+// an element that is already JSON text
+static JAry& operator<<(JAry& a, const std::string& json)
 {
-    if (a.m_first)
-        a.m_first = false;
-    else
-        a.m_s << ',';
-    a.m_s << json_escape(str);
+    a.sep();
+    a.m_s += json;
     return a;
 }
 
 static JAry& operator<<(JAry& a, double d)
 {
-    return a << wxString::Format("%.2f", d);
+    a.sep();
+    JsonWriter::AppendFixed(a.m_s, d, 2);
+    return a;
 }
 
 static JAry& operator<<(JAry& a, int i)
 {
-    return a << wxString::Format("%d", i);
+    a.sep();
+    JsonWriter::AppendInt(a.m_s, i);
+    return a;
 }
 
-static wxString json_format(const json_value *j)
+static void json_format(std::string& out, const json_value *j)
 {
     if (!j)
-        return literal_null;
+    {
+        out += "null";
+        return;
+    }
 
     switch (j->type) {
     default:
-    case JSON_NULL: return literal_null;
+    case JSON_NULL:
+        out += "null";
+        break;
     case JSON_OBJECT: {
-        wxString ret("{");
+        out += '{';
         bool first = true;
         json_for_each (jj, j)
         {
             if (first)
                 first = false;
             else
-                ret << ",";
-            ret << '"' << jj->name << "\":" << json_format(jj);
+                out += ',';
+            JsonWriter::AppendString(out, jj->name, strlen(jj->name));
+            out += ':';
+            json_format(out, jj);
         }
-        ret << "}";
-        return ret;
+        out += '}';
+        break;
     }
     case JSON_ARRAY: {
-        wxString ret("[");
+        out += '[';
         bool first = true;
         json_for_each (jj, j)
         {
             if (first)
                 first = false;
             else
-                ret << ",";
-            ret << json_format(jj);
+                out += ',';
+            json_format(out, jj);
         }
-        ret << "]";
-        return ret;
+        out += ']';
+        break;
     }
-    case JSON_STRING: return '"' + json_escape(j->string_value) + '"';
-    case JSON_INT:    return wxString::Format("%d", j->int_value);
-    case JSON_FLOAT:  return wxString::Format("%g", (double) j->float_value);
-    case JSON_BOOL:   return j->int_value ? literal_true : literal_false;
+    case JSON_STRING: JsonWriter::AppendString(out, j->string_value, strlen(j->string_value)); break;
+    case JSON_INT:    JsonWriter::AppendInt(out, j->int_value); break;
+    case JSON_FLOAT:  JsonWriter::AppendDouble(out, j->float_value); break;
+    case JSON_BOOL:   out += j->int_value ? "true" : "false"; break;
     }
 }
 
 struct NULL_TYPE { } NULL_VALUE;
 
-// name-value pair
+// name-value pair, the name is not copied
 struct NV
 {
-    wxString n;
-    wxString v;
-    NV(const wxString& n_, const wxString& v_) : n(n_), v('"' + json_escape(v_) + '"') { }
-    NV(const wxString& n_, const char *v_) : n(n_), v('"' + json_escape(v_) + '"') { }
-    NV(const wxString& n_, const wchar_t *v_) : n(n_), v('"' + json_escape(v_) + '"') { }
-    NV(const wxString& n_, int v_) : n(n_), v(wxString::Format("%d", v_)) { }
-    NV(const wxString& n_, double v_) : n(n_), v(wxString::Format("%g", v_)) { }
-    NV(const wxString& n_, double v_, int prec) : n(n_), v(wxString::Format("%.*f", prec, v_)) { }
-    NV(const wxString& n_, bool v_) : n(n_), v(v_ ? literal_true : literal_false) { }
+    const char *n;
+    std::string v;
+    NV(const char *n_, const wxString& v_) : n(n_) { json_append_string(v, v_); }
+    NV(const char *n_, const char *v_) : n(n_) { JsonWriter::AppendString(v, v_, strlen(v_)); }
+    NV(const char *n_, const wchar_t *v_) : n(n_) { json_append_string(v, v_); }
+    NV(const char *n_, int v_) : n(n_) { JsonWriter::AppendInt(v, v_); }
+    NV(const char *n_, double v_) : n(n_) { JsonWriter::AppendDouble(v, v_); }
+    NV(const char *n_, double v_, int prec) : n(n_) { JsonWriter::AppendFixed(v, v_, prec); }
+    NV(const char *n_, bool v_) : n(n_), v(v_ ? "true" : "false") { }
     template<typename T>
-    NV(const wxString& n_, const std::vector<T>& vec);
-    NV(const wxString& n_, JAry& ary) : n(n_), v(ary.str()) { }
-    NV(const wxString& n_, JObj& obj) : n(n_), v(obj.str()) { }
-    NV(const wxString& n_, const json_value *v_) : n(n_), v(json_format(v_)) { }
-    NV(const wxString& n_, const PHD_Point& p) : n(n_) { JAry ary; ary << p.X << p.Y; v = ary.str(); }
-    NV(const wxString& n_, const wxPoint& p) : n(n_) { JAry ary; ary << p.x << p.y; v = ary.str(); }
-    NV(const wxString& n_, const NULL_TYPE& nul) : n(n_), v(literal_null) { }
+    NV(const char *n_, const std::vector<T>& vec);
+    NV(const char *n_, JAry& ary) : n(n_), v(ary.str()) { }
+    NV(const char *n_, JObj& obj) : n(n_), v(obj.str()) { }
+    NV(const char *n_, const json_value *v_) : n(n_) { json_format(v, v_); }
+    NV(const char *n_, const PHD_Point& p) : n(n_) { JAry ary; ary << p.X << p.Y; v = ary.str(); }
+    NV(const char *n_, const wxPoint& p) : n(n_) { JAry ary; ary << p.x << p.y; v = ary.str(); }
+    NV(const char *n_, const NULL_TYPE& nul) : n(n_), v("null") { }
 };
 
 template<typename T>
-NV::NV(const wxString& n_, const std::vector<T>& vec)
+NV::NV(const char *n_, const std::vector<T>& vec)
     : n(n_)
 {
     std::ostringstream os;
@@ -200,11 +217,10 @@ NV::NV(const wxString& n_, const std::vector<T>& vec)
 
 static JObj& operator<<(JObj& j, const NV& nv)
 {
-    if (j.m_first)
-        j.m_first = false;
-    else
-        j.m_s << ',';
-    j.m_s << '"' << nv.n << "\":" << nv.v;
+    j.sep();
+    JsonWriter::AppendString(j.m_s, nv.n, strlen(nv.n));
+    j.m_s += ':';
+    j.m_s += nv.v;
     return j;
 }
 
@@ -223,6 +239,21 @@ static JAry& operator<<(JAry& a, JObj& j)
     return a << j.str();
 }
 
+// looked up once, it is in every event
+static const wxString& host_name()
+{
+    static wxString s_hostName = wxGetHostName();
+    return s_hostName;
+}
+
+static const std::string& host_name_json()
+{
+    static std::string s_hostNameJson;
+    if (s_hostNameJson.empty())
+        json_append_string(s_hostNameJson, host_name());
+    return s_hostNameJson;
+}
+
 struct Ev : public JObj
 {
     Ev(const wxString& event)
@@ -230,11 +261,23 @@ struct Ev : public JObj
         double const now = ::wxGetUTCTimeMillis().ToDouble() / 1000.0;
         *this << NV("Event", event)
             << NV("Timestamp", now, 3)
-            << NV("Host", wxGetHostName())
+            << NV("Host", host_name())
             << NV("Inst", pFrame->GetInstanceNumber());
     }
 };
 
+// the members of Ev, for events written with a JsonWriter
+static void begin_event(JsonWriter& w, const char *event)
+{
+    double const now = ::wxGetUTCTimeMillis().ToDouble() / 1000.0;
+    w.Reset();
+    w.BeginObject()
+        .Key("Event").String(event)
+        .Key("Timestamp").Fixed(now, 3)
+        .Key("Host").Raw(host_name_json())
+        .Key("Inst").Int(pFrame->GetInstanceNumber());
+}
+
 static Ev ev_message_version()
 {
     Ev ev("Version");
@@ -322,42 +365,484 @@ static Ev ev_settle_done(const wxString& errorMsg)
     return ev;
 }
 
-static void send_buf(wxSocketClient *client, const wxCharBuffer& buf)
+// Input of a client, read until it holds complete lines. The buffer grows for
+// long requests, up to MAX_SIZE, and goes back to a pool when the client
+// disconnects.
+struct ClientReadBuf
+{
+    enum
+    {
+        INITIAL_SIZE = 4 * 1024,
+        MAX_SIZE = 1024 * 1024,     // a longer request is rejected
+        POOL_SIZE = 16,
+    };
+
+    std::vector<char> buf;
+    size_t len;                 // bytes read
+    size_t scanned;             // bytes searched for a line end already
+
+    ClientReadBuf();
+    ~ClientReadBuf();
+
+    // makes room for the next read, false if the buffer is full at MAX_SIZE
+    bool reserve();
+    char *dest() { return &buf[len]; }
+    size_t avail() const { return buf.size() - len; }
+    // the next complete line from pos on, null terminated, or NULL
+    char *next_line(size_t *pos);
+    // drops what comes before pos
+    void consume(size_t pos);
+    void reset() { len = scanned = 0; }
+};
+
+static std::vector<std::vector<char> >& read_buf_pool()
+{
+    static std::vector<std::vector<char> > s_pool;
+    return s_pool;
+}
+
+ClientReadBuf::ClientReadBuf()
+    : len(0), scanned(0)
+{
+    std::vector<std::vector<char> >& pool = read_buf_pool();
+
+    if (pool.empty())
+        buf.resize(INITIAL_SIZE);
+    else
+    {
+        buf.swap(pool.back());
+        pool.pop_back();
+    }
+}
+
+ClientReadBuf::~ClientReadBuf()
+{
+    std::vector<std::vector<char> >& pool = read_buf_pool();
+
+    if (buf.size() == INITIAL_SIZE && pool.size() < POOL_SIZE)
+    {
+        pool.push_back(std::vector<char>());
+        pool.back().swap(buf);
+    }
+}
+
+bool ClientReadBuf::reserve()
+{
+    if (len < buf.size())
+        return true;
+
+    if (buf.size() >= MAX_SIZE)
+        return false;
+
+    buf.resize(std::min(buf.size() * 2, (size_t) MAX_SIZE));
+    return true;
+}
+
+char *ClientReadBuf::next_line(size_t *pos)
+{
+    for (size_t i = std::max(*pos, scanned); i < len; i++)
+    {
+        if (buf[i] == '\r' || buf[i] == '\n')
+        {
+            buf[i] = 0;
+            char *line = &buf[*pos];
+            *pos = scanned = i + 1;
+            return line;
+        }
+    }
+
+    scanned = len;
+    return 0;
+}
+
+void ClientReadBuf::consume(size_t pos)
+{
+    if (pos == 0)
+        return;
+
+    memmove(&buf[0], &buf[pos], len - pos);
+    len -= pos;
+    scanned -= pos;
+
+    // a long request is done with, give its memory back
+    if (len == 0 && buf.size() > INITIAL_SIZE)
+        std::vector<char>(INITIAL_SIZE).swap(buf);
+}
+
+struct OutboundMsg
+{
+    std::string data;           // including the line terminator
+    bool guideStep;             // may be replaced by a newer guide step
+};
+
+// Messages waiting for a client that reads slower than we write. Writes never
+// block the GUI thread: whatever the socket does not take is kept here and
+// sent when the socket becomes writable again.
+struct ClientWriteQueue
+{
+    enum
+    {
+        // past this, queued guide steps are replaced by the newest one and
+        // the client is marked lagged
+        SOFT_LIMIT = 256 * 1024,
+        // past this, the client is disconnected
+        HARD_LIMIT = 1024 * 1024,
+    };
+
+    std::deque<OutboundMsg> msgs;
+    size_t bytes;               // queued, including the part of the first message already sent
+    size_t offset;              // bytes of the first message already sent
+    size_t maxBytes;
+    unsigned int sent;
+    unsigned int coalesced;
+    unsigned int lagCount;      // times the client went past the soft limit
+    bool lagged;
+    bool overflowed;            // past the hard limit, to be disconnected
+
+    ClientWriteQueue() : bytes(0), offset(0), maxBytes(0), sent(0), coalesced(0), lagCount(0),
+        lagged(false), overflowed(false) { }
+};
+
+struct ClientData
+{
+    ClientReadBuf rdbuf;
+    ClientWriteQueue wrq;
+};
+
+inline static ClientData *client_data(wxSocketClient *cli)
+{
+    return (ClientData *) cli->GetClientData();
+}
+
+inline static ClientReadBuf *client_rdbuf(wxSocketClient *cli)
+{
+    return &client_data(cli)->rdbuf;
+}
+
+static void destroy_client(wxSocketClient *cli)
+{
+    ClientData *data = client_data(cli);
+    cli->Destroy();
+    delete data;
+}
+
+/*
+ * Frame stream
+ *
+ * A side channel next to the JSON-RPC connection, on port 4500 + instance - 1,
+ * that pushes guide frame pixels as binary messages. A client subscribes by
+ * sending a line with a JSON object, and can send another one at any time to
+ * change the subscription:
+ *
+ *   {"mode": "cutout", "size": 21, "decimation": 1}
+ *   {"mode": "frame", "roi": [x, y, width, height], "decimation": 4}
+ *   {"mode": "none"}
+ *
+ * "cutout" follows the guide star with a size x size box (by default the 21 x
+ * 21 box of the star profile window), "frame" sends the whole frame or the
+ * roi. Only every decimation'th frame is sent, and a frame is skipped for a
+ * client that has not received all of the previous one yet.
+ *
+ * Each message is a FrameMsgHeader followed by width x height 16-bit pixels,
+ * row by row, all in little endian byte order.
+ */
+
+struct FrameMsgHeader
+{
+    uint32_t length;            // bytes following this field
+    uint32_t type;              // FRAME_MSG_FRAME or FRAME_MSG_CUTOUT
+    uint32_t frame;             // frame number, as in the GuideStep event
+    uint32_t reserved;
+    double time;                // unix time the exposure started
+    int32_t x;                  // position of the first pixel in the full frame
+    int32_t y;
+    uint32_t width;
+    uint32_t height;
+    float starX;                // star position in the full frame, NaN if none
+    float starY;
+};
+
+enum
+{
+    FRAME_MSG_FRAME = 1,
+    FRAME_MSG_CUTOUT = 2,
+};
+
+struct FrameSubscriber
+{
+    enum Mode
+    {
+        MODE_NONE,
+        MODE_FRAME,
+        MODE_CUTOUT,
+    };
+    enum { DEFAULT_CUTOUT = 21, MAX_CUTOUT = 201 };
+
+    Mode mode;
+    int cutoutSize;
+    unsigned int decimation;
+    wxRect roi;                 // empty for the whole frame
+    unsigned int frames;        // frames seen since subscribing
+    unsigned int sent;
+    unsigned int skipped;
+    std::string pending;        // the part of the last message the socket did not take
+    size_t pendingOffset;
+    ClientReadBuf rdbuf;
+
+    FrameSubscriber() : mode(MODE_NONE), cutoutSize(DEFAULT_CUTOUT), decimation(1), frames(0), sent(0), skipped(0),
+        pendingOffset(0) { }
+};
+
+static const char *frame_mode_name(FrameSubscriber::Mode mode)
+{
+    switch (mode)
+    {
+    case FrameSubscriber::MODE_FRAME:  return "frame";
+    case FrameSubscriber::MODE_CUTOUT: return "cutout";
+    default:                           return "none";
+    }
+}
+
+inline static FrameSubscriber *frame_subscriber(wxSocketClient *cli)
+{
+    return (FrameSubscriber *) cli->GetClientData();
+}
+
+// writes as much of the queue as the socket takes without blocking
+static void flush_client(wxSocketClient *cli)
+{
+    ClientWriteQueue& q = client_data(cli)->wrq;
+
+    while (!q.msgs.empty())
+    {
+        const std::string& data = q.msgs.front().data;
+        size_t len = data.size() - q.offset;
+
+        cli->Write(data.data() + q.offset, len);
+        size_t n = cli->LastCount();
+
+        q.offset += n;
+        q.bytes -= n;
+
+        if (q.offset < data.size())
+            break;              // the socket is full, wait for wxSOCKET_OUTPUT
+
+        q.msgs.pop_front();
+        q.offset = 0;
+        ++q.sent;
+    }
+
+    if (q.msgs.empty() && q.lagged)
+    {
+        Debug.AddLine("evsrv: cli %p caught up", cli);
+        q.lagged = false;
+    }
+}
+
+// drops the queued guide steps that have not started to go out
+static void coalesce_guide_steps(ClientWriteQueue& q)
+{
+    std::deque<OutboundMsg>::iterator it = q.msgs.begin();
+
+    if (it != q.msgs.end() && q.offset > 0)
+        ++it;
+
+    while (it != q.msgs.end())
+    {
+        if (it->guideStep)
+        {
+            q.bytes -= it->data.size();
+            it = q.msgs.erase(it);
+            ++q.coalesced;
+        }
+        else
+            ++it;
+    }
+}
+
+static void send_buf(wxSocketClient *client, const char *buf, size_t len, bool guideStep = false)
 {
-    client->Write(buf.data(), buf.length());
-    client->Write("\r\n", 2);
+    ClientWriteQueue& q = client_data(client)->wrq;
+
+    if (q.overflowed)
+        return;
+
+    if (q.bytes + len > ClientWriteQueue::SOFT_LIMIT)
+    {
+        if (!q.lagged)
+        {
+            Debug.AddLine("evsrv: cli %p lagging, %u bytes queued", client, (unsigned int) q.bytes);
+            q.lagged = true;
+            ++q.lagCount;
+        }
+
+        if (guideStep)
+            coalesce_guide_steps(q);
+
+        if (q.bytes + len > ClientWriteQueue::HARD_LIMIT)
+        {
+            Debug.AddLine("evsrv: cli %p not reading, %u bytes queued, disconnecting", client, (unsigned int) q.bytes);
+            q.overflowed = true;
+            // this can happen while one of the client's own requests is
+            // being handled, so it is only disconnected later
+            EvtServer.ScheduleDropOverflowedClients();
+            return;
+        }
+    }
+
+    size_t sent = 0;
+
+    // nothing queued: write straight from the caller's buffer, which is
+    // shared by all the clients, and only copy what the socket does not take
+    if (q.msgs.empty())
+    {
+        client->Write(buf, len);
+        sent = client->LastCount();
+        if (sent == len)
+        {
+            ++q.sent;
+            return;
+        }
+    }
+
+    // if something was queued already, the socket is full and we will be
+    // told when it can take more
+    OutboundMsg msg;
+    msg.data.assign(buf, len);
+    msg.guideStep = guideStep;
+
+    if (q.msgs.empty())
+        q.offset = sent;
+
+    q.bytes += len - sent;
+    q.maxBytes = std::max(q.maxBytes, q.bytes);
+    q.msgs.push_back(msg);
 }
 
-static void do_notify1(wxSocketClient *client, const JAry& ary)
+static void send_json(wxSocketClient *client, const std::string& json)
 {
-    send_buf(client, JAry(ary).str().ToUTF8());
+    std::string line;
+    line.reserve(json.size() + 2);
+    line.append(json).append("\r\n", 2);
+    send_buf(client, line.data(), line.size());
 }
 
 static void do_notify1(wxSocketClient *client, const JObj& j)
 {
-    send_buf(client, JObj(j).str().ToUTF8());
+    send_json(client, JObj(j).str());
+}
+
+// disconnects the clients that went past the hard limit of their queue
+static void drop_overflowed_clients(EventServer::CliSockSet& cli)
+{
+    for (EventServer::CliSockSet::iterator it = cli.begin(); it != cli.end(); )
+    {
+        if (client_data(*it)->wrq.overflowed)
+        {
+            destroy_client(*it);
+            cli.erase(it++);
+        }
+        else
+            ++it;
+    }
+}
+
+// The latest events, numbered, so that a client that lost its connection can
+// get the ones it missed with get_events_since. The sequence numbers go on
+// across profile changes and server restarts.
+class EventHistory
+{
+    std::vector<std::string> m_ring;    // events as sent, with their line terminator
+    size_t m_count;                     // entries in use
+    size_t m_next;                      // slot of the next event
+    unsigned int m_seq;                 // sequence number of the next event
+
+public:
+    EventHistory() : m_count(0), m_next(0), m_seq(1) { }
+
+    bool Enabled() const { return !m_ring.empty(); }
+    void Resize(unsigned int size);
+    unsigned int NextSeq() const { return m_seq; }
+    unsigned int OldestSeq() const { return m_seq - (unsigned int) m_count; }
+    // adds the sequence number to the event and keeps it
+    const std::string& Add(const char *buf, size_t len);
+    // the event with the given sequence number, which must still be kept
+    const std::string& Event(unsigned int seq) const;
+};
+
+void EventHistory::Resize(unsigned int size)
+{
+    std::vector<std::string>(size).swap(m_ring);
+    m_count = m_next = 0;
+}
+
+const std::string& EventHistory::Add(const char *buf, size_t len)
+{
+    // the slots are reused, so this only allocates while the ring fills
+    std::string& line = m_ring[m_next];
+
+    // the number goes last in the event object, before "}\r\n"
+    line.assign(buf, len - 3);
+    line.append(",\"Seq\":", 7);
+    JsonWriter::AppendInt(line, m_seq);
+    line.append("}\r\n", 3);
+
+    ++m_seq;
+    m_next = (m_next + 1) % m_ring.size();
+    if (m_count < m_ring.size())
+        ++m_count;
+
+    return line;
+}
+
+const std::string& EventHistory::Event(unsigned int seq) const
+{
+    size_t back = m_seq - seq;      // 1 for the latest event
+    return m_ring[(m_next + m_ring.size() - back) % m_ring.size()];
+}
+
+static EventHistory s_history;
+
+// nothing to build the event for
+inline static bool no_listeners(const EventServer::CliSockSet& cli)
+{
+    return cli.empty() && !s_history.Enabled();
 }
 
-static void do_notify(const EventServer::CliSockSet& cli, const JObj& jj)
+// serialized once, sent to all the clients; buf ends with the line terminator
+static void do_notify(EventServer::CliSockSet& cli, const char *buf, size_t len, bool guideStep = false)
 {
-    wxCharBuffer buf = JObj(jj).str().ToUTF8();
+    // events are kept, and sent, with their sequence number
+    if (s_history.Enabled() && len >= 3 && buf[len - 3] == '}')
+    {
+        const std::string& line = s_history.Add(buf, len);
+        buf = line.data();
+        len = line.size();
+    }
 
     for (EventServer::CliSockSet::const_iterator it = cli.begin();
         it != cli.end(); ++it)
     {
-        send_buf(*it, buf);
+        send_buf(*it, buf, len, guideStep);
     }
 }
 
-inline static void simple_notify(const EventServer::CliSockSet& cli, const wxString& ev)
+static void do_notify(EventServer::CliSockSet& cli, const JObj& jj, bool guideStep = false)
+{
+    std::string line(JObj(jj).str());
+    line.append("\r\n", 2);
+    do_notify(cli, line.data(), line.size(), guideStep);
+}
+
+inline static void simple_notify(EventServer::CliSockSet& cli, const wxString& ev)
 {
-    if (!cli.empty())
+    if (!no_listeners(cli))
         do_notify(cli, Ev(ev));
 }
 
-inline static void simple_notify_ev(const EventServer::CliSockSet& cli, const Ev& ev)
+inline static void simple_notify_ev(EventServer::CliSockSet& cli, const Ev& ev)
 {
-    if (!cli.empty())
+    if (!no_listeners(cli))
         do_notify(cli, ev);
 }
 
@@ -403,29 +888,6 @@ static void send_catchup_events(wxSocketClient *cli)
     do_notify1(cli, ev_app_state());
 }
 
-struct ClientReadBuf
-{
-    enum { SIZE = 1024 };
-    char buf[SIZE];
-    char *dest;
-
-    ClientReadBuf() { reset(); }
-    size_t avail() const { return &buf[SIZE] - dest; }
-    void reset() { dest = &buf[0]; }
-};
-
-inline static ClientReadBuf *client_rdbuf(wxSocketClient *cli)
-{
-    return (ClientReadBuf *) cli->GetClientData();
-}
-
-static void destroy_client(wxSocketClient *cli)
-{
-    ClientReadBuf *buf = client_rdbuf(cli);
-    cli->Destroy();
-    delete buf;
-}
-
 static void drain_input(wxSocketInputStream& sis)
 {
     while (sis.CanRead())
@@ -436,20 +898,6 @@ static void drain_input(wxSocketInputStream& sis)
     }
 }
 
-static bool find_eol(char *p, size_t len)
-{
-    const char *end = p + len;
-    for (; p < end; p++)
-    {
-        if (*p == '\r' || *p == '\n')
-        {
-            *p = 0;
-            return true;
-        }
-    }
-    return false;
-}
-
 enum {
     JSONRPC_PARSE_ERROR = -32700,
     JSONRPC_INVALID_REQUEST = -32600,
@@ -575,7 +1023,7 @@ static void set_exposure(JObj& response, const json_value *params)
         return;
     }
 
-    bool ok = pFrame->SetExposureDuration(exp->int_value);
+    bool ok = pFrame->SetExposureDuration((int) exp->int_value);
     if (ok)
     {
         response << jrpc_result(1);
@@ -618,7 +1066,7 @@ static void set_profile(JObj& response, const json_value *params)
     }
 
     wxString errMsg;
-    bool error = pFrame->pGearDialog->SetProfile(id->int_value, &errMsg);
+    bool error = pFrame->pGearDialog->SetProfile((int) id->int_value, &errMsg);
 
     if (error)
     {
@@ -937,30 +1385,229 @@ static void get_lock_shift_params(JObj& response, const json_value *params)
     response << jrpc_result(rslt);
 }
 
-static bool get_double(double *d, const json_value *j)
+static void get_worker_latency(JObj& response, const json_value *params)
 {
-    if (j->type == JSON_FLOAT)
+    JObj rslt;
+
+    for (int i = 0; i < MyFrame::WORKER_THREAD_COUNT; i++)
     {
-        *d = j->float_value;
-        return true;
+        MyFrame::WORKER_THREAD_ID id = static_cast<MyFrame::WORKER_THREAD_ID>(i);
+        WorkerLatency latency[WorkerThread::REQUEST_TYPE_COUNT];
+
+        if (!pFrame->GetWorkerThreadLatency(id, latency))
+            continue;
+
+        JObj thread;
+
+        for (int type = WorkerThread::REQUEST_EXPOSE; type < WorkerThread::REQUEST_TYPE_COUNT; type++)
+        {
+            const WorkerLatency& lat = latency[type];
+            JObj t;
+            t << NV("count", (int) lat.count)
+              << NV("coalesced", (int) lat.coalesced)
+              << NV("cancelled", (int) lat.cancelled)
+              << NV("avgQueueMs", lat.count ? lat.totalQueueMs / lat.count : 0.0, 1)
+              << NV("maxQueueMs", lat.maxQueueMs, 0)
+              << NV("avgRunMs", lat.count ? lat.totalRunMs / lat.count : 0.0, 1)
+              << NV("maxRunMs", lat.maxRunMs, 0);
+            thread << NV(WorkerThread::RequestTypeName(type), t);
+        }
+
+        rslt << NV(MyFrame::WorkerThreadName(id), thread);
     }
-    else if (j->type == JSON_INT)
+
+    response << jrpc_result(rslt);
+}
+
+static void set_trace_enabled(JObj& response, const json_value *params)
+{
+    const json_value *val;
+    if (!params || (val = at(params, 0)) == 0 || val->type != JSON_BOOL)
     {
-        *d = j->int_value;
-        return true;
+        response << jrpc_error(JSONRPC_INVALID_PARAMS, "expected enabled boolean param");
+        return;
     }
-    return false;
+
+    bool enable = val->int_value ? true : false;
+    Trace::Enable(enable);
+    pConfig->Global.SetBoolean("/TraceEnabled", enable);
+
+    response << jrpc_result(0);
 }
 
-static bool parse_point(PHD_Point *pt, const json_value *j)
+static void export_trace(JObj& response, const json_value *params)
 {
-    if (j->type != JSON_ARRAY)
-        return false;
-    const json_value *jx = j->first_child;
-    if (!jx)
-        return false;
-    const json_value *jy = jx->next_sibling;
-    if (!jy || jy->next_sibling)
+    wxString fname = Debug.GetLogDir() + PATHSEPSTR + "PHD2_Trace" + wxDateTime::Now().Format("_%Y-%m-%d_%H%M%S") + ".json";
+
+    if (Trace::ExportChromeTrace(fname))
+    {
+        response << jrpc_error(1, "error writing trace file");
+        return;
+    }
+
+    Trace::LogSummary();
+
+    JObj rslt;
+    rslt << NV("filename", fname);
+    response << jrpc_result(rslt);
+}
+
+static void get_frame_stream(JObj& response, const json_value *params)
+{
+    JObj rslt;
+    JAry subscribers;
+
+    const EventServer::CliSockSet& clients = EvtServer.GetFrameClients();
+    for (EventServer::CliSockSet::const_iterator it = clients.begin(); it != clients.end(); ++it)
+    {
+        const FrameSubscriber *sub = frame_subscriber(*it);
+        JObj t;
+        t << NV("mode", frame_mode_name(sub->mode))
+          << NV("decimation", (int) sub->decimation)
+          << NV("sent", (int) sub->sent)
+          << NV("skipped", (int) sub->skipped);
+        subscribers << t;
+    }
+
+    rslt << NV("port", (int) EvtServer.GetFrameServerPort())
+         << NV("subscribers", subscribers);
+    response << jrpc_result(rslt);
+}
+
+static void get_events_since(JObj& response, const json_value *params)
+{
+    // {"method": "get_events_since", "params": {"seq": 1234, "max": 100}}
+    // returns the kept events from seq on, in order, as they were sent
+
+    enum { DEFAULT_MAX = 500 };
+
+    const json_value *seqParam = 0;
+    const json_value *maxParam = 0;
+
+    if (params && params->type == JSON_ARRAY)
+    {
+        seqParam = at(params, 0);
+        maxParam = at(params, 1);
+    }
+    else if (params && params->type == JSON_OBJECT)
+    {
+        json_for_each (t, params)
+        {
+            if (strcmp(t->name, "seq") == 0)
+                seqParam = t;
+            else if (strcmp(t->name, "max") == 0)
+                maxParam = t;
+        }
+    }
+
+    if (!seqParam || seqParam->type != JSON_INT || seqParam->int_value < 0 || seqParam->int_value > UINT_MAX)
+    {
+        response << jrpc_error(JSONRPC_INVALID_PARAMS, "expected seq param");
+        return;
+    }
+
+    unsigned int max = DEFAULT_MAX;
+    if (maxParam)
+    {
+        if (maxParam->type != JSON_INT || maxParam->int_value <= 0)
+        {
+            response << jrpc_error(JSONRPC_INVALID_PARAMS, "expected a positive max param");
+            return;
+        }
+        max = (unsigned int) wxMin(maxParam->int_value, (long long) DEFAULT_MAX);
+    }
+
+    if (!s_history.Enabled())
+    {
+        response << jrpc_error(1, "event history disabled");
+        return;
+    }
+
+    unsigned int seq = (unsigned int) seqParam->int_value;
+    if (seq > s_history.NextSeq())
+    {
+        response << jrpc_error(JSONRPC_INVALID_PARAMS, "seq is past the latest event");
+        return;
+    }
+
+    // events that are no longer kept are reported, the client must then get
+    // the state again
+    unsigned int oldest = s_history.OldestSeq();
+    unsigned int missed = 0;
+    if (seq < oldest)
+    {
+        missed = oldest - seq;
+        seq = oldest;
+    }
+
+    JAry events;
+    unsigned int end = wxMin(s_history.NextSeq(), seq + max);
+    for (; seq < end; ++seq)
+    {
+        const std::string& line = s_history.Event(seq);
+        events << line.substr(0, line.size() - 2);
+    }
+
+    JObj rslt;
+    rslt << NV("events", events)
+         << NV("next", (int) seq)
+         << NV("latest", (int) s_history.NextSeq() - 1)
+         << NV("missed", (int) missed);
+    response << jrpc_result(rslt);
+}
+
+static void get_client_stats(JObj& response, const json_value *params)
+{
+    JAry ary;
+
+    const EventServer::CliSockSet& clients = EvtServer.GetClients();
+    for (EventServer::CliSockSet::const_iterator it = clients.begin(); it != clients.end(); ++it)
+    {
+        wxSocketClient *cli = *it;
+        const ClientWriteQueue& q = client_data(cli)->wrq;
+
+        wxIPV4address addr;
+        wxString peer = cli->GetPeer(addr) ? addr.IPAddress() + ":" + wxString::Format("%u", (unsigned int) addr.Service()) : wxString("unknown");
+
+        JObj t;
+        t << NV("peer", peer)
+          << NV("queuedBytes", (int) q.bytes)
+          << NV("queuedMessages", (int) q.msgs.size())
+          << NV("maxQueuedBytes", (int) q.maxBytes)
+          << NV("sent", (int) q.sent)
+          << NV("coalesced", (int) q.coalesced)
+          << NV("lagCount", (int) q.lagCount)
+          << NV("lagged", q.lagged);
+        ary << t;
+    }
+
+    response << jrpc_result(ary);
+}
+
+static bool get_double(double *d, const json_value *j)
+{
+    if (j->type == JSON_FLOAT)
+    {
+        *d = j->float_value;
+        return true;
+    }
+    else if (j->type == JSON_INT)
+    {
+        *d = (double) j->int_value;
+        return true;
+    }
+    return false;
+}
+
+static bool parse_point(PHD_Point *pt, const json_value *j)
+{
+    if (j->type != JSON_ARRAY)
+        return false;
+    const json_value *jx = j->first_child;
+    if (!jx)
+        return false;
+    const json_value *jy = jx->next_sibling;
+    if (!jy || jy->next_sibling)
         return false;
     double x, y;
     if (!get_double(&x, jx) || !get_double(&y, jy))
@@ -1217,12 +1864,15 @@ static void dither(JObj& response, const json_value *params)
 
 static void dump_request(const wxSocketClient *cli, const json_value *req)
 {
-    Debug.AddLine(wxString::Format("evsrv: cli %p request: %s", cli, json_format(req)));
+    std::string s;
+    json_format(s, req);
+    Debug.AddLine(wxString::Format("evsrv: cli %p request: %s", cli, wxString::FromUTF8(s.c_str())));
 }
 
 static void dump_response(const wxSocketClient *cli, const JRpcResponse& resp)
 {
-    Debug.AddLine(wxString::Format("evsrv: cli %p response: %s", cli, const_cast<JRpcResponse&>(resp).str()));
+    const std::string& s = const_cast<JRpcResponse&>(resp).str();
+    Debug.AddLine(wxString::Format("evsrv: cli %p response: %s", cli, wxString::FromUTF8(s.c_str())));
 }
 
 static bool handle_request(const wxSocketClient *cli, JObj& response, const json_value *req)
@@ -1273,6 +1923,12 @@ static bool handle_request(const wxSocketClient *cli, JObj& response, const json
         { "get_lock_shift_params", &get_lock_shift_params, },
         { "set_lock_shift_params", &set_lock_shift_params, },
         { "save_image", &save_image, },
+        { "get_worker_latency", &get_worker_latency, },
+        { "set_trace_enabled", &set_trace_enabled, },
+        { "export_trace", &export_trace, },
+        { "get_client_stats", &get_client_stats, },
+        { "get_events_since", &get_events_since, },
+        { "get_frame_stream", &get_frame_stream, },
     };
 
     for (unsigned int i = 0; i < WXSIZEOF(methods); i++)
@@ -1303,14 +1959,26 @@ static bool handle_request(const wxSocketClient *cli, JObj& response, const json
     }
 }
 
-static void handle_cli_input_complete(wxSocketClient *cli, char *input, JsonParser& parser)
+static void append_reply(std::string& replies, JObj& j)
+{
+    replies += j.str();
+    replies.append("\r\n", 2);
+}
+
+static void append_reply(std::string& replies, JAry& ary)
+{
+    replies += ary.str();
+    replies.append("\r\n", 2);
+}
+
+static void handle_cli_input_complete(wxSocketClient *cli, char *input, JsonParser& parser, std::string& replies)
 {
     if (!parser.Parse(input))
     {
         JRpcResponse response;
         response << jrpc_error(JSONRPC_PARSE_ERROR, parser_error(parser)) << jrpc_id(0);
         dump_response(cli, response);
-        do_notify1(cli, response);
+        append_reply(replies, response);
         return;
     }
 
@@ -1318,7 +1986,17 @@ static void handle_cli_input_complete(wxSocketClient *cli, char *input, JsonPars
 
     if (root->type == JSON_ARRAY)
     {
-        // a batch request
+        // a batch request: the responses to the requests that have an id
+        // come back together in one array
+
+        if (!root->first_child)
+        {
+            JRpcResponse response;
+            response << jrpc_error(JSONRPC_INVALID_REQUEST, "empty batch") << jrpc_id(0);
+            dump_response(cli, response);
+            append_reply(replies, response);
+            return;
+        }
 
         JAry ary;
 
@@ -1335,7 +2013,7 @@ static void handle_cli_input_complete(wxSocketClient *cli, char *input, JsonPars
         }
 
         if (found)
-            do_notify1(cli, ary);
+            append_reply(replies, ary);
     }
     else
     {
@@ -1346,7 +2024,7 @@ static void handle_cli_input_complete(wxSocketClient *cli, char *input, JsonPars
         if (handle_request(cli, response, req))
         {
             dump_response(cli, response);
-            do_notify1(cli, response);
+            append_reply(replies, response);
         }
     }
 }
@@ -1356,40 +2034,307 @@ static void handle_cli_input(wxSocketClient *cli, JsonParser& parser)
     ClientReadBuf *rdbuf = client_rdbuf(cli);
 
     wxSocketInputStream sis(*cli);
-    size_t avail = rdbuf->avail();
+
+    // a client may send many requests without waiting for the responses,
+    // which are all sent back in one write
+    std::string replies;
 
     while (sis.CanRead())
     {
-        if (avail == 0)
+        if (!rdbuf->reserve())
         {
             drain_input(sis);
 
             JRpcResponse response;
             response << jrpc_error(JSONRPC_INTERNAL_ERROR, "too big") << jrpc_id(0);
-            do_notify1(cli, response);
+            append_reply(replies, response);
 
             rdbuf->reset();
             break;
         }
-        size_t n = sis.Read(rdbuf->dest, avail).LastRead();
+
+        size_t n = sis.Read(rdbuf->dest(), rdbuf->avail()).LastRead();
         if (n == 0)
             break;
+        rdbuf->len += n;
 
-        if (find_eol(rdbuf->dest, n))
+        // one request or batch per line
+        size_t pos = 0;
+        char *line;
+        while ((line = rdbuf->next_line(&pos)) != 0)
+        {
+            if (*line)
+                handle_cli_input_complete(cli, line, parser, replies);
+
+            // an event for one of the requests went past the client's hard
+            // limit; it is disconnected once we return
+            if (client_data(cli)->wrq.overflowed)
+            {
+                parser.Reset();
+                rdbuf->reset();
+                return;
+            }
+        }
+
+        // the parsed values point into the lines that consume() discards;
+        // drop them but keep the parser's blocks for the next request
+        parser.Reset();
+        rdbuf->consume(pos);
+    }
+
+    if (!replies.empty())
+        send_buf(cli, replies.data(), replies.size());
+}
+
+static void destroy_frame_client(wxSocketClient *cli)
+{
+    FrameSubscriber *sub = frame_subscriber(cli);
+    cli->Destroy();
+    delete sub;
+}
+
+static void frame_flush(wxSocketClient *cli, FrameSubscriber *sub)
+{
+    while (sub->pendingOffset < sub->pending.size())
+    {
+        cli->Write(sub->pending.data() + sub->pendingOffset, sub->pending.size() - sub->pendingOffset);
+        size_t n = cli->LastCount();
+        if (n == 0)
+            return;                 // wait for wxSOCKET_OUTPUT
+        sub->pendingOffset += n;
+    }
+
+    sub->pending.clear();
+    sub->pendingOffset = 0;
+}
+
+// writes straight from the caller's memory; only what the socket does not
+// take is copied
+static void frame_write(wxSocketClient *cli, FrameSubscriber *sub, const void *data, size_t len)
+{
+    const char *p = static_cast<const char *>(data);
+
+    if (sub->pending.empty())
+    {
+        cli->Write(p, len);
+        size_t n = cli->LastCount();
+        if (n == len)
+            return;
+        p += n;
+        len -= n;
+    }
+
+    sub->pending.append(p, len);
+}
+
+static void frame_subscribe(wxSocketClient *cli, FrameSubscriber *sub, const json_value *req)
+{
+    if (req->type != JSON_OBJECT)
+    {
+        Debug.AddLine("evsrv: frame cli %p: expected a subscription object", cli);
+        return;
+    }
+
+    json_for_each (t, req)
+    {
+        double d;
+
+        if (strcmp(t->name, "mode") == 0 && t->type == JSON_STRING)
+        {
+            if (strcmp(t->string_value, "frame") == 0)
+                sub->mode = FrameSubscriber::MODE_FRAME;
+            else if (strcmp(t->string_value, "cutout") == 0)
+                sub->mode = FrameSubscriber::MODE_CUTOUT;
+            else
+                sub->mode = FrameSubscriber::MODE_NONE;
+        }
+        else if (float_param("decimation", t, &d))
+        {
+            sub->decimation = d >= 1.0 ? (unsigned int) d : 1;
+        }
+        else if (float_param("size", t, &d))
+        {
+            sub->cutoutSize = wxMax(3, wxMin((int) d, (int) FrameSubscriber::MAX_CUTOUT));
+        }
+        else if (strcmp(t->name, "roi") == 0 && t->type == JSON_ARRAY)
+        {
+            double v[4];
+            const json_value *j;
+            bool ok = true;
+            for (unsigned int i = 0; i < 4 && ok; i++)
+                ok = (j = at(t, i)) != 0 && get_double(&v[i], j);
+            sub->roi = ok ? wxRect((int) v[0], (int) v[1], (int) v[2], (int) v[3]) : wxRect();
+        }
+    }
+
+    sub->frames = 0;
+
+    Debug.AddLine(wxString::Format("evsrv: frame cli %p subscribes: mode %s size %d decimation %u roi %d,%d,%d,%d", cli,
+        frame_mode_name(sub->mode), sub->cutoutSize, sub->decimation, sub->roi.x, sub->roi.y, sub->roi.width, sub->roi.height));
+}
+
+static void handle_frame_cli_input(wxSocketClient *cli, JsonParser& parser)
+{
+    FrameSubscriber *sub = frame_subscriber(cli);
+    ClientReadBuf& rdbuf = sub->rdbuf;
+
+    wxSocketInputStream sis(*cli);
+
+    while (sis.CanRead())
+    {
+        if (!rdbuf.reserve())
         {
             drain_input(sis);
-            handle_cli_input_complete(cli, &rdbuf->buf[0], parser);
-            rdbuf->reset();
+            rdbuf.reset();
             break;
         }
 
-        rdbuf->dest += n;
-        avail -= n;
+        size_t n = sis.Read(rdbuf.dest(), rdbuf.avail()).LastRead();
+        if (n == 0)
+            break;
+        rdbuf.len += n;
+
+        // a line per subscription
+        size_t pos = 0;
+        char *line;
+        while ((line = rdbuf.next_line(&pos)) != 0)
+        {
+            if (!*line)
+                continue;
+            if (parser.Parse(line))
+                frame_subscribe(cli, sub, parser.Root());
+            else
+                Debug.AddLine("evsrv: frame cli %p: invalid subscription", cli);
+        }
+        parser.Reset();
+        rdbuf.consume(pos);
+    }
+}
+
+void EventServer::NotifyFrame(const usImage *pImage, const PHD_Point& star)
+{
+    if (m_frameClients.empty() || !pImage->ImageData)
+        return;
+
+    const wxSize& size = pImage->Size;
+    std::vector<unsigned short> rows;
+
+    for (CliSockSet::const_iterator it = m_frameClients.begin(); it != m_frameClients.end(); ++it)
+    {
+        wxSocketClient *cli = *it;
+        FrameSubscriber *sub = frame_subscriber(cli);
+
+        if (sub->mode == FrameSubscriber::MODE_NONE)
+            continue;
+
+        if (sub->frames++ % sub->decimation != 0)
+            continue;
+
+        if (!sub->pending.empty())
+        {
+            ++sub->skipped;
+            continue;
+        }
+
+        wxRect rect;
+
+        if (sub->mode == FrameSubscriber::MODE_CUTOUT)
+        {
+            if (!star.IsValid())
+                continue;
+
+            // clamped to the frame, like the star profile window
+            int width = wxMin(sub->cutoutSize, size.GetWidth());
+            int height = wxMin(sub->cutoutSize, size.GetHeight());
+            int x = wxMax(0, wxMin(ROUND(star.X) - width / 2, size.GetWidth() - width));
+            int y = wxMax(0, wxMin(ROUND(star.Y) - height / 2, size.GetHeight() - height));
+            rect = wxRect(x, y, width, height);
+        }
+        else
+        {
+            rect = wxRect(size);
+            if (!sub->roi.IsEmpty())
+                rect.Intersect(sub->roi);
+            if (rect.IsEmpty())
+                continue;
+        }
+
+        size_t pixelBytes = (size_t) rect.width * rect.height * sizeof(unsigned short);
+
+        FrameMsgHeader hdr;
+        hdr.length = (uint32_t) (sizeof(hdr) - sizeof(hdr.length) + pixelBytes);
+        hdr.type = sub->mode == FrameSubscriber::MODE_CUTOUT ? FRAME_MSG_CUTOUT : FRAME_MSG_FRAME;
+        hdr.frame = pFrame->m_frameCounter;
+        hdr.reserved = 0;
+        hdr.time = pImage->ImgExpStartMillis.ToDouble() / 1000.0;
+        hdr.x = rect.x;
+        hdr.y = rect.y;
+        hdr.width = rect.width;
+        hdr.height = rect.height;
+        hdr.starX = star.IsValid() ? (float) star.X : std::numeric_limits<float>::quiet_NaN();
+        hdr.starY = star.IsValid() ? (float) star.Y : std::numeric_limits<float>::quiet_NaN();
+
+        frame_write(cli, sub, &hdr, sizeof(hdr));
+
+        if (rect.width == size.GetWidth())
+        {
+            // whole rows are contiguous in the frame
+            frame_write(cli, sub, pImage->ImageData + rect.y * size.GetWidth(), pixelBytes);
+        }
+        else
+        {
+            rows.resize((size_t) rect.width * rect.height);
+            for (int r = 0; r < rect.height; r++)
+            {
+                memcpy(&rows[(size_t) r * rect.width], pImage->ImageData + (rect.y + r) * size.GetWidth() + rect.x,
+                    rect.width * sizeof(unsigned short));
+            }
+            frame_write(cli, sub, &rows[0], pixelBytes);
+        }
+
+        ++sub->sent;
     }
 }
 
 EventServer::EventServer()
+    : m_historySize(DefaultEventHistorySize),
+      m_dropPending(false)
+{
+}
+
+void EventServer::LoadProfileSettings()
 {
+    SetEventHistorySize(pConfig->Profile.GetInt("/EventServer/HistorySize", DefaultEventHistorySize));
+}
+
+bool EventServer::SetEventHistorySize(int size)
+{
+    bool bError = false;
+    unsigned int prevSize = m_historySize;
+
+    try
+    {
+        if (size < 0 || size > MaxEventHistorySize)
+        {
+            throw ERROR_INFO("invalid event history size");
+        }
+
+        m_historySize = size;
+    }
+    catch (wxString Msg)
+    {
+        POSSIBLY_UNUSED(Msg);
+        bError = true;
+        m_historySize = DefaultEventHistorySize;
+    }
+
+    pConfig->Profile.SetInt("/EventServer/HistorySize", m_historySize);
+
+    // resizing drops the kept events, which reconnecting clients may still need
+    if (m_serverSocket && m_historySize != prevSize)
+        s_history.Resize(m_historySize);
+
+    return bError;
 }
 
 EventServer::~EventServer()
@@ -1423,6 +2368,29 @@ bool EventServer::EventServerStart(unsigned int instanceId)
 
     Debug.AddLine(wxString::Format("event server started, listening on port %u", port));
 
+    s_history.Resize(m_historySize);
+
+    // the frame stream is optional, the event server works without it
+    m_frameServerPort = 4500 + instanceId - 1;
+    wxIPV4address frameServerAddr;
+    frameServerAddr.Service(m_frameServerPort);
+    m_frameServerSocket = new wxSocketServer(frameServerAddr);
+
+    if (m_frameServerSocket->Ok())
+    {
+        m_frameServerSocket->SetEventHandler(*this, FRAME_SERVER_ID);
+        m_frameServerSocket->SetNotify(wxSOCKET_CONNECTION_FLAG);
+        m_frameServerSocket->Notify(true);
+
+        Debug.AddLine(wxString::Format("frame stream listening on port %u", m_frameServerPort));
+    }
+    else
+    {
+        Debug.AddLine(wxString::Format("frame stream not available - Could not listen at port %u", m_frameServerPort));
+        delete m_frameServerSocket;
+        m_frameServerSocket = NULL;
+    }
+
     return false;
 }
 
@@ -1438,9 +2406,20 @@ void EventServer::EventServerStop()
     }
     m_eventServerClients.clear();
 
+    for (CliSockSet::const_iterator it = m_frameClients.begin(); it != m_frameClients.end(); ++it)
+    {
+        destroy_frame_client(*it);
+    }
+    m_frameClients.clear();
+
+    delete m_frameServerSocket;
+    m_frameServerSocket = NULL;
+
     delete m_serverSocket;
     m_serverSocket = NULL;
 
+    s_history.Resize(0);
+
     Debug.AddLine("event server stopped");
 }
 
@@ -1459,16 +2438,31 @@ void EventServer::OnEventServerEvent(wxSocketEvent& event)
     Debug.AddLine("evsrv: cli %p connect", client);
 
     client->SetEventHandler(*this, EVENT_SERVER_CLIENT_ID);
-    client->SetNotify(wxSOCKET_LOST_FLAG | wxSOCKET_INPUT_FLAG);
+    client->SetNotify(wxSOCKET_LOST_FLAG | wxSOCKET_INPUT_FLAG | wxSOCKET_OUTPUT_FLAG);
     client->SetFlags(wxSOCKET_NOWAIT);
     client->Notify(true);
-    client->SetClientData(new ClientReadBuf());
+    client->SetClientData(new ClientData());
 
     send_catchup_events(client);
 
     m_eventServerClients.insert(client);
 }
 
+void EventServer::ScheduleDropOverflowedClients()
+{
+    if (!m_dropPending)
+    {
+        m_dropPending = true;
+        CallAfter(&EventServer::DropOverflowedClients);
+    }
+}
+
+void EventServer::DropOverflowedClients()
+{
+    m_dropPending = false;
+    drop_overflowed_clients(m_eventServerClients);
+}
+
 void EventServer::OnEventServerClientEvent(wxSocketEvent& event)
 {
     wxSocketClient *cli = static_cast<wxSocketClient *>(event.GetSocket());
@@ -1486,6 +2480,11 @@ void EventServer::OnEventServerClientEvent(wxSocketEvent& event)
     else if (event.GetSocketEvent() == wxSOCKET_INPUT)
     {
         handle_cli_input(cli, m_parser);
+        drop_overflowed_clients(m_eventServerClients);
+    }
+    else if (event.GetSocketEvent() == wxSOCKET_OUTPUT)
+    {
+        flush_client(cli);
     }
     else
     {
@@ -1493,6 +2492,51 @@ void EventServer::OnEventServerClientEvent(wxSocketEvent& event)
     }
 }
 
+void EventServer::OnFrameServerEvent(wxSocketEvent& event)
+{
+    wxSocketServer *server = static_cast<wxSocketServer *>(event.GetSocket());
+
+    if (event.GetSocketEvent() != wxSOCKET_CONNECTION)
+        return;
+
+    wxSocketClient *client = static_cast<wxSocketClient *>(server->Accept(false));
+
+    if (!client)
+        return;
+
+    Debug.AddLine("evsrv: frame cli %p connect", client);
+
+    client->SetEventHandler(*this, FRAME_SERVER_CLIENT_ID);
+    client->SetNotify(wxSOCKET_LOST_FLAG | wxSOCKET_INPUT_FLAG | wxSOCKET_OUTPUT_FLAG);
+    client->SetFlags(wxSOCKET_NOWAIT);
+    client->Notify(true);
+    client->SetClientData(new FrameSubscriber());
+
+    m_frameClients.insert(client);
+}
+
+void EventServer::OnFrameServerClientEvent(wxSocketEvent& event)
+{
+    wxSocketClient *cli = static_cast<wxSocketClient *>(event.GetSocket());
+
+    switch (event.GetSocketEvent())
+    {
+    case wxSOCKET_LOST:
+        Debug.AddLine("evsrv: frame cli %p disconnect", cli);
+        m_frameClients.erase(cli);
+        destroy_frame_client(cli);
+        break;
+    case wxSOCKET_INPUT:
+        handle_frame_cli_input(cli, m_parser);
+        break;
+    case wxSOCKET_OUTPUT:
+        frame_flush(cli, frame_subscriber(cli));
+        break;
+    default:
+        break;
+    }
+}
+
 void EventServer::NotifyStartCalibration(Mount *mount)
 {
     SIMPLE_NOTIFY_EV(ev_start_calibration(mount));
@@ -1500,7 +2544,7 @@ void EventServer::NotifyStartCalibration(Mount *mount)
 
 void EventServer::NotifyCalibrationFailed(Mount *mount, const wxString& msg)
 {
-    if (m_eventServerClients.empty())
+    if (no_listeners(m_eventServerClients))
         return;
 
     Ev ev("CalibrationFailed");
@@ -1511,7 +2555,7 @@ void EventServer::NotifyCalibrationFailed(Mount *mount, const wxString& msg)
 
 void EventServer::NotifyCalibrationComplete(Mount *mount)
 {
-    if (m_eventServerClients.empty())
+    if (no_listeners(m_eventServerClients))
         return;
 
     do_notify(m_eventServerClients, ev_calibration_complete(mount));
@@ -1519,7 +2563,7 @@ void EventServer::NotifyCalibrationComplete(Mount *mount)
 
 void EventServer::NotifyCalibrationDataFlipped(Mount *mount)
 {
-    if (m_eventServerClients.empty())
+    if (no_listeners(m_eventServerClients))
         return;
 
     Ev ev("CalibrationDataFlipped");
@@ -1530,7 +2574,7 @@ void EventServer::NotifyCalibrationDataFlipped(Mount *mount)
 
 void EventServer::NotifyLooping(unsigned int exposure)
 {
-    if (m_eventServerClients.empty())
+    if (no_listeners(m_eventServerClients))
         return;
 
     Ev ev("LoopingExposures");
@@ -1551,7 +2595,7 @@ void EventServer::NotifyStarSelected(const PHD_Point& pt)
 
 void EventServer::NotifyStarLost(const FrameDroppedInfo& info)
 {
-    if (m_eventServerClients.empty())
+    if (no_listeners(m_eventServerClients))
         return;
 
     Ev ev("StarLost");
@@ -1571,6 +2615,22 @@ void EventServer::NotifyStarLost(const FrameDroppedInfo& info)
     do_notify(m_eventServerClients, ev);
 }
 
+void EventServer::NotifyMoveDropped(const MoveDroppedInfo& info)
+{
+    if (no_listeners(m_eventServerClients))
+        return;
+
+    Ev ev("GuideStepDropped");
+
+    ev << NV("Time", info.time, 3)
+       << NVMount(info.mount)
+       << NV("dx", info.cameraOffset.X, 3)
+       << NV("dy", info.cameraOffset.Y, 3)
+       << NV("SupersededBy", info.supersededBy);
+
+    do_notify(m_eventServerClients, ev);
+}
+
 void EventServer::NotifyStartGuiding()
 {
     SIMPLE_NOTIFY_EV(ev_start_guiding());
@@ -1593,57 +2653,68 @@ void EventServer::NotifyResumed()
 
 void EventServer::NotifyGuideStep(const GuideStepInfo& step)
 {
-    if (m_eventServerClients.empty())
+    if (no_listeners(m_eventServerClients))
         return;
 
-    Ev ev("GuideStep");
+    // the most frequent event, written into a buffer that is kept
+    static JsonWriter w;
 
-    ev << NV("Frame", step.frameNumber)
-       << NV("Time", step.time, 3)
-       << NVMount(step.mount)
-       << NV("dx", step.cameraOffset->X, 3)
-       << NV("dy", step.cameraOffset->Y, 3)
-       << NV("RADistanceRaw", step.mountOffset->X, 3)
-       << NV("DECDistanceRaw", step.mountOffset->Y, 3)
-       << NV("RADistanceGuide", step.guideDistanceRA, 3)
-       << NV("DECDistanceGuide", step.guideDistanceDec, 3);
+    begin_event(w, "GuideStep");
+
+    w.Key("Frame").Int(step.frameNumber)
+     .Key("Time").Fixed(step.time, 3)
+     .Key("Mount");
+    json_string(w, step.mount->Name());
+    w.Key("dx").Fixed(step.cameraOffset.X, 3)
+     .Key("dy").Fixed(step.cameraOffset.Y, 3)
+     .Key("RADistanceRaw").Fixed(step.mountOffset.X, 3)
+     .Key("DECDistanceRaw").Fixed(step.mountOffset.Y, 3)
+     .Key("RADistanceGuide").Fixed(step.guideDistanceRA, 3)
+     .Key("DECDistanceGuide").Fixed(step.guideDistanceDec, 3);
 
     if (step.durationRA > 0)
     {
-       ev << NV("RADuration", step.durationRA)
-          << NV("RADirection", step.mount->DirectionStr((GUIDE_DIRECTION)step.directionRA));
+        w.Key("RADuration").Int(step.durationRA)
+         .Key("RADirection").String(step.mount->DirectionStr((GUIDE_DIRECTION)step.directionRA));
     }
 
     if (step.durationDec > 0)
     {
-        ev << NV("DECDuration", step.durationDec)
-           << NV("DECDirection", step.mount->DirectionStr((GUIDE_DIRECTION)step.directionDec));
+        w.Key("DECDuration").Int(step.durationDec)
+         .Key("DECDirection").String(step.mount->DirectionStr((GUIDE_DIRECTION)step.directionDec));
+    }
+
+    if (step.moveDuration > 0)
+    {
+        w.Key("MoveDuration").Int(step.moveDuration);
     }
 
     if (step.mount->IsStepGuider())
     {
-        ev << NV("Pos", step.aoPos);
+        w.Key("Pos").BeginArray().Int(step.aoPos.x).Int(step.aoPos.y).EndArray();
     }
 
-    ev << NV("StarMass", step.starMass, 0)
-       << NV("SNR", step.starSNR, 2)
-       << NV("AvgDist", step.avgDist, 2);
+    w.Key("StarMass").Fixed(step.starMass, 0)
+     .Key("SNR").Fixed(step.starSNR, 2)
+     .Key("AvgDist").Fixed(step.avgDist, 2);
 
     if (step.starError)
-       ev << NV("ErrorCode", step.starError);
+        w.Key("ErrorCode").Int(step.starError);
 
     if (step.raLimited)
-        ev << NV("RALimited", true);
+        w.Key("RALimited").Bool(true);
 
     if (step.decLimited)
-        ev << NV("DecLimited", true);
+        w.Key("DecLimited").Bool(true);
 
-    do_notify(m_eventServerClients, ev);
+    w.EndObject().EndLine();
+
+    do_notify(m_eventServerClients, w.Data(), w.Size(), true);
 }
 
 void EventServer::NotifyGuidingDithered(double dx, double dy)
 {
-    if (m_eventServerClients.empty())
+    if (no_listeners(m_eventServerClients))
         return;
 
     Ev ev("GuidingDithered");
@@ -1654,7 +2725,7 @@ void EventServer::NotifyGuidingDithered(double dx, double dy)
 
 void EventServer::NotifySetLockPosition(const PHD_Point& xy)
 {
-    if (m_eventServerClients.empty())
+    if (no_listeners(m_eventServerClients))
         return;
 
     do_notify(m_eventServerClients, ev_set_lock_position(xy));
@@ -1667,7 +2738,7 @@ void EventServer::NotifyLockPositionLost()
 
 void EventServer::NotifyAppState()
 {
-    if (m_eventServerClients.empty())
+    if (no_listeners(m_eventServerClients))
         return;
 
     do_notify(m_eventServerClients, ev_app_state());
@@ -1675,7 +2746,7 @@ void EventServer::NotifyAppState()
 
 void EventServer::NotifySettling(double distance, double time, double settleTime)
 {
-    if (m_eventServerClients.empty())
+    if (no_listeners(m_eventServerClients))
         return;
 
     Ev ev(ev_settling(distance, time, settleTime));
@@ -1687,7 +2758,7 @@ void EventServer::NotifySettling(double distance, double time, double settleTime
 
 void EventServer::NotifySettleDone(const wxString& errorMsg)
 {
-    if (m_eventServerClients.empty())
+    if (no_listeners(m_eventServerClients))
         return;
 
     Ev ev(ev_settle_done(errorMsg));
@@ -1699,7 +2770,7 @@ void EventServer::NotifySettleDone(const wxString& errorMsg)
 
 void EventServer::NotifyAlert(const wxString& msg, int type)
 {
-    if (m_eventServerClients.empty())
+    if (no_listeners(m_eventServerClients))
         return;
 
     Ev ev("Alert");
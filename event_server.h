@@ -48,6 +48,18 @@ private:
     wxSocketServer *m_serverSocket;
     CliSockSet m_eventServerClients;
 
+    // binary side channel for frame pixels, see NotifyFrame
+    wxSocketServer *m_frameServerSocket;
+    unsigned int m_frameServerPort;
+    CliSockSet m_frameClients;
+
+    // events kept for clients that reconnect, see get_events_since
+    unsigned int m_historySize;
+
+    // clients past their hard queue limit are disconnected from the event
+    // loop, never while a notification or a request is in progress
+    bool m_dropPending;
+
 public:
     EventServer();
     ~EventServer(void);
@@ -55,6 +67,18 @@ public:
     bool EventServerStart(unsigned int instanceId);
     void EventServerStop();
 
+    void LoadProfileSettings();
+    bool SetEventHistorySize(int size);
+    unsigned int GetEventHistorySize() const { return m_historySize; }
+
+    const CliSockSet& GetClients() const { return m_eventServerClients; }
+    const CliSockSet& GetFrameClients() const { return m_frameClients; }
+    unsigned int GetFrameServerPort() const { return m_frameServerSocket ? m_frameServerPort : 0; }
+
+    // disconnects the clients that went past their queue limit, once
+    // control is back in the event loop
+    void ScheduleDropOverflowedClients();
+
     void NotifyStartCalibration(Mount *pCalibrationMount);
     void NotifyCalibrationFailed(Mount *pCalibrationMount, const wxString& msg);
     void NotifyCalibrationComplete(Mount *pCalibrationMount);
@@ -68,6 +92,7 @@ public:
     void NotifyPaused();
     void NotifyResumed();
     void NotifyGuideStep(const GuideStepInfo& info);
+    void NotifyMoveDropped(const MoveDroppedInfo& info);
     void NotifyGuidingDithered(double dx, double dy);
     void NotifySetLockPosition(const PHD_Point& xy);
     void NotifyLockPositionLost();
@@ -76,9 +101,17 @@ public:
     void NotifySettleDone(const wxString& errorMsg);
     void NotifyAlert(const wxString& msg, int type);
 
+    // sends the frame, or the part of it around the star, to the frame
+    // stream subscribers
+    void NotifyFrame(const usImage *pImage, const PHD_Point& star);
+
 private:
+    void DropOverflowedClients();
+
     void OnEventServerEvent(wxSocketEvent& evt);
     void OnEventServerClientEvent(wxSocketEvent& evt);
+    void OnFrameServerEvent(wxSocketEvent& evt);
+    void OnFrameServerClientEvent(wxSocketEvent& evt);
 
     wxDECLARE_EVENT_TABLE();
 };
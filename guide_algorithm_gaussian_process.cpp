@@ -34,13 +34,16 @@
 
 #include "phd.h"
 
-#include "UDPGuidingInteraction.h"
 #include "tools/circular_buffer.h"
+#include "src/gaussian_process.h"
+#include "src/covariance_functions.h"
+#include "src/bfgs_optimizer.h"
+#include "periodogram.h"
 
 #include "guide_algorithm_gaussian_process.h"
 #include <wx/stopwatch.h>
-#include "tools/math_tools.h"
-#include "UDPGuidingInteraction.h"
+
+#include <atomic>
 
 
 class GuideGaussianProcess::GuideGaussianProcessDialogPane : public ConfigDialogPane
@@ -90,10 +93,265 @@ public:
 
 
 
+// number of measurements the GP is conditioned on
+static const int GPWindowSize = 100;
+
+static const double DefaultControlGain = 1.0;
+
+// Minimum number of measurements before the GP prediction is used
+static const int MinimumMeasurementsForGP = 5;
+
+/*
+ * Default hyperparameters of the GP, in log space. The GP works in seconds
+ * and pixels: log(noise sd), log(ell_SE), log(sigma_SE), log(ell_P),
+ * log(sigma_P), log(period). The period default is a typical worm period.
+ */
+static const double DefaultHyperParameters[] =
+{
+    -1.386, // noise sd 0.25 px
+     6.215, // SE length scale 500 s
+    -0.693, // SE signal sd 0.5 px
+     0.0,   // periodic length scale 1
+    -0.693, // periodic signal sd 0.5 px
+     6.173, // period 480 s
+};
+
+static const int NumHyperParameters = sizeof(DefaultHyperParameters) / sizeof(DefaultHyperParameters[0]);
+
+// Run the hyperparameter optimization every this many measurements...
+static const int OptimizationInterval = 20;
+
+// ...once there are enough measurements for a meaningful fit
+static const int MinimumMeasurementsForOptimization = 40;
+
+// Maximum number of BFGS iterations per optimization
+static const int MaxOptimizerIterations = 50;
+
+/*
+ * Standard deviation of the Gaussian prior on the log hyperparameters,
+ * centered at the defaults. It keeps the optimizer from running away with
+ * a poorly constrained period or length scale on short data sets.
+ */
+static const double HyperParameterPriorSd = 1.0;
+
+// Index of log(period) in the hyperparameter vector
+static const int PeriodHyperParameter = 5;
+
+/*
+ * The gear error is also fed to a streaming periodogram, which sees the
+ * whole guiding session rather than only the GP window. Its dominant period
+ * is used as the prior mean of the period hyperparameter, and it resets the
+ * period when the GP has settled on a different one, since the marginal
+ * likelihood has many local optima in the period. The trial periods and
+ * the minimum power are shared with the guiding assistant (periodogram.h).
+ */
+
+// Relative deviation from the spectral estimate that resets the GP period
+static const double MaximumPeriodDeviation = 0.2;
+
+/*
+ * The hyperparameters of the GP are fitted to the data on a low priority
+ * background thread, so that the BFGS optimization never delays a guide
+ * pulse. The guide path and the thread exchange data through two
+ * single-slot mailboxes, each owned by one side at a time as indicated by
+ * an atomic flag:
+ *  - the guide path copies a snapshot of the measurement window into the
+ *    request slot while the thread is idle, then wakes the thread up;
+ *  - the thread writes the optimized hyperparameters into the result slot
+ *    and raises the result flag, which the guide path polls on each step.
+ * Neither side ever waits for the other. Each request carries the
+ * generation of the guide state it was taken from, which reset() bumps, so
+ * that a result computed from data older than the last reset is dropped.
+ */
+class GuideGaussianProcess::HyperparameterOptimizerThread : public wxThread
+{
+    GP gp_;
+    wxString axis_;
+
+    // request slot, owned by the optimizer thread while request_pending_ is set
+    Eigen::VectorXd request_timestamps_;
+    Eigen::VectorXd request_measurements_;
+    Eigen::VectorXd request_hyper_parameters_;
+    Eigen::VectorXd request_prior_mean_;
+    unsigned int request_generation_;
+    std::atomic<bool> request_pending_;
+
+    // result slot, owned by the guide path while result_ready_ is set
+    Eigen::VectorXd result_hyper_parameters_;
+    unsigned int result_generation_;
+    std::atomic<bool> result_ready_;
+
+    std::atomic<bool> stop_;
+    wxSemaphore wakeup_;
+
+    // progress and timing of the optimizations
+    std::atomic<bool> running_;
+    std::atomic<int> runs_;
+    std::atomic<int> last_duration_ms_;
+    std::atomic<int> last_iterations_;
+
+    Eigen::VectorXd Optimize();
+
+public:
+    HyperparameterOptimizerThread(const GP& gp, const wxString& axis);
+
+    bool Request(const Eigen::VectorXd& timestamps, const Eigen::VectorXd& measurements,
+        const Eigen::VectorXd& hyper_parameters, const Eigen::VectorXd& prior_mean,
+        unsigned int generation);
+    bool FetchResult(Eigen::VectorXd *hyper_parameters, unsigned int *generation);
+    void Stop();
+
+    bool IsOptimizing() const { return running_; }
+    int GetRuns() const { return runs_; }
+    int GetLastDurationMs() const { return last_duration_ms_; }
+    int GetLastIterations() const { return last_iterations_; }
+
+protected:
+    virtual ExitCode Entry();
+};
+
+GuideGaussianProcess::HyperparameterOptimizerThread::HyperparameterOptimizerThread(const GP& gp, const wxString& axis)
+    : wxThread(wxTHREAD_JOINABLE),
+      gp_(gp),
+      axis_(axis),
+      request_generation_(0),
+      request_pending_(false),
+      result_generation_(0),
+      result_ready_(false),
+      stop_(false),
+      running_(false),
+      runs_(0),
+      last_duration_ms_(0),
+      last_iterations_(0)
+{
+    gp_.clearData();
+}
+
+// called on the guide path, returns false if the optimizer is still busy
+bool GuideGaussianProcess::HyperparameterOptimizerThread::Request(const Eigen::VectorXd& timestamps,
+    const Eigen::VectorXd& measurements, const Eigen::VectorXd& hyper_parameters,
+    const Eigen::VectorXd& prior_mean, unsigned int generation)
+{
+    if (request_pending_.load(std::memory_order_acquire) || result_ready_.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+
+    request_timestamps_ = timestamps;
+    request_measurements_ = measurements;
+    request_hyper_parameters_ = hyper_parameters;
+    request_prior_mean_ = prior_mean;
+    request_generation_ = generation;
+    request_pending_.store(true, std::memory_order_release);
+
+    wakeup_.Post();
+
+    return true;
+}
+
+// called on the guide path, returns true and the new hyperparameters if an optimization finished,
+// along with the generation of the request they were computed from
+bool GuideGaussianProcess::HyperparameterOptimizerThread::FetchResult(Eigen::VectorXd *hyper_parameters,
+    unsigned int *generation)
+{
+    if (!result_ready_.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+
+    *hyper_parameters = result_hyper_parameters_;
+    *generation = result_generation_;
+    result_ready_.store(false, std::memory_order_release);
+
+    return true;
+}
+
+void GuideGaussianProcess::HyperparameterOptimizerThread::Stop()
+{
+    stop_ = true;
+    wakeup_.Post();
+    Wait();
+}
+
+Eigen::VectorXd GuideGaussianProcess::HyperparameterOptimizerThread::Optimize()
+{
+    const Eigen::VectorXd& prior_mean = request_prior_mean_;
+    double prior_precision = 1.0 / (HyperParameterPriorSd * HyperParameterPriorSd);
+
+    gp_.setHyperParameters(request_hyper_parameters_);
+    gp_.infer(request_timestamps_, request_measurements_);
+
+    GP& gp = gp_;
+    bfgs_optimizer::BFGS bfgs(
+        [&gp, &prior_mean, prior_precision](const Eigen::VectorXd& x, Eigen::VectorXd *gradient)
+        {
+            gp.setHyperParameters(x);
+            Eigen::VectorXd deviation = x - prior_mean;
+            *gradient = gp.neg_log_likelihood_gradient() + prior_precision * deviation;
+            return gp.neg_log_likelihood() + 0.5 * prior_precision * deviation.squaredNorm();
+        },
+        MaxOptimizerIterations);
+
+    std::atomic<bool>& stop = stop_;
+    bfgs.setAbortCheck([&stop]() { return stop.load(); });
+
+    double neg_log_likelihood = 0.0;
+    Eigen::VectorXd result = bfgs.minimize(request_hyper_parameters_, &neg_log_likelihood);
+    last_iterations_ = bfgs.getIterations();
+
+    Debug.Write(wxString::Format("GP hyperparameter optimizer (%s): %d points, %d iterations, "
+        "%d evaluations, objective %.3f\n", axis_, (int) request_timestamps_.rows(),
+        bfgs.getIterations(), bfgs.getFunctionEvaluations(), neg_log_likelihood));
+
+    gp_.clearData();
+
+    return result;
+}
+
+wxThread::ExitCode GuideGaussianProcess::HyperparameterOptimizerThread::Entry()
+{
+    Debug.AddLine(wxString::Format("GP hyperparameter optimizer thread (%s) begins", axis_));
+
+    while (true)
+    {
+        wakeup_.Wait();
+
+        if (stop_)
+            break;
+
+        if (!request_pending_.load(std::memory_order_acquire))
+            continue;
+
+        running_ = true;
+        wxStopWatch swatch;
+
+        Eigen::VectorXd result = Optimize();
+
+        last_duration_ms_ = swatch.Time();
+        ++runs_;
+        running_ = false;
+
+        Debug.Write(wxString::Format("GP hyperparameter optimizer (%s): run %d took %d ms\n",
+            axis_, (int) runs_, (int) last_duration_ms_));
+
+        if (stop_)
+            break;
+
+        result_hyper_parameters_ = result;
+        result_generation_ = request_generation_;
+        result_ready_.store(true, std::memory_order_release);
+        request_pending_.store(false, std::memory_order_release);
+    }
+
+    Debug.AddLine(wxString::Format("GP hyperparameter optimizer thread (%s) ends", axis_));
+
+    return (wxThread::ExitCode) 0;
+}
+
+
 // parameters of the GP guiding algorithm
 struct GuideGaussianProcess::gp_guide_parameters
 {
-    UDPGuidingInteraction udpInteraction;
     CircularDoubleBuffer timestamps_;
     CircularDoubleBuffer measurements_;
     CircularDoubleBuffer modified_measurements_;
@@ -102,16 +360,27 @@ struct GuideGaussianProcess::gp_guide_parameters
     int number_of_measurements_;
     double control_gain_;
     double elapsed_time_ms_;
+    GP gp_;
+    HyperparameterOptimizerThread *optimizer_;
+    unsigned int optimizer_generation_;
+    Periodogram periodogram_;
+    double gear_error_;
+    double spectral_period_;
 
     gp_guide_parameters() :
-      udpInteraction(_T("localhost"), _T("1308"), _T("1309")),
-      timestamps_(100),
-      measurements_(100),
-      modified_measurements_(100),
+      timestamps_(GPWindowSize),
+      measurements_(GPWindowSize),
+      modified_measurements_(GPWindowSize),
       timer_(),
       control_signal_(0.0),
       number_of_measurements_(0),
-      elapsed_time_ms_(0.0)
+      elapsed_time_ms_(0.0),
+      gp_(covariance_functions::PeriodicSquareExponential()),
+      optimizer_(0),
+      optimizer_generation_(0),
+      periodogram_(PeriodogramMinPeriod, PeriodogramMaxPeriod, PeriodogramResolution),
+      gear_error_(0.0),
+      spectral_period_(0.0)
     {
 
     }
@@ -124,6 +393,12 @@ struct GuideGaussianProcess::gp_guide_parameters
         measurements_.clear();
         modified_measurements_.clear();
         number_of_measurements_ = 0;
+        control_signal_ = 0.0;
+        elapsed_time_ms_ = 0.0;
+        gp_.clearData();
+        periodogram_.Reset();
+        gear_error_ = 0.0;
+        spectral_period_ = 0.0;
     }
 
 };
@@ -131,13 +406,28 @@ struct GuideGaussianProcess::gp_guide_parameters
 
 
 
-static const double DefaultControlGain = 1.0;
-
 GuideGaussianProcess::GuideGaussianProcess(Mount *pMount, GuideAxis axis)
     : GuideAlgorithm(pMount, axis),
       parameters(0)
 {
     parameters = new gp_guide_parameters();
+    parameters->gp_.setHyperParameters(Eigen::Map<const Eigen::VectorXd>(DefaultHyperParameters, NumHyperParameters));
+
+    // without the optimizer thread the GP keeps guiding with the default hyperparameters
+    parameters->optimizer_ = new HyperparameterOptimizerThread(parameters->gp_, GetAxis());
+    bool started = parameters->optimizer_->Create() == wxTHREAD_NO_ERROR;
+    if (started)
+    {
+        parameters->optimizer_->SetPriority(WXTHREAD_MIN_PRIORITY);
+        started = parameters->optimizer_->Run() == wxTHREAD_NO_ERROR;
+    }
+    if (!started)
+    {
+        Debug.AddLine("GuideGaussianProcess: could not start the hyperparameter optimizer thread");
+        delete parameters->optimizer_;
+        parameters->optimizer_ = 0;
+    }
+
     wxString configPath = GetConfigPath();
     double control_gain = pConfig->Profile.GetDouble(configPath + "/controlGain", DefaultControlGain);
     SetControlGain(control_gain);
@@ -147,7 +437,12 @@ GuideGaussianProcess::GuideGaussianProcess(Mount *pMount, GuideAxis axis)
 
 GuideGaussianProcess::~GuideGaussianProcess(void)
 {
-  delete parameters;
+    if (parameters->optimizer_)
+    {
+        parameters->optimizer_->Stop();
+        delete parameters->optimizer_;
+    }
+    delete parameters;
 }
 
 
@@ -190,7 +485,28 @@ double GuideGaussianProcess::GetControlGain()
 
 wxString GuideGaussianProcess::GetSettingsSummary()
 {
-    return wxString::Format("Control Gain = %.3f\n", GetControlGain());
+    wxString summary = wxString::Format("Control Gain = %.3f\n", GetControlGain());
+
+    Eigen::VectorXd hyper_parameters = parameters->gp_.getHyperParameters().array().exp();
+    summary += wxString::Format("Noise SD = %.3f, SE length scale = %.1f, SE SD = %.3f, "
+        "periodic length scale = %.3f, periodic SD = %.3f, period = %.1f\n",
+        hyper_parameters(0), hyper_parameters(1), hyper_parameters(2),
+        hyper_parameters(3), hyper_parameters(4), hyper_parameters(5));
+
+    if (parameters->optimizer_)
+    {
+        summary += wxString::Format("Hyperparameter optimizer: %d runs, last run %d ms, %d iterations%s\n",
+            parameters->optimizer_->GetRuns(), parameters->optimizer_->GetLastDurationMs(),
+            parameters->optimizer_->GetLastIterations(),
+            parameters->optimizer_->IsOptimizing() ? ", running" : "");
+    }
+
+    if (parameters->spectral_period_ > 0.0)
+    {
+        summary += wxString::Format("Periodogram period = %.1f s\n", parameters->spectral_period_);
+    }
+
+    return summary;
 }
 
 
@@ -212,6 +528,81 @@ void GuideGaussianProcess::HandleTimestamps()
     parameters->timestamps_.append(parameters->elapsed_time_ms_ - delta_measurement_time_ms / 2);
 }
 
+void GuideGaussianProcess::HandlePeriodogram()
+{
+    // the periodogram sees the accumulated gear error, its drift is fitted out
+    parameters->gear_error_ += parameters->modified_measurements_.getLastElement();
+    parameters->periodogram_.AddSample(parameters->timestamps_.getLastElement() / 1000.0,
+        parameters->gear_error_);
+
+    if (parameters->number_of_measurements_ < MinimumMeasurementsForOptimization ||
+        parameters->number_of_measurements_ % OptimizationInterval != 0)
+    {
+        return;
+    }
+
+    std::vector<Periodogram::Peak> peaks = parameters->periodogram_.DominantPeriods(1);
+    if (peaks.empty() || peaks[0].power < MinimumPeriodogramPower)
+    {
+        return;
+    }
+
+    parameters->spectral_period_ = peaks[0].period;
+
+    Eigen::VectorXd hyper_parameters = parameters->gp_.getHyperParameters();
+    double period = exp(hyper_parameters(PeriodHyperParameter));
+    if (fabs(period - parameters->spectral_period_) > MaximumPeriodDeviation * parameters->spectral_period_)
+    {
+        Debug.Write(wxString::Format("GuideGaussianProcess: periodogram period %.1f s (power %.2f, amplitude %.2f px) "
+            "replaces GP period %.1f s\n", peaks[0].period, peaks[0].power, peaks[0].amplitude, period));
+        hyper_parameters(PeriodHyperParameter) = log(parameters->spectral_period_);
+        parameters->gp_.setHyperParameters(hyper_parameters);
+    }
+}
+
+void GuideGaussianProcess::HandleHyperparameterOptimization()
+{
+    if (!parameters->optimizer_)
+    {
+        return;
+    }
+
+    // pick up the result of a finished optimization
+    Eigen::VectorXd hyper_parameters;
+    unsigned int generation;
+    if (parameters->optimizer_->FetchResult(&hyper_parameters, &generation))
+    {
+        if (generation != parameters->optimizer_generation_)
+        {
+            Debug.Write("GuideGaussianProcess: dropping hyperparameters optimized before the last reset\n");
+        }
+        else
+        {
+            parameters->gp_.setHyperParameters(hyper_parameters);
+            Debug.Write(wxString::Format("GuideGaussianProcess: new hyperparameters applied, period = %.1f s\n",
+                exp(hyper_parameters(5))));
+        }
+    }
+
+    // hand a snapshot of the current window to the optimizer, unless it is busy
+    if (parameters->number_of_measurements_ >= MinimumMeasurementsForOptimization &&
+        parameters->number_of_measurements_ % OptimizationInterval == 0)
+    {
+        Eigen::VectorXd prior_mean = Eigen::Map<const Eigen::VectorXd>(DefaultHyperParameters, NumHyperParameters);
+        if (parameters->spectral_period_ > 0.0)
+        {
+            prior_mean(PeriodHyperParameter) = log(parameters->spectral_period_);
+        }
+
+        Eigen::VectorXd timestamps_s = *parameters->timestamps_.getEigenVector() / 1000.0;
+        if (!parameters->optimizer_->Request(timestamps_s, *parameters->modified_measurements_.getEigenVector(),
+            parameters->gp_.getHyperParameters(), prior_mean, parameters->optimizer_generation_))
+        {
+            Debug.Write("GuideGaussianProcess: hyperparameter optimizer busy, skipping snapshot\n");
+        }
+    }
+}
+
 void GuideGaussianProcess::HandleMeasurements(double input)
 {
     parameters->measurements_.append(input);
@@ -219,25 +610,21 @@ void GuideGaussianProcess::HandleMeasurements(double input)
 
 void GuideGaussianProcess::HandleModifiedMeasurements(double input)
 {
-    // If there is no previous measurement, a random one is generated.
-    if(parameters->number_of_measurements_ == 0)
+    /*
+     * The modified measurement is the displacement caused by the gear error
+     * during the last interval, i.e. the change of the measured error plus
+     * the correction that was applied in between.
+     */
+    if (parameters->number_of_measurements_ == 0)
     {
-        //The daytime indoor measurement noise SD is 0.25-0.35
-        double indoor_noise_standard_deviation = 0.25;
-        double first_random_measurement = indoor_noise_standard_deviation *
-            math_tools::generate_normal_random_double();
-        double new_modified_measurement =
-            parameters->control_signal_ +
-            first_random_measurement * (1 - parameters->control_gain_) -
-            input;
-        parameters->modified_measurements_.append(new_modified_measurement);
+        parameters->modified_measurements_.append(input);
     }
     else
     {
         double new_modified_measurement =
-            parameters->control_signal_ +
-            parameters->measurements_.getSecondLastElement() * (1 - parameters->control_gain_) -
-            parameters->measurements_.getLastElement();
+            parameters->measurements_.getLastElement() -
+            parameters->measurements_.getSecondLastElement() +
+            parameters->control_signal_;
         parameters->modified_measurements_.append(new_modified_measurement);
     }
 }
@@ -252,89 +639,52 @@ double GuideGaussianProcess::result(double input)
     /*
      * Need to read this value here because it is not loaded at the construction
      * time of this object.
-     * 
-     *
-     * Not used when testing the Code with Matlab, will be used in the actual GP
      */
     double delta_controller_time_ms = pFrame->RequestedExposureDuration();
 
-
-
-    // This is the Code sending the circular buffers to Matlab:
-
-    double* timestamp_data = parameters->timestamps_.getEigenVector()->data();
-    double* modified_measurement_data = parameters->modified_measurements_.getEigenVector()->data();
-    double result;
-    double wait_time = 100;
-
-    bool sent = false;
-    bool received = false;
-
-    // Send the input
-    double input_buf[] = { input };
-    sent = parameters->udpInteraction.SendToUDPPort(input_buf, 8);
-    received = parameters->udpInteraction.ReceiveFromUDPPort(&result, 8);
-    wxMilliSleep(wait_time);
-
-    // Send the size of the buffer
-    double size = parameters->timestamps_.getEigenVector()->size();
-    double size_buf[] = { size };
-    sent = parameters->udpInteraction.SendToUDPPort(size_buf, 8);
-    received = parameters->udpInteraction.ReceiveFromUDPPort(&result, 8);
-    wxMilliSleep(wait_time);
-
-    // Send modified measurements
-    sent = parameters->udpInteraction.SendToUDPPort(modified_measurement_data, size * 8);
-    received = parameters->udpInteraction.ReceiveFromUDPPort(&result, 8);
-    wxMilliSleep(wait_time);
-
-    // Send timestamps
-    sent = parameters->udpInteraction.SendToUDPPort(timestamp_data, size * 8);
-    // Receive the final control signal
-    received = parameters->udpInteraction.ReceiveFromUDPPort(&result, 8);
-
-    return result;
-
-
     /*
-     * This is the code running the actual GP
-     *
-     * TODO: 
-     * - Let GP class be a member of this Guiding Class
-     * - Call the GP´s BFGS Optimizer every once in a while (how often?)
-     *
+     * Inference over the sliding window: the GP factorization is updated with
+     * the newest measurement and downdated with the one that fell out of the
+     * window, which is O(n^2) instead of refactorizing in O(n^3). The GP works
+     * in seconds, the timestamps are in milliseconds.
      */
+    parameters->gp_.appendData(parameters->timestamps_.getLastElement() / 1000.0,
+        parameters->modified_measurements_.getLastElement());
+    if (parameters->gp_.getDataCount() > GPWindowSize)
+    {
+        parameters->gp_.removeOldestData();
+    }
 
+    HandlePeriodogram();
+    HandleHyperparameterOptimization();
 
-    /*
-
-    if (number_of_measurements_ > 5)
+    if (parameters->number_of_measurements_ > MinimumMeasurementsForGP)
     {
+        // Prediction of the gear error displacement during the next interval
+        Eigen::VectorXd next_location(1);
+        next_location << (parameters->elapsed_time_ms_ + delta_controller_time_ms / 2) / 1000.0;
+        double prediction = parameters->gp_.predictMean(next_location)(0);
 
-        // Inference
-        gp_->infer(*timestamps_.getEigenVector(),
-                   *modified_measurements_.getEigenVector());
-        // Prediction of new control_signal_
-        Eigen::VectorXd prediction =
-            gp_->predict(elapsed_time_ms_ + delta_controller_time_ms / 2) -
-            control_gain_ * input / delta_controller_time_ms;
-        control_signal_ = prediction(0);
-
+        parameters->control_signal_ = parameters->control_gain_ * input + prediction;
     }
     else
     {
-        // Simpler prediction when there are not enough data points for the GP
-        control_signal_ = -input / delta_controller_time_ms;
+        // Simpler control when there are not enough data points for the GP
+        parameters->control_signal_ = parameters->control_gain_ * input;
     }
 
-    return control_signal_;
+    Debug.Write(wxString::Format("GuideGaussianProcess::result() returns %.2f from input %.2f\n",
+        parameters->control_signal_, input));
 
-     */
+    return parameters->control_signal_;
 }
 
 
 void GuideGaussianProcess::reset()
 {
     parameters->clear();
+
+    // an optimization still running works on the data cleared here
+    ++parameters->optimizer_generation_;
     return;
 }
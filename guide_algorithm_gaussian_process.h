@@ -44,12 +44,15 @@ class GuideGaussianProcess : public GuideAlgorithm
 private:
     struct gp_guide_parameters;
     class GuideGaussianProcessDialogPane;
+    class HyperparameterOptimizerThread;
 
     gp_guide_parameters* parameters;
 
     void HandleTimestamps();
     void HandleMeasurements(double input);
     void HandleModifiedMeasurements(double input);
+    void HandlePeriodogram();
+    void HandleHyperparameterOptimization();
 
 protected:
 
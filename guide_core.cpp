@@ -0,0 +1,158 @@
+/*
+ *  guide_core.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "phd.h"
+
+struct GuideCoreResult
+{
+    const usImage *image;
+    wxLongLong expStart;        // tells a recycled image from the one guided on
+    Star star;
+};
+
+struct GuideCoreState
+{
+    wxCriticalSection lock;     // protects everything below
+    bool published;
+    unsigned int generation;    // changes whenever params are published or withdrawn
+    GuideCore::Params params;
+    std::deque<GuideCoreResult> results;
+
+    GuideCoreState() : published(false), generation(0) { }
+};
+
+static GuideCoreState s_core;
+
+// with pipelined capture a result may wait while the next frame is guided on
+enum { MAX_RESULTS = 4 };
+
+void GuideCore::Publish(const Params& params)
+{
+    wxCriticalSectionLocker lock(s_core.lock);
+    s_core.params = params;
+    s_core.published = true;
+    ++s_core.generation;
+}
+
+void GuideCore::Withdraw(void)
+{
+    wxCriticalSectionLocker lock(s_core.lock);
+    s_core.published = false;
+    ++s_core.generation;
+}
+
+bool GuideCore::Step(usImage *pImage)
+{
+    Params params;
+    unsigned int generation;
+
+    {
+        wxCriticalSectionLocker lock(s_core.lock);
+        if (!s_core.published)
+            return false;
+        params = s_core.params;
+        generation = s_core.generation;
+    }
+
+    Star star(params.star);
+
+    if (!star.Find(pImage, params.searchRegion, params.findMode))
+    {
+        Debug.AddLine("GuideCore: star not found, leaving the frame to the guider");
+        return false;
+    }
+
+    if (params.maxMass > 0.0 && (star.Mass < params.minMass || star.Mass > params.maxMass))
+    {
+        Debug.AddLine(wxString::Format("GuideCore: star mass %.1f outside (%.1f, %.1f), leaving the frame to the guider",
+            star.Mass, params.minMass, params.maxMass));
+        return false;
+    }
+
+    PHD_Point offset = star - params.lockPosition;
+
+    // the step reports this frame's star, whatever frame the GUI thread is
+    // on when it gets there
+    GuideStepFrame frame;
+    frame.frameNumber = params.frameNumber + (int) (pImage->ImgFrameSeq - params.frameSeq);
+    frame.starMass = star.Mass;
+    frame.starSNR = star.SNR;
+    frame.avgDist = Guider::AverageDistance(params.avgDistance, star.Distance(params.lockPosition));
+    frame.starError = star.GetError();
+
+    {
+        wxCriticalSectionLocker lock(s_core.lock);
+
+        // the lock position may have moved while the star was being found
+        if (!s_core.published || s_core.generation != generation)
+        {
+            Debug.AddLine("GuideCore: guider state changed, leaving the frame to the guider");
+            return false;
+        }
+
+        GuideCoreResult result;
+        result.image = pImage;
+        result.expStart = pImage->ImgExpStartMillis;
+        result.star = star;
+        s_core.results.push_back(result);
+        if (s_core.results.size() > MAX_RESULTS)
+            s_core.results.pop_front();
+    }
+
+    Debug.AddLine(wxString::Format("GuideCore: star at (%.2f, %.2f), offset (%.2f, %.2f)",
+        star.X, star.Y, offset.X, offset.Y));
+
+    // the move is requested without holding the lock: SchedulePrimaryMove
+    // takes the worker thread lock, which the GUI thread holds while it stops
+    // a worker and may call Withdraw() from the events it yields to
+    pFrame->SchedulePrimaryMove(params.mount, offset, true, frame, pImage);
+
+    return true;
+}
+
+bool GuideCore::TakeResult(const usImage *pImage, Star *star)
+{
+    wxCriticalSectionLocker lock(s_core.lock);
+
+    for (std::deque<GuideCoreResult>::iterator it = s_core.results.begin(); it != s_core.results.end(); ++it)
+    {
+        if (it->image == pImage && it->expStart == pImage->ImgExpStartMillis)
+        {
+            *star = it->star;
+            s_core.results.erase(it);
+            return true;
+        }
+    }
+
+    return false;
+}
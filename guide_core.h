@@ -0,0 +1,88 @@
+/*
+ *  guide_core.h
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef GUIDE_CORE_INCLUDED
+#define GUIDE_CORE_INCLUDED
+
+class Mount;
+
+/*
+ * The guide core makes ordinary guide steps on the worker thread that took the
+ * exposure: it finds the guide star, computes the guide error and requests the
+ * correction, so that the guide pulse does not wait for the GUI thread to get
+ * around to the frame.
+ *
+ * The GUI thread publishes the guider state the core works from after each
+ * frame it has processed, and withdraws it whenever that state may change.
+ * Frames the core does not handle (nothing published, star lost, star mass
+ * changed) are guided by Guider::UpdateGuideState as before. Either way the
+ * GUI thread renders and logs every frame, and the mount posts the resulting
+ * GuideStepInfo to it.
+ *
+ * The core does not wait for earlier corrections to finish: the worker queue
+ * keeps only the latest guide step for a mount and accounts for the
+ * corrections the frame did not see when the step is served.
+ */
+class GuideCore
+{
+public:
+    // the guider state the core works from
+    struct Params
+    {
+        Mount *mount;
+        Star star;                  // guide star on the last processed frame
+        PHD_Point lockPosition;
+        int searchRegion;
+        Star::FindMode findMode;
+        double minMass;             // accepted star mass, not checked when
+        double maxMass;             // maxMass is 0
+        int frameNumber;            // number and ImgFrameSeq of the last
+        unsigned int frameSeq;      // processed frame
+        double avgDistance;         // the guider's average distance after it
+    };
+
+    // GUI thread. A step that is past its checks when Withdraw() is called
+    // may still request its move; stopping a worker sets INT_STOP, which
+    // keeps its steps from starting.
+    static void Publish(const Params& params);
+    static void Withdraw(void);
+
+    // Worker thread: guides on the frame if the published state allows it.
+    // Returns true if the core requested the correction for the frame.
+    static bool Step(usImage *pImage);
+
+    // GUI thread: gets the star the core found on a frame it guided on
+    static bool TakeResult(const usImage *pImage, Star *star);
+};
+
+#endif
@@ -0,0 +1,587 @@
+/*
+ *  guidelog_binary.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "guidelog_binary.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char FILE_MAGIC[8] = { 'P', 'H', 'D', '2', 'G', 'L', 'O', 'G' };
+static const uint32_t FILE_VERSION = 1;
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+static const uint32_t BLOCK_MAGIC = 0x4b424c47; // "GLBK" on little endian hosts
+
+GuideLogRecord::GuideLogRecord()
+    :
+    kind(GUIDELOG_STEP),
+    mount(GUIDELOG_MOUNT),
+    frame(0),
+    time(0.0),
+    sessionStart(0.0),
+    dx(0.f),
+    dy(0.f),
+    raRawDistance(0.f),
+    decRawDistance(0.f),
+    raGuideDistance(0.f),
+    decGuideDistance(0.f),
+    raDuration(0),
+    decDuration(0),
+    raDirection(0),
+    decDirection(0),
+    starMass(0.0),
+    snr(0.f),
+    errorCode(0)
+{
+}
+
+static void InitBlock(GuideLogBlock *block, double sessionStart)
+{
+    memset(block, 0, sizeof(*block));
+    block->header.magic = BLOCK_MAGIC;
+    block->header.sessionStart = sessionStart;
+}
+
+// Adds a status string to the pool of a block, sharing it with an earlier
+// record if possible. Returns false if the pool is full.
+static bool AddStatus(GuideLogBlock *block, const std::string& status, uint16_t *offset)
+{
+    if (status.empty())
+    {
+        *offset = GUIDELOG_NO_STATUS;
+        return true;
+    }
+
+    unsigned int pos = 0;
+    while (pos < block->header.statusUsed)
+    {
+        const char *s = block->statusPool + pos;
+        if (status == s)
+        {
+            *offset = (uint16_t) pos;
+            return true;
+        }
+        pos += (unsigned int) strlen(s) + 1;
+    }
+
+    size_t len = status.size() + 1;
+    if (block->header.statusUsed + len > GUIDELOG_STATUS_POOL)
+        return false;
+
+    memcpy(block->statusPool + block->header.statusUsed, status.c_str(), len);
+    *offset = (uint16_t) block->header.statusUsed;
+    block->header.statusUsed += (uint32_t) len;
+    return true;
+}
+
+void GuideLogBlockRecord(const GuideLogBlock& block, unsigned int i, GuideLogRecord *rec)
+{
+    rec->kind = static_cast<GuideLogRecordKind>(block.kind[i]);
+    rec->mount = static_cast<GuideLogMountKind>(block.mount[i]);
+    rec->frame = block.frame[i];
+    rec->time = block.time[i];
+    rec->sessionStart = block.header.sessionStart;
+    rec->dx = block.dx[i];
+    rec->dy = block.dy[i];
+    rec->raRawDistance = block.raRawDistance[i];
+    rec->decRawDistance = block.decRawDistance[i];
+    rec->raGuideDistance = block.raGuideDistance[i];
+    rec->decGuideDistance = block.decGuideDistance[i];
+    rec->raDuration = block.raDuration[i];
+    rec->decDuration = block.decDuration[i];
+    rec->raDirection = block.raDirection[i];
+    rec->decDirection = block.decDirection[i];
+    rec->starMass = block.starMass[i];
+    rec->snr = block.snr[i];
+    rec->errorCode = block.errorCode[i];
+
+    if (block.status[i] != GUIDELOG_NO_STATUS && block.status[i] < block.header.statusUsed)
+        rec->status.assign(block.statusPool + block.status[i]);
+    else
+        rec->status.clear();
+}
+
+// vsnprintf at the end of a std::string
+static void AppendFormat(std::string *s, const char *format, ...)
+{
+    char buf[256];
+
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+
+    if (n > 0)
+        s->append(buf, n < (int) sizeof(buf) ? n : sizeof(buf) - 1);
+}
+
+const char *GuideLogCsvHeader()
+{
+    return "Frame,Time,mount,dx,dy,RARawDistance,DECRawDistance,RAGuideDistance,DECGuideDistance,"
+        "RADuration,RADirection,DECDuration,DECDirection,XStep,YStep,StarMass,SNR,ErrorCode\n";
+}
+
+// the same layout as GuidingLog::GuideStep and GuidingLog::FrameDropped
+std::string GuideLogRecordToCsv(const GuideLogRecord& rec)
+{
+    std::string line;
+
+    if (rec.kind == GUIDELOG_DROP)
+    {
+        AppendFormat(&line, "%d,%.3f,\"DROP\",,,,,,,,,,,,,%.f,%.2f,%d,\"%s\"\n",
+            rec.frame, rec.time, rec.starMass, rec.snr, rec.errorCode, rec.status.c_str());
+        return line;
+    }
+
+    AppendFormat(&line, "%d,%.3f,\"%s\",%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,",
+        rec.frame, rec.time,
+        rec.mount == GUIDELOG_AO ? "AO" : "Mount",
+        rec.dx, rec.dy,
+        rec.raRawDistance, rec.decRawDistance,
+        rec.raGuideDistance, rec.decGuideDistance);
+
+    if (rec.mount == GUIDELOG_AO)
+    {
+        AppendFormat(&line, ",,,,%d,%d,", rec.raDuration, rec.decDuration);
+    }
+    else
+    {
+        char raDir[2] = { rec.raDirection, 0 };
+        char decDir[2] = { rec.decDirection, 0 };
+        AppendFormat(&line, "%d,%s,%d,%s,,,", rec.raDuration, raDir, rec.decDuration, decDir);
+    }
+
+    AppendFormat(&line, "%.f,%.2f,%d\n", rec.starMass, rec.snr, rec.errorCode);
+
+    return line;
+}
+
+// splits a CSV line, removing the quotes around quoted fields
+static void SplitCsv(const char *line, std::vector<std::string> *fields)
+{
+    fields->clear();
+    std::string field;
+    bool quoted = false;
+
+    for (const char *p = line; *p && *p != '\n' && *p != '\r'; p++)
+    {
+        if (*p == '"')
+            quoted = !quoted;
+        else if (*p == ',' && !quoted)
+        {
+            fields->push_back(field);
+            field.clear();
+        }
+        else
+            field += *p;
+    }
+    fields->push_back(field);
+}
+
+static bool ParseInt(const std::string& s, int *val)
+{
+    if (s.empty())
+        return false;
+    char *end;
+    long l = strtol(s.c_str(), &end, 10);
+    if (*end)
+        return false;
+    *val = (int) l;
+    return true;
+}
+
+static bool ParseFloat(const std::string& s, double *val)
+{
+    if (s.empty())
+        return false;
+    char *end;
+    *val = strtod(s.c_str(), &end);
+    return *end == 0;
+}
+
+static bool ParseFloat(const std::string& s, float *val)
+{
+    double d;
+    if (!ParseFloat(s, &d))
+        return false;
+    *val = (float) d;
+    return true;
+}
+
+bool GuideLogRecordFromCsv(const char *line, GuideLogRecord *rec)
+{
+    enum { FRAME, TIME, MOUNT, DX, DY, RA_RAW, DEC_RAW, RA_GUIDE, DEC_GUIDE, RA_DURATION, RA_DIRECTION,
+           DEC_DURATION, DEC_DIRECTION, XSTEP, YSTEP, STAR_MASS, SNR, ERROR_CODE, STATUS, };
+
+    std::vector<std::string> f;
+    SplitCsv(line, &f);
+
+    if (f.size() < ERROR_CODE + 1)
+        return false;
+
+    if (!ParseInt(f[FRAME], &rec->frame) || !ParseFloat(f[TIME], &rec->time))
+        return false;
+
+    if (!ParseFloat(f[STAR_MASS], &rec->starMass) || !ParseFloat(f[SNR], &rec->snr) ||
+        !ParseInt(f[ERROR_CODE], &rec->errorCode))
+    {
+        return false;
+    }
+
+    rec->mount = GUIDELOG_MOUNT;
+    rec->dx = rec->dy = 0.f;
+    rec->raRawDistance = rec->decRawDistance = 0.f;
+    rec->raGuideDistance = rec->decGuideDistance = 0.f;
+    rec->raDuration = rec->decDuration = 0;
+    rec->raDirection = rec->decDirection = 0;
+    rec->status.clear();
+
+    if (f[MOUNT] == "DROP")
+    {
+        rec->kind = GUIDELOG_DROP;
+        if (f.size() > STATUS)
+            rec->status = f[STATUS];
+        return true;
+    }
+
+    rec->kind = GUIDELOG_STEP;
+
+    if (f[MOUNT] == "AO")
+        rec->mount = GUIDELOG_AO;
+    else if (f[MOUNT] != "Mount")
+        return false;
+
+    if (!ParseFloat(f[DX], &rec->dx) || !ParseFloat(f[DY], &rec->dy) ||
+        !ParseFloat(f[RA_RAW], &rec->raRawDistance) || !ParseFloat(f[DEC_RAW], &rec->decRawDistance) ||
+        !ParseFloat(f[RA_GUIDE], &rec->raGuideDistance) || !ParseFloat(f[DEC_GUIDE], &rec->decGuideDistance))
+    {
+        return false;
+    }
+
+    if (rec->mount == GUIDELOG_AO)
+    {
+        return ParseInt(f[XSTEP], &rec->raDuration) && ParseInt(f[YSTEP], &rec->decDuration);
+    }
+
+    if (!ParseInt(f[RA_DURATION], &rec->raDuration) || !ParseInt(f[DEC_DURATION], &rec->decDuration))
+        return false;
+
+    rec->raDirection = f[RA_DIRECTION].empty() ? 0 : f[RA_DIRECTION][0];
+    rec->decDirection = f[DEC_DIRECTION].empty() ? 0 : f[DEC_DIRECTION][0];
+
+    return true;
+}
+
+GuideLogBinaryWriter::GuideLogBinaryWriter()
+    :
+    m_file(0),
+    m_blockIndex(0),
+    m_block(new GuideLogBlock()),
+    m_recordCount(0)
+{
+}
+
+GuideLogBinaryWriter::~GuideLogBinaryWriter()
+{
+    Close();
+    delete m_block;
+}
+
+bool GuideLogBinaryWriter::Open(const char *fileName)
+{
+    Close();
+
+    m_file = fopen(fileName, "w+b");
+    if (!m_file)
+        return true;
+
+    GuideLogFileHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, FILE_MAGIC, sizeof(hdr.magic));
+    hdr.version = FILE_VERSION;
+    hdr.byteOrder = BYTE_ORDER_MARK;
+    hdr.blockRecords = GUIDELOG_BLOCK_RECORDS;
+    hdr.blockSize = sizeof(GuideLogBlock);
+
+    m_blockIndex = 0;
+    m_recordCount = 0;
+    InitBlock(m_block, 0.0);
+
+    if (fwrite(&hdr, sizeof(hdr), 1, m_file) != 1)
+    {
+        Close();
+        return true;
+    }
+
+    return false;
+}
+
+void GuideLogBinaryWriter::Close()
+{
+    if (!m_file)
+        return;
+
+    Flush();
+    fclose(m_file);
+    m_file = 0;
+}
+
+bool GuideLogBinaryWriter::WriteBlock()
+{
+    if (!m_block->header.count)
+        return false;
+
+    long pos = (long) sizeof(GuideLogFileHeader) + (long) m_blockIndex * (long) sizeof(GuideLogBlock);
+
+    return fseek(m_file, pos, SEEK_SET) != 0 ||
+        fwrite(m_block, sizeof(*m_block), 1, m_file) != 1;
+}
+
+bool GuideLogBinaryWriter::Append(const GuideLogRecord& rec)
+{
+    if (!m_file)
+        return true;
+
+    GuideLogBlockHeader& hdr = m_block->header;
+
+    // a block holds a single guiding session
+    if (hdr.count > 0 && hdr.sessionStart != rec.sessionStart)
+    {
+        if (WriteBlock())
+            return true;
+        ++m_blockIndex;
+        InitBlock(m_block, rec.sessionStart);
+    }
+    else if (hdr.count == 0)
+    {
+        hdr.sessionStart = rec.sessionStart;
+    }
+
+    uint16_t status;
+    if (!AddStatus(m_block, rec.status, &status))
+    {
+        // status pool full, start a new block
+        if (WriteBlock())
+            return true;
+        ++m_blockIndex;
+        InitBlock(m_block, rec.sessionStart);
+        AddStatus(m_block, rec.status.substr(0, GUIDELOG_STATUS_POOL - 1), &status);
+    }
+
+    unsigned int i = hdr.count;
+
+    m_block->kind[i] = (uint8_t) rec.kind;
+    m_block->mount[i] = (uint8_t) rec.mount;
+    m_block->frame[i] = rec.frame;
+    m_block->time[i] = rec.time;
+    m_block->dx[i] = rec.dx;
+    m_block->dy[i] = rec.dy;
+    m_block->raRawDistance[i] = rec.raRawDistance;
+    m_block->decRawDistance[i] = rec.decRawDistance;
+    m_block->raGuideDistance[i] = rec.raGuideDistance;
+    m_block->decGuideDistance[i] = rec.decGuideDistance;
+    m_block->raDuration[i] = rec.raDuration;
+    m_block->decDuration[i] = rec.decDuration;
+    m_block->raDirection[i] = rec.raDirection;
+    m_block->decDirection[i] = rec.decDirection;
+    m_block->starMass[i] = rec.starMass;
+    m_block->snr[i] = rec.snr;
+    m_block->errorCode[i] = rec.errorCode;
+    m_block->status[i] = status;
+
+    if (i == 0)
+    {
+        hdr.firstTime = rec.time;
+        hdr.firstFrame = rec.frame;
+    }
+    hdr.lastTime = rec.time;
+    hdr.lastFrame = rec.frame;
+    ++hdr.count;
+    ++m_recordCount;
+
+    if (hdr.count == GUIDELOG_BLOCK_RECORDS)
+    {
+        if (WriteBlock())
+            return true;
+        ++m_blockIndex;
+        InitBlock(m_block, rec.sessionStart);
+    }
+
+    return false;
+}
+
+bool GuideLogBinaryWriter::Flush()
+{
+    if (!m_file)
+        return true;
+
+    bool err = WriteBlock();
+    return fflush(m_file) != 0 || err;
+}
+
+unsigned int GuideLogBinaryWriter::RecordCount() const
+{
+    return m_recordCount;
+}
+
+GuideLogBinaryReader::GuideLogBinaryReader()
+    :
+    m_file(0),
+    m_blockCount(0),
+    m_block(new GuideLogBlock()),
+    m_cachedBlock(-1)
+{
+}
+
+GuideLogBinaryReader::~GuideLogBinaryReader()
+{
+    Close();
+    delete m_block;
+}
+
+bool GuideLogBinaryReader::Open(const char *fileName)
+{
+    Close();
+
+    m_file = fopen(fileName, "rb");
+    if (!m_file)
+        return true;
+
+    GuideLogFileHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, m_file) != 1 ||
+        memcmp(hdr.magic, FILE_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.version != FILE_VERSION ||
+        hdr.byteOrder != BYTE_ORDER_MARK ||
+        hdr.blockRecords != GUIDELOG_BLOCK_RECORDS ||
+        hdr.blockSize != sizeof(GuideLogBlock))
+    {
+        Close();
+        return true;
+    }
+
+    while (true)
+    {
+        long pos = (long) sizeof(GuideLogFileHeader) + (long) m_headers.size() * (long) sizeof(GuideLogBlock);
+        GuideLogBlockHeader blockHdr;
+
+        if (fseek(m_file, pos, SEEK_SET) != 0 || fread(&blockHdr, sizeof(blockHdr), 1, m_file) != 1)
+            break;
+
+        if (blockHdr.magic != BLOCK_MAGIC || blockHdr.count > GUIDELOG_BLOCK_RECORDS)
+        {
+            Close();
+            return true;
+        }
+
+        m_headers.push_back(blockHdr);
+    }
+
+    m_blockCount = (unsigned int) m_headers.size();
+
+    return false;
+}
+
+void GuideLogBinaryReader::Close()
+{
+    if (m_file)
+    {
+        fclose(m_file);
+        m_file = 0;
+    }
+    m_headers.clear();
+    m_blockCount = 0;
+    m_cachedBlock = -1;
+}
+
+const GuideLogBlock *GuideLogBinaryReader::LoadBlock(unsigned int index)
+{
+    long pos = (long) sizeof(GuideLogFileHeader) + (long) index * (long) sizeof(GuideLogBlock);
+
+    // the last block of a file being written may not be complete yet
+    memset(m_block, 0, sizeof(*m_block));
+    if (fseek(m_file, pos, SEEK_SET) != 0 || fread(m_block, 1, sizeof(*m_block), m_file) < sizeof(GuideLogBlockHeader))
+        return 0;
+
+    m_cachedBlock = (int) index;
+    return m_block;
+}
+
+const GuideLogBlock *GuideLogBinaryReader::Block(unsigned int index)
+{
+    if (!m_file || index >= m_blockCount)
+        return 0;
+
+    if ((int) index == m_cachedBlock)
+        return m_block;
+
+    return LoadBlock(index);
+}
+
+bool GuideLogBinaryReader::Seek(double unixTime, unsigned int *block, unsigned int *record)
+{
+    // first block that ends at or after the time
+    unsigned int lo = 0, hi = m_blockCount;
+    while (lo < hi)
+    {
+        unsigned int mid = (lo + hi) / 2;
+        const GuideLogBlockHeader& hdr = m_headers[mid];
+        if (hdr.sessionStart + hdr.lastTime < unixTime)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo == m_blockCount)
+        return false;
+
+    const GuideLogBlock *b = Block(lo);
+    if (!b)
+        return false;
+
+    unsigned int first = 0, last = b->header.count;
+    while (first < last)
+    {
+        unsigned int mid = (first + last) / 2;
+        if (b->header.sessionStart + b->time[mid] < unixTime)
+            first = mid + 1;
+        else
+            last = mid;
+    }
+
+    if (first == b->header.count)
+        return false;
+
+    *block = lo;
+    *record = first;
+    return true;
+}
@@ -0,0 +1,248 @@
+/*
+ *  guidelog_binary.h
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef GUIDELOG_BINARY_INCLUDED
+#define GUIDELOG_BINARY_INCLUDED
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/*
+ * Binary guide log: the guide steps and dropped frames of the text guide
+ * log, in fixed size blocks of fixed width columns.
+ *
+ * The file is a GuideLogFileHeader followed by GuideLogBlocks, so block i is
+ * at sizeof(GuideLogFileHeader) + i * sizeof(GuideLogBlock) and the file
+ * can be memory-mapped as an array of blocks. The block headers carry the
+ * time range of their records, which allows a binary search by time without
+ * reading the columns. A file may hold several guiding sessions, but each
+ * block belongs to a single one, and the last block of a file may be
+ * partially filled.
+ *
+ * Values are stored in host byte order; the header records which one.
+ *
+ * This only depends on the standard library, so that tools can read and
+ * write the format without wxWidgets.
+ */
+
+enum GuideLogRecordKind
+{
+    GUIDELOG_STEP,
+    GUIDELOG_DROP,
+};
+
+enum GuideLogMountKind
+{
+    GUIDELOG_MOUNT,
+    GUIDELOG_AO,
+};
+
+// one row of the guide step table of the text log
+struct GuideLogRecord
+{
+    GuideLogRecordKind kind;
+    GuideLogMountKind mount;    // steps only
+    int frame;
+    double time;                // seconds since guiding started
+    double sessionStart;        // unix time guiding started
+    float dx;
+    float dy;
+    float raRawDistance;
+    float decRawDistance;
+    float raGuideDistance;
+    float decGuideDistance;
+    int raDuration;             // ms, or AO steps (signed)
+    int decDuration;
+    char raDirection;           // 0 if there was no pulse
+    char decDirection;
+    double starMass;            // can exceed the 2^24 a float holds exactly
+    float snr;
+    int errorCode;
+    std::string status;         // dropped frames only
+
+    GuideLogRecord();
+};
+
+enum
+{
+    GUIDELOG_BLOCK_RECORDS = 512,
+    GUIDELOG_STATUS_POOL = 4096,
+    GUIDELOG_NO_STATUS = 0xffff,
+};
+
+struct GuideLogFileHeader
+{
+    char magic[8];              // "PHD2GLOG"
+    uint32_t version;
+    uint32_t byteOrder;         // 0x01020304 as written by the host
+    uint32_t blockRecords;
+    uint32_t blockSize;
+    char reserved[40];
+};
+
+struct GuideLogBlockHeader
+{
+    uint32_t magic;             // 'GLBK'
+    uint32_t count;             // records in use
+    uint32_t statusUsed;        // bytes of the status pool in use
+    uint32_t reserved;
+    double sessionStart;
+    double firstTime;           // of the first and last record, seconds since sessionStart
+    double lastTime;
+    int32_t firstFrame;
+    int32_t lastFrame;
+};
+
+// the columns are ordered by size so that every one of them is aligned
+struct GuideLogBlock
+{
+    GuideLogBlockHeader header;
+    double time[GUIDELOG_BLOCK_RECORDS];
+    double starMass[GUIDELOG_BLOCK_RECORDS];
+    int32_t frame[GUIDELOG_BLOCK_RECORDS];
+    float dx[GUIDELOG_BLOCK_RECORDS];
+    float dy[GUIDELOG_BLOCK_RECORDS];
+    float raRawDistance[GUIDELOG_BLOCK_RECORDS];
+    float decRawDistance[GUIDELOG_BLOCK_RECORDS];
+    float raGuideDistance[GUIDELOG_BLOCK_RECORDS];
+    float decGuideDistance[GUIDELOG_BLOCK_RECORDS];
+    int32_t raDuration[GUIDELOG_BLOCK_RECORDS];
+    int32_t decDuration[GUIDELOG_BLOCK_RECORDS];
+    float snr[GUIDELOG_BLOCK_RECORDS];
+    int32_t errorCode[GUIDELOG_BLOCK_RECORDS];
+    uint16_t status[GUIDELOG_BLOCK_RECORDS];    // offset in statusPool or GUIDELOG_NO_STATUS
+    uint8_t kind[GUIDELOG_BLOCK_RECORDS];
+    uint8_t mount[GUIDELOG_BLOCK_RECORDS];
+    char raDirection[GUIDELOG_BLOCK_RECORDS];
+    char decDirection[GUIDELOG_BLOCK_RECORDS];
+    char statusPool[GUIDELOG_STATUS_POOL];      // nul terminated strings
+};
+
+// Extracts record i of a block
+extern void GuideLogBlockRecord(const GuideLogBlock& block, unsigned int i, GuideLogRecord *rec);
+
+// Formats a record as a line of the guide step table of the text log,
+// including the newline
+extern std::string GuideLogRecordToCsv(const GuideLogRecord& rec);
+
+// Parses a line of the guide step table; returns false for any other line
+extern bool GuideLogRecordFromCsv(const char *line, GuideLogRecord *rec);
+
+// the column header line of the guide step table, including the newline
+extern const char *GuideLogCsvHeader();
+
+class GuideLogBinaryWriter
+{
+    FILE *m_file;
+    unsigned int m_blockIndex;      // index in the file of m_block
+    GuideLogBlock *m_block;
+    unsigned int m_recordCount;
+
+    bool WriteBlock();
+
+public:
+    GuideLogBinaryWriter();
+    ~GuideLogBinaryWriter();
+
+    // creates the file, returns true on error
+    bool Open(const char *fileName);
+    void Close();
+    bool IsOpen() const { return m_file != 0; }
+
+    // records are kept in memory until their block is full or Flush() is
+    // called. Returns true on error.
+    bool Append(const GuideLogRecord& rec);
+
+    // writes the partially filled block and flushes the file, so that what
+    // is on disk is a complete log. Returns true on error.
+    bool Flush();
+
+    // number of records appended since the file was opened
+    unsigned int RecordCount() const;
+};
+
+class GuideLogBinaryReader
+{
+    FILE *m_file;
+    unsigned int m_blockCount;
+    std::vector<GuideLogBlockHeader> m_headers;
+    GuideLogBlock *m_block;         // the block last read
+    int m_cachedBlock;
+
+    const GuideLogBlock *LoadBlock(unsigned int index);
+
+public:
+    GuideLogBinaryReader();
+    ~GuideLogBinaryReader();
+
+    // opens the file and reads the block headers, returns true on error
+    bool Open(const char *fileName);
+    void Close();
+
+    unsigned int BlockCount() const { return m_blockCount; }
+    const GuideLogBlockHeader& BlockHeader(unsigned int index) const { return m_headers[index]; }
+    const GuideLogBlock *Block(unsigned int index);
+
+    // Calls the visitor for every record, in file order. Returns true on
+    // error.
+    template<typename Visitor> bool ForEach(Visitor& visitor);
+
+    // Position of the first record at or after the given unix time, as block
+    // and record index within the block. Returns false if there is none.
+    bool Seek(double unixTime, unsigned int *block, unsigned int *record);
+};
+
+template<typename Visitor>
+bool GuideLogBinaryReader::ForEach(Visitor& visitor)
+{
+    GuideLogRecord rec;
+
+    for (unsigned int b = 0; b < m_blockCount; b++)
+    {
+        const GuideLogBlock *block = Block(b);
+        if (!block)
+            return true;
+
+        for (unsigned int i = 0; i < block->header.count; i++)
+        {
+            GuideLogBlockRecord(*block, i, &rec);
+            visitor(rec);
+        }
+    }
+
+    return false;
+}
+
+#endif
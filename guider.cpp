@@ -119,7 +119,7 @@ Guider::Guider(wxWindow *parent, int xSize, int ySize) :
     m_lockPosShift.shiftIsMountCoords = true;
     m_lockPosIsSticky = false;
     m_forceFullFrame = false;
-    m_pCurrentImage = new usImage(); // so we always have one
+    m_pCurrentImage = usImagePool::Acquire(); // so we always have one
 
     SetOverlayMode(DefaultOverlayMode);
 
@@ -146,7 +146,7 @@ Guider::Guider(wxWindow *parent, int xSize, int ySize) :
 Guider::~Guider(void)
 {
     delete m_displayedImage;
-    delete m_pCurrentImage;
+    usImagePool::Release(m_pCurrentImage);
 
     s_deflectionLogger.Uninit();
 }
@@ -163,6 +163,7 @@ void Guider::LoadProfileSettings(void)
 PauseType Guider::SetPaused(PauseType pause)
 {
     Debug.AddLine("Guider::SetPaused(%d)", pause);
+    GuideCore::Withdraw();
     PauseType prev = m_paused;
     m_paused = pause;
 
@@ -558,7 +559,7 @@ bool Guider::PaintHelper(wxClientDC& dc, wxMemoryDC& memDC)
             dc.SetPen(wxPen(wxColor(255, 0, 0), 1, wxSOLID));
             for (DefectMap::const_iterator it = m_defectMapPreview->begin(); it != m_defectMapPreview->end(); ++it)
             {
-                const wxPoint& pt = *it;
+                const DefectPixel& pt = *it;
                 dc.DrawPoint((int)(pt.x * m_scaleFactor), (int)(pt.y * m_scaleFactor));
             }
         }
@@ -638,6 +639,7 @@ bool Guider::SaveCurrentImage(const wxString& fileName)
 
 void Guider::InvalidateLockPosition(void)
 {
+    GuideCore::Withdraw();
     m_lockPosition.Invalidate();
     EvtServer.NotifyLockPositionLost();
     NudgeLockTool::UpdateNudgeLockControls();
@@ -676,6 +678,7 @@ bool Guider::SetLockPosition(const PHD_Point& position)
             NudgeLockTool::UpdateNudgeLockControls();
         }
 
+        GuideCore::Withdraw();
         m_lockPosition.SetXY(x, y);
     }
     catch (wxString Msg)
@@ -761,6 +764,8 @@ void Guider::SetState(GUIDER_STATE newState)
     {
         Debug.Write(wxString::Format("Changing from state %d to %d\n", m_state, newState));
 
+        GuideCore::Withdraw();
+
         if (newState == STATE_STOP)
         {
             // we are going to stop looping exposures.  We should put
@@ -899,9 +904,7 @@ void Guider::UpdateCurrentDistance(double distance)
 
     if (IsGuiding())
     {
-        // update moving average distance
-        static double const alpha = .3; // moderately high weighting for latest sample
-        m_avgDistance += alpha * (distance - m_avgDistance);
+        m_avgDistance = AverageDistance(m_avgDistance, distance);
     }
     else
     {
@@ -917,6 +920,24 @@ void Guider::UpdateCurrentDistance(double distance)
     }
 }
 
+// moving average distance while guiding
+double Guider::AverageDistance(double avgDistance, double distance)
+{
+    static double const alpha = .3; // moderately high weighting for latest sample
+    return avgDistance + alpha * (distance - avgDistance);
+}
+
+GuideStepFrame Guider::CurrentGuideStepFrame(void)
+{
+    GuideStepFrame frame;
+    frame.frameNumber = pFrame->m_frameCounter;
+    frame.starMass = StarMass();
+    frame.starSNR = SNR();
+    frame.avgDist = CurrentError();
+    frame.starError = StarError();
+    return frame;
+}
+
 double Guider::CurrentError(void)
 {
     enum { THRESHOLD_SECONDS = 20 };
@@ -1010,7 +1031,7 @@ void Guider::UpdateGuideState(usImage *pImage, bool bStopping)
 
             usImage *pPrevImage = m_pCurrentImage;
             m_pCurrentImage = pImage;
-            delete pPrevImage;
+            usImagePool::Release(pPrevImage);
         }
         else
         {
@@ -1024,8 +1045,6 @@ void Guider::UpdateGuideState(usImage *pImage, bool bStopping)
             throw THROW_INFO("Stopped Guiding");
         }
 
-        assert(!pMount || !pMount->IsBusy());
-
         // shift lock position
         if (LockPosShiftEnabled() && IsGuiding())
         {
@@ -1037,9 +1056,19 @@ void Guider::UpdateGuideState(usImage *pImage, bool bStopping)
             NudgeLockTool::UpdateNudgeLockControls();
         }
 
+        // a frame the guide core has already guided on comes with the star
+        // it found; for any other frame the core must stay out of the way
+        // while the guider makes its own step
+        Star coreStar;
+        bool coreGuided = GuideCore::TakeResult(pImage, &coreStar);
+        if (!coreGuided)
+        {
+            GuideCore::Withdraw();
+        }
+
         FrameDroppedInfo info;
 
-        if (UpdateCurrentPosition(pImage, &info))
+        if (UpdateCurrentPosition(pImage, &info, coreGuided ? &coreStar : NULL))
         {
             info.frameNumber = pFrame->m_frameCounter;
             info.time = pFrame->TimeSinceGuidingStarted();
@@ -1198,7 +1227,12 @@ void Guider::UpdateGuideState(usImage *pImage, bool bStopping)
                 EvtServer.NotifyStartGuiding();
                 break;
             case STATE_GUIDING:
-                if (m_ditherRecenterRemaining.IsValid())
+                if (coreGuided)
+                {
+                    // the guide core has already requested the correction
+                    s_deflectionLogger.Log(CurrentPosition());
+                }
+                else if (m_ditherRecenterRemaining.IsValid())
                 {
                     // fast recenter after dither taking large steps and bypassing
                     // guide algorithms (normalMove=false)
@@ -1223,13 +1257,17 @@ void Guider::UpdateGuideState(usImage *pImage, bool bStopping)
                     PHD_Point mountCoords(step.X * m_ditherRecenterDir.x, step.Y * m_ditherRecenterDir.y);
                     PHD_Point cameraCoords;
                     pMount->TransformMountCoordinatesToCameraCoordinates(mountCoords, cameraCoords);
-                    pFrame->SchedulePrimaryMove(pMount, cameraCoords, false);
+                    pFrame->SchedulePrimaryMove(pMount, cameraCoords, false, CurrentGuideStepFrame());
                 }
                 else
                 {
                     // ordinary guide step
                     s_deflectionLogger.Log(CurrentPosition());
-                    pFrame->SchedulePrimaryMove(pMount, CurrentPosition() - LockPosition());
+
+                    // if the mount is still busy with an earlier correction the
+                    // step waits for it, see WorkerThread
+                    PHD_Point offset = CurrentPosition() - LockPosition();
+                    pFrame->SchedulePrimaryMove(pMount, offset, true, CurrentGuideStepFrame(), pImage);
                 }
                 break;
 
@@ -1243,6 +1281,21 @@ void Guider::UpdateGuideState(usImage *pImage, bool bStopping)
         POSSIBLY_UNUSED(Msg);
     }
 
+    // hand ordinary guide steps on the next frames to the guide core
+    GuideCore::Params coreParams;
+    if (m_state == STATE_GUIDING && !IsPaused() && !m_ditherRecenterRemaining.IsValid() &&
+        !LockPosShiftEnabled() && pImage && GetGuideCoreParams(&coreParams))
+    {
+        coreParams.frameNumber = pFrame->m_frameCounter;
+        coreParams.frameSeq = pImage->ImgFrameSeq;
+        coreParams.avgDistance = m_avgDistance;
+        GuideCore::Publish(coreParams);
+    }
+    else
+    {
+        GuideCore::Withdraw();
+    }
+
     // during calibration, the mount is responsible for updating the status message
     if (m_state != STATE_CALIBRATING_PRIMARY && m_state != STATE_CALIBRATING_SECONDARY)
     {
@@ -1251,6 +1304,9 @@ void Guider::UpdateGuideState(usImage *pImage, bool bStopping)
 
     pFrame->UpdateButtonsStatus();
 
+    if (pImage && !bStopping)
+        EvtServer.NotifyFrame(pImage, CurrentPosition());
+
     UpdateImageDisplay(pImage);
 
     Debug.AddLine("UpdateGuideState exits: " + statusMessage);
@@ -235,6 +235,9 @@ public:
     bool GetScaleImage(void);
 
     double CurrentError(void);
+    static double AverageDistance(double avgDistance, double distance);
+    // the star data of the current frame, for a guide step made from it
+    GuideStepFrame CurrentGuideStepFrame(void);
 
     bool GetBookmarksShown(void);
     void SetBookmarksShown(bool show);
@@ -250,6 +253,9 @@ public:
     // their operation
 private:
     virtual void InvalidateLockPosition(void);
+    // the guider state the guide core needs to guide on the next frames,
+    // false if the guider cannot hand its steps to the core
+    virtual bool GetGuideCoreParams(GuideCore::Params *params) { return false; }
 public:
     virtual void LoadProfileSettings(void);
 
@@ -258,7 +264,7 @@ public:
     virtual bool IsValidLockPosition(const PHD_Point& pt) = 0;
 private:
     virtual void InvalidateCurrentPosition(bool fullReset = false) = 0;
-    virtual bool UpdateCurrentPosition(usImage *pImage, FrameDroppedInfo *errorInfo) = 0;
+    virtual bool UpdateCurrentPosition(usImage *pImage, FrameDroppedInfo *errorInfo, const Star *coreStar) = 0;
     virtual bool SetCurrentPosition(usImage *pImage, const PHD_Point& position) = 0;
 
 public:
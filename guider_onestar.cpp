@@ -517,7 +517,7 @@ static wxString StarStatusStr(const Star& star)
     }
 }
 
-bool GuiderOneStar::UpdateCurrentPosition(usImage *pImage, FrameDroppedInfo *errorInfo)
+bool GuiderOneStar::UpdateCurrentPosition(usImage *pImage, FrameDroppedInfo *errorInfo, const Star *coreStar)
 {
     if (!m_star.IsValid() && m_star.X == 0.0 && m_star.Y == 0.0)
     {
@@ -535,7 +535,14 @@ bool GuiderOneStar::UpdateCurrentPosition(usImage *pImage, FrameDroppedInfo *err
     {
         Star newStar(m_star);
 
-        if (!newStar.Find(pImage, m_searchRegion, pFrame->GetStarFindMode()))
+        m_massChecker->SetExposure(pFrame->RequestedExposureDuration());
+
+        if (coreStar)
+        {
+            // the guide core has already found the star and checked its mass
+            newStar = *coreStar;
+        }
+        else if (!newStar.Find(pImage, m_searchRegion, pFrame->GetStarFindMode()))
         {
             errorInfo->starError = newStar.GetError();
             errorInfo->starMass = 0.0;
@@ -548,9 +555,8 @@ bool GuiderOneStar::UpdateCurrentPosition(usImage *pImage, FrameDroppedInfo *err
         // check to see if it seems like the star we just found was the
         // same as the original star.  We do this by comparing the
         // mass
-        m_massChecker->SetExposure(pFrame->RequestedExposureDuration());
         double limits[3];
-        if (m_massChangeThresholdEnabled &&
+        if (!coreStar && m_massChangeThresholdEnabled &&
             m_massChecker->CheckMass(newStar.Mass, m_massChangeThreshold, limits))
         {
             m_star.SetError(Star::STAR_MASSCHANGE);
@@ -601,6 +607,30 @@ bool GuiderOneStar::UpdateCurrentPosition(usImage *pImage, FrameDroppedInfo *err
     return bError;
 }
 
+bool GuiderOneStar::GetGuideCoreParams(GuideCore::Params *params)
+{
+    if (!m_star.WasFound())
+        return false;
+
+    params->mount = pMount;
+    params->star = m_star;
+    params->lockPosition = LockPosition();
+    params->searchRegion = m_searchRegion;
+    params->findMode = pFrame->GetStarFindMode();
+
+    // the limits the next mass check would apply; CheckMass leaves them
+    // alone when there is not enough history to check against
+    double limits[3] = { 0.0, 0.0, 0.0 };
+    if (m_massChangeThresholdEnabled)
+    {
+        m_massChecker->CheckMass(0.0, m_massChangeThreshold, limits);
+    }
+    params->minMass = limits[0];
+    params->maxMass = limits[2];
+
+    return true;
+}
+
 bool GuiderOneStar::IsValidLockPosition(const PHD_Point& pt)
 {
     const usImage *pImage = CurrentImage();
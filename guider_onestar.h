@@ -103,7 +103,8 @@ public:
 private:
     virtual bool IsValidLockPosition(const PHD_Point& pt);
     virtual void InvalidateCurrentPosition(bool fullReset = false);
-    virtual bool UpdateCurrentPosition(usImage *pImage, FrameDroppedInfo *errorInfo);
+    virtual bool UpdateCurrentPosition(usImage *pImage, FrameDroppedInfo *errorInfo, const Star *coreStar);
+    virtual bool GetGuideCoreParams(GuideCore::Params *params);
     virtual bool SetCurrentPosition(usImage *pImage, const PHD_Point& position);
 
     void OnLClick(wxMouseEvent& evt);
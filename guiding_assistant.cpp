@@ -34,6 +34,7 @@
 
 #include "phd.h"
 #include "guiding_assistant.h"
+#include "periodogram.h"
 
 struct Stats
 {
@@ -169,6 +170,7 @@ struct GuidingAsstWin : public wxDialog
     wxStaticText *m_dec_msg;
     wxStaticText *m_snr_msg;
     wxStaticText *m_pae_msg;
+    wxStaticText *m_pe_msg;
     double m_ra_val_rec;  // recommended value
     double m_dec_val_rec; // recommended value
 
@@ -180,6 +182,7 @@ struct GuidingAsstWin : public wxDialog
     double m_freqThresh;
     Stats m_statsRA;
     Stats m_statsDec;
+    Periodogram m_periodogramRA;
     double sumSNR;
     double sumMass;
     double minRA;
@@ -237,7 +240,7 @@ struct GridTooltipInfo : public wxObject
 // Constructor
 GuidingAsstWin::GuidingAsstWin()
 : wxDialog(pFrame, wxID_ANY, wxGetTranslation(_("Guiding Assistant")), wxPoint(-1, -1), wxDefaultSize),
-    m_measuring(false), m_measurementsTaken(false)
+    m_measuring(false), m_periodogramRA(PeriodogramMinPeriod, PeriodogramMaxPeriod, PeriodogramResolution), m_measurementsTaken(false)
 {
     m_vSizer = new wxBoxSizer(wxVERTICAL);
 
@@ -386,6 +389,7 @@ GuidingAsstWin::GuidingAsstWin()
     m_dec_msg = NULL;
     m_snr_msg = NULL;
     m_pae_msg = 0;
+    m_pe_msg = 0;
 
     m_recommend_group->Add(m_recommendgrid, wxSizerFlags(1).Expand());
     // Put the recommendation block at the bottom so it can be hidden/shown
@@ -590,6 +594,14 @@ void GuidingAsstWin::LogResults()
     Debug.Write(wxString::Format("Dec Drift Rate=%s, Dec Peak=%s, PA Error=%s\n",
         m_othergrid->GetCellValue(m_dec_drift_as_loc), m_othergrid->GetCellValue(m_dec_peak_as_loc),
         m_othergrid->GetCellValue(m_pae_loc)));
+
+    std::vector<Periodogram::Peak> peaks = m_periodogramRA.DominantPeriods(3);
+    double pxscale = pFrame->GetCameraPixelScale();
+    for (unsigned int i = 0; i < peaks.size(); i++)
+    {
+        Debug.Write(wxString::Format("RA Periodic Error: period=%.1f s, amplitude=%.2f px (%.2f arc-sec), power=%.2f\n",
+            peaks[i].period, peaks[i].amplitude, peaks[i].amplitude * pxscale, peaks[i].power));
+    }
 }
 
 void GuidingAsstWin::MakeRecommendations()
@@ -666,6 +678,30 @@ void GuidingAsstWin::MakeRecommendations()
         Debug.Write(wxString::Format("Recommendation: %s\n", m_dec_msg->GetLabelText()));
     }
 
+    // The guide output is disabled while measuring, so the RA history is the
+    // unguided periodic error of the mount on top of the drift
+    std::vector<Periodogram::Peak> peaks = m_periodogramRA.DominantPeriods(1);
+    if (!peaks.empty() && peaks[0].power >= MinimumPeriodogramPower)
+    {
+        double pxscale = pFrame->GetCameraPixelScale();
+        wxString msg = wxString::Format(_("Your mount shows a periodic error of %.1f arc-sec with a period of %.0f s. "
+            "Consider using a predictive guide algorithm for RA, such as the Gaussian Process guider."),
+            2.0 * peaks[0].amplitude * pxscale, peaks[0].period);
+        if (!m_pe_msg)
+            m_pe_msg = AddRecommendationEntry(msg);
+        else
+        {
+            m_pe_msg->SetLabel(msg);
+            m_pe_msg->Wrap(400);
+        }
+        Debug.Write(wxString::Format("Recommendation: %s\n", msg));
+    }
+    else
+    {
+        if (m_pe_msg)
+            m_pe_msg->SetLabel(wxEmptyString);
+    }
+
     if ((sumSNR / (double)m_statsRA.n) < 10.0)
     {
         wxString msg(_("Consider using a brighter star or increasing the exposure time"));
@@ -699,6 +735,7 @@ void GuidingAsstWin::OnStart(wxCommandEvent& event)
     m_freqThresh = 1.0 / hp_cutoff;
     m_statsRA.InitStats(hp_cutoff, lp_cutoff, exposure);
     m_statsDec.InitStats(hp_cutoff, lp_cutoff, exposure);
+    m_periodogramRA.Reset();
 
     sumSNR = sumMass = 0.0;
 
@@ -793,17 +830,18 @@ void GuidingAsstWin::OnClose(wxCloseEvent& evt)
 
 void GuidingAsstWin::UpdateInfo(const GuideStepInfo& info)
 {
-    double ra = info.mountOffset->X;
-    double dec = info.mountOffset->Y;
+    double ra = info.mountOffset.X;
+    double dec = info.mountOffset.Y;
     double prevRAlpf = m_statsRA.lpf;
 
     m_statsRA.AddSample(ra);
     m_statsDec.AddSample(dec);
+    m_periodogramRA.AddSample(info.time, ra);
 
     if (m_statsRA.n == 1)
     {
         minRA = maxRA = ra;
-        m_startPos = *info.mountOffset;
+        m_startPos = info.mountOffset;
         maxRateRA = 0.0;
     }
     else
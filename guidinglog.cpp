@@ -39,15 +39,62 @@
 
 const int RetentionPeriod = 60;
 
+static const int DefaultFlushIntervalSeconds = 10;
+
 GuidingLog::GuidingLog(void)
     : m_enabled(false),
     m_keepFile(false),
-    m_isGuiding(false)
+    m_isGuiding(false),
+    m_flushPolicy(FLUSH_PERIODIC),
+    m_flushIntervalMs(DefaultFlushIntervalSeconds * 1000),
+    m_bufferUsed(0),
+    m_sessionStart(0.0)
 {
 }
 
 GuidingLog::~GuidingLog(void)
 {
+    Flush();
+}
+
+void GuidingLog::Write(const char *data, size_t len)
+{
+    if (m_bufferUsed + len > BUFFER_SIZE)
+    {
+        WriteBuffer();
+
+        if (len > BUFFER_SIZE)
+        {
+            m_file.Write(data, len);
+            return;
+        }
+    }
+
+    memcpy(m_buffer + m_bufferUsed, data, len);
+    m_bufferUsed += len;
+}
+
+void GuidingLog::Write(const wxString& str)
+{
+    wxScopedCharBuffer utf8 = str.utf8_str();
+    Write(utf8.data(), utf8.length());
+}
+
+// hands the buffered lines to the file, returns true on error
+bool GuidingLog::WriteBuffer(void)
+{
+    if (!m_bufferUsed)
+        return false;
+
+    bool err = m_file.Write(m_buffer, m_bufferUsed) != m_bufferUsed;
+    m_bufferUsed = 0;
+    return err;
+}
+
+void GuidingLog::FlushIfDue(void)
+{
+    if (m_flushPolicy == FLUSH_EVERY_LINE || wxGetUTCTimeMillis() - m_lastFlush >= m_flushIntervalMs)
+        Flush();
 }
 
 bool GuidingLog::EnableLogging(void)
@@ -59,22 +106,33 @@ bool GuidingLog::EnableLogging(void)
 
     try
     {
+        m_flushPolicy = static_cast<FlushPolicy>(pConfig->Global.GetInt("/GuideLogFlushPolicy", FLUSH_PERIODIC));
+        m_flushIntervalMs = wxMax(1, pConfig->Global.GetInt("/GuideLogFlushInterval", DefaultFlushIntervalSeconds)) * 1000;
+
         wxDateTime now = wxDateTime::Now();
         if (!m_file.IsOpened())
         {
-            m_fileName = GetLogDir() + PATHSEPSTR + "PHD2_GuideLog" + now.Format(_T("_%Y-%m-%d")) +
-                now.Format(_T("_%H%M%S")) + ".txt";
+            wxString baseName = GetLogDir() + PATHSEPSTR + "PHD2_GuideLog" + now.Format(_T("_%Y-%m-%d")) +
+                now.Format(_T("_%H%M%S"));
+            m_fileName = baseName + ".txt";
 
             if (!m_file.Open(m_fileName, "w"))
             {
                 throw ERROR_INFO("unable to open file");
             }
             m_keepFile = false;             // Don't keep it until something meaningful is logged
+
+            if (pConfig->Global.GetBoolean("/GuideLogBinary", false))
+            {
+                m_binaryFileName = baseName + ".glog";
+                if (m_binary.Open(m_binaryFileName.mb_str()))
+                    Debug.AddLine("GuidingLog: unable to create binary log %s", m_binaryFileName);
+            }
         }
 
         assert(m_file.IsOpened());
 
-        m_file.Write(_T("PHD2 version ") FULLVER _T(", Log version ") GUIDELOG_VERSION _T(". Log enabled at ") +
+        Write(_T("PHD2 version ") FULLVER _T(", Log version ") GUIDELOG_VERSION _T(". Log enabled at ") +
             now.Format(_T("%Y-%m-%d %H:%M:%S")) + "\n");
         Flush();
 
@@ -113,8 +171,8 @@ void GuidingLog::DisableLogging(void)
     assert(m_file.IsOpened());
     wxDateTime now = wxDateTime::Now();
 
-    m_file.Write("\n");
-    m_file.Write("Log disabled at " + now.Format(_T("%Y-%m-%d %H:%M:%S")) + "\n");
+    Write("\n");
+    Write("Log disabled at " + now.Format(_T("%Y-%m-%d %H:%M:%S")) + "\n");
     Flush();
     m_enabled = false;
 
@@ -147,6 +205,7 @@ bool GuidingLog::ChangeDirLog(const wxString& newdir)
 void GuidingLog::RemoveOldFiles()
 {
     Logger::RemoveOldFiles("PHD2_GuideLog*.txt", RetentionPeriod);
+    Logger::RemoveOldFiles("PHD2_GuideLog*.glog", RetentionPeriod);
 }
 
 bool GuidingLog::Flush(void)
@@ -160,10 +219,17 @@ bool GuidingLog::Flush(void)
     {
         assert(m_file.IsOpened());
 
-        if (!m_file.Flush())
+        m_lastFlush = wxGetUTCTimeMillis();
+
+        if (WriteBuffer() || !m_file.Flush())
         {
             throw ERROR_INFO("unable to flush file");
         }
+
+        if (m_binary.IsOpen() && m_binary.Flush())
+        {
+            throw ERROR_INFO("unable to flush binary file");
+        }
     }
     catch (wxString Msg)
     {
@@ -182,8 +248,8 @@ void GuidingLog::Close(void)
     assert(m_file.IsOpened());
     wxDateTime now = wxDateTime::Now();
 
-    m_file.Write("\n");
-    m_file.Write("Log closed at " + now.Format(_T("%Y-%m-%d %H:%M:%S")) + "\n");
+    Write("\n");
+    Write("Log closed at " + now.Format(_T("%Y-%m-%d %H:%M:%S")) + "\n");
     Flush();
     m_file.Close();
     m_enabled = false;
@@ -192,6 +258,14 @@ void GuidingLog::Close(void)
     {
         wxRemove(m_fileName);
     }
+
+    if (m_binary.IsOpen())
+    {
+        bool empty = m_binary.RecordCount() == 0;
+        m_binary.Close();
+        if (empty)
+            wxRemove(m_binaryFileName);
+    }
 }
 
 static const char *PierSideStr(PierSide p, const char *unknown = _("Unknown"))
@@ -244,34 +318,34 @@ void GuidingLog::StartCalibration(Mount *pCalibrationMount)
     assert(m_file.IsOpened());
     wxDateTime now = wxDateTime::Now();
 
-    m_file.Write("\n");
-    m_file.Write("Calibration Begins at " + now.Format(_T("%Y-%m-%d %H:%M:%S")) + "\n");
-    m_file.Write("Equipment Profile = " + pConfig->GetCurrentProfile() + "\n");
+    Write("\n");
+    Write("Calibration Begins at " + now.Format(_T("%Y-%m-%d %H:%M:%S")) + "\n");
+    Write("Equipment Profile = " + pConfig->GetCurrentProfile() + "\n");
 
     assert(pCalibrationMount && pCalibrationMount->IsConnected());
 
     if (pCamera)
     {
         // phdlab v0.5.3 expects camera name on a line by itself
-        m_file.Write(wxString::Format("Camera = %s\nExposure = %s\n",
+        Write(wxString::Format("Camera = %s\nExposure = %s\n",
             pCamera->Name, pFrame->ExposureDurationSummary()));
     }
-    m_file.Write(pFrame->PixelScaleSummary() + "\n");
+    Write(pFrame->PixelScaleSummary() + "\n");
 
-    m_file.Write("Mount = " + pCalibrationMount->Name());
+    Write("Mount = " + pCalibrationMount->Name());
     wxString calSettings = pCalibrationMount->CalibrationSettingsSummary();
     if (!calSettings.IsEmpty())
-        m_file.Write(", " + calSettings);
-    m_file.Write("\n");
+        Write(", " + calSettings);
+    Write("\n");
 
-    m_file.Write(wxString::Format("%s\n", PointingInfo()));
+    Write(wxString::Format("%s\n", PointingInfo()));
 
-    m_file.Write(wxString::Format("Lock position = %.3f, %.3f, Star position = %.3f, %.3f\n",
+    Write(wxString::Format("Lock position = %.3f, %.3f, Star position = %.3f, %.3f\n",
                 pFrame->pGuider->LockPosition().X,
                 pFrame->pGuider->LockPosition().Y,
                 pFrame->pGuider->CurrentPosition().X,
                 pFrame->pGuider->CurrentPosition().Y));
-    m_file.Write("Direction,Step,dx,dy,x,y,Dist\n");
+    Write("Direction,Step,dx,dy,x,y,Dist\n");
     Flush();
 
     m_keepFile = true;
@@ -285,7 +359,7 @@ void GuidingLog::CalibrationFailed(Mount *pCalibrationMount, const wxString& msg
         return;
 
     assert(m_file.IsOpened());
-    m_file.Write(msg); m_file.Write("\n");
+    Write(msg); Write("\n");
     Flush();
 }
 
@@ -297,7 +371,7 @@ void GuidingLog::CalibrationStep(Mount *pCalibrationMount, const wxString& direc
 
     assert(m_file.IsOpened());
     // Direction,Step,dx,dy,x,y,Dist
-    m_file.Write(wxString::Format("%s,%d,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+    Write(wxString::Format("%s,%d,%.3f,%.3f,%.3f,%.3f,%.3f\n",
         direction,
         steps,
         dx, dy,
@@ -312,7 +386,7 @@ void GuidingLog::CalibrationDirectComplete(Mount *pCalibrationMount, const wxStr
         return;
 
     assert(m_file.IsOpened());
-    m_file.Write(wxString::Format("%s calibration complete. Angle = %.1f deg, Rate = %.3f\n",
+    Write(wxString::Format("%s calibration complete. Angle = %.1f deg, Rate = %.3f\n",
         direction, degrees(angle), rate * 1000.0));
     Flush();
 }
@@ -325,7 +399,7 @@ void GuidingLog::CalibrationComplete(Mount *pCalibrationMount)
         return;
 
     assert(m_file.IsOpened());
-    m_file.Write(wxString::Format("Calibration complete, mount = %s.\n", pCalibrationMount->Name()));
+    Write(wxString::Format("Calibration complete, mount = %s.\n", pCalibrationMount->Name()));
     Flush();
 }
 
@@ -338,8 +412,10 @@ void GuidingLog::StartGuiding()
 
     assert(m_file.IsOpened());
 
-    m_file.Write("\n");
-    m_file.Write("Guiding Begins at " + pFrame->m_guidingStarted.Format(_T("%Y-%m-%d %H:%M:%S")) + "\n");
+    m_sessionStart = (double) pFrame->m_guidingStarted.GetTicks();
+
+    Write("\n");
+    Write("Guiding Begins at " + pFrame->m_guidingStarted.Format(_T("%Y-%m-%d %H:%M:%S")) + "\n");
     m_keepFile = true;
 
     // add common guiding header
@@ -354,42 +430,58 @@ void GuidingLog::StopGuiding(void)
         return;
 
     assert(m_file.IsOpened());
-    m_file.Write("Guiding Ends at " + wxDateTime::Now().Format(_T("%Y-%m-%d %H:%M:%S")) + "\n");
+    Write("Guiding Ends at " + wxDateTime::Now().Format(_T("%Y-%m-%d %H:%M:%S")) + "\n");
+    Flush();
 }
 
 void GuidingLog::GuidingHeader(void)
     // output guiding header to log file
 {
-    m_file.Write(pFrame->GetSettingsSummary());
-    m_file.Write(pFrame->pGuider->GetSettingsSummary());
+    Write(pFrame->GetSettingsSummary());
+    Write(pFrame->pGuider->GetSettingsSummary());
 
-    m_file.Write("Equipment Profile = " + pConfig->GetCurrentProfile() + "\n");
+    Write("Equipment Profile = " + pConfig->GetCurrentProfile() + "\n");
 
     if (pCamera)
     {
-        m_file.Write(pCamera->GetSettingsSummary());
-        m_file.Write("Exposure = " + pFrame->ExposureDurationSummary() + "\n");
+        Write(pCamera->GetSettingsSummary());
+        Write("Exposure = " + pFrame->ExposureDurationSummary() + "\n");
     }
 
     if (pMount)
-        m_file.Write(pMount->GetSettingsSummary());
+        Write(pMount->GetSettingsSummary());
 
     if (pSecondaryMount)
-        m_file.Write(pSecondaryMount->GetSettingsSummary());
+        Write(pSecondaryMount->GetSettingsSummary());
 
-    m_file.Write(wxString::Format("%s\n", PointingInfo()));
+    Write(wxString::Format("%s\n", PointingInfo()));
 
-    m_file.Write(wxString::Format("Lock position = %.3f, %.3f, Star position = %.3f, %.3f\n",
+    Write(wxString::Format("Lock position = %.3f, %.3f, Star position = %.3f, %.3f\n",
                 pFrame->pGuider->LockPosition().X,
                 pFrame->pGuider->LockPosition().Y,
                 pFrame->pGuider->CurrentPosition().X,
                 pFrame->pGuider->CurrentPosition().Y));
 
-    m_file.Write("Frame,Time,mount,dx,dy,RARawDistance,DECRawDistance,RAGuideDistance,DECGuideDistance,RADuration,RADirection,DECDuration,DECDirection,XStep,YStep,StarMass,SNR,ErrorCode\n");
+    Write("Frame,Time,mount,dx,dy,RARawDistance,DECRawDistance,RAGuideDistance,DECGuideDistance,RADuration,RADirection,DECDuration,DECDirection,XStep,YStep,StarMass,SNR,ErrorCode\n");
 
     Flush();
 }
 
+// vsnprintf at the end of what is already in buf, never past its end
+static void AppendFormat(char *buf, size_t size, size_t *len, const char *format, ...)
+{
+    if (*len + 1 >= size)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buf + *len, size - *len, format, args);
+    va_end(args);
+
+    if (n > 0)
+        *len = wxMin(*len + n, size - 1);
+}
+
 void GuidingLog::GuideStep(const GuideStepInfo& step)
 {
     if (!m_enabled)
@@ -397,30 +489,69 @@ void GuidingLog::GuideStep(const GuideStepInfo& step)
 
     assert(m_file.IsOpened());
 
-    m_file.Write(wxString::Format("%d,%.3f,\"%s\",%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,",
+    char line[512];
+    size_t len = 0;
+
+    AppendFormat(line, sizeof(line), &len, "%d,%.3f,\"%s\",%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,",
         step.frameNumber, step.time,
         step.mount->IsStepGuider() ? "AO" : "Mount",
-        step.cameraOffset->X, step.cameraOffset->Y,
-        step.mountOffset->X, step.mountOffset->Y,
-        step.guideDistanceRA, step.guideDistanceDec));
+        step.cameraOffset.X, step.cameraOffset.Y,
+        step.mountOffset.X, step.mountOffset.Y,
+        step.guideDistanceRA, step.guideDistanceDec);
 
     if (step.mount->IsStepGuider())
     {
         int xSteps = step.directionRA == LEFT ? -step.durationRA : step.durationRA;
         int ySteps = step.directionDec == DOWN ? -step.durationDec : step.durationDec;
-        m_file.Write(wxString::Format(",,,,%d,%d,", xSteps, ySteps));
+        AppendFormat(line, sizeof(line), &len, ",,,,%d,%d,", xSteps, ySteps);
     }
     else
     {
-        m_file.Write(wxString::Format("%d,%s,%d,%s,,,",
+        AppendFormat(line, sizeof(line), &len, "%d,%s,%d,%s,,,",
             step.durationRA, step.durationRA > 0 ? step.mount->DirectionChar((GUIDE_DIRECTION)step.directionRA) : "",
-            step.durationDec, step.durationDec > 0 ? step.mount->DirectionChar((GUIDE_DIRECTION)step.directionDec): ""));
+            step.durationDec, step.durationDec > 0 ? step.mount->DirectionChar((GUIDE_DIRECTION)step.directionDec): "");
     }
 
-    m_file.Write(wxString::Format("%.f,%.2f,%d\n",
-            step.starMass, step.starSNR, step.starError));
+    AppendFormat(line, sizeof(line), &len, "%.f,%.2f,%d\n",
+            step.starMass, step.starSNR, step.starError);
 
-    Flush();
+    Write(line, len);
+
+    if (m_binary.IsOpen())
+    {
+        GuideLogRecord rec;
+        rec.kind = GUIDELOG_STEP;
+        rec.mount = step.mount->IsStepGuider() ? GUIDELOG_AO : GUIDELOG_MOUNT;
+        rec.frame = step.frameNumber;
+        rec.time = step.time;
+        rec.sessionStart = m_sessionStart;
+        rec.dx = step.cameraOffset.X;
+        rec.dy = step.cameraOffset.Y;
+        rec.raRawDistance = step.mountOffset.X;
+        rec.decRawDistance = step.mountOffset.Y;
+        rec.raGuideDistance = step.guideDistanceRA;
+        rec.decGuideDistance = step.guideDistanceDec;
+        if (step.mount->IsStepGuider())
+        {
+            rec.raDuration = step.directionRA == LEFT ? -step.durationRA : step.durationRA;
+            rec.decDuration = step.directionDec == DOWN ? -step.durationDec : step.durationDec;
+        }
+        else
+        {
+            rec.raDuration = step.durationRA;
+            rec.decDuration = step.durationDec;
+            if (step.durationRA > 0)
+                rec.raDirection = step.mount->DirectionChar((GUIDE_DIRECTION)step.directionRA)[0];
+            if (step.durationDec > 0)
+                rec.decDirection = step.mount->DirectionChar((GUIDE_DIRECTION)step.directionDec)[0];
+        }
+        rec.starMass = step.starMass;
+        rec.snr = step.starSNR;
+        rec.errorCode = step.starError;
+        m_binary.Append(rec);
+    }
+
+    FlushIfDue();
 }
 
 void GuidingLog::FrameDropped(const FrameDroppedInfo& info)
@@ -430,9 +561,38 @@ void GuidingLog::FrameDropped(const FrameDroppedInfo& info)
 
     assert(m_file.IsOpened());
 
-    m_file.Write(wxString::Format("%d,%.3f,\"DROP\",,,,,,,,,,,,,%.f,%.2f,%d,\"%s\"\n",
-        info.frameNumber, info.time, info.starMass, info.starSNR, info.starError, info.status));
+    char line[512];
+    size_t len = 0;
+
+    AppendFormat(line, sizeof(line), &len, "%d,%.3f,\"DROP\",,,,,,,,,,,,,%.f,%.2f,%d,\"%s\"\n",
+        info.frameNumber, info.time, info.starMass, info.starSNR, info.starError, (const char *) info.status.utf8_str());
+
+    Write(line, len);
+
+    if (m_binary.IsOpen())
+    {
+        GuideLogRecord rec;
+        rec.kind = GUIDELOG_DROP;
+        rec.frame = info.frameNumber;
+        rec.time = info.time;
+        rec.sessionStart = m_sessionStart;
+        rec.starMass = info.starMass;
+        rec.snr = info.starSNR;
+        rec.errorCode = info.starError;
+        rec.status = (const char *) info.status.utf8_str();
+        m_binary.Append(rec);
+    }
+
+    FlushIfDue();
+}
+
+void GuidingLog::MoveDropped(const MoveDroppedInfo& info)
+{
+    if (!m_enabled || !m_isGuiding)
+        return;
 
+    Write(wxString::Format("INFO: GUIDE STEP DROPPED, Mount = %s, dx = %.3f, dy = %.3f, superseded by dx = %.3f, dy = %.3f\n",
+        info.mount->Name(), info.cameraOffset.X, info.cameraOffset.Y, info.supersededBy.X, info.supersededBy.Y));
     Flush();
 }
 
@@ -441,14 +601,14 @@ void GuidingLog::NotifyGuidingDithered(Guider *guider, double dx, double dy)
     if (!m_enabled || !m_isGuiding)
         return;
 
-    m_file.Write(wxString::Format("INFO: DITHER by %.3f, %.3f, new lock pos = %.3f, %.3f\n",
+    Write(wxString::Format("INFO: DITHER by %.3f, %.3f, new lock pos = %.3f, %.3f\n",
         dx, dy, guider->LockPosition().X, guider->LockPosition().Y));
     Flush();
 }
 
 void GuidingLog::NotifySettlingStateChange(const wxString& msg)
 {
-    m_file.Write(wxString::Format("INFO: SETTLING STATE CHANGE, %s\n", msg));
+    Write(wxString::Format("INFO: SETTLING STATE CHANGE, %s\n", msg));
     Flush();
 }
 
@@ -457,7 +617,7 @@ void GuidingLog::NotifySetLockPosition(Guider *guider)
     if (!m_enabled || !m_isGuiding)
         return;
 
-    m_file.Write(wxString::Format("INFO: SET LOCK POSITION, new lock pos = %.3f, %.3f\n",
+    Write(wxString::Format("INFO: SET LOCK POSITION, new lock pos = %.3f, %.3f\n",
         guider->LockPosition().X, guider->LockPosition().Y));
     m_keepFile = true;
     Flush();
@@ -479,7 +639,7 @@ void GuidingLog::NotifyLockShiftParams(const LockPosShiftParams& shiftParams, co
                                     cameraRate.IsValid() ? cameraRate.X * 3600.0 : 0.0,
                                     cameraRate.IsValid() ? cameraRate.Y * 3600.0 : 0.0);
     }
-    m_file.Write(wxString::Format("INFO: LOCK SHIFT, enabled = %d %s\n", shiftParams.shiftEnabled, details));
+    Write(wxString::Format("INFO: LOCK SHIFT, enabled = %d %s\n", shiftParams.shiftEnabled, details));
     m_keepFile = true;
     Flush();
 }
@@ -489,7 +649,7 @@ void GuidingLog::ServerCommand(Guider *guider, const wxString& cmd)
     if (!m_enabled || !m_isGuiding)
         return;
 
-    m_file.Write(wxString::Format("INFO: Server received %s\n", cmd));
+    Write(wxString::Format("INFO: Server received %s\n", cmd));
     m_keepFile = true;
     Flush();
 }
@@ -499,7 +659,7 @@ void GuidingLog::SetGuidingParam(const wxString& name, double val)
     if (!m_enabled || !m_isGuiding)
         return;
 
-    m_file.Write(wxString::Format("INFO: Guiding parameter change, %s = %.2f\n", name, val));
+    Write(wxString::Format("INFO: Guiding parameter change, %s = %.2f\n", name, val));
     m_keepFile = true;
     Flush();
 }
@@ -509,7 +669,7 @@ void GuidingLog::SetGuidingParam(const wxString& name, int val)
     if (!m_enabled || !m_isGuiding)
         return;
 
-    m_file.Write(wxString::Format("INFO: Guiding parameter change, %s = %d\n", name, val));
+    Write(wxString::Format("INFO: Guiding parameter change, %s = %d\n", name, val));
     m_keepFile = true;
     Flush();
 }
@@ -519,7 +679,7 @@ void GuidingLog::SetGuidingParam(const wxString& name, const wxString& val)
     if (!m_enabled || !m_isGuiding)
         return;
 
-    m_file.Write(wxString::Format("INFO: Guiding parameter change, %s = %s\n", name, val));
+    Write(wxString::Format("INFO: Guiding parameter change, %s = %s\n", name, val));
     m_keepFile = true;
     Flush();
 }
@@ -37,18 +37,33 @@
 #define GUIDINGLOG_INCLUDED
 
 #include "logger.h"
+#include "guidelog_binary.h"
 
 class Mount;
 class Guider;
 struct LockPosShiftParams;
 
+// The frame a guide step was computed from. It is recorded when the step is
+// requested and travels with it, since by the time the step reaches the GUI
+// thread the guider may have moved on to a later frame.
+struct GuideStepFrame
+{
+    int frameNumber;
+    double starMass;
+    double starSNR;
+    double avgDist;
+    int starError;
+};
+
+// A guide step is computed on a worker thread and posted to the GUI thread by
+// value, so everything it carries is a copy.
 struct GuideStepInfo
 {
     Mount *mount;
     int frameNumber;
     double time;
-    const PHD_Point *cameraOffset;
-    const PHD_Point *mountOffset;
+    PHD_Point cameraOffset;
+    PHD_Point mountOffset;
     double guideDistanceRA;
     double guideDistanceDec;
     int durationRA;
@@ -59,6 +74,8 @@ struct GuideStepInfo
     // dependencies in our header files so cannot use GUIDE_DIRECTION here
     int directionRA;
     int directionDec;
+    int moveDuration;   // wall time (ms) of the move, less than the sum of the
+                        // durations when both axes are pulsed at once
     wxPoint aoPos;
     double starMass;
     double starSNR;
@@ -66,6 +83,16 @@ struct GuideStepInfo
     int starError;
 };
 
+// a guide step that was dropped before it reached the mount because a newer
+// one for the same mount arrived first
+struct MoveDroppedInfo
+{
+    Mount *mount;
+    double time;
+    PHD_Point cameraOffset;     // the dropped correction
+    PHD_Point supersededBy;     // the correction that replaced it
+};
+
 struct FrameDroppedInfo
 {
     int frameNumber;
@@ -77,13 +104,49 @@ struct FrameDroppedInfo
     wxString status;
 };
 
+/*
+ * Lines are collected in a buffer and written out according to the flush
+ * policy. Guide steps and dropped frames only go to the disk when the flush
+ * interval has passed or the buffer is full, everything else is written
+ * right away. On hosts with slow storage this keeps a flush syscall out of
+ * every guide step, at the price of losing up to a flush interval of guide
+ * steps if PHD2 is killed. The policy and interval are read from the global
+ * settings /GuideLogFlushPolicy and /GuideLogFlushInterval (seconds) when
+ * logging is enabled.
+ *
+ * If /GuideLogBinary is set, the guide steps and dropped frames are also
+ * written to a binary log next to the text log (see guidelog_binary.h).
+ */
 class GuidingLog : public Logger
 {
+public:
+    enum FlushPolicy
+    {
+        FLUSH_EVERY_LINE,       // every line is written to the file before the call returns
+        FLUSH_PERIODIC,         // guide steps are flushed every flush interval
+    };
+
+private:
+    enum { BUFFER_SIZE = 64 * 1024 };
+
     bool m_enabled;
     wxFFile m_file;
     wxString m_fileName;
     bool m_keepFile;
     bool m_isGuiding;
+    FlushPolicy m_flushPolicy;
+    int m_flushIntervalMs;
+    wxLongLong m_lastFlush;
+    size_t m_bufferUsed;
+    char m_buffer[BUFFER_SIZE];
+    GuideLogBinaryWriter m_binary;
+    wxString m_binaryFileName;
+    double m_sessionStart;
+
+    void Write(const char *data, size_t len);
+    void Write(const wxString& str);
+    bool WriteBuffer(void);
+    void FlushIfDue(void);
 
 protected:
     void GuidingHeader(void);
@@ -109,6 +172,7 @@ public:
     void StopGuiding();
     void GuideStep(const GuideStepInfo& info);
     void FrameDropped(const FrameDroppedInfo& info);
+    void MoveDropped(const MoveDroppedInfo& info);
 
     void ServerCommand(Guider *guider, const wxString& cmd);
     void NotifyGuidingDithered(Guider *guider, double dx, double dy);
@@ -0,0 +1,1017 @@
+/*
+ *  image_kernels.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "image_kernels.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define HAVE_SSE2_KERNELS
+# include <emmintrin.h>
+#endif
+
+#if defined(HAVE_SSE2_KERNELS) && \
+    ((defined(_MSC_VER) && _MSC_VER >= 1700) || defined(__clang__) || \
+     (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+# define HAVE_AVX2_KERNELS
+# include <immintrin.h>
+# if defined(_MSC_VER)
+#  include <intrin.h>
+#  define TARGET_AVX2
+# else
+#  define TARGET_AVX2 __attribute__((target("avx2")))
+# endif
+#endif
+
+static SimdLevel DetectSimdLevel()
+{
+#if defined(HAVE_AVX2_KERNELS)
+# if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] >= 7)
+    {
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        // the OS has to save the ymm registers too
+        if (osxsave && avx && (_xgetbv(0) & 6) == 6)
+        {
+            __cpuidex(info, 7, 0);
+            if (info[1] & (1 << 5))
+                return SIMD_AVX2;
+        }
+    }
+# else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SIMD_AVX2;
+# endif
+#endif
+
+#if defined(HAVE_SSE2_KERNELS)
+    return SIMD_SSE2;
+#else
+    return SIMD_NONE;
+#endif
+}
+
+static const SimdLevel s_supportedSimdLevel = DetectSimdLevel();
+static SimdLevel s_simdLevel = s_supportedSimdLevel;
+
+SimdLevel GetSupportedSimdLevel()
+{
+    return s_supportedSimdLevel;
+}
+
+SimdLevel GetSimdLevel()
+{
+    return s_simdLevel;
+}
+
+void SetSimdLevel(SimdLevel level)
+{
+    s_simdLevel = level < s_supportedSimdLevel ? level : s_supportedSimdLevel;
+}
+
+static void PixelMinMaxScalar(const unsigned short *src, size_t n, unsigned short *pmin, unsigned short *pmax)
+{
+    unsigned short lo = 65535, hi = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        unsigned short d = src[i];
+        if (d < lo) lo = d;
+        if (d > hi) hi = d;
+    }
+    *pmin = lo;
+    *pmax = hi;
+}
+
+#if defined(HAVE_SSE2_KERNELS)
+static void PixelMinMaxSSE2(const unsigned short *src, size_t n, unsigned short *pmin, unsigned short *pmax)
+{
+    // SSE2 only has signed 16-bit min/max, so the values are biased by 0x8000
+    const __m128i bias = _mm_set1_epi16((short) 0x8000);
+    __m128i vmin = _mm_set1_epi16(0x7fff);
+    __m128i vmax = bias;
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(src + i)), bias);
+        vmin = _mm_min_epi16(vmin, v);
+        vmax = _mm_max_epi16(vmax, v);
+    }
+
+    unsigned short lo, hi;
+    PixelMinMaxScalar(src + i, n - i, &lo, &hi);
+
+    unsigned short mins[8], maxs[8];
+    _mm_storeu_si128((__m128i *) mins, _mm_xor_si128(vmin, bias));
+    _mm_storeu_si128((__m128i *) maxs, _mm_xor_si128(vmax, bias));
+    for (int k = 0; k < 8; k++)
+    {
+        if (mins[k] < lo) lo = mins[k];
+        if (maxs[k] > hi) hi = maxs[k];
+    }
+
+    *pmin = lo;
+    *pmax = hi;
+}
+#endif
+
+#if defined(HAVE_AVX2_KERNELS)
+TARGET_AVX2 static void PixelMinMaxAVX2(const unsigned short *src, size_t n, unsigned short *pmin, unsigned short *pmax)
+{
+    __m256i vmin = _mm256_set1_epi16((short) 0xffff);
+    __m256i vmax = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        vmin = _mm256_min_epu16(vmin, v);
+        vmax = _mm256_max_epu16(vmax, v);
+    }
+
+    unsigned short lo, hi;
+    PixelMinMaxScalar(src + i, n - i, &lo, &hi);
+
+    unsigned short mins[16], maxs[16];
+    _mm256_storeu_si256((__m256i *) mins, vmin);
+    _mm256_storeu_si256((__m256i *) maxs, vmax);
+    for (int k = 0; k < 16; k++)
+    {
+        if (mins[k] < lo) lo = mins[k];
+        if (maxs[k] > hi) hi = maxs[k];
+    }
+
+    *pmin = lo;
+    *pmax = hi;
+}
+#endif
+
+void PixelMinMax(const unsigned short *src, size_t n, unsigned short *pmin, unsigned short *pmax)
+{
+    switch (s_simdLevel)
+    {
+#if defined(HAVE_AVX2_KERNELS)
+    case SIMD_AVX2:
+        PixelMinMaxAVX2(src, n, pmin, pmax);
+        return;
+#endif
+#if defined(HAVE_SSE2_KERNELS)
+    case SIMD_SSE2:
+        PixelMinMaxSSE2(src, n, pmin, pmax);
+        return;
+#endif
+    default:
+        PixelMinMaxScalar(src, n, pmin, pmax);
+        return;
+    }
+}
+
+void RectMinMax(const unsigned short *src, int width, int rx, int ry, int rw, int rh,
+    unsigned short *pmin, unsigned short *pmax)
+{
+    if (rx == 0 && rw == width)
+    {
+        // whole rows are contiguous
+        PixelMinMax(src + (size_t) ry * width, (size_t) rw * rh, pmin, pmax);
+        return;
+    }
+
+    unsigned short lo = 65535, hi = 0;
+    for (int y = 0; y < rh; y++)
+    {
+        unsigned short rowmin, rowmax;
+        PixelMinMax(src + (size_t)(ry + y) * width + rx, rw, &rowmin, &rowmax);
+        if (rowmin < lo) lo = rowmin;
+        if (rowmax > hi) hi = rowmax;
+    }
+    *pmin = lo;
+    *pmax = hi;
+}
+
+static int SubtractDarkScalar(unsigned short *light, const unsigned short *dark, size_t n, unsigned short pedestal, bool apply)
+{
+    int mindiff = 65535;
+    for (size_t i = 0; i < n; i++)
+    {
+        int diff = (int) light[i] - (int) dark[i];
+        if (diff < mindiff)
+            mindiff = diff;
+        if (apply)
+        {
+            int newval = diff + pedestal;
+            if (newval < 0) newval = 0;
+            else if (newval > 65535) newval = 65535;
+            light[i] = (unsigned short) newval;
+        }
+    }
+    return mindiff;
+}
+
+// Combines the per-lane minimum of max(light - dark, 0) and maximum of
+// max(dark - light, 0) into the minimum of light - dark
+inline static int CombineMinDiff(const unsigned short *pos, const unsigned short *neg, int lanes, int mindiff)
+{
+    for (int k = 0; k < lanes; k++)
+    {
+        int diff = neg[k] ? -(int) neg[k] : (int) pos[k];
+        if (diff < mindiff)
+            mindiff = diff;
+    }
+    return mindiff;
+}
+
+#if defined(HAVE_SSE2_KERNELS)
+static int SubtractDarkSSE2(unsigned short *light, const unsigned short *dark, size_t n, unsigned short pedestal, bool apply)
+{
+    // With pos = light -sat dark and neg = dark -sat light, one of which is
+    // zero, light - dark + pedestal clamped to 16 bits is
+    // (pos +sat pedestal) -sat neg.
+    const __m128i bias = _mm_set1_epi16((short) 0x8000);
+    const __m128i ped = _mm_set1_epi16((short) pedestal);
+    __m128i vpos = _mm_set1_epi16(0x7fff);
+    __m128i vneg = bias;
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i l = _mm_loadu_si128((const __m128i *)(light + i));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dark + i));
+        __m128i pos = _mm_subs_epu16(l, d);
+        __m128i neg = _mm_subs_epu16(d, l);
+        vpos = _mm_min_epi16(vpos, _mm_xor_si128(pos, bias));
+        vneg = _mm_max_epi16(vneg, _mm_xor_si128(neg, bias));
+        if (apply)
+            _mm_storeu_si128((__m128i *)(light + i), _mm_subs_epu16(_mm_adds_epu16(pos, ped), neg));
+    }
+
+    int mindiff = SubtractDarkScalar(light + i, dark + i, n - i, pedestal, apply);
+
+    unsigned short pos[8], neg[8];
+    _mm_storeu_si128((__m128i *) pos, _mm_xor_si128(vpos, bias));
+    _mm_storeu_si128((__m128i *) neg, _mm_xor_si128(vneg, bias));
+    return CombineMinDiff(pos, neg, 8, mindiff);
+}
+#endif
+
+#if defined(HAVE_AVX2_KERNELS)
+TARGET_AVX2 static int SubtractDarkAVX2(unsigned short *light, const unsigned short *dark, size_t n, unsigned short pedestal, bool apply)
+{
+    const __m256i ped = _mm256_set1_epi16((short) pedestal);
+    __m256i vpos = _mm256_set1_epi16((short) 0xffff);
+    __m256i vneg = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i l = _mm256_loadu_si256((const __m256i *)(light + i));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dark + i));
+        __m256i pos = _mm256_subs_epu16(l, d);
+        __m256i neg = _mm256_subs_epu16(d, l);
+        vpos = _mm256_min_epu16(vpos, pos);
+        vneg = _mm256_max_epu16(vneg, neg);
+        if (apply)
+            _mm256_storeu_si256((__m256i *)(light + i), _mm256_subs_epu16(_mm256_adds_epu16(pos, ped), neg));
+    }
+
+    int mindiff = SubtractDarkScalar(light + i, dark + i, n - i, pedestal, apply);
+
+    unsigned short pos[16], neg[16];
+    _mm256_storeu_si256((__m256i *) pos, vpos);
+    _mm256_storeu_si256((__m256i *) neg, vneg);
+    return CombineMinDiff(pos, neg, 16, mindiff);
+}
+#endif
+
+static int SubtractDarkDispatch(unsigned short *light, const unsigned short *dark, size_t n, unsigned short pedestal, bool apply)
+{
+    switch (s_simdLevel)
+    {
+#if defined(HAVE_AVX2_KERNELS)
+    case SIMD_AVX2:
+        return SubtractDarkAVX2(light, dark, n, pedestal, apply);
+#endif
+#if defined(HAVE_SSE2_KERNELS)
+    case SIMD_SSE2:
+        return SubtractDarkSSE2(light, dark, n, pedestal, apply);
+#endif
+    default:
+        return SubtractDarkScalar(light, dark, n, pedestal, apply);
+    }
+}
+
+int SubtractDarkRow(unsigned short *light, const unsigned short *dark, size_t n, unsigned short pedestal)
+{
+    return SubtractDarkDispatch(light, dark, n, pedestal, true);
+}
+
+int DarkMinDiffRow(const unsigned short *light, const unsigned short *dark, size_t n)
+{
+    // the light pixels are only read when apply is false
+    return SubtractDarkDispatch(const_cast<unsigned short *>(light), dark, n, 0, false);
+}
+
+unsigned short DarkPedestal(int mindiff)
+{
+    int offset = mindiff < 0 ? -mindiff : 0;
+    int pedestal = offset + offset / 4;
+    return (unsigned short) (pedestal > 65535 ? 65535 : pedestal);
+}
+
+int SubtractDarkRows(unsigned short *light, const unsigned short *dark, size_t stride, size_t width,
+    size_t rows, unsigned short pedestal, unsigned char *deferred)
+{
+    int mindiff = 65535;
+
+    for (size_t r = 0; r < rows; r++)
+    {
+        unsigned short *pl = light + r * stride;
+        const unsigned short *pd = dark + r * stride;
+
+        // the row is checked before it is written, while it is in the cache
+        int rowMin = DarkMinDiffRow(pl, pd, width);
+        deferred[r] = rowMin + (int) pedestal < 0;
+        if (!deferred[r])
+            SubtractDarkRow(pl, pd, width, pedestal);
+
+        if (rowMin < mindiff)
+            mindiff = rowMin;
+    }
+
+    return mindiff;
+}
+
+void FinishDarkRows(unsigned short *light, const unsigned short *dark, size_t stride, size_t width,
+    size_t rows, unsigned short pedestal, unsigned short newPedestal, const unsigned char *deferred)
+{
+    int delta = (int) newPedestal - (int) pedestal;
+
+    for (size_t r = 0; r < rows; r++)
+    {
+        unsigned short *pl = light + r * stride;
+
+        if (deferred[r])
+        {
+            SubtractDarkRow(pl, dark + r * stride, width, newPedestal);
+            continue;
+        }
+
+        for (size_t i = 0; i < width; i++)
+        {
+            int val = pl[i] + delta;
+            pl[i] = (unsigned short) (val > 65535 ? 65535 : val);
+        }
+    }
+}
+
+inline static void swap(unsigned short& a, unsigned short& b)
+{
+    unsigned short const t = a;
+    a = b;
+    b = t;
+}
+
+inline static unsigned short median9(const unsigned short l[9])
+{
+    unsigned short l0 = l[0], l1 = l[1], l2 = l[2], l3 = l[3], l4 = l[4];
+    unsigned short x;
+    x = l[5];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+    if (x < l3) swap(x, l3);
+    if (x < l4) swap(x, l4);
+    x = l[6];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+    if (x < l3) swap(x, l3);
+    if (x < l4) swap(x, l4);
+    x = l[7];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+    if (x < l3) swap(x, l3);
+    if (x < l4) swap(x, l4);
+    x = l[8];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+    if (x < l3) swap(x, l3);
+    if (x < l4) swap(x, l4);
+
+    if (l1 > l0) l0 = l1;
+    if (l2 > l0) l0 = l2;
+    if (l3 > l0) l0 = l3;
+    if (l4 > l0) l0 = l4;
+
+    return l0;
+}
+
+inline static unsigned short median6(const unsigned short l[6])
+{
+    unsigned short l0 = l[0], l1 = l[1], l2 = l[2], l3 = l[3];
+    unsigned short x;
+
+    x = l[4];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+    if (x < l3) swap(x, l3);
+    x = l[5];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+    if (x < l3) swap(x, l3);
+
+    if (l2 > l0) swap(l2, l0);
+    if (l2 > l1) swap(l2, l1);
+
+    if (l3 > l0) swap(l3, l0);
+    if (l3 > l1) swap(l3, l1);
+
+    return (unsigned short)(((unsigned int) l0 + (unsigned int) l1) / 2);
+}
+
+inline static unsigned short median4(const unsigned short l[4])
+{
+    unsigned short l0 = l[0], l1 = l[1], l2 = l[2];
+    unsigned short x;
+    x = l[3];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+
+    if (l2 > l0) swap(l2, l0);
+    if (l2 > l1) swap(l2, l1);
+
+    return (unsigned short)(((unsigned int) l0 + (unsigned int) l1) / 2);
+}
+
+// top or bottom row of the rectangle, p and q are the two rows of the window
+static void Median3EdgeRow(unsigned short *d, const unsigned short *p, const unsigned short *q, int rw)
+{
+    unsigned short a[6];
+
+    // left corner
+    a[0] = p[0];
+    a[1] = p[1];
+    a[2] = q[0];
+    a[3] = q[1];
+    *d++ = median4(a);
+
+    // middle pixels
+    for (int x = 1; x <= rw - 2; x++)
+    {
+        a[0] = p[x - 1];
+        a[1] = p[x];
+        a[2] = p[x + 1];
+        a[3] = q[x - 1];
+        a[4] = q[x];
+        a[5] = q[x + 1];
+        *d++ = median6(a);
+    }
+
+    // right corner
+    a[0] = p[rw - 2];
+    a[1] = p[rw - 1];
+    a[2] = q[rw - 2];
+    a[3] = q[rw - 1];
+    *d = median4(a);
+}
+
+/*
+ * The vectorized 3x3 median sorts the three pixels of each column of the
+ * window, then takes the median of the largest of the column minimums, the
+ * median of the column medians and the smallest of the column maximums.
+ * This gives exactly the same result as median9(), for 8 (SSE2) or 16
+ * (AVX2) adjacent pixels at a time. The kernels filter the pixels x..xend-1
+ * of the row and return the first pixel they did not filter.
+ */
+#if defined(HAVE_SSE2_KERNELS)
+
+// SSE2 only has signed 16-bit min/max, so the pixels are biased by 0x8000
+inline static __m128i LoadBiased(const unsigned short *src)
+{
+    return _mm_xor_si128(_mm_loadu_si128((const __m128i *) src), _mm_set1_epi16((short) 0x8000));
+}
+
+inline static void Sort2(__m128i& a, __m128i& b)
+{
+    __m128i const t = a;
+    a = _mm_min_epi16(t, b);
+    b = _mm_max_epi16(t, b);
+}
+
+inline static void Sort3(__m128i& a, __m128i& b, __m128i& c)
+{
+    Sort2(a, b);
+    Sort2(b, c);
+    Sort2(a, b);
+}
+
+inline static __m128i Med3(__m128i a, __m128i b, __m128i c)
+{
+    return _mm_max_epi16(_mm_min_epi16(a, b), _mm_min_epi16(_mm_max_epi16(a, b), c));
+}
+
+static int Median9SSE2(unsigned short *d, const unsigned short *p, const unsigned short *q,
+    const unsigned short *r, int x, int xend)
+{
+    for (; x + 8 <= xend; x += 8)
+    {
+        __m128i p0 = LoadBiased(p + x - 1), p1 = LoadBiased(p + x), p2 = LoadBiased(p + x + 1);
+        __m128i q0 = LoadBiased(q + x - 1), q1 = LoadBiased(q + x), q2 = LoadBiased(q + x + 1);
+        __m128i r0 = LoadBiased(r + x - 1), r1 = LoadBiased(r + x), r2 = LoadBiased(r + x + 1);
+
+        Sort3(p0, q0, r0);
+        Sort3(p1, q1, r1);
+        Sort3(p2, q2, r2);
+
+        __m128i lo = _mm_max_epi16(_mm_max_epi16(p0, p1), p2);
+        __m128i mid = Med3(q0, q1, q2);
+        __m128i hi = _mm_min_epi16(_mm_min_epi16(r0, r1), r2);
+
+        __m128i m = _mm_xor_si128(Med3(lo, mid, hi), _mm_set1_epi16((short) 0x8000));
+        _mm_storeu_si128((__m128i *)(d + x), m);
+    }
+    return x;
+}
+
+#endif
+
+#if defined(HAVE_AVX2_KERNELS)
+
+TARGET_AVX2 inline static __m256i Load(const unsigned short *src)
+{
+    return _mm256_loadu_si256((const __m256i *) src);
+}
+
+TARGET_AVX2 inline static void Sort2(__m256i& a, __m256i& b)
+{
+    __m256i const t = a;
+    a = _mm256_min_epu16(t, b);
+    b = _mm256_max_epu16(t, b);
+}
+
+TARGET_AVX2 inline static void Sort3(__m256i& a, __m256i& b, __m256i& c)
+{
+    Sort2(a, b);
+    Sort2(b, c);
+    Sort2(a, b);
+}
+
+TARGET_AVX2 inline static __m256i Med3(__m256i a, __m256i b, __m256i c)
+{
+    return _mm256_max_epu16(_mm256_min_epu16(a, b), _mm256_min_epu16(_mm256_max_epu16(a, b), c));
+}
+
+TARGET_AVX2 static int Median9AVX2(unsigned short *d, const unsigned short *p, const unsigned short *q,
+    const unsigned short *r, int x, int xend)
+{
+    for (; x + 16 <= xend; x += 16)
+    {
+        __m256i p0 = Load(p + x - 1), p1 = Load(p + x), p2 = Load(p + x + 1);
+        __m256i q0 = Load(q + x - 1), q1 = Load(q + x), q2 = Load(q + x + 1);
+        __m256i r0 = Load(r + x - 1), r1 = Load(r + x), r2 = Load(r + x + 1);
+
+        Sort3(p0, q0, r0);
+        Sort3(p1, q1, r1);
+        Sort3(p2, q2, r2);
+
+        __m256i lo = _mm256_max_epu16(_mm256_max_epu16(p0, p1), p2);
+        __m256i mid = Med3(q0, q1, q2);
+        __m256i hi = _mm256_min_epu16(_mm256_min_epu16(r0, r1), r2);
+
+        _mm256_storeu_si256((__m256i *)(d + x), Med3(lo, mid, hi));
+    }
+    return x;
+}
+
+#endif
+
+// any other row, p, q and r are the rows above, at and below the output row
+static void Median3InnerRow(unsigned short *d, const unsigned short *p, const unsigned short *q,
+    const unsigned short *r, int rw)
+{
+    unsigned short a[9];
+
+    // leftmost pixel
+    a[0] = p[0];
+    a[1] = p[1];
+    a[2] = q[0];
+    a[3] = q[1];
+    a[4] = r[0];
+    a[5] = r[1];
+    *d = median6(a);
+
+    int x = 1;
+    switch (s_simdLevel)
+    {
+#if defined(HAVE_AVX2_KERNELS)
+    case SIMD_AVX2:
+        x = Median9AVX2(d, p, q, r, x, rw - 1);
+        break;
+#endif
+#if defined(HAVE_SSE2_KERNELS)
+    case SIMD_SSE2:
+        x = Median9SSE2(d, p, q, r, x, rw - 1);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    // scalar pixels after the vectors
+    for (; x <= rw - 2; x++)
+    {
+        a[0] = p[x - 1];
+        a[1] = p[x];
+        a[2] = p[x + 1];
+        a[3] = q[x - 1];
+        a[4] = q[x];
+        a[5] = q[x + 1];
+        a[6] = r[x - 1];
+        a[7] = r[x];
+        a[8] = r[x + 1];
+        d[x] = median9(a);
+    }
+
+    // rightmost pixel
+    a[0] = p[rw - 2];
+    a[1] = p[rw - 1];
+    a[2] = q[rw - 2];
+    a[3] = q[rw - 1];
+    a[4] = r[rw - 2];
+    a[5] = r[rw - 1];
+    d[rw - 1] = median6(a);
+}
+
+void Median3Row(unsigned short *dst, const unsigned short *src, int width,
+    int rx, int ry, int rw, int rh, int y)
+{
+#define ROW(y_) (src + (size_t)(ry + (y_)) * width + rx)
+
+    if (y == 0)
+        Median3EdgeRow(dst, ROW(0), ROW(1), rw);
+    else if (y == rh - 1)
+        Median3EdgeRow(dst, ROW(rh - 2), ROW(rh - 1), rw);
+    else
+        Median3InnerRow(dst, ROW(y - 1), ROW(y), ROW(y + 1), rw);
+
+#undef ROW
+}
+
+void Median3MinMax(const unsigned short *src, int width, int rx, int ry, int rw, int rh,
+    std::vector<unsigned short>& scratch, unsigned short *pmin, unsigned short *pmax)
+{
+    if (rw < 2 || rh < 2)
+    {
+        // too small for the filter, use the raw pixels
+        RectMinMax(src, width, rx, ry, rw, rh, pmin, pmax);
+        return;
+    }
+
+    if (scratch.size() < (size_t) rw)
+        scratch.resize(rw);
+
+    unsigned short *row = &scratch[0];
+    unsigned short lo = 65535, hi = 0;
+
+    for (int y = 0; y < rh; y++)
+    {
+        Median3Row(row, src, width, rx, ry, rw, rh, y);
+
+        unsigned short rowmin, rowmax;
+        PixelMinMax(row, rw, &rowmin, &rowmax);
+        if (rowmin < lo) lo = rowmin;
+        if (rowmax > hi) hi = rowmax;
+    }
+
+    *pmin = lo;
+    *pmax = hi;
+}
+
+inline static unsigned short median8(const unsigned short l[8])
+{
+    unsigned short l0 = l[0], l1 = l[1], l2 = l[2], l3 = l[3], l4 = l[4];
+    unsigned short x;
+
+    x = l[5];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+    if (x < l3) swap(x, l3);
+    if (x < l4) swap(x, l4);
+    x = l[6];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+    if (x < l3) swap(x, l3);
+    if (x < l4) swap(x, l4);
+    x = l[7];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+    if (x < l3) swap(x, l3);
+    if (x < l4) swap(x, l4);
+
+    if (l2 > l0) swap(l2, l0);
+    if (l2 > l1) swap(l2, l1);
+
+    if (l3 > l0) swap(l3, l0);
+    if (l3 > l1) swap(l3, l1);
+
+    if (l4 > l0) swap(l4, l0);
+    if (l4 > l1) swap(l4, l1);
+
+    return (unsigned short)(((unsigned int) l0 + (unsigned int) l1) / 2);
+}
+
+inline static unsigned short median5(const unsigned short l[5])
+{
+    unsigned short l0 = l[0], l1 = l[1], l2 = l[2];
+    unsigned short x;
+    x = l[3];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+    x = l[4];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+
+    if (l1 > l0) l0 = l1;
+    if (l2 > l0) l0 = l2;
+
+    return l0;
+}
+
+inline static unsigned short median3(const unsigned short l[3])
+{
+    unsigned short l0 = l[0], l1 = l[1], l2 = l[2];
+    if (l2 < l0) swap(l2, l0);
+    if (l2 < l1) swap(l2, l1);
+    if (l1 > l0) l0 = l1;
+    return l0;
+}
+
+inline static unsigned short median_small(unsigned short *l, int n)
+{
+    // insertion sort, n is at most 8
+    for (int i = 1; i < n; i++)
+    {
+        unsigned short x = l[i];
+        int j = i;
+        for (; j > 0 && l[j - 1] > x; j--)
+            l[j] = l[j - 1];
+        l[j] = x;
+    }
+    if (n & 1)
+        return l[n / 2];
+    return (unsigned short)(((unsigned int) l[n / 2 - 1] + (unsigned int) l[n / 2]) / 2);
+}
+
+// The 8 neighbors of a pixel, in the bit order of DefectIndex::NeighborMask.
+// Neighbor 7 - k is the opposite of neighbor k.
+static const int s_nbrDx[8] = { -1,  0,  1, -1, 1, -1, 0, 1 };
+static const int s_nbrDy[8] = { -1, -1, -1,  0, 0,  1, 1, 1 };
+
+enum
+{
+    NBR_LEFT = 0x29,     // neighbors 0, 3, 5
+    NBR_RIGHT = 0x94,    // neighbors 2, 4, 7
+    NBR_ABOVE = 0x07,    // neighbors 0, 1, 2
+    NBR_BELOW = 0xe0,    // neighbors 5, 6, 7
+};
+
+// Median of the good neighbors of the defect at (x, y) that lie inside the
+// rectangle (rx, ry, rw, rh)
+static unsigned short DefectReplacement(const unsigned short *img, int width, int rx, int ry, int rw, int rh,
+    int x, int y, unsigned int mask)
+{
+    unsigned int inside = 0xff;
+    if (x == rx)
+        inside &= ~NBR_LEFT;
+    if (x == rx + rw - 1)
+        inside &= ~NBR_RIGHT;
+    if (y == ry)
+        inside &= ~NBR_ABOVE;
+    if (y == ry + rh - 1)
+        inside &= ~NBR_BELOW;
+
+    // in a cluster where every neighbor is a defect, fall back to all of them
+    if (!(mask & inside))
+        mask = 0xff;
+    mask &= inside;
+
+    unsigned short array[8];
+    int n = 0;
+    for (int k = 0; k < 8; k++)
+    {
+        if (mask & (1 << k))
+            array[n++] = img[(size_t)(y + s_nbrDy[k]) * width + x + s_nbrDx[k]];
+    }
+
+    switch (n)
+    {
+    case 0: return img[(size_t) y * width + x];
+    case 3: return median3(array);
+    case 5: return median5(array);
+    case 8: return median8(array);
+    default: return median_small(array, n);
+    }
+}
+
+static bool DefectLess(const DefectPixel& a, const DefectPixel& b)
+{
+    return a.y < b.y || (a.y == b.y && a.x < b.x);
+}
+
+static bool DefectXLess(const DefectPixel& a, const DefectPixel& b)
+{
+    return a.x < b.x;
+}
+
+static bool DefectEqual(const DefectPixel& a, const DefectPixel& b)
+{
+    return a.x == b.x && a.y == b.y;
+}
+
+DefectIndex::DefectIndex()
+    : m_width(MaxSensorSize), m_height(MaxSensorSize)
+{
+}
+
+void DefectIndex::SetSensorSize(int width, int height)
+{
+    m_width = width < MaxSensorSize ? width : MaxSensorSize;
+    m_height = height < MaxSensorSize ? height : MaxSensorSize;
+}
+
+void DefectIndex::clear()
+{
+    m_defects.clear();
+    m_rowStart.clear();
+    m_neighbors.clear();
+}
+
+bool DefectIndex::Inside(int x, int y) const
+{
+    return x >= 0 && x < m_width && y >= 0 && y < m_height;
+}
+
+unsigned int DefectIndex::Assign(const std::vector<DefectPixel>& defects)
+{
+    unsigned int rejected = 0;
+
+    m_defects.clear();
+    m_defects.reserve(defects.size());
+    for (std::vector<DefectPixel>::const_iterator it = defects.begin(); it != defects.end(); ++it)
+    {
+        if (Inside(it->x, it->y))
+            m_defects.push_back(*it);
+        else
+            ++rejected;
+    }
+
+    std::sort(m_defects.begin(), m_defects.end(), DefectLess);
+    m_defects.erase(std::unique(m_defects.begin(), m_defects.end(), DefectEqual), m_defects.end());
+
+    // the index only spans the rows that have defects, which are all on the sensor
+    int const rows = m_defects.empty() ? 0 : m_defects.back().y + 1;
+    unsigned int const n = m_defects.size();
+
+    m_rowStart.resize(rows + 1);
+    unsigned int i = 0;
+    for (int y = 0; y <= rows; y++)
+    {
+        while (i < n && m_defects[i].y < y)
+            ++i;
+        m_rowStart[y] = i;
+    }
+
+    m_neighbors.resize(n);
+    for (i = 0; i < n; i++)
+    {
+        unsigned int mask = 0;
+        for (int k = 0; k < 8; k++)
+        {
+            if (!Find(m_defects[i].x + s_nbrDx[k], m_defects[i].y + s_nbrDy[k]))
+                mask |= 1 << k;
+        }
+        m_neighbors[i] = (unsigned char) mask;
+    }
+
+    return rejected;
+}
+
+bool DefectIndex::Insert(int x, int y)
+{
+    if (!Inside(x, y) || Find(x, y))
+        return false;
+
+    // extend the index to the row of the new defect
+    if (y + 2 > (int) m_rowStart.size())
+        m_rowStart.resize(y + 2, m_defects.size());
+
+    DefectPixel pt(x, y);
+    std::vector<DefectPixel>::iterator pos = std::upper_bound(m_defects.begin(), m_defects.end(), pt, DefectLess);
+    size_t const idx = pos - m_defects.begin();
+
+    // the new defect is a bad neighbor of the defects around it
+    unsigned int mask = 0;
+    for (int k = 0; k < 8; k++)
+    {
+        int nx = x + s_nbrDx[k], ny = y + s_nbrDy[k];
+        if (!Find(nx, ny))
+        {
+            mask |= 1 << k;
+            continue;
+        }
+        const_iterator nbr = std::lower_bound(RowBegin(ny), RowEnd(ny), DefectPixel(nx, ny), DefectXLess);
+        m_neighbors[nbr - m_defects.begin()] &= (unsigned char) ~(1 << (7 - k));
+    }
+
+    m_defects.insert(pos, pt);
+    m_neighbors.insert(m_neighbors.begin() + idx, (unsigned char) mask);
+    for (size_t r = y + 1; r < m_rowStart.size(); r++)
+        ++m_rowStart[r];
+
+    return true;
+}
+
+DefectIndex::const_iterator DefectIndex::RowBegin(int y) const
+{
+    if (y < 0)
+        return m_defects.begin();
+    if (y + 1 >= (int) m_rowStart.size())
+        return m_defects.end();
+    return m_defects.begin() + m_rowStart[y];
+}
+
+DefectIndex::const_iterator DefectIndex::RowEnd(int y) const
+{
+    if (y < 0)
+        return m_defects.begin();
+    if (y + 1 >= (int) m_rowStart.size())
+        return m_defects.end();
+    return m_defects.begin() + m_rowStart[y + 1];
+}
+
+bool DefectIndex::Find(int x, int y) const
+{
+    return std::binary_search(RowBegin(y), RowEnd(y), DefectPixel(x, y), DefectXLess);
+}
+
+void RemoveDefectsRect(unsigned short *img, int width, const DefectIndex& defects, int rx, int ry, int rw, int rh)
+{
+    DefectPixel left(rx, 0);
+
+    for (int y = ry; y < ry + rh; y++)
+    {
+        DefectIndex::const_iterator end = defects.RowEnd(y);
+        DefectIndex::const_iterator it = std::lower_bound(defects.RowBegin(y), end, left, DefectXLess);
+
+        // replace each defect with the median of the surrounding pixels
+        for (; it != end && it->x < rx + rw; ++it)
+        {
+            img[(size_t) y * width + it->x] = DefectReplacement(img, width, rx, ry, rw, rh, it->x, y,
+                defects.NeighborMask(it));
+        }
+    }
+}
@@ -0,0 +1,169 @@
+/*
+ *  image_kernels.h
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef IMAGE_KERNELS_INCLUDED
+#define IMAGE_KERNELS_INCLUDED
+
+#include <stddef.h>
+#include <vector>
+
+/*
+ * Pixel kernels that run on every guide frame. They only depend on the
+ * standard library, so that they can be tested and benchmarked without
+ * wxWidgets.
+ *
+ * On x86 the kernels use SSE2 or AVX2, whichever is the best the CPU
+ * supports at run time, and there is a scalar fallback for every other
+ * architecture.
+ */
+
+enum SimdLevel
+{
+    SIMD_NONE,
+    SIMD_SSE2,
+    SIMD_AVX2
+};
+
+// Best instruction set supported by both the build and the CPU
+extern SimdLevel GetSupportedSimdLevel();
+// Instruction set currently used by the kernels
+extern SimdLevel GetSimdLevel();
+// Limits the instruction set used by the kernels, e.g. to compare against the
+// scalar code. Levels above the supported one are lowered to it.
+extern void SetSimdLevel(SimdLevel level);
+
+// Minimum and maximum of n > 0 pixels
+extern void PixelMinMax(const unsigned short *src, size_t n, unsigned short *pmin, unsigned short *pmax);
+
+// Minimum and maximum of the rectangle (rx, ry, rw, rh) of an image that is
+// width pixels wide
+extern void RectMinMax(const unsigned short *src, int width, int rx, int ry, int rw, int rh,
+    unsigned short *pmin, unsigned short *pmax);
+
+// Dark subtraction of n pixels in a single pass: each light pixel becomes
+// light - dark + pedestal, clamped to [0, 65535]. Returns the minimum of
+// light - dark (65535 if n is 0), which tells the caller whether pixels
+// were clipped at zero and what pedestal would have avoided it.
+extern int SubtractDarkRow(unsigned short *light, const unsigned short *dark, size_t n, unsigned short pedestal);
+
+// Minimum of light - dark over n pixels, without modifying the light frame
+extern int DarkMinDiffRow(const unsigned short *light, const unsigned short *dark, size_t n);
+
+// Pedestal that keeps light - dark + pedestal non-negative when the minimum
+// of light - dark is mindiff, with 25% headroom for the next frames
+extern unsigned short DarkPedestal(int mindiff);
+
+// Dark subtraction of rows rows of width pixels, stride pixels apart, with
+// the given pedestal. A row where light - dark + pedestal would go below
+// zero is left unchanged and flagged in deferred[], so that no pixel is
+// ever clipped at zero. Returns the minimum of light - dark.
+extern int SubtractDarkRows(unsigned short *light, const unsigned short *dark, size_t stride, size_t width,
+    size_t rows, unsigned short pedestal, unsigned char *deferred);
+
+// Completes SubtractDarkRows() with a higher pedestal: the rows that were
+// subtracted are raised by the difference and the deferred rows are
+// subtracted with the new pedestal
+extern void FinishDarkRows(unsigned short *light, const unsigned short *dark, size_t stride, size_t width,
+    size_t rows, unsigned short pedestal, unsigned short newPedestal, const unsigned char *deferred);
+
+// Computes row y of the 3x3 median filter of the rectangle (rx, ry, rw, rh)
+// of an image that is width pixels wide, and writes the rw results to dst.
+// Pixels on the edge of the rectangle take the median of their neighbours
+// inside it. The rectangle must be at least 2x2.
+extern void Median3Row(unsigned short *dst, const unsigned short *src, int width,
+    int rx, int ry, int rw, int rh, int y);
+
+// Minimum and maximum of the 3x3 median filter of the rectangle, without
+// producing the filtered image. The rows are filtered one at a time into
+// scratch, which grows as needed and can be reused between calls.
+extern void Median3MinMax(const unsigned short *src, int width, int rx, int ry, int rw, int rh,
+    std::vector<unsigned short>& scratch, unsigned short *pmin, unsigned short *pmax);
+
+struct DefectPixel
+{
+    int x, y;
+
+    DefectPixel() : x(0), y(0) { }
+    DefectPixel(int x_, int y_) : x(x_), y(y_) { }
+};
+
+// The defects of a sensor, sorted by row, then column, with an index of where
+// each row starts, so that a subframe only visits its own defects. For each
+// defect the index also keeps which of its 8 neighbors are not defects
+// themselves; only those are used to replace it. Defects outside the sensor
+// are rejected, so the row index never grows past the sensor height.
+class DefectIndex
+{
+    std::vector<DefectPixel> m_defects;
+    std::vector<unsigned int> m_rowStart;   // defects in row y are [m_rowStart[y], m_rowStart[y + 1])
+    std::vector<unsigned char> m_neighbors; // per defect, bit mask of the neighbors that are good pixels
+    int m_width;
+    int m_height;
+
+    bool Inside(int x, int y) const;
+
+public:
+    typedef std::vector<DefectPixel>::const_iterator const_iterator;
+
+    // largest sensor dimension, used until the sensor size is known
+    enum { MaxSensorSize = 65535 };
+
+    DefectIndex();
+    void SetSensorSize(int width, int height);
+
+    // replaces the defects, returns how many were outside the sensor
+    unsigned int Assign(const std::vector<DefectPixel>& defects);
+    // adds a defect without rebuilding the index, returns false if it is
+    // outside the sensor or already there
+    bool Insert(int x, int y);
+    bool Find(int x, int y) const;
+    void clear();
+
+    const_iterator begin() const { return m_defects.begin(); }
+    const_iterator end() const { return m_defects.end(); }
+    size_t size() const { return m_defects.size(); }
+    bool empty() const { return m_defects.empty(); }
+
+    // defects in row y, in increasing x
+    const_iterator RowBegin(int y) const;
+    const_iterator RowEnd(int y) const;
+    unsigned int NeighborMask(const_iterator it) const { return m_neighbors[it - m_defects.begin()]; }
+};
+
+// Replaces the defects inside the rectangle (rx, ry, rw, rh) of an image that
+// is width pixels wide with the median of their good neighbors, taking the
+// neighbors from inside the rectangle too
+extern void RemoveDefectsRect(unsigned short *img, int width, const DefectIndex& defects,
+    int rx, int ry, int rw, int rh);
+
+#endif
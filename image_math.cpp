@@ -34,6 +34,8 @@
 
 #include "phd.h"
 #include "image_math.h"
+#include "image_kernels.h"
+#include "parallel_for.h"
 
 #include <wx/wfstream.h>
 #include <wx/txtstrm.h>
@@ -76,41 +78,46 @@ double CalcSlope(const ArrayOfDbl& y)
     return (n * s_xy - (s_x * s_y)) / (n * s_xx - (s_x * s_x));
 }
 
-bool QuickLRecon(usImage& img)
+struct QuickLReconTask : public ParallelTask
 {
-    // Does a simple debayer of luminance data only -- sliding 2x2 window
-    usImage tmp;
-    if (tmp.Init(img.Size))
-    {
-        pFrame->Alert(_("Memory allocation error"));
-        return true;
-    }
+    const usImage& img;
+    usImage& out;
+    int RX, RY, RW, RH;
+
+    QuickLReconTask(const usImage& img_, usImage& out_, int rx, int ry, int rw, int rh)
+        : img(img_), out(out_), RX(rx), RY(ry), RW(rw), RH(rh) { }
+
+    void Run(int rowBegin, int rowEnd);
+};
 
+void QuickLReconTask::Run(int rowBegin, int rowEnd)
+{
     int const W = img.Size.GetWidth();
-    int RX, RY, RW, RH;
-    if (img.Subframe.IsEmpty())
-    {
-        RX = RY = 0;
-        RW = img.Size.GetWidth();
-        RH = img.Size.GetHeight();
-    }
-    else
-    {
-        RX = img.Subframe.GetX();
-        RY = img.Subframe.GetY();
-        RW = img.Subframe.GetWidth();
-        RH = img.Subframe.GetHeight();
-        tmp.Clear();
-    }
 
 #define IX(x_, y_) ((RY + (y_)) * W + RX + (x_))
 
     unsigned short *d;
     unsigned int t;
 
-    for (int y = 0; y <= RH - 2; y++)
+    for (int y = rowBegin; y < rowEnd; y++)
     {
-        d = &tmp.ImageData[IX(0, y)];
+        d = &out.ImageData[IX(0, y)];
+
+        if (y == RH - 1)
+        {
+            // last row
+
+            for (int x = 0; x <= RW - 2; x++)
+            {
+                t  = img.ImageData[IX(x    , RH - 1)];
+                t += img.ImageData[IX(x + 1, RH - 1)];
+                *d++ = (unsigned short)(t >> 1);
+            }
+
+            // bottom-right pixel
+            *d = img.ImageData[IX(RW - 1, RH - 1)];
+            continue;
+        }
 
         for (int x = 0; x <= RW - 2; x++)
         {
@@ -127,21 +134,40 @@ bool QuickLRecon(usImage& img)
         *d = (unsigned short)(t >> 1);
     }
 
-    // last row
+#undef IX
+}
 
-    d = &tmp.ImageData[IX(0, RH - 1)];
+bool QuickLRecon(usImage& img)
+{
+    TraceScope trace(TRACE_NOISE_REDUCTION);
 
-    for (int x = 0; x <= RW - 2; x++)
+    // Does a simple debayer of luminance data only -- sliding 2x2 window
+    usImage tmp;
+    if (tmp.Init(img.Size))
     {
-        t  = img.ImageData[IX(x    , RH - 1)];
-        t += img.ImageData[IX(x + 1, RH - 1)];
-        *d++ = (unsigned short)(t >> 1);
+        pFrame->Alert(_("Memory allocation error"));
+        return true;
     }
 
-    // bottom-right pixel
-    *d = img.ImageData[IX(RW - 1, RH - 1)];
+    int RX, RY, RW, RH;
+    if (img.Subframe.IsEmpty())
+    {
+        RX = RY = 0;
+        RW = img.Size.GetWidth();
+        RH = img.Size.GetHeight();
+    }
+    else
+    {
+        RX = img.Subframe.GetX();
+        RY = img.Subframe.GetY();
+        RW = img.Subframe.GetWidth();
+        RH = img.Subframe.GetHeight();
+        tmp.Clear();
+    }
 
-#undef IX
+    // each row reads the row below it from the unmodified source image
+    QuickLReconTask task(img, tmp, RX, RY, RW, RH);
+    ParallelFor::Run(task, RH, RW);
 
     img.SwapImageData(tmp);
     return false;
@@ -149,6 +175,8 @@ bool QuickLRecon(usImage& img)
 
 bool Median3(usImage& img)
 {
+    TraceScope trace(TRACE_NOISE_REDUCTION);
+
     usImage tmp;
     tmp.Init(img.Size);
 
@@ -168,365 +196,34 @@ bool Median3(usImage& img)
     return err;
 }
 
-inline static void swap(unsigned short& a, unsigned short& b)
+struct Median3Task : public ParallelTask
 {
-    unsigned short const t = a;
-    a = b;
-    b = t;
-}
+    unsigned short *dst;
+    const unsigned short *src;
+    int W;
+    const wxRect& rect;
 
-inline static unsigned short median9(const unsigned short l[9])
-{
-    unsigned short l0 = l[0], l1 = l[1], l2 = l[2], l3 = l[3], l4 = l[4];
-    unsigned short x;
-    x = l[5];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-    if (x < l3) swap(x, l3);
-    if (x < l4) swap(x, l4);
-    x = l[6];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-    if (x < l3) swap(x, l3);
-    if (x < l4) swap(x, l4);
-    x = l[7];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-    if (x < l3) swap(x, l3);
-    if (x < l4) swap(x, l4);
-    x = l[8];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-    if (x < l3) swap(x, l3);
-    if (x < l4) swap(x, l4);
-
-    if (l1 > l0) l0 = l1;
-    if (l2 > l0) l0 = l2;
-    if (l3 > l0) l0 = l3;
-    if (l4 > l0) l0 = l4;
-
-    return l0;
-}
-
-inline static unsigned short median8(const unsigned short l[8])
-{
-    unsigned short l0 = l[0], l1 = l[1], l2 = l[2], l3 = l[3], l4 = l[4];
-    unsigned short x;
-
-    x = l[5];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-    if (x < l3) swap(x, l3);
-    if (x < l4) swap(x, l4);
-    x = l[6];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-    if (x < l3) swap(x, l3);
-    if (x < l4) swap(x, l4);
-    x = l[7];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-    if (x < l3) swap(x, l3);
-    if (x < l4) swap(x, l4);
-
-    if (l2 > l0) swap(l2, l0);
-    if (l2 > l1) swap(l2, l1);
-
-    if (l3 > l0) swap(l3, l0);
-    if (l3 > l1) swap(l3, l1);
-
-    if (l4 > l0) swap(l4, l0);
-    if (l4 > l1) swap(l4, l1);
-
-    return (unsigned short)(((unsigned int) l0 + (unsigned int) l1) / 2);
-}
-
-inline static unsigned short median6(const unsigned short l[6])
-{
-    unsigned short l0 = l[0], l1 = l[1], l2 = l[2], l3 = l[3];
-    unsigned short x;
-
-    x = l[4];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-    if (x < l3) swap(x, l3);
-    x = l[5];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-    if (x < l3) swap(x, l3);
-
-    if (l2 > l0) swap(l2, l0);
-    if (l2 > l1) swap(l2, l1);
-
-    if (l3 > l0) swap(l3, l0);
-    if (l3 > l1) swap(l3, l1);
-
-    return (unsigned short)(((unsigned int) l0 + (unsigned int) l1) / 2);
-}
-
-inline static unsigned short median5(const unsigned short l[5])
-{
-    unsigned short l0 = l[0], l1 = l[1], l2 = l[2];
-    unsigned short x;
-    x = l[3];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-    x = l[4];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-
-    if (l1 > l0) l0 = l1;
-    if (l2 > l0) l0 = l2;
-
-    return l0;
-}
-
-inline static unsigned short median4(const unsigned short l[4])
-{
-    unsigned short l0 = l[0], l1 = l[1], l2 = l[2];
-    unsigned short x;
-    x = l[3];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-
-    if (l2 > l0) swap(l2, l0);
-    if (l2 > l1) swap(l2, l1);
-
-    return (unsigned short)(((unsigned int) l0 + (unsigned int) l1) / 2);
-}
-
-inline static unsigned short median3(const unsigned short l[3])
-{
-    unsigned short l0 = l[0], l1 = l[1], l2 = l[2];
-    if (l2 < l0) swap(l2, l0);
-    if (l2 < l1) swap(l2, l1);
-    if (l1 > l0) l0 = l1;
-    return l0;
-}
+    Median3Task(unsigned short *dst_, const unsigned short *src_, int width, const wxRect& rect_)
+        : dst(dst_), src(src_), W(width), rect(rect_) { }
 
-bool Median3(unsigned short *dst, const unsigned short *src, const wxSize& size, const wxRect& rect)
-{
-    int const W = size.GetWidth();
-    int const RX = rect.GetX();
-    int const RY = rect.GetY();
-    int const RW = rect.GetWidth();
-    int const RH = rect.GetHeight();
-
-    unsigned short a[9];
-    unsigned short *d;
-
-#define IX(x_, y_) ((RY + (y_)) * W + RX + (x_))
-
-    // top row
-    d = &dst[IX(0, 0)];
-
-    // top-left corner
-    a[0] = src[IX(0, 0)];
-    a[1] = src[IX(1, 0)];
-    a[2] = src[IX(0, 1)];
-    a[3] = src[IX(1, 1)];
-    *d++ = median4(a);
-
-    // top row middle pixels
-    for (int x = 1; x <= RW - 2; x++)
-    {
-        a[0] = src[IX(x - 1, 0)];
-        a[1] = src[IX(x,     0)];
-        a[2] = src[IX(x + 1, 0)];
-        a[3] = src[IX(x - 1, 1)];
-        a[4] = src[IX(x,     1)];
-        a[5] = src[IX(x + 1, 1)];
-        *d++ = median6(a);
-    }
-
-    // top-right corner
-    a[0] = src[IX(RW - 2, 0)];
-    a[1] = src[IX(RW - 1, 0)];
-    a[2] = src[IX(RW - 2, 1)];
-    a[3] = src[IX(RW - 1, 1)];
-    *d = median4(a);
-
-    for (int y = 1; y <= RH - 2; y++)
+    void Run(int rowBegin, int rowEnd)
     {
-        d = &dst[IX(0, y)];
-
-        // leftmost pixel
-        a[0] = src[IX(0, y - 1)];
-        a[1] = src[IX(1, y - 1)];
-        a[2] = src[IX(0, y    )];
-        a[3] = src[IX(1, y    )];
-        a[4] = src[IX(0, y + 1)];
-        a[5] = src[IX(1, y + 1)];
-        *d++ = median6(a);
-
-        for (int x = 1; x <= RW - 2; x++)
+        for (int y = rowBegin; y < rowEnd; y++)
         {
-            a[0] = src[IX(x - 1, y - 1)];
-            a[1] = src[IX(x    , y - 1)];
-            a[2] = src[IX(x + 1, y - 1)];
-            a[3] = src[IX(x - 1, y    )];
-            a[4] = src[IX(x    , y    )];
-            a[5] = src[IX(x + 1, y    )];
-            a[6] = src[IX(x - 1, y + 1)];
-            a[7] = src[IX(x    , y + 1)];
-            a[8] = src[IX(x + 1, y + 1)];
-            *d++ = median9(a);
+            Median3Row(&dst[(rect.GetY() + y) * W + rect.GetX()], src, W,
+                rect.GetX(), rect.GetY(), rect.GetWidth(), rect.GetHeight(), y);
         }
-
-        // rightmost pixel
-        a[0] = src[IX(RW - 2, y - 1)];
-        a[1] = src[IX(RW - 1, y - 1)];
-        a[2] = src[IX(RW - 2, y    )];
-        a[3] = src[IX(RW - 1, y    )];
-        a[4] = src[IX(RW - 2, y + 1)];
-        a[5] = src[IX(RW - 1, y + 1)];
-        *d++ = median6(a);
-    }
-
-    // bottom row
-    d = &dst[IX(0, RH - 1)];
-
-    // bottom-left corner
-    a[0] = src[IX(0, RH - 2)];
-    a[1] = src[IX(1, RH - 2)];
-    a[2] = src[IX(0, RH - 1)];
-    a[3] = src[IX(1, RH - 1)];
-    *d++ = median4(a);
-
-    // bottom row middle pixels
-    for (int x = 1; x <= RW - 2; x++)
-    {
-        a[0] = src[IX(x - 1, RH - 2)];
-        a[1] = src[IX(x    , RH - 2)];
-        a[2] = src[IX(x + 1, RH - 2)];
-        a[3] = src[IX(x - 1, RH - 1)];
-        a[4] = src[IX(x    , RH - 1)];
-        a[5] = src[IX(x + 1, RH - 1)];
-        *d++ = median6(a);
     }
+};
 
-    // bottom-right corner
-    a[0] = src[IX(RW - 2, RH - 2)];
-    a[1] = src[IX(RW - 1, RH - 2)];
-    a[2] = src[IX(RW - 2, RH - 1)];
-    a[3] = src[IX(RW - 1, RH - 1)];
-    *d = median4(a);
-
-#undef IX
-
-    return false;
-}
-
-static unsigned short MedianBorderingPixels(const usImage& img, int x, int y)
+bool Median3(unsigned short *dst, const unsigned short *src, const wxSize& size, const wxRect& rect)
 {
-    unsigned short array[8];
-    int const xsize = img.Size.GetWidth();
-    int const ysize = img.Size.GetHeight();
-
-    if (x > 0 && y > 0 && x < xsize - 1 && y < ysize - 1)
-    {
-        array[0] = img.ImageData[(x-1) + (y-1) * xsize];
-        array[1] = img.ImageData[(x)   + (y-1) * xsize];
-        array[2] = img.ImageData[(x+1) + (y-1) * xsize];
-        array[3] = img.ImageData[(x-1) + (y)   * xsize];
-        array[4] = img.ImageData[(x+1) + (y)   * xsize];
-        array[5] = img.ImageData[(x-1) + (y+1) * xsize];
-        array[6] = img.ImageData[(x)   + (y+1) * xsize];
-        array[7] = img.ImageData[(x+1) + (y+1) * xsize];
-        return median8(array);
-    }
-
-    if (x == 0 && y > 0 && y < ysize - 1)
-    {
-        // On left edge
-        array[0] = img.ImageData[(x)     + (y - 1) * xsize];
-        array[1] = img.ImageData[(x)     + (y + 1) * xsize];
-        array[2] = img.ImageData[(x + 1) + (y - 1) * xsize];
-        array[3] = img.ImageData[(x + 1) + (y)     * xsize];
-        array[4] = img.ImageData[(x + 1) + (y + 1) * xsize];
-        return median5(array);
-    }
-
-    if (x == xsize - 1 && y > 0 && y < ysize - 1)
-    {
-        // On right edge
-        array[0] = img.ImageData[(x)     + (y - 1) * xsize];
-        array[1] = img.ImageData[(x)     + (y + 1) * xsize];
-        array[2] = img.ImageData[(x - 1) + (y - 1) * xsize];
-        array[3] = img.ImageData[(x - 1) + (y)     * xsize];
-        array[4] = img.ImageData[(x - 1) + (y + 1) * xsize];
-        return median5(array);
-    }
-
-    if (y == 0 && x > 0 && x < xsize - 1)
-    {
-        // On bottom edge
-        array[0] = img.ImageData[(x - 1) + (y)     * xsize];
-        array[1] = img.ImageData[(x - 1) + (y + 1) * xsize];
-        array[2] = img.ImageData[(x)     + (y + 1) * xsize];
-        array[3] = img.ImageData[(x + 1) + (y)     * xsize];
-        array[4] = img.ImageData[(x + 1) + (y + 1) * xsize];
-        return median5(array);
-    }
-
-    if (y == ysize - 1 && x > 0 && x < xsize - 1)
-    {
-        // On top edge
-        array[0] = img.ImageData[(x - 1) + (y)     * xsize];
-        array[1] = img.ImageData[(x - 1) + (y - 1) * xsize];
-        array[2] = img.ImageData[(x)     + (y - 1) * xsize];
-        array[3] = img.ImageData[(x + 1) + (y)     * xsize];
-        array[4] = img.ImageData[(x + 1) + (y - 1) * xsize];
-        return median5(array);
-    }
-
-    if (x == 0 && y == 0)
-    {
-        // At lower left corner
-        array[0] = img.ImageData[(x + 1) + (y)     * xsize];
-        array[1] = img.ImageData[(x)     + (y + 1) * xsize];
-        array[2] = img.ImageData[(x + 1) + (y + 1) * xsize];
-    }
-    else if (x == 0 && y == ysize - 1)
-    {
-        // At upper left corner
-        array[0] = img.ImageData[(x + 1) + (y)     * xsize];
-        array[1] = img.ImageData[(x)     + (y - 1) * xsize];
-        array[2] = img.ImageData[(x + 1) + (y - 1) * xsize];
-    }
-    else if (x == xsize - 1 && y == ysize - 1)
-    {
-        // At upper right corner
-        array[0] = img.ImageData[(x - 1) + (y)     * xsize];
-        array[1] = img.ImageData[(x)     + (y - 1) * xsize];
-        array[2] = img.ImageData[(x - 1) + (y - 1) * xsize];
-    }
-    else if (x == xsize - 1 && y == 0)
-    {
-        // At lower right corner
-        array[0] = img.ImageData[(x - 1) + (y)     * xsize];
-        array[1] = img.ImageData[(x)     + (y + 1) * xsize];
-        array[2] = img.ImageData[(x - 1) + (y + 1) * xsize];
-    }
-    else
-    {
-        // unreachable
-        return 0;
-    }
+    // rows at the edge of a band read their neighbors from src, so the bands
+    // can be filtered independently
+    Median3Task task(dst, src, size.GetWidth(), rect);
+    ParallelFor::Run(task, rect.GetHeight(), rect.GetWidth());
 
-    return median3(array);
+    return false;
 }
 
 bool SquarePixels(usImage& img, float xsize, float ysize)
@@ -570,70 +267,115 @@ bool SquarePixels(usImage& img, float xsize, float ysize)
     return false;
 }
 
-bool Subtract(usImage& light, const usImage& dark)
+struct SubtractTask : public ParallelTask
 {
-    if (!light.ImageData || !dark.ImageData)
-        return true;
-    if (light.Size != dark.Size)
-        return true;
+    usImage& light;
+    const usImage& dark;
+    unsigned int left, top, width;
+    unsigned short pedestal;
+    unsigned char *deferred;    // rows that would clip, NULL to only find the minimum
+    wxCriticalSection lock;
+    int mindiff;
+
+    SubtractTask(usImage& light_, const usImage& dark_, const wxRect& rect, unsigned short pedestal_, unsigned char *deferred_)
+        : light(light_), dark(dark_), left(rect.GetLeft()), top(rect.GetTop()), width(rect.GetWidth()),
+          pedestal(pedestal_), deferred(deferred_), mindiff(65535) { }
+
+    void Run(int rowBegin, int rowEnd);
+};
 
-    unsigned int left, top, width, height;
-    if (!light.Subframe.IsEmpty())
+void SubtractTask::Run(int rowBegin, int rowEnd)
+{
+    int bandMin = 65535;
+
+    if (deferred)
     {
-        left = light.Subframe.GetLeft();
-        width = light.Subframe.GetWidth();
-        top = light.Subframe.GetTop();
-        height = light.Subframe.GetHeight();
+        bandMin = SubtractDarkRows(&light.Pixel(left, top + rowBegin), &dark.Pixel(left, top + rowBegin),
+            light.Size.GetWidth(), width, rowEnd - rowBegin, pedestal, deferred + rowBegin);
     }
     else
     {
-        left = top = 0;
-        width = light.Size.GetWidth();
-        height = light.Size.GetHeight();
-    }
-
-    int mindiff = 65535;
-
-    unsigned short *pl0 = &light.Pixel(left, top);
-    const unsigned short *pd0 = &dark.Pixel(left, top);
-    for (unsigned int r = 0; r < height;
-         r++, pl0 += light.Size.GetWidth(), pd0 += light.Size.GetWidth())
-    {
-        unsigned short *const endl = pl0 + width;
-        unsigned short *pl;
-        const unsigned short *pd;
-        for (pl = pl0, pd = pd0; pl < endl; pl++, pd++)
+        for (int r = rowBegin; r < rowEnd; r++)
         {
-            int diff = (int) *pl - (int) *pd;
-            if (diff < mindiff)
-                mindiff = diff;
+            int rowMin = DarkMinDiffRow(&light.Pixel(left, top + r), &dark.Pixel(left, top + r), width);
+            if (rowMin < bandMin)
+                bandMin = rowMin;
         }
     }
 
-    int offset = 0;
-    if (mindiff < 0) // dark was lighter than light
-        offset = -mindiff;
+    wxCriticalSectionLocker lck(lock);
+    if (bandMin < mindiff)
+        mindiff = bandMin;
+}
+
+static wxRect SubtractRect(const usImage& light)
+{
+    // only the subframe rows hold image data
+    if (!light.Subframe.IsEmpty())
+        return light.Subframe;
+    return wxRect(light.Size);
+}
+
+// Single pass subtraction with a pedestal: light - dark + *pedestal, clamped to
+// [0, 65535]. If the pedestal is too low for this frame it is raised before any
+// pixel is clipped at zero: the rows that would clip are held back, the rows
+// already written are raised by the difference, and the new pedestal is left
+// in *pedestal for the next frames.
+bool SubtractPedestal(usImage& light, const usImage& dark, unsigned short *pedestal)
+{
+    if (!light.ImageData || !dark.ImageData)
+        return true;
+    if (light.Size != dark.Size)
+        return true;
+
+    wxRect rect(SubtractRect(light));
+    if (rect.IsEmpty())
+        return false;
+
+    std::vector<unsigned char> deferred(rect.GetHeight());
+    SubtractTask task(light, dark, rect, *pedestal, &deferred[0]);
+    ParallelFor::Run(task, rect.GetHeight(), rect.GetWidth());
 
-    pl0 = &light.Pixel(left, top);
-    pd0 = &dark.Pixel(left, top);
-    for (unsigned int r = 0; r < height;
-         r++, pl0 += light.Size.GetWidth(), pd0 += light.Size.GetWidth())
+    if (task.mindiff + (int) *pedestal < 0)
     {
-        unsigned short *const endl = pl0 + width;
-        unsigned short *pl;
-        const unsigned short *pd;
-        for (pl = pl0, pd = pd0; pl < endl; pl++, pd++)
-        {
-            int newval = (int) *pl - (int) *pd + offset;
-            if (newval < 0) newval = 0; // shouldn't hit this...
-            else if (newval > 65535) newval = 65535;
-            *pl = (unsigned short) newval;
-        }
+        unsigned short newPedestal = DarkPedestal(task.mindiff);
+        Debug.AddLine("SubtractDark: dark exceeds light by %d, pedestal raised from %u to %u",
+            -task.mindiff, *pedestal, newPedestal);
+
+        FinishDarkRows(&light.Pixel(rect.GetLeft(), rect.GetTop()), &dark.Pixel(rect.GetLeft(), rect.GetTop()),
+            light.Size.GetWidth(), rect.GetWidth(), rect.GetHeight(), *pedestal, newPedestal, &deferred[0]);
+        *pedestal = newPedestal;
     }
 
     return false;
 }
 
+// Subtracts the dark, adding the smallest offset that keeps every pixel
+// non-negative. Finding the offset takes an extra read-only pass.
+bool Subtract(usImage& light, const usImage& dark, int *pOffset)
+{
+    if (!light.ImageData || !dark.ImageData)
+        return true;
+    if (light.Size != dark.Size)
+        return true;
+
+    wxRect rect(SubtractRect(light));
+
+    // find the offset that keeps every pixel non-negative, then subtract
+    SubtractTask minTask(light, dark, rect, 0, NULL);
+    ParallelFor::Run(minTask, rect.GetHeight(), rect.GetWidth());
+
+    int offset = 0;
+    if (minTask.mindiff < 0) // dark was lighter than light
+        offset = -minTask.mindiff;
+
+    if (pOffset)
+        *pOffset = offset;
+
+    unsigned short pedestal = (unsigned short) offset;
+    return SubtractPedestal(light, dark, &pedestal);
+}
+
 inline static unsigned short histo_median(unsigned short histo1[256], unsigned short histo2[65536], int n)
 {
     n /= 2;
@@ -653,15 +395,31 @@ inline static unsigned short histo_median(unsigned short histo1[256], unsigned s
     return i;
 }
 
-static void MedianFilter(usImage& dst, const usImage& src, int halfWidth)
+struct MedianFilterTask : public ParallelTask
 {
-    dst.Init(src.Size);
-    unsigned short *d = &dst.ImageData[0];
+    usImage& dst;
+    const usImage& src;
+    int halfWidth;
+
+    MedianFilterTask(usImage& dst_, const usImage& src_, int halfWidth_)
+        : dst(dst_), src(src_), halfWidth(halfWidth_) { }
+
+    void Run(int rowBegin, int rowEnd);
+};
 
+void MedianFilterTask::Run(int rowBegin, int rowEnd)
+{
     int const width = src.Size.GetWidth();
     int const height = src.Size.GetHeight();
 
-    for (int y = 0; y < height; y++)
+    unsigned short *d = &dst.ImageData[rowBegin * width];
+
+    // each band has its own histograms; the window rows above and below the
+    // band are read from src
+    std::vector<unsigned short> histo1(256);
+    std::vector<unsigned short> histo2(65536);
+
+    for (int y = rowBegin; y < rowEnd; y++)
     {
         int top = std::max(0, y - halfWidth);
         int bot = std::min(y + halfWidth, height - 1);
@@ -673,10 +431,8 @@ static void MedianFilter(usImage& dst, const usImage& src, int halfWidth)
         // reinitialize the histogram
 
         // initialize 2-level histogram
-        unsigned short histo1[256];
-        unsigned short histo2[65536];
-        memset(&histo1[0], 0, sizeof(histo1));
-        memset(&histo2[0], 0, sizeof(histo2));
+        std::fill(histo1.begin(), histo1.end(), 0);
+        std::fill(histo2.begin(), histo2.end(), 0);
 
         for (int j = top; j <= bot; j++)
         {
@@ -690,7 +446,7 @@ static void MedianFilter(usImage& dst, const usImage& src, int halfWidth)
         unsigned int n = (right - left + 1) * (bot - top + 1);
 
         // read off first value for this row
-        *d++ = histo_median(histo1, histo2, n);
+        *d++ = histo_median(&histo1[0], &histo2[0], n);
 
         // loop across remaining columns for this row
         for (int i = 1; i < width; i++)
@@ -722,65 +478,112 @@ static void MedianFilter(usImage& dst, const usImage& src, int halfWidth)
                 n += (bot - top + 1);
             }
 
-            *d++ = histo_median(histo1, histo2, n);
+            *d++ = histo_median(&histo1[0], &histo2[0], n);
         }
     }
 }
 
+static void MedianFilter(usImage& dst, const usImage& src, int halfWidth)
+{
+    dst.Init(src.Size);
+
+    MedianFilterTask task(dst, src, halfWidth);
+    ParallelFor::Run(task, src.Size.GetHeight(), src.Size.GetWidth() * (2 * halfWidth + 1));
+}
+
+// Histogram of the pixel values in a window, built in bands and merged
+struct HistogramTask : public ParallelTask
+{
+    const usImage& img;
+    const wxRect& win;
+    wxCriticalSection lock;
+    std::vector<unsigned int>& histo;
+
+    HistogramTask(const usImage& img_, const wxRect& win_, std::vector<unsigned int>& histo_)
+        : img(img_), win(win_), histo(histo_) { }
+
+    void Run(int rowBegin, int rowEnd);
+};
+
+void HistogramTask::Run(int rowBegin, int rowEnd)
+{
+    std::vector<unsigned int> band(65536);
+
+    const unsigned short *p0 = &img.Pixel(win.GetLeft(), win.GetTop() + rowBegin);
+    for (int y = rowBegin; y < rowEnd; y++)
+    {
+        const unsigned short *end = p0 + win.GetWidth();
+        for (const unsigned short *p = p0; p < end; p++)
+            ++band[*p];
+        p0 += img.Size.GetWidth();
+    }
+
+    wxCriticalSectionLocker lck(lock);
+    for (unsigned int i = 0; i < 65536; i++)
+        histo[i] += band[i];
+}
+
 struct ImageStatsWork
 {
     ImageStats stats;
-    usImage temp;
+    std::vector<unsigned int> histo;
 };
 
 static void GetImageStats(ImageStatsWork& w, const usImage& img, const wxRect& win)
 {
-    w.temp.Init(img.Size);
+    w.histo.assign(65536, 0);
+
+    HistogramTask task(img, win, w.histo);
+    ParallelFor::Run(task, win.GetHeight(), win.GetWidth());
+
+    const std::vector<unsigned int>& histo = w.histo;
+    unsigned int winPixels = win.GetWidth() * win.GetHeight();
 
     // Determine the mean and standard deviation
-    double sum = 0.0;
-    double a = 0.0;
-    double q = 0.0;
-    double k = 1.0;
-    double km1 = 0.0;
+    wxULongLong_t sum = 0;
+    for (unsigned int i = 0; i < 65536; i++)
+        sum += (wxULongLong_t) histo[i] * i;
 
-    const unsigned short *p0 = &img.Pixel(win.GetLeft(), win.GetTop());
-    unsigned short *dst = &w.temp.ImageData[0];
-    for (int y = 0; y < win.GetHeight(); y++)
+    double const mean = (double) sum / (double) winPixels;
+    double q = 0.0;
+    for (unsigned int i = 0; i < 65536; i++)
     {
-        const unsigned short *end = p0 + win.GetWidth();
-        for (const unsigned short *p = p0; p < end; p++)
+        if (histo[i])
         {
-            *dst++ = *p;
-            double const x = (double) *p;
-            sum += x;
-            double const a0 = a;
-            a += (x - a) / k;
-            q += (x - a0) * (x - a);
-            km1 = k;
-            k += 1.0;
+            double const dx = (double) i - mean;
+            q += (double) histo[i] * dx * dx;
         }
-        p0 += img.Size.GetWidth();
     }
 
-    w.stats.mean = sum / km1;
-    w.stats.stdev = sqrt(q / km1);
+    w.stats.mean = mean;
+    w.stats.stdev = sqrt(q / (double) winPixels);
 
-    int winPixels = win.GetWidth() * win.GetHeight();
-    unsigned short *tmp = &w.temp.ImageData[0];
-    std::nth_element(tmp, tmp + winPixels / 2, tmp + winPixels);
+    // the median is the value at position winPixels / 2 in sorted order
+    unsigned int const rank = winPixels / 2;
+    unsigned int cum = 0;
+    unsigned int median;
+    for (median = 0; median < 65535; median++)
+    {
+        cum += histo[median];
+        if (cum > rank)
+            break;
+    }
 
-    w.stats.median = tmp[winPixels / 2];
+    w.stats.median = median;
 
-    // replace each pixel with the absolute deviation from the median
-    unsigned short *p = tmp;
-    for (int i = 0; i < winPixels; i++)
+    // the number of pixels at absolute deviation d from the median is
+    // histo[median - d] + histo[median + d]
+    cum = histo[median];
+    unsigned int mad = 0;
+    while (cum <= rank)
     {
-        unsigned short ad = (unsigned short) std::abs((int) *p - (int) w.stats.median);
-        *p++ = ad;
+        ++mad;
+        if (mad <= median)
+            cum += histo[median - mad];
+        if (median + mad < 65536)
+            cum += histo[median + mad];
     }
-    std::nth_element(tmp, tmp + winPixels / 2, tmp + winPixels);
-    w.stats.mad = tmp[winPixels / 2];
+    w.stats.mad = mad;
 }
 
 void DefectMapDarks::BuildFilteredDark()
@@ -973,7 +776,7 @@ int DefectMapBuilder::GetHotPixelCnt() const
     return m_impl->hotPxSelected;
 }
 
-inline static unsigned int emit_defects(DefectMap& defectMap, BadPxSet::const_iterator p0, BadPxSet::const_iterator p1, double stdev, int sign, bool verbose)
+inline static unsigned int emit_defects(std::vector<wxPoint>& defects, BadPxSet::const_iterator p0, BadPxSet::const_iterator p1, double stdev, int sign, bool verbose)
 {
     unsigned int cnt = 0;
     for (BadPxSet::const_iterator it = p0; it != p1; ++it, ++cnt)
@@ -983,7 +786,7 @@ inline static unsigned int emit_defects(DefectMap& defectMap, BadPxSet::const_it
             int v = sign * it->v;
             Debug.AddLine("DefectMap: defect @ (%d, %d) val = %d (%+.1f sigma)", it->x, it->y, v, stdev > 0.1 ? (double)v / stdev : 0.0);
         }
-        defectMap.push_back(wxPoint(it->x, it->y));
+        defects.push_back(wxPoint(it->x, it->y));
     }
     return cnt;
 }
@@ -1020,9 +823,10 @@ void DefectMapBuilder::BuildDefectMap(DefectMap& defectMap, bool verbose) const
 
     FindThresh(m_impl);
 
-    defectMap.clear();
-    unsigned int nr_cold = emit_defects(defectMap, m_impl->coldPxThresh, m_impl->coldPx.end(), stats.stdev, -1, verbose);
-    unsigned int nr_hot = emit_defects(defectMap, m_impl->hotPxThresh, m_impl->hotPx.end(), stats.stdev, +1, verbose);
+    std::vector<wxPoint> defects;
+    unsigned int nr_cold = emit_defects(defects, m_impl->coldPxThresh, m_impl->coldPx.end(), stats.stdev, -1, verbose);
+    unsigned int nr_hot = emit_defects(defects, m_impl->hotPxThresh, m_impl->hotPx.end(), stats.stdev, +1, verbose);
+    defectMap.SetDefects(defects);
 
     if (verbose) Debug.AddLine("New defect map created, count=%d (cold=%d, hot=%d)", defectMap.size(), nr_cold, nr_hot);
 }
@@ -1038,35 +842,14 @@ bool RemoveDefects(usImage& light, const DefectMap& defectMap)
     if (!light.ImageData)
         return true;
 
+    // Only the defects inside the subframe are corrected, and their neighbors are
+    // taken from inside the subframe too
+    wxRect rect(light.Size);
     if (!light.Subframe.IsEmpty())
-    {
-        // Step over each defect and replace the light value
-        // with the median of the surrounding pixels
-        for (DefectMap::const_iterator it = defectMap.begin(); it != defectMap.end(); ++it)
-        {
-            const wxPoint& pt = *it;
-            // Check to see if we are within the subframe before correcting the defect
-            if (light.Subframe.Contains(pt))
-            {
-                light.Pixel(pt.x, pt.y) = MedianBorderingPixels(light, pt.x, pt.y);
-            }
-        }
-    }
-    else
-    {
-        // Step over each defect and replace the light value
-        // with the median of the surrounding pixels
-        for (DefectMap::const_iterator it = defectMap.begin(); it != defectMap.end(); ++it)
-        {
-            int const x = it->x;
-            int const y = it->y;
+        rect.Intersect(light.Subframe);
 
-            if (x >= 0 && x < light.Size.GetWidth() && y >= 0 && y < light.Size.GetHeight())
-            {
-                light.Pixel(x, y) = MedianBorderingPixels(light, x, y);
-            }
-        }
-    }
+    RemoveDefectsRect(light.ImageData, light.Size.GetWidth(), defectMap.Index(),
+        rect.GetLeft(), rect.GetTop(), rect.GetWidth(), rect.GetHeight());
 
     return false;
 }
@@ -1184,15 +967,43 @@ DefectMap::DefectMap(int profileId)
 {
 }
 
+void DefectMap::clear()
+{
+    m_index.clear();
+}
+
+// defects outside the camera's sensor are dropped, so that a corrupt map file
+// cannot make the index arbitrarily large
+static void SetSensorSize(DefectIndex *index)
+{
+    if (pCamera && pCamera->DarkFrameSize() != UNDEFINED_FRAME_SIZE)
+        index->SetSensorSize(pCamera->DarkFrameSize().GetWidth(), pCamera->DarkFrameSize().GetHeight());
+}
+
+void DefectMap::SetDefects(const std::vector<wxPoint>& defects)
+{
+    std::vector<DefectPixel> pixels;
+    pixels.reserve(defects.size());
+    for (std::vector<wxPoint>::const_iterator it = defects.begin(); it != defects.end(); ++it)
+        pixels.push_back(DefectPixel(it->x, it->y));
+
+    SetSensorSize(&m_index);
+    unsigned int rejected = m_index.Assign(pixels);
+    if (rejected)
+        Debug.AddLine(wxString::Format("DefectMap: ignored %u defects outside the sensor", rejected));
+}
+
 bool DefectMap::FindDefect(const wxPoint& pt) const
 {
-    return std::find(begin(), end(), pt) != end();
+    return m_index.Find(pt.x, pt.y);
 }
 
 void DefectMap::AddDefect(const wxPoint& pt)
 {
     // first add the point
-    push_back(pt);
+    SetSensorSize(&m_index);
+    if (!m_index.Insert(pt.x, pt.y))
+        return;
 
     wxString filename = DefectMapFileName(m_profileId);
     wxFile file(filename, wxFile::write_append);
@@ -1233,6 +1044,7 @@ DefectMap *DefectMap::LoadDefectMap(int profileId)
     }
 
     DefectMap *defectMap = new DefectMap(profileId);
+    std::vector<wxPoint> defects;
 
     int linenum = 0;
     while (!inText.GetInputStream().Eof())
@@ -1251,7 +1063,7 @@ DefectMap *DefectMap::LoadDefectMap(int profileId)
         long x, y;
         if (s1.ToLong(&x) && s2.ToLong(&y))
         {
-            defectMap->push_back(wxPoint(x, y));
+            defects.push_back(wxPoint(x, y));
         }
         else
         {
@@ -1259,7 +1071,9 @@ DefectMap *DefectMap::LoadDefectMap(int profileId)
         }
     }
 
-    Debug.AddLine(wxString::Format("Loaded %d defects", defectMap->size()));
+    defectMap->SetDefects(defects);
+
+    Debug.AddLine(wxString::Format("Loaded %d defects", (int) defectMap->size()));
     return defectMap;
 }
 
@@ -36,11 +36,15 @@
 #ifndef IMAGE_MATH_INCLUDED
 #define IMAGE_MATH_INCLUDED
 
-class DefectMap : public std::vector<wxPoint>
+// The defect map of a profile, indexed by row (see DefectIndex)
+class DefectMap
 {
     int m_profileId;
+    DefectIndex m_index;
     DefectMap(int profileId);
 public:
+    typedef DefectIndex::const_iterator const_iterator;
+
     static void DeleteDefectMap(int profileId);
     static bool DefectMapExists(int profileId, bool showAlert = true);
     static DefectMap *LoadDefectMap(int profileId);
@@ -50,7 +54,15 @@ public:
     void Save(const wxArrayString& mapInfo) const;
     bool FindDefect(const wxPoint& pt) const;
     void AddDefect(const wxPoint& pt);
+    void SetDefects(const std::vector<wxPoint>& defects);
+
+    const_iterator begin() const { return m_index.begin(); }
+    const_iterator end() const { return m_index.end(); }
+    size_t size() const { return m_index.size(); }
+    bool empty() const { return m_index.empty(); }
+    void clear();
 
+    const DefectIndex& Index() const { return m_index; }
 };
 
 extern bool QuickLRecon(usImage& img);
@@ -58,7 +70,8 @@ extern bool Median3(unsigned short *dst, const unsigned short *src, const wxSize
 extern bool Median3(usImage& img);
 extern bool SquarePixels(usImage& img, float xsize, float ysize);
 extern int dbl_sort_func(double *first, double *second);
-extern bool Subtract(usImage& light, const usImage& dark);
+extern bool Subtract(usImage& light, const usImage& dark, int *offset = 0);
+extern bool SubtractPedestal(usImage& light, const usImage& dark, unsigned short *pedestal);
 extern double CalcSlope(const ArrayOfDbl& y);
 extern bool RemoveDefects(usImage& light, const DefectMap& defectMap);
 
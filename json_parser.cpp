@@ -54,11 +54,14 @@
  *  THE SOFTWARE.
  */
 
-#include "phd.h"
 #include "json_parser.h"
 
 #include <algorithm>
+#include <climits>
+#include <locale.h>
 #include <memory.h>
+#include <stdlib.h>
+#include <string>
 
 class block_allocator
 {
@@ -70,7 +73,17 @@ private:
         block *next;
     };
 
-    block *m_head;
+    enum
+    {
+        // blocks double in size up to this, so that large messages need
+        // few of them
+        MAX_BLOCKSIZE = 64 * 1024,
+        // reset() frees the blocks beyond this
+        MAX_KEPT = 256 * 1024,
+    };
+
+    block *m_head;      // blocks in use, the current one first
+    block *m_free;      // blocks kept by reset(), in the order they were allocated
     size_t m_blocksize;
 
     block_allocator(const block_allocator &);
@@ -86,40 +99,60 @@ public:
     // allocate memory
     void *malloc(size_t size);
 
-    // reset to empty state, keeping one allocated block
+    // reset to empty state, keeping the allocated blocks for reuse
     void reset();
 
     // free all allocated blocks
     void free();
 };
 
-block_allocator::block_allocator(size_t blocksize): m_head(0), m_blocksize(blocksize)
+block_allocator::block_allocator(size_t blocksize): m_head(0), m_free(0), m_blocksize(blocksize)
 {
 }
 
 block_allocator::~block_allocator()
 {
-    while (m_head)
+    block *lists[] = { m_head, m_free };
+    for (unsigned int i = 0; i < 2; i++)
     {
-        block *temp = m_head->next;
-        ::free(m_head);
-        m_head = temp;
+        block *b = lists[i];
+        while (b)
+        {
+            block *temp = b->next;
+            ::free(b);
+            b = temp;
+        }
     }
 }
 
 void block_allocator::reset()
 {
-    if (m_head)
+    // the blocks in use are listed newest first; put them back in front of
+    // the free list so that they are reused in the order they were allocated
+    while (m_head)
     {
-        block *b = m_head->next;
-        m_head->next = 0;
-        while (b)
+        block *b = m_head;
+        m_head = b->next;
+        b->used = sizeof(block);
+        b->next = m_free;
+        m_free = b;
+    }
+
+    // keep what a usual message needs, not what the largest one did
+    size_t kept = 0;
+    for (block **pb = &m_free; *pb; )
+    {
+        block *b = *pb;
+        if (kept + b->size <= MAX_KEPT)
+        {
+            kept += b->size;
+            pb = &b->next;
+        }
+        else
         {
-            block *t = b->next;
+            *pb = b->next;
             ::free(b);
-            b = t;
         }
-        m_head->used = sizeof(block);
     }
 }
 
@@ -127,18 +160,32 @@ void block_allocator::swap(block_allocator& rhs)
 {
     std::swap(m_blocksize, rhs.m_blocksize);
     std::swap(m_head, rhs.m_head);
+    std::swap(m_free, rhs.m_free);
 }
 
 void *block_allocator::malloc(size_t size)
 {
     if (!m_head || m_head->used + size > m_head->size)
     {
-        // calc needed size for allocation
-        size_t alloc_size = std::max(sizeof(block) + size, m_blocksize);
+        block *b;
+
+        if (m_free && m_free->size >= sizeof(block) + size)
+        {
+            // reuse a block kept by reset()
+            b = m_free;
+            m_free = b->next;
+        }
+        else
+        {
+            // calc needed size for allocation
+            size_t blocksize = m_head ? std::min(m_head->size * 2, (size_t) MAX_BLOCKSIZE) : m_blocksize;
+            size_t alloc_size = std::max(sizeof(block) + size, std::max(blocksize, m_blocksize));
+
+            // create new block
+            b = (block *)::malloc(alloc_size);
+            b->size = alloc_size;
+        }
 
-        // create new block
-        block *b = (block *)::malloc(alloc_size);
-        b->size = alloc_size;
         b->used = sizeof(block);
         b->next = m_head;
         m_head = b;
@@ -158,33 +205,6 @@ void block_allocator::free()
 // true if character represent a digit
 #define IS_DIGIT(c) (c >= '0' && c <= '9')
 
-// convert string to integer
-static char *atoi(char *first, char *last, int *out)
-{
-    int sign = 1;
-    if (first != last)
-    {
-        if (*first == '-')
-        {
-            sign = -1;
-            ++first;
-        }
-        else if (*first == '+')
-        {
-            ++first;
-        }
-    }
-
-    int result = 0;
-    for (; first != last && IS_DIGIT(*first); ++first)
-    {
-        result = 10 * result + (*first - '0');
-    }
-    *out = result * sign;
-
-    return first;
-}
-
 // convert hexadecimal string to unsigned integer
 static char *hatoui(char *first, char *last, unsigned int *out)
 {
@@ -215,91 +235,151 @@ static char *hatoui(char *first, char *last, unsigned int *out)
     return first;
 }
 
-// convert string to floating point
-static char *atof(char *first, char *last, float *out)
+// convert string to number: integers that fit in 64 bits become JSON_INT,
+// everything else a JSON_FLOAT with full double precision
+static char *parse_number(char *first, char *last, json_value *out)
 {
+    // powers of ten that are exact in a double
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+
+    char *it = first;
+
     // sign
-    float sign = 1;
-    if (first != last)
+    bool negative = false;
+    if (it != last && *it == '-')
     {
-        if (*first == '-')
-        {
-            sign = -1;
-            ++first;
-        }
-        else if (*first == '+')
-        {
-            ++first;
-        }
+        negative = true;
+        ++it;
     }
 
+    // up to 19 significant digits, scaled by 10^exponent
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool have_digits = false;
+    bool is_float = false;
+
     // integer part
-    float result = 0;
-    for (; first != last && IS_DIGIT(*first); ++first)
+    for (; it != last && IS_DIGIT(*it); ++it)
     {
-        result = 10 * result + (*first - '0');
+        have_digits = true;
+        if (digits < 19)
+        {
+            mantissa = 10 * mantissa + (*it - '0');
+            if (mantissa)
+                ++digits;
+        }
+        else
+        {
+            ++exponent;
+        }
     }
 
     // fraction part
-    if (first != last && *first == '.')
+    if (it != last && *it == '.')
     {
-        ++first;
+        ++it;
+        is_float = true;
 
-        float inv_base = 0.1f;
-        for (; first != last && IS_DIGIT(*first); ++first)
+        for (; it != last && IS_DIGIT(*it); ++it)
         {
-            result += (*first - '0') * inv_base;
-            inv_base *= 0.1f;
+            have_digits = true;
+            if (digits < 19)
+            {
+                mantissa = 10 * mantissa + (*it - '0');
+                if (mantissa)
+                    ++digits;
+                --exponent;
+            }
         }
     }
 
-    // result w\o exponent
-    result *= sign;
+    if (!have_digits)
+    {
+        return first;
+    }
 
     // exponent
-    bool exponent_negative = false;
-    int exponent = 0;
-    if (first != last && (*first == 'e' || *first == 'E'))
+    if (it != last && (*it == 'e' || *it == 'E'))
     {
-        ++first;
+        ++it;
+        is_float = true;
 
-        if (*first == '-')
+        bool exponent_negative = false;
+        if (it != last && (*it == '-' || *it == '+'))
         {
-            exponent_negative = true;
-            ++first;
+            exponent_negative = *it == '-';
+            ++it;
         }
-        else if (*first == '+')
+
+        if (it == last || !IS_DIGIT(*it))
         {
-            ++first;
+            return first;
         }
 
-        for (; first != last && IS_DIGIT(*first); ++first)
+        int e = 0;
+        for (; it != last && IS_DIGIT(*it); ++it)
         {
-            exponent = 10 * exponent + (*first - '0');
+            if (e < 100000)
+                e = 10 * e + (*it - '0');
         }
+        exponent += exponent_negative ? -e : e;
     }
 
-    if (exponent)
+    if (it != last)
     {
-        float power_of_ten = 10;
-        for (; exponent > 1; exponent--)
-        {
-            power_of_ten *= 10;
-        }
+        return it;
+    }
 
-        if (exponent_negative)
+    if (!is_float && exponent == 0)
+    {
+        if (!negative && mantissa <= (unsigned long long) LLONG_MAX)
         {
-            result /= power_of_ten;
+            out->type = JSON_INT;
+            out->int_value = (long long) mantissa;
+            return it;
         }
-        else
+        if (negative && mantissa <= (unsigned long long) LLONG_MAX + 1)
         {
-            result *= power_of_ten;
+            out->type = JSON_INT;
+            out->int_value = mantissa == (unsigned long long) LLONG_MAX + 1 ? LLONG_MIN : -(long long) mantissa;
+            return it;
         }
+        // too large for an integer, fall through
     }
 
-    *out = result;
+    double result;
 
-    return first;
+    if (mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22)
+    {
+        // both the mantissa and the power of ten are exact, so a single
+        // rounding gives the correctly rounded result
+        result = (double) mantissa;
+        if (exponent < 0)
+            result /= pow10[-exponent];
+        else
+            result *= pow10[exponent];
+        if (negative)
+            result = -result;
+    }
+    else
+    {
+        // long mantissas and large exponents are rare; leave them to strtod,
+        // which expects the decimal point of the current locale
+        std::string text(first, last);
+        char decimal_point = *localeconv()->decimal_point;
+        if (decimal_point != '.')
+            std::replace(text.begin(), text.end(), '.', decimal_point);
+        result = strtod(text.c_str(), 0);
+    }
+
+    out->type = JSON_FLOAT;
+    out->float_value = result;
+
+    return it;
 }
 
 static json_value *json_alloc(block_allocator *allocator)
@@ -355,6 +435,11 @@ static json_value *json_parse(char *source, const char **error_pos,
                 // create new value
                 json_value *object = json_alloc(allocator);
 
+                if (top && top->type == JSON_OBJECT && !name)
+                {
+                    JSON_ERROR(it, "Missing name");
+                }
+
                 // name
                 object->name = name;
                 name = 0;
@@ -592,26 +677,16 @@ static json_value *json_parse(char *source, const char **error_pos,
                 object->name = name;
                 name = 0;
 
-                object->type = JSON_INT;
-
                 char *first = it;
-                while (*it != '\x20' && *it != '\x9' && *it != '\xD' && *it != '\xA' && *it != ',' && *it != ']' && *it != '}')
+                while (*it && *it != '\x20' && *it != '\x9' && *it != '\xD' && *it != '\xA' && *it != ',' && *it != ']' && *it != '}')
                 {
-                    if (*it == '.' || *it == 'e' || *it == 'E')
-                    {
-                        object->type = JSON_FLOAT;
-                    }
                     ++it;
                 }
 
-                if (object->type == JSON_INT && atoi(first, it, &object->int_value) != it)
+                char *end = parse_number(first, it, object);
+                if (end != it)
                 {
-                    JSON_ERROR(first, "Bad integer number");
-                }
-
-                if (object->type == JSON_FLOAT && atof(first, it, &object->float_value) != it)
-                {
-                    JSON_ERROR(first, "Bad float number");
+                    JSON_ERROR(end, "Bad number");
                 }
 
                 json_append(top, object);
@@ -654,7 +729,7 @@ struct JsonParserImpl
     const char *error_desc;
     int error_line;
 
-    JsonParserImpl() : alloc(4096) { }
+    JsonParserImpl() : alloc(4096), root(0) { }
 };
 
 JsonParser::JsonParser()
@@ -674,6 +749,12 @@ bool JsonParser::Parse(char *str)
     return m_impl->root != 0;
 }
 
+void JsonParser::Reset()
+{
+    m_impl->alloc.reset();
+    m_impl->root = 0;
+}
+
 const char *JsonParser::ErrorPos() const
 {
     return m_impl->error_pos;
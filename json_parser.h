@@ -79,8 +79,8 @@ struct json_value
     union
     {
         char *string_value;
-        int int_value;
-        float float_value;
+        long long int_value;    // JSON_INT and JSON_BOOL
+        double float_value;     // JSON_FLOAT
     };
 
     json_type type;
@@ -98,8 +98,13 @@ public:
     JsonParser();
     ~JsonParser();
 
+    // parses str in place; the values point into it
     bool Parse(char *str);
 
+    // drops the parsed values, keeping the memory they used for the next
+    // Parse
+    void Reset();
+
     const char *ErrorPos() const;
     const char *ErrorDesc() const;
     int ErrorLine() const;
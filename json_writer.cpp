@@ -0,0 +1,314 @@
+/*
+ *  json_writer.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include "json_writer.h"
+
+#include <cmath>
+#include <locale.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+# define snprintf _snprintf
+#endif
+
+JsonWriter::JsonWriter()
+    : m_needComma(false)
+{
+    m_buf.reserve(512);
+}
+
+void JsonWriter::Reset()
+{
+    m_buf.clear();
+    m_needComma = false;
+}
+
+inline void JsonWriter::Separate()
+{
+    if (m_needComma)
+        m_buf += ',';
+    m_needComma = true;
+}
+
+JsonWriter& JsonWriter::BeginObject()
+{
+    Separate();
+    m_buf += '{';
+    m_needComma = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::EndObject()
+{
+    m_buf += '}';
+    m_needComma = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::BeginArray()
+{
+    Separate();
+    m_buf += '[';
+    m_needComma = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::EndArray()
+{
+    m_buf += ']';
+    m_needComma = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::Key(const char *name)
+{
+    Separate();
+    AppendString(m_buf, name, strlen(name));
+    m_buf += ':';
+    m_needComma = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::String(const char *s)
+{
+    return String(s, strlen(s));
+}
+
+JsonWriter& JsonWriter::String(const char *s, size_t len)
+{
+    Separate();
+    AppendString(m_buf, s, len);
+    return *this;
+}
+
+JsonWriter& JsonWriter::Int(long long v)
+{
+    Separate();
+    AppendInt(m_buf, v);
+    return *this;
+}
+
+JsonWriter& JsonWriter::Fixed(double v, int prec)
+{
+    Separate();
+    AppendFixed(m_buf, v, prec);
+    return *this;
+}
+
+JsonWriter& JsonWriter::Double(double v)
+{
+    Separate();
+    AppendDouble(m_buf, v);
+    return *this;
+}
+
+JsonWriter& JsonWriter::Bool(bool v)
+{
+    Separate();
+    m_buf += v ? "true" : "false";
+    return *this;
+}
+
+JsonWriter& JsonWriter::Null()
+{
+    Separate();
+    m_buf += "null";
+    return *this;
+}
+
+JsonWriter& JsonWriter::Raw(const char *json, size_t len)
+{
+    Separate();
+    m_buf.append(json, len);
+    return *this;
+}
+
+JsonWriter& JsonWriter::EndLine()
+{
+    m_buf += "\r\n";
+    m_needComma = false;
+    return *this;
+}
+
+void JsonWriter::AppendString(std::string& out, const char *s, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    out += '"';
+
+    // copy runs of characters that need no escape in one go
+    const char *run = s;
+    const char *end = s + len;
+
+    for (const char *p = s; p < end; p++)
+    {
+        unsigned char c = (unsigned char) *p;
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        out.append(run, p - run);
+        run = p + 1;
+
+        switch (c)
+        {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        default:
+            {
+                char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+                out.append(esc, sizeof(esc));
+            }
+            break;
+        }
+    }
+
+    out.append(run, end - run);
+    out += '"';
+}
+
+void JsonWriter::AppendInt(std::string& out, long long v)
+{
+    char buf[24];
+    char *p = buf + sizeof(buf);
+
+    // negate as unsigned so that LLONG_MIN works
+    unsigned long long u = v < 0 ? 0ULL - (unsigned long long) v : (unsigned long long) v;
+
+    do
+    {
+        *--p = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+
+    if (v < 0)
+        *--p = '-';
+
+    out.append(p, buf + sizeof(buf) - p);
+}
+
+// replaces the decimal point of the current locale by '.'
+static void AppendFormatted(std::string& out, const char *buf, int len)
+{
+    if (len <= 0)
+        return;
+
+    char point = *localeconv()->decimal_point;
+    size_t start = out.size();
+    out.append(buf, len);
+
+    if (point != '.')
+    {
+        for (size_t i = start; i < out.size(); i++)
+        {
+            if (out[i] == point)
+                out[i] = '.';
+        }
+    }
+}
+
+void JsonWriter::AppendFixed(std::string& out, double v, int prec)
+{
+    static const double POW10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+    enum { MAX_PREC = 9 };
+
+    if (!std::isfinite(v))
+    {
+        out += "null";
+        return;
+    }
+
+    if (prec < 0)
+        prec = 0;
+
+    double scaled = fabs(v) * (prec <= MAX_PREC ? POW10[prec] : 0.0);
+
+    // beyond what the integer conversion covers exactly, let the C library
+    // do it
+    if (prec > MAX_PREC || scaled >= 9.0e15)
+    {
+        char buf[400];
+        AppendFormatted(out, buf, snprintf(buf, sizeof(buf), "%.*f", prec, v));
+        return;
+    }
+
+    unsigned long long u = (unsigned long long)(scaled + 0.5);
+
+    char buf[32];
+    char *p = buf + sizeof(buf);
+
+    for (int i = 0; i < prec; i++)
+    {
+        *--p = (char)('0' + u % 10);
+        u /= 10;
+    }
+    if (prec > 0)
+        *--p = '.';
+
+    do
+    {
+        *--p = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+
+    // like printf, -0.0 and values rounding to zero keep their sign
+    if (std::signbit(v))
+        *--p = '-';
+
+    out.append(p, buf + sizeof(buf) - p);
+}
+
+void JsonWriter::AppendDouble(std::string& out, double v)
+{
+    if (!std::isfinite(v))
+    {
+        out += "null";
+        return;
+    }
+
+    // integral values are common and need no C library call
+    if (fabs(v) < 1e6 && v == floor(v))
+    {
+        AppendInt(out, (long long) v);
+        return;
+    }
+
+    char buf[32];
+    AppendFormatted(out, buf, snprintf(buf, sizeof(buf), "%g", v));
+}
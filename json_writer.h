@@ -0,0 +1,104 @@
+/*
+ *  json_writer.h
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef JSON_WRITER_INCLUDED
+#define JSON_WRITER_INCLUDED
+
+#include <stddef.h>
+#include <string>
+
+/*
+ * Writes JSON text into a UTF-8 byte buffer that is kept between messages,
+ * so that a message costs no allocation once the buffer has grown to the
+ * largest one.
+ *
+ *     JsonWriter w;
+ *     w.BeginObject().Key("Frame").Int(12).Key("dx").Fixed(dx, 3).EndObject().EndLine();
+ *     write(w.Data(), w.Size());
+ *     w.Reset();
+ *
+ * Numbers are formatted without the C library where possible, and always
+ * with a '.' decimal point whatever the locale. NaN and infinities, which
+ * JSON cannot represent, are written as null.
+ *
+ * Strings must be UTF-8. This only depends on the standard library.
+ */
+class JsonWriter
+{
+    std::string m_buf;
+    bool m_needComma;
+
+    void Separate();
+
+public:
+    JsonWriter();
+
+    // starts a new message, keeping the buffer
+    void Reset();
+
+    JsonWriter& BeginObject();
+    JsonWriter& EndObject();
+    JsonWriter& BeginArray();
+    JsonWriter& EndArray();
+
+    // member name, the value follows
+    JsonWriter& Key(const char *name);
+
+    JsonWriter& String(const char *s);
+    JsonWriter& String(const char *s, size_t len);
+    JsonWriter& Int(long long v);
+    JsonWriter& Fixed(double v, int prec);    // like "%.*f"
+    JsonWriter& Double(double v);             // like "%g"
+    JsonWriter& Bool(bool v);
+    JsonWriter& Null();
+    // a value that is already JSON text
+    JsonWriter& Raw(const char *json, size_t len);
+    JsonWriter& Raw(const std::string& json) { return Raw(json.data(), json.size()); }
+
+    // the message terminator of the event server protocol
+    JsonWriter& EndLine();
+
+    const char *Data() const { return m_buf.data(); }
+    size_t Size() const { return m_buf.size(); }
+    const std::string& Str() const { return m_buf; }
+
+    // the formatting used by the writer, for callers that build the text
+    // themselves
+    static void AppendString(std::string& out, const char *s, size_t len);
+    static void AppendInt(std::string& out, long long v);
+    static void AppendFixed(std::string& out, double v, int prec);
+    static void AppendDouble(std::string& out, double v);
+};
+
+#endif
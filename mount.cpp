@@ -34,7 +34,6 @@
  */
 
 #include "phd.h"
-#include "guiding_assistant.h"
 
 #include <wx/tokenzr.h>
 
@@ -466,6 +465,7 @@ Mount::Mount(void)
 {
     m_connected = false;
     m_requestCount = 0;
+    m_pulseStart = 0;
 
     m_pYGuideAlgorithm = NULL;
     m_pXGuideAlgorithm = NULL;
@@ -574,7 +574,7 @@ bool Mount::FlipCalibration(void)
     return bError;
 }
 
-Mount::MOVE_RESULT Mount::Move(const PHD_Point& cameraVectorEndpoint, bool normalMove)
+Mount::MOVE_RESULT Mount::Move(const PHD_Point& cameraVectorEndpoint, bool normalMove, const GuideStepFrame& frame)
 {
     MOVE_RESULT result = MOVE_OK;
 
@@ -596,6 +596,7 @@ Mount::MOVE_RESULT Mount::Move(const PHD_Point& cameraVectorEndpoint, bool norma
         if (normalMove)
         {
             // Feed the raw distances to the guide algorithms
+            TraceScope trace(TRACE_GUIDE_ALGORITHM);
 
             if (m_pXGuideAlgorithm)
             {
@@ -613,8 +614,46 @@ Mount::MOVE_RESULT Mount::Move(const PHD_Point& cameraVectorEndpoint, bool norma
         GUIDE_DIRECTION yDirection = yDistance > 0.0 ? DOWN : UP;
 
         int requestedXAmount = (int) floor(fabs(xDistance / m_xRate) + 0.5);
+        int requestedYAmount = (int) floor(fabs(yDistance / m_cal.yRate) + 0.5);
+        bool bothAxes = CanMoveBothAxes();
+
+        wxLongLong traceStart = Trace::Now();
+        wxLongLong start = wxGetUTCTimeMillis();
+        {
+            wxCriticalSectionLocker lock(m_pulseLock);
+            m_pulseStart = start;
+        }
+
         MoveResultInfo xMoveResult;
-        result = Move(xDirection, requestedXAmount, normalMove, &xMoveResult);
+        MoveResultInfo yMoveResult;
+        wxLongLong xEnd;
+        wxLongLong yStart;
+
+        if (bothAxes)
+        {
+            // both pulses start together, the x pulse ends after its duration
+            result = MoveBothAxes(xDirection, requestedXAmount, yDirection, requestedYAmount, normalMove,
+                &xMoveResult, &yMoveResult);
+            xEnd = start + xMoveResult.amountMoved;
+            yStart = start;
+        }
+        else
+        {
+            result = Move(xDirection, requestedXAmount, normalMove, &xMoveResult);
+            xEnd = wxGetUTCTimeMillis();
+            yStart = xEnd;
+
+            if (result == MOVE_OK || result == MOVE_ERROR)
+            {
+                result = Move(yDirection, requestedYAmount, normalMove, &yMoveResult);
+            }
+        }
+
+        wxLongLong end = wxGetUTCTimeMillis();
+        if (xEnd > end)
+            xEnd = end;
+
+        Trace::Record(TRACE_GUIDE_PULSE, traceStart, Trace::Now());
 
         wxString msg;
 
@@ -624,18 +663,31 @@ Mount::MOVE_RESULT Mount::Move(const PHD_Point& cameraVectorEndpoint, bool norma
                 fabs(xDistance), xMoveResult.amountMoved);
         }
 
-        MoveResultInfo yMoveResult;
-        if (result == MOVE_OK || result == MOVE_ERROR)
+        if (yMoveResult.amountMoved > 0)
         {
-            int requestedYAmount = (int) floor(fabs(yDistance / m_cal.yRate) + 0.5);
-            result = Move(yDirection, requestedYAmount, normalMove, &yMoveResult);
+            msg = wxString::Format(_("%s%*s%s %.2f px %d ms"), msg,
+                msg.IsEmpty() ? 42 : msg.Len() < 30 ? 30 - msg.Len() : 1, "",
+                yDirection == SOUTH ? _("South") : _("North"),
+                fabs(yDistance), yMoveResult.amountMoved);
+        }
 
-            if (yMoveResult.amountMoved > 0)
+        {
+            GuidePulse pulse;
+            pulse.xEnd = xEnd;
+            pulse.yStart = yStart;
+            pulse.end = end;
+            pulse.correction.SetXY(xDistance >= 0.0 ? xMoveResult.amountMoved * m_xRate : -xMoveResult.amountMoved * m_xRate,
+                yDistance >= 0.0 ? yMoveResult.amountMoved * m_cal.yRate : -yMoveResult.amountMoved * m_cal.yRate);
+
+            enum { MAX_PULSES = 16 };
+            wxCriticalSectionLocker lock(m_pulseLock);
+            pulse.start = start;
+            m_pulseStart = 0;
+            if (xMoveResult.amountMoved > 0 || yMoveResult.amountMoved > 0)
             {
-                msg = wxString::Format(_("%s%*s%s %.2f px %d ms"), msg,
-                    msg.IsEmpty() ? 42 : msg.Len() < 30 ? 30 - msg.Len() : 1, "",
-                    yDirection == SOUTH ? _("South") : _("North"),
-                    fabs(yDistance), yMoveResult.amountMoved);
+                m_pulses.push_back(pulse);
+                if (m_pulses.size() > MAX_PULSES)
+                    m_pulses.pop_front();
             }
         }
 
@@ -647,10 +699,10 @@ Mount::MOVE_RESULT Mount::Move(const PHD_Point& cameraVectorEndpoint, bool norma
 
         GuideStepInfo info;
         info.mount = this;
-        info.frameNumber = pFrame->m_frameCounter;
+        info.frameNumber = frame.frameNumber;
         info.time = pFrame->TimeSinceGuidingStarted();
-        info.cameraOffset = &cameraVectorEndpoint;
-        info.mountOffset = &mountVectorEndpoint;
+        info.cameraOffset = cameraVectorEndpoint;
+        info.mountOffset = mountVectorEndpoint;
         info.guideDistanceRA = xDistance;
         info.guideDistanceDec = yDistance;
         info.durationRA = xMoveResult.amountMoved;
@@ -660,20 +712,13 @@ Mount::MOVE_RESULT Mount::Move(const PHD_Point& cameraVectorEndpoint, bool norma
         info.raLimited = xMoveResult.limited;
         info.decLimited = yMoveResult.limited;
         info.aoPos = GetAoPos();
-        info.starMass = pFrame->pGuider->StarMass();
-        info.starSNR = pFrame->pGuider->SNR();
-        info.avgDist = pFrame->pGuider->CurrentError();
-        info.starError = pFrame->pGuider->StarError();
-
-        GuideLog.GuideStep(info);
-        EvtServer.NotifyGuideStep(info);
+        info.moveDuration = (xMoveResult.amountMoved > 0 || yMoveResult.amountMoved > 0) ? (end - start).ToLong() : 0;
+        info.starMass = frame.starMass;
+        info.starSNR = frame.starSNR;
+        info.avgDist = frame.avgDist;
+        info.starError = frame.starError;
 
-        if (normalMove)
-        {
-            pFrame->pGraphLog->AppendData(info);
-            pFrame->pTarget->AppendData(info);
-            GuidingAssistant::NotifyGuideStep(info);
-        }
+        pFrame->NotifyGuideStep(info, normalMove);
     }
     catch (wxString errMsg)
     {
@@ -684,6 +729,84 @@ Mount::MOVE_RESULT Mount::Move(const PHD_Point& cameraVectorEndpoint, bool norma
     return result;
 }
 
+/*
+ * Fraction of a pulse that shows up in the star position measured on an
+ * exposure, assuming the star moves at a constant rate while the pulse is on
+ * and the centroid is the average position over the exposure.
+ */
+static double PulseFractionSeen(double pulseStart, double pulseEnd, double expStart, double expEnd)
+{
+    if (pulseEnd <= expStart)
+        return 1.0;
+    if (pulseStart >= expEnd)
+        return 0.0;
+    if (expEnd <= expStart)
+        return (expStart - pulseStart) / (pulseEnd - pulseStart);
+
+    double seen = 0.0;
+
+    // partly applied while the pulse is on
+    double a = wxMax(expStart, pulseStart);
+    double b = wxMin(expEnd, pulseEnd);
+    if (b > a)
+        seen += ((b - pulseStart) * (b - pulseStart) - (a - pulseStart) * (a - pulseStart)) / (2.0 * (pulseEnd - pulseStart));
+
+    // fully applied after the pulse
+    if (pulseEnd < expEnd)
+        seen += expEnd - wxMax(expStart, pulseEnd);
+
+    return seen / (expEnd - expStart);
+}
+
+bool Mount::PulseOverlaps(const wxLongLong& expStart, const wxLongLong& expEnd)
+{
+    wxCriticalSectionLocker lock(m_pulseLock);
+
+    if (m_pulseStart != 0 && m_pulseStart < expEnd)
+        return true;
+
+    for (std::deque<GuidePulse>::const_iterator it = m_pulses.begin(); it != m_pulses.end(); ++it)
+    {
+        if (it->start < expEnd && it->end > expStart)
+            return true;
+    }
+
+    return false;
+}
+
+/*
+ * Returns the part of the corrections already sent to the mount that an
+ * exposure from expStart to expEnd has not seen, in mount coordinates. With
+ * pipelined capture the next exposure starts before the correction for the
+ * previous frame is made, so the error measured on it must be reduced by this
+ * amount or the same error would be corrected twice.
+ *
+ * Pulses that ended before the exposure started add nothing. They are not
+ * dropped here since the guide core and the GUI thread may ask about frames
+ * out of order; the history is short anyway.
+ */
+PHD_Point Mount::UnseenCorrection(const wxLongLong& expStart, const wxLongLong& expEnd)
+{
+    wxCriticalSectionLocker lock(m_pulseLock);
+
+    double x = 0.0;
+    double y = 0.0;
+    double exposure = (expEnd - expStart).ToDouble();
+
+    for (std::deque<GuidePulse>::const_iterator it = m_pulses.begin(); it != m_pulses.end(); ++it)
+    {
+        double start = (it->start - expStart).ToDouble();
+        double xEnd = (it->xEnd - expStart).ToDouble();
+        double yStart = (it->yStart - expStart).ToDouble();
+        double end = (it->end - expStart).ToDouble();
+
+        x += it->correction.X * (1.0 - PulseFractionSeen(start, xEnd, 0.0, exposure));
+        y += it->correction.Y * (1.0 - PulseFractionSeen(yStart, end, 0.0, exposure));
+    }
+
+    return PHD_Point(x, y);
+}
+
 /*
  * The transform code has proven really tricky to get right.  For future generations
  * (and for me the next time I try to work on it), I'm going to put some notes here.
@@ -906,22 +1029,22 @@ void Mount::AdjustCalibrationForScopePointing(void)
 
 bool Mount::IsBusy(void)
 {
+    wxCriticalSectionLocker lock(m_requestLock);
     return m_requestCount > 0;
 }
 
 void Mount::IncrementRequestCount(void)
 {
-    m_requestCount++;
-
-    // for the moment we never enqueue requests if the mount is busy, but we can
-    // enqueue them two at a time.  There is no reason we can't, it's just that
-    // right now we don't, and this might catch an error
-    assert(m_requestCount <= 2);
+    wxCriticalSectionLocker lock(m_requestLock);
 
+    // guide steps can queue up behind a slow mount; the worker queue keeps
+    // only the latest one and completes the others unserved
+    m_requestCount++;
 }
 
 void Mount::DecrementRequestCount(void)
 {
+    wxCriticalSectionLocker lock(m_requestLock);
     assert(m_requestCount > 0);
     m_requestCount--;
 }
@@ -936,6 +1059,23 @@ bool Mount::SynchronousOnly(void)
     return false;
 }
 
+bool Mount::CanMoveBothAxes(void)
+{
+    return false;
+}
+
+Mount::MOVE_RESULT Mount::MoveBothAxes(GUIDE_DIRECTION xDirection, int xAmount, GUIDE_DIRECTION yDirection, int yAmount,
+    bool normalMove, MoveResultInfo *xMoveResultInfo, MoveResultInfo *yMoveResultInfo)
+{
+    // only reached for mounts that cannot move both axes at once
+    MOVE_RESULT result = Move(xDirection, xAmount, normalMove, xMoveResultInfo);
+    if (result == MOVE_OK || result == MOVE_ERROR)
+    {
+        result = Move(yDirection, yAmount, normalMove, yMoveResultInfo);
+    }
+    return result;
+}
+
 bool Mount::HasSetupDialog(void) const
 {
     return false;
@@ -97,7 +97,24 @@ struct MoveResultInfo
 class Mount : public wxMessageBoxProxy
 {
     bool m_connected;
-    int m_requestCount;
+
+    // moves can be requested by the guide core on a worker thread
+    wxCriticalSection m_requestLock;
+    int m_requestCount;         // requests whose completion the GUI has not seen yet
+
+    // recent guide pulses, kept so that a frame that was exposed while a
+    // pulse was running can tell how much of the correction it saw
+    struct GuidePulse
+    {
+        wxLongLong start;       // wall clock (ms) when the x pulse began
+        wxLongLong xEnd;        // when the x pulse ended
+        wxLongLong yStart;      // when the y pulse began, start if both axes moved at once
+        wxLongLong end;         // when the y pulse ended
+        PHD_Point correction;   // correction applied, mount coordinates
+    };
+    wxCriticalSection m_pulseLock;
+    std::deque<GuidePulse> m_pulses;
+    wxLongLong m_pulseStart;    // start of the pulse in progress, 0 if none
 
     bool m_calibrated;
     Calibration m_cal;
@@ -178,13 +195,17 @@ public:
     bool GetGuidingEnabled(void);
     void SetGuidingEnabled(bool guidingEnabled);
 
-    virtual MOVE_RESULT Move(const PHD_Point& cameraVectorEndpoint, bool normalMove=true);
+    virtual MOVE_RESULT Move(const PHD_Point& cameraVectorEndpoint, bool normalMove, const GuideStepFrame& frame);
     bool TransformCameraCoordinatesToMountCoordinates(const PHD_Point& cameraVectorEndpoint,
                                                       PHD_Point& mountVectorEndpoint);
 
     bool TransformMountCoordinatesToCameraCoordinates(const PHD_Point& mountVectorEndpoint,
                                                      PHD_Point& cameraVectorEndpoint);
 
+    // guide pulse timing, the times are wall clock milliseconds
+    bool PulseOverlaps(const wxLongLong& expStart, const wxLongLong& expEnd);
+    PHD_Point UnseenCorrection(const wxLongLong& expStart, const wxLongLong& expEnd);
+
     GraphControlPane *GetXGuideAlgorithmControlPane(wxWindow *pParent);
     GraphControlPane *GetYGuideAlgorithmControlPane(wxWindow *pParent);
     virtual GraphControlPane *GetGraphControlPane(wxWindow *pParent, const wxString& label);
@@ -223,6 +244,12 @@ public:
 
     virtual bool HasNonGuiMove(void);
     virtual bool SynchronousOnly(void);
+
+    // mounts that can pulse both axes at the same time, so that a guide step
+    // takes as long as the longer of the two pulses
+    virtual bool CanMoveBothAxes(void);
+    virtual MOVE_RESULT MoveBothAxes(GUIDE_DIRECTION xDirection, int xAmount, GUIDE_DIRECTION yDirection, int yAmount,
+        bool normalMove, MoveResultInfo *xMoveResultInfo, MoveResultInfo *yMoveResultInfo);
     virtual bool HasSetupDialog(void) const;
     virtual void SetupDialog(void);
 
@@ -137,6 +137,8 @@ BEGIN_EVENT_TABLE(MyFrame, wxFrame)
     EVT_CLOSE(MyFrame::OnClose)
     EVT_THREAD(MYFRAME_WORKER_THREAD_EXPOSE_COMPLETE, MyFrame::OnExposeComplete)
     EVT_THREAD(MYFRAME_WORKER_THREAD_MOVE_COMPLETE, MyFrame::OnMoveComplete)
+    EVT_THREAD(MYFRAME_WORKER_THREAD_GUIDE_STEP, MyFrame::OnGuideStep)
+    EVT_THREAD(MYFRAME_WORKER_THREAD_MOVE_DROPPED, MyFrame::OnMoveDropped)
 
     EVT_COMMAND(wxID_ANY, REQUEST_EXPOSURE_EVENT, MyFrame::OnRequestExposure)
     EVT_COMMAND(wxID_ANY, WXMESSAGEBOX_PROXY_EVENT, MyFrame::OnMessageBoxProxy)
@@ -168,6 +170,8 @@ MyFrame::MyFrame(int instanceNumber, wxLocale *locale)
     StartWorkerThread(m_pPrimaryWorkerThread);
     m_pSecondaryWorkerThread = NULL;
     StartWorkerThread(m_pSecondaryWorkerThread);
+    m_pCaptureWorkerThread = NULL;
+    StartWorkerThread(m_pCaptureWorkerThread);
 
     m_statusbarTimer.SetOwner(this, STATUSBAR_TIMER_EVENT);
 
@@ -181,6 +185,9 @@ MyFrame::MyFrame(int instanceNumber, wxLocale *locale)
     m_image_logging_enabled = false;
     m_logged_image_format = (LOGGED_IMAGE_FORMAT) pConfig->Global.GetInt("/LoggedImageFormat", LIF_LOW_Q_JPEG);
 
+    SetImageProcessingThreads(pConfig->Global.GetInt("/ImageProcessingThreads", 0));
+    Trace::Enable(pConfig->Global.GetBoolean("/TraceEnabled", false));
+
     m_sampling = 1.0;
 
     #include "icons/phd2_128.png.h"
@@ -729,6 +736,10 @@ void MyFrame::LoadProfileSettings(void)
 
     SetAutoLoadCalibration(pConfig->Profile.GetBoolean("/AutoLoadCalibration", false));
 
+    SetPipelinedCapture(pConfig->Profile.GetBoolean("/frame/PipelinedCapture", false));
+
+    EvtServer.LoadProfileSettings();
+
     int focalLength = pConfig->Profile.GetInt("/frame/focalLength", DefaultFocalLength);
     SetFocalLength(focalLength);
 
@@ -1223,7 +1234,7 @@ void MyFrame::OnRequestMountMove(wxCommandEvent& evt)
     }
     else
     {
-        pRequest->moveResult = pRequest->pMount->Move(pRequest->vectorEndpoint, pRequest->normalMove);
+        pRequest->moveResult = pRequest->pMount->Move(pRequest->vectorEndpoint, pRequest->normalMove, pRequest->frame);
     }
 
     pRequest->pSemaphore->Post();
@@ -1235,28 +1246,58 @@ void MyFrame::OnStatusbarTimerEvent(wxTimerEvent& evt)
     wxFrame::SetStatusText(wxEmptyString, 1);
 }
 
-void MyFrame::ScheduleExposure(void)
+/*
+ * Exposures normally go to the primary worker thread, behind any pending move
+ * of the primary mount. A pipelined exposure goes to the capture thread
+ * instead and runs while the mount moves.
+ */
+void MyFrame::ScheduleExposure(bool pipelined)
 {
     int exposureDuration = RequestedExposureDuration();
     int exposureOptions = GetRawImageMode() ? CAPTURE_BPM_REVIEW : CAPTURE_LIGHT;
     const wxRect& subframe = pGuider->GetBoundingBox();
 
-    Debug.AddLine("ScheduleExposure(%d,%x,%d) exposurePending=%d",
-        exposureDuration, exposureOptions, !subframe.IsEmpty(), m_exposurePending);
+    Debug.AddLine("ScheduleExposure(%d,%x,%d) exposurePending=%d pipelined=%d",
+        exposureDuration, exposureOptions, !subframe.IsEmpty(), m_exposurePending, pipelined);
 
     assert(wxThread::IsMain()); // m_exposurePending only updated in main thread
     assert(!m_exposurePending);
 
     m_exposurePending = true;
 
-    usImage *img = new usImage();
+    usImage *img = usImagePool::Acquire();
+
+    if (!img)
+    {
+        // fail the capture the same way the worker thread reports a camera error
+        wxThreadEvent *event = new wxThreadEvent(wxEVT_THREAD, MYFRAME_WORKER_THREAD_EXPOSE_COMPLETE);
+        event->SetPayload<usImage *>(NULL);
+        event->SetInt(true);
+        wxQueueEvent(this, event);
+        return;
+    }
 
     wxCriticalSectionLocker lock(m_CSpWorkerThread);
-    assert(m_pPrimaryWorkerThread);
-    m_pPrimaryWorkerThread->EnqueueWorkerThreadExposeRequest(img, exposureDuration, exposureOptions, subframe);
+    WorkerThread *pWorkerThread = pipelined ? m_pCaptureWorkerThread : m_pPrimaryWorkerThread;
+    assert(pWorkerThread);
+    pWorkerThread->EnqueueWorkerThreadExposeRequest(img, exposureDuration, exposureOptions, subframe);
+}
+
+/*
+ * Pipelining is only done while guiding: calibration and star selection need
+ * each frame to be taken after the previous move has completed. Mounts that
+ * guide through the camera cannot move while it exposes.
+ */
+bool MyFrame::CanPipelineCapture(void) const
+{
+    return m_pipelinedCapture && m_continueCapturing && m_pCaptureWorkerThread &&
+        pGuider->IsGuiding() && !pGuider->IsPaused() &&
+        pMount && !pMount->SynchronousOnly() &&
+        (!pSecondaryMount || !pSecondaryMount->SynchronousOnly());
 }
 
-void MyFrame::SchedulePrimaryMove(Mount *pMount, const PHD_Point& vectorEndpoint, bool normalMove)
+void MyFrame::SchedulePrimaryMove(Mount *pMount, const PHD_Point& vectorEndpoint, bool normalMove,
+    const GuideStepFrame& frame, const usImage *pImage)
 {
     wxCriticalSectionLocker lock(m_CSpWorkerThread);
 
@@ -1266,10 +1307,11 @@ void MyFrame::SchedulePrimaryMove(Mount *pMount, const PHD_Point& vectorEndpoint
     pMount->IncrementRequestCount();
 
     assert(m_pPrimaryWorkerThread);
-    m_pPrimaryWorkerThread->EnqueueWorkerThreadMoveRequest(pMount, vectorEndpoint, normalMove);
+    m_pPrimaryWorkerThread->EnqueueWorkerThreadMoveRequest(pMount, vectorEndpoint, normalMove, frame, pImage);
 }
 
-void MyFrame::ScheduleSecondaryMove(Mount *pMount, const PHD_Point& vectorEndpoint, bool normalMove)
+void MyFrame::ScheduleSecondaryMove(Mount *pMount, const PHD_Point& vectorEndpoint, bool normalMove,
+    const GuideStepFrame& frame)
 {
     wxCriticalSectionLocker lock(m_CSpWorkerThread);
 
@@ -1280,17 +1322,49 @@ void MyFrame::ScheduleSecondaryMove(Mount *pMount, const PHD_Point& vectorEndpoi
     if (pMount->SynchronousOnly())
     {
         // some mounts must run on the Primary thread even if the secondary is requested.
-        SchedulePrimaryMove(pMount, vectorEndpoint, normalMove);
+        SchedulePrimaryMove(pMount, vectorEndpoint, normalMove, frame);
     }
     else
     {
         pMount->IncrementRequestCount();
 
         assert(m_pSecondaryWorkerThread);
-        m_pSecondaryWorkerThread->EnqueueWorkerThreadMoveRequest(pMount, vectorEndpoint, normalMove);
+        m_pSecondaryWorkerThread->EnqueueWorkerThreadMoveRequest(pMount, vectorEndpoint, normalMove, frame);
     }
 }
 
+const char *MyFrame::WorkerThreadName(WORKER_THREAD_ID id)
+{
+    switch (id)
+    {
+        case WORKER_PRIMARY:   return "primary";
+        case WORKER_SECONDARY: return "secondary";
+        case WORKER_CAPTURE:   return "capture";
+        default:               return "unknown";
+    }
+}
+
+bool MyFrame::GetWorkerThreadLatency(WORKER_THREAD_ID id, WorkerLatency *latency)
+{
+    wxCriticalSectionLocker lock(m_CSpWorkerThread);
+
+    WorkerThread *thread = NULL;
+
+    switch (id)
+    {
+        case WORKER_PRIMARY:   thread = m_pPrimaryWorkerThread; break;
+        case WORKER_SECONDARY: thread = m_pSecondaryWorkerThread; break;
+        case WORKER_CAPTURE:   thread = m_pCaptureWorkerThread; break;
+        default:               break;
+    }
+
+    if (!thread)
+        return false;
+
+    thread->GetLatency(latency);
+    return true;
+}
+
 void MyFrame::ScheduleCalibrationMove(Mount *pMount, const GUIDE_DIRECTION direction, int duration)
 {
     wxCriticalSectionLocker lock(m_CSpWorkerThread);
@@ -1333,6 +1407,9 @@ void MyFrame::StopCapturing(void)
 {
     Debug.AddLine("StopCapturing CaptureActive=%d continueCapturing=%d exposurePending=%d", CaptureActive, m_continueCapturing, m_exposurePending);
 
+    // no more guide steps without the GUI thread seeing the frame first
+    GuideCore::Withdraw();
+
     if (m_continueCapturing)
     {
         SetStatusText(_("Waiting for devices..."));
@@ -1340,7 +1417,10 @@ void MyFrame::StopCapturing(void)
 
         if (m_exposurePending)
         {
+            // the exposure is on one of these, stop whichever has it
             m_pPrimaryWorkerThread->RequestStop();
+            if (m_pCaptureWorkerThread)
+                m_pCaptureWorkerThread->RequestStop();
         }
         else
         {
@@ -1543,7 +1623,13 @@ void MyFrame::OnClose(wxCloseEvent& event)
 
     StopCapturing();
 
-    bool killed = StopWorkerThread(m_pPrimaryWorkerThread);
+    // the guide core must not request moves while the workers go away. The
+    // capture worker goes first, as its guide steps go to the primary worker.
+    GuideCore::Withdraw();
+
+    bool killed = StopWorkerThread(m_pCaptureWorkerThread);
+    if (StopWorkerThread(m_pPrimaryWorkerThread))
+        killed = true;
     if (StopWorkerThread(m_pSecondaryWorkerThread))
         killed = true;
 
@@ -1653,6 +1739,17 @@ bool MyFrame::GetAutoLoadCalibration(void)
     return m_autoLoadCalibration;
 }
 
+bool MyFrame::GetPipelinedCapture(void) const
+{
+    return m_pipelinedCapture;
+}
+
+void MyFrame::SetPipelinedCapture(bool val)
+{
+    m_pipelinedCapture = val;
+    pConfig->Profile.SetBoolean("/frame/PipelinedCapture", m_pipelinedCapture);
+}
+
 void MyFrame::SetAutoLoadCalibration(bool val)
 {
     if (m_autoLoadCalibration != val)
@@ -1709,7 +1806,7 @@ static bool save_multi_darks(const ExposureImgMap& darks, const wxString& fname,
 
         for (ExposureImgMap::const_iterator it = darks.begin(); it != darks.end(); ++it)
         {
-            const usImage *const img = it->second;
+            const usImage *const img = it->second.get();
             long fpixel[3] = { 1, 1, 1 };
             long fsize[] = {
                 (long)img->Size.GetWidth(),
@@ -2036,6 +2133,37 @@ bool MyFrame::SetTimeLapse(int timeLapse)
     return bError;
 }
 
+int MyFrame::GetImageProcessingThreads(void)
+{
+    return ParallelFor::GetMaxThreads();
+}
+
+bool MyFrame::SetImageProcessingThreads(int threads)
+{
+    bool bError = false;
+
+    try
+    {
+        if (threads < 0)
+        {
+            throw ERROR_INFO("threads < 0");
+        }
+
+        ParallelFor::SetMaxThreads(threads);
+    }
+    catch (wxString Msg)
+    {
+        POSSIBLY_UNUSED(Msg);
+        bError = true;
+        ParallelFor::SetMaxThreads(0);
+    }
+
+    // machine setting: it depends on the host, not on the equipment profile
+    pConfig->Global.SetInt("/ImageProcessingThreads", ParallelFor::GetMaxThreads());
+
+    return bError;
+}
+
 int MyFrame::GetFocalLength(void)
 {
     return m_focalLength;
@@ -2107,12 +2235,13 @@ wxString MyFrame::PixelScaleSummary(void) const
 wxString MyFrame::GetSettingsSummary()
 {
     // return a loggable summary of current global configs managed by MyFrame
-    return wxString::Format("Dither = %s, Dither scale = %.3f, Image noise reduction = %s, Guide-frame time lapse = %d, Server %s\n"
+    return wxString::Format("Dither = %s, Dither scale = %.3f, Image noise reduction = %s, Guide-frame time lapse = %d, Pipelined capture = %s, Server %s\n"
         "%s\n",
         m_ditherRaOnly ? "RA only" : "both axes",
         m_ditherScaleFactor,
         m_noiseReductionMethod == NR_NONE ? "none" : m_noiseReductionMethod == NR_2x2MEAN ? "2x2 mean" : "3x3 mean",
         m_timeLapse,
+        m_pipelinedCapture ? "on" : "off",
         m_serverMode ? "enabled" : "disabled",
         PixelScaleSummary()
     );
@@ -2206,6 +2335,16 @@ MyFrameConfigDialogPane::MyFrameConfigDialogPane(wxWindow *pParent, MyFrame *pFr
     DoAdd(_("Time Lapse (ms)"), m_pTimeLapse,
           _("How long should PHD wait between guide frames? Default = 0ms, useful when using very short exposures (e.g., using a video camera) but wanting to send guide commands less frequently"));
 
+    int cpus = std::max(1, wxThread::GetCPUCount());
+    int threadsWidth = StringWidth(_T("000"));
+    m_pImageProcessingThreads = new wxSpinCtrl(pParent, wxID_ANY, _T(""), wxPoint(-1,-1),
+            wxSize(threadsWidth+30, -1), wxSP_ARROW_KEYS, 0, cpus, 0, _T("ImageProcessingThreads"));
+    DoAdd(_("Image processing threads"), m_pImageProcessingThreads,
+          wxString::Format(_("Maximum number of threads used for dark subtraction and noise reduction. Lower this if the imaging application on the same computer needs the cores. Default = 0 (all %d cores)"), cpus));
+
+    m_pPipelinedCapture = new wxCheckBox(pParent, wxID_ANY, _("Pipelined capture"), wxDefaultPosition, wxDefaultSize);
+    DoAdd(m_pPipelinedCapture, _("While guiding, start the next exposure as soon as the previous one is downloaded instead of waiting for the guide pulses to finish. Shortens the guide cycle with short exposures. Not used with on-camera guide ports."));
+
     m_pFocalLength = new wxTextCtrl(pParent, wxID_ANY, _T("    "), wxDefaultPosition, wxSize(width+30, -1));
     DoAdd( _("Focal length (mm)"), m_pFocalLength,
            _("Guider telescope focal length, used with the camera pixel size to display guiding error in arc-sec."));
@@ -2312,6 +2451,8 @@ void MyFrameConfigDialogPane::LoadValues(void)
     m_pDitherRaOnly->SetValue(m_pFrame->GetDitherRaOnly());
     m_pDitherScaleFactor->SetValue(m_pFrame->GetDitherScaleFactor());
     m_pTimeLapse->SetValue(m_pFrame->GetTimeLapse());
+    m_pImageProcessingThreads->SetValue(m_pFrame->GetImageProcessingThreads());
+    m_pPipelinedCapture->SetValue(m_pFrame->GetPipelinedCapture());
     SetFocalLength(m_pFrame->GetFocalLength());
     m_pFocalLength->Enable(!pFrame->CaptureActive);
 
@@ -2365,6 +2506,8 @@ void MyFrameConfigDialogPane::UnloadValues(void)
         m_pFrame->SetDitherRaOnly(m_pDitherRaOnly->GetValue());
         m_pFrame->SetDitherScaleFactor(m_pDitherScaleFactor->GetValue());
         m_pFrame->SetTimeLapse(m_pTimeLapse->GetValue());
+        m_pFrame->SetImageProcessingThreads(m_pImageProcessingThreads->GetValue());
+        m_pFrame->SetPipelinedCapture(m_pPipelinedCapture->GetValue());
 
         m_pFrame->SetFocalLength(GetFocalLength());
 
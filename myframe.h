@@ -38,6 +38,7 @@
 #define MYFRAME_H_INCLUDED
 
 class WorkerThread;
+struct WorkerLatency;
 class MyFrame;
 class RefineDefMap;
 struct alert_params;
@@ -46,6 +47,8 @@ enum E_MYFRAME_WORKER_THREAD_MESSAGES
 {
     MYFRAME_WORKER_THREAD_EXPOSE_COMPLETE = wxID_HIGHEST+1,
     MYFRAME_WORKER_THREAD_MOVE_COMPLETE,
+    MYFRAME_WORKER_THREAD_GUIDE_STEP,
+    MYFRAME_WORKER_THREAD_MOVE_DROPPED,
 };
 
 wxDECLARE_EVENT(REQUEST_EXPOSURE_EVENT, wxCommandEvent);
@@ -90,6 +93,8 @@ class MyFrameConfigDialogPane : public ConfigDialogPane
     wxSpinCtrlDouble *m_pDitherScaleFactor;
     wxChoice *m_pNoiseReduction;
     wxSpinCtrl *m_pTimeLapse;
+    wxSpinCtrl *m_pImageProcessingThreads;
+    wxCheckBox *m_pPipelinedCapture;
     wxTextCtrl *m_pFocalLength;
     wxChoice* m_pLanguage;
     wxArrayInt m_LanguageIDs;
@@ -126,6 +131,11 @@ protected:
     bool SetTimeLapse(int timeLapse);
     int GetTimeLapse(void);
 
+    bool SetImageProcessingThreads(int threads);
+    int GetImageProcessingThreads(void);
+
+    void SetPipelinedCapture(bool val);
+
     bool SetFocalLength(int focalLength);
 
     bool SetLanguage(int language);
@@ -146,6 +156,7 @@ private:
     int  m_focalLength;
     double m_sampling;
     bool m_autoLoadCalibration;
+    bool m_pipelinedCapture;    // expose on the capture thread while the mount moves
     int m_instanceNumber;
 
     wxAuiManager m_mgr;
@@ -261,6 +272,8 @@ public:
 
     void OnExposeComplete(wxThreadEvent& evt);
     void OnMoveComplete(wxThreadEvent& evt);
+    void OnGuideStep(wxThreadEvent& evt);
+    void OnMoveDropped(wxThreadEvent& evt);
     void LoadProfileSettings(void);
     void UpdateTitle(void);
 
@@ -293,6 +306,7 @@ public:
     int GetFocalLength(void);
     int GetLanguage(void);
     bool GetAutoLoadCalibration(void);
+    bool GetPipelinedCapture(void) const;
     void LoadCalibration(void);
     int GetInstanceNumber() const { return m_instanceNumber; }
     static wxString GetDefaultFileDir();
@@ -330,15 +344,34 @@ public:
         bool            normalMove;
         Mount::MOVE_RESULT moveResult;
         PHD_Point       vectorEndpoint;
+        wxLongLong      frameStart;     // exposure of the frame the move was computed
+        wxLongLong      frameEnd;       // from, 0 if none
+        GuideStepFrame  frame;          // star data reported with the step
         wxSemaphore     *pSemaphore;
     };
     void OnRequestMountMove(wxCommandEvent& evt);
 
-    void ScheduleExposure(void);
+    void ScheduleExposure(bool pipelined = false);
 
-    void SchedulePrimaryMove(Mount *pMount, const PHD_Point& vectorEndpoint, bool normalMove=true);
-    void ScheduleSecondaryMove(Mount *pMount, const PHD_Point& vectorEndpoint, bool normalMove=true);
+    void SchedulePrimaryMove(Mount *pMount, const PHD_Point& vectorEndpoint, bool normalMove,
+        const GuideStepFrame& frame, const usImage *pImage=NULL);
+    void ScheduleSecondaryMove(Mount *pMount, const PHD_Point& vectorEndpoint, bool normalMove,
+        const GuideStepFrame& frame);
     void ScheduleCalibrationMove(Mount *pMount, const GUIDE_DIRECTION direction, int duration);
+    void NotifyGuideStep(const GuideStepInfo& info, bool normalMove);
+    void NotifyMoveDropped(const MoveDroppedInfo& info);
+
+    enum WORKER_THREAD_ID
+    {
+        WORKER_PRIMARY,
+        WORKER_SECONDARY,
+        WORKER_CAPTURE,
+
+        WORKER_THREAD_COUNT
+    };
+    static const char *WorkerThreadName(WORKER_THREAD_ID id);
+    // request latency of a worker thread, false if the thread is not running
+    bool GetWorkerThreadLatency(WORKER_THREAD_ID id, WorkerLatency *latency);
 
     void StartCapturing(void);
     void StopCapturing(void);
@@ -368,6 +401,7 @@ private:
     wxCriticalSection m_CSpWorkerThread;
     WorkerThread *m_pPrimaryWorkerThread;
     WorkerThread *m_pSecondaryWorkerThread;
+    WorkerThread *m_pCaptureWorkerThread;
 
     wxSocketServer *SocketServer;
 
@@ -381,6 +415,7 @@ private:
 
     bool StartWorkerThread(WorkerThread*& pWorkerThread);
     bool StopWorkerThread(WorkerThread*& pWorkerThread);
+    bool CanPipelineCapture(void) const;
     void OnSetStatusText(wxThreadEvent& event);
     void DoAlert(const alert_params& params);
     void OnAlertButton(wxCommandEvent& evt);
@@ -557,6 +592,8 @@ enum {
     SOCK_SERVER_CLIENT_ID,
     EVENT_SERVER_ID,
     EVENT_SERVER_CLIENT_ID,
+    FRAME_SERVER_ID,
+    FRAME_SERVER_CLIENT_ID,
 };
 
 wxDECLARE_EVENT(APPSTATE_NOTIFY_EVENT, wxCommandEvent);
@@ -38,6 +38,7 @@
 #include "darks_dialog.h"
 #include "Refine_DefMap.h"
 #include "camcal_import_dialog.h"
+#include "guiding_assistant.h"
 
 #include <wx/spinctrl.h>
 #include <wx/textfile.h>
@@ -300,6 +301,12 @@ void MyFrame::FinishStop(void)
     UpdateButtonsStatus();
     SetStatusText(_("Stopped."));
     PhdController::AbortController("Stopped capturing");
+
+    // give back the idle frame buffers while not capturing
+    usImagePool::LogStats();
+    usImagePool::Clear();
+
+    Trace::LogSummary();
 }
 
 static wxString RawModeWarningKey(void)
@@ -335,6 +342,10 @@ static void WarnRawImageMode(void)
  * - updates button state based on appropriate state variables
  * - schedules another exposure if CaptureActive is stil true
  *
+ * With pipelined capture the next exposure is scheduled on the capture thread
+ * before the frame is processed, so that it runs while the correction for this
+ * frame is sent to the mount.
+ *
  */
 void MyFrame::OnExposeComplete(wxThreadEvent& event)
 {
@@ -348,14 +359,14 @@ void MyFrame::OnExposeComplete(wxThreadEvent& event)
 
         if (pGuider->GetPauseType() == PAUSE_FULL)
         {
-            delete pNewFrame;
+            usImagePool::Release(pNewFrame);
             Debug.AddLine("guider is paused, ignoring frame, not scheduling exposure");
             return;
         }
 
         if (event.GetInt())
         {
-            delete pNewFrame;
+            usImagePool::Release(pNewFrame);
 
             StopCapturing();
             if (pGuider->IsCalibratingOrGuiding())
@@ -385,13 +396,25 @@ void MyFrame::OnExposeComplete(wxThreadEvent& event)
             m_rawImageModeWarningDone = true;
         }
 
+        if (CanPipelineCapture())
+        {
+            ScheduleExposure(true);
+        }
+
         pGuider->UpdateGuideState(pNewFrame, !m_continueCapturing);
         pNewFrame = NULL; // the guider owns it now
 
         PhdController::UpdateControllerState();
 
-        Debug.AddLine(wxString::Format("OnExposeCompete: CaptureActive=%d m_continueCapturing=%d",
-            CaptureActive, m_continueCapturing));
+        Debug.AddLine(wxString::Format("OnExposeCompete: CaptureActive=%d m_continueCapturing=%d exposurePending=%d",
+            CaptureActive, m_continueCapturing, m_exposurePending));
+
+        if (m_exposurePending)
+        {
+            // the pipelined exposure is already running. If capturing was
+            // stopped meanwhile, it completes the stop when it comes back.
+            return;
+        }
 
         CaptureActive = m_continueCapturing;
 
@@ -437,6 +460,54 @@ void MyFrame::OnMoveComplete(wxThreadEvent& event)
     }
 }
 
+/*
+ * Guide steps are made on the worker threads. They are posted here so that the
+ * logs, the event server and the graphs are only updated on the GUI thread.
+ * Can be called from any thread.
+ */
+void MyFrame::NotifyGuideStep(const GuideStepInfo& info, bool normalMove)
+{
+    wxThreadEvent *event = new wxThreadEvent(wxEVT_THREAD, MYFRAME_WORKER_THREAD_GUIDE_STEP);
+    event->SetPayload<GuideStepInfo>(info);
+    event->SetInt(normalMove);
+    wxQueueEvent(this, event);
+}
+
+void MyFrame::OnGuideStep(wxThreadEvent& event)
+{
+    GuideStepInfo info = event.GetPayload<GuideStepInfo>();
+    bool normalMove = event.GetInt() != 0;
+
+    GuideLog.GuideStep(info);
+    EvtServer.NotifyGuideStep(info);
+
+    if (normalMove)
+    {
+        pGraphLog->AppendData(info);
+        pTarget->AppendData(info);
+        GuidingAssistant::NotifyGuideStep(info);
+    }
+}
+
+/*
+ * Guide steps dropped from the worker queues, posted here for the same reason
+ * as the guide steps. Can be called from any thread.
+ */
+void MyFrame::NotifyMoveDropped(const MoveDroppedInfo& info)
+{
+    wxThreadEvent *event = new wxThreadEvent(wxEVT_THREAD, MYFRAME_WORKER_THREAD_MOVE_DROPPED);
+    event->SetPayload<MoveDroppedInfo>(info);
+    wxQueueEvent(this, event);
+}
+
+void MyFrame::OnMoveDropped(wxThreadEvent& event)
+{
+    MoveDroppedInfo info = event.GetPayload<MoveDroppedInfo>();
+
+    GuideLog.MoveDropped(info);
+    EvtServer.NotifyMoveDropped(info);
+}
+
 void MyFrame::OnButtonStop(wxCommandEvent& WXUNUSED(event))
 {
     StopCapturing();
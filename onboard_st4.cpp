@@ -57,3 +57,25 @@ bool OnboardST4::ST4PulseGuideScope(int direction, int duration)
     assert(false);
     return true;
 }
+
+bool OnboardST4::ST4HasDualAxisPulse(void)
+{
+    return false;
+}
+
+bool OnboardST4::ST4PulseGuideScopeDual(int raDirection, int raDuration, int decDirection, int decDuration)
+{
+    bool bError = false;
+
+    if (raDuration > 0)
+    {
+        bError = ST4PulseGuideScope(raDirection, raDuration);
+    }
+
+    if (!bError && decDuration > 0)
+    {
+        bError = ST4PulseGuideScope(decDirection, decDuration);
+    }
+
+    return bError;
+}
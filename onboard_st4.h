@@ -43,6 +43,10 @@ public:
     virtual bool    ST4HostConnected(void);
     virtual bool    ST4HasNonGuiMove(void);
     virtual bool    ST4PulseGuideScope(int direction, int duration);
+
+    // hosts that can pulse both axes at once, returning after the longer pulse
+    virtual bool    ST4HasDualAxisPulse(void);
+    virtual bool    ST4PulseGuideScopeDual(int raDirection, int raDuration, int decDirection, int decDuration);
 };
 
 #endif //ONBOARD_ST4_H_INCLUDED
@@ -0,0 +1,270 @@
+/*
+ *  parallel_for.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "phd.h"
+#include "parallel_for.h"
+
+#include <vector>
+
+// Jobs smaller than this run on the calling thread; waking the workers costs
+// more than the work itself.
+static const int MIN_PARALLEL_PIXELS = 256 * 256;
+
+// Each thread gets a few bands so that a slow thread (e.g. one preempted by
+// the imaging application) does not hold up the whole job.
+static const int BANDS_PER_THREAD = 4;
+
+class ParallelForWorker : public wxThread
+{
+public:
+    ParallelForWorker() : wxThread(wxTHREAD_JOINABLE) { }
+    ExitCode Entry();
+};
+
+struct ParallelForState
+{
+    wxMutex lock;               // protects everything below
+    wxCondition workReady;      // signaled when a job is posted or on shutdown
+    wxCondition workDone;       // signaled when the last band of a job finishes
+    wxMutex runLock;            // held by the thread that owns the current job
+
+    std::vector<ParallelForWorker *> workers;
+    int maxThreads;
+    bool stopping;
+
+    ParallelTask *task;
+    int rows;
+    int bandRows;
+    int bandCount;
+    int nextBand;
+    int bandsDone;
+
+    ParallelForState()
+        :
+        workReady(lock),
+        workDone(lock),
+        maxThreads(0),
+        stopping(false),
+        task(0),
+        rows(0),
+        bandRows(0),
+        bandCount(0),
+        nextBand(0),
+        bandsDone(0)
+    { }
+};
+
+static ParallelForState s_pool;
+
+static int EffectiveThreadCount(int maxThreads)
+{
+    int cpus = wxThread::GetCPUCount();
+    if (cpus < 1)
+        cpus = 1;
+    if (maxThreads > 0 && maxThreads < cpus)
+        return maxThreads;
+    return cpus;
+}
+
+// Runs bands of the current job until none are left. Called with s_pool.lock
+// held, returns with it held.
+static void RunBands()
+{
+    while (s_pool.task && s_pool.nextBand < s_pool.bandCount)
+    {
+        int band = s_pool.nextBand++;
+        ParallelTask *task = s_pool.task;
+        int begin = band * s_pool.bandRows;
+        int end = std::min(begin + s_pool.bandRows, s_pool.rows);
+
+        s_pool.lock.Unlock();
+        task->Run(begin, end);
+        s_pool.lock.Lock();
+
+        if (++s_pool.bandsDone == s_pool.bandCount)
+            s_pool.workDone.Signal();
+    }
+}
+
+wxThread::ExitCode ParallelForWorker::Entry()
+{
+    wxMutexLocker lock(s_pool.lock);
+
+    while (true)
+    {
+        while (!s_pool.stopping && (!s_pool.task || s_pool.nextBand >= s_pool.bandCount))
+            s_pool.workReady.Wait();
+
+        if (s_pool.stopping)
+            break;
+
+        RunBands();
+    }
+
+    return 0;
+}
+
+// Called with s_pool.runLock held
+static void StopWorkers()
+{
+    if (s_pool.workers.empty())
+        return;
+
+    {
+        wxMutexLocker lock(s_pool.lock);
+        s_pool.stopping = true;
+        s_pool.workReady.Broadcast();
+    }
+
+    for (std::vector<ParallelForWorker *>::iterator it = s_pool.workers.begin(); it != s_pool.workers.end(); ++it)
+    {
+        (*it)->Wait();
+        delete *it;
+    }
+    s_pool.workers.clear();
+
+    wxMutexLocker lock(s_pool.lock);
+    s_pool.stopping = false;
+}
+
+// Called with s_pool.runLock held
+static void StartWorkers(int count)
+{
+    while ((int) s_pool.workers.size() < count)
+    {
+        ParallelForWorker *worker = new ParallelForWorker();
+        if (worker->Create() != wxTHREAD_NO_ERROR || worker->Run() != wxTHREAD_NO_ERROR)
+        {
+            Debug.AddLine("ParallelFor: could not start worker thread, running with %d workers", (int) s_pool.workers.size());
+            delete worker;
+            break;
+        }
+        s_pool.workers.push_back(worker);
+    }
+}
+
+void ParallelFor::Run(ParallelTask& task, int rows, int rowPixels)
+{
+    if (rows <= 0)
+        return;
+
+    int threads = EffectiveThreadCount(s_pool.maxThreads);
+
+    if (threads < 2 || rows < 2 || (double) rows * rowPixels < MIN_PARALLEL_PIXELS)
+    {
+        task.Run(0, rows);
+        return;
+    }
+
+    // Another thread owns the pool (or this is a nested call from a task):
+    // do the work here rather than wait for the pool.
+    if (s_pool.runLock.TryLock() != wxMUTEX_NO_ERROR)
+    {
+        task.Run(0, rows);
+        return;
+    }
+
+    bool nested;
+    {
+        // wxMutex is recursive on Windows, so TryLock succeeds for a task
+        // that calls back into the pool
+        wxMutexLocker lock(s_pool.lock);
+        nested = s_pool.task != 0;
+    }
+    if (nested)
+    {
+        s_pool.runLock.Unlock();
+        task.Run(0, rows);
+        return;
+    }
+
+    StartWorkers(threads - 1);
+
+    {
+        wxMutexLocker lock(s_pool.lock);
+
+        int bands = std::min(rows, ((int) s_pool.workers.size() + 1) * BANDS_PER_THREAD);
+        s_pool.task = &task;
+        s_pool.rows = rows;
+        s_pool.bandRows = (rows + bands - 1) / bands;
+        s_pool.bandCount = (rows + s_pool.bandRows - 1) / s_pool.bandRows;
+        s_pool.nextBand = 0;
+        s_pool.bandsDone = 0;
+
+        s_pool.workReady.Broadcast();
+
+        RunBands();
+
+        while (s_pool.bandsDone < s_pool.bandCount)
+            s_pool.workDone.Wait();
+
+        s_pool.task = 0;
+    }
+
+    s_pool.runLock.Unlock();
+}
+
+void ParallelFor::SetMaxThreads(int maxThreads)
+{
+    wxMutexLocker runLock(s_pool.runLock);
+
+    if (maxThreads < 0)
+        maxThreads = 0;
+
+    if (maxThreads == s_pool.maxThreads)
+        return;
+
+    s_pool.maxThreads = maxThreads;
+
+    // the workers are restarted at the new size on the next job
+    StopWorkers();
+
+    Debug.AddLine("ParallelFor: max threads = %d, using %d of %d cores", maxThreads,
+        EffectiveThreadCount(maxThreads), wxThread::GetCPUCount());
+}
+
+int ParallelFor::GetMaxThreads()
+{
+    return s_pool.maxThreads;
+}
+
+int ParallelFor::GetThreadCount()
+{
+    return EffectiveThreadCount(s_pool.maxThreads);
+}
+
+void ParallelFor::Shutdown()
+{
+    wxMutexLocker runLock(s_pool.runLock);
+    StopWorkers();
+}
@@ -0,0 +1,79 @@
+/*
+ *  parallel_for.h
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef PARALLEL_FOR_INCLUDED
+#define PARALLEL_FOR_INCLUDED
+
+/*
+ * A unit of work that can be split into bands of rows. Run() is called
+ * concurrently for disjoint row ranges, so implementations must only write to
+ * the rows they were given. Reading neighboring rows (the halo of a filter
+ * kernel) is fine as long as the source is not the buffer being written.
+ */
+class ParallelTask
+{
+public:
+    virtual ~ParallelTask() { }
+    virtual void Run(int rowBegin, int rowEnd) = 0;
+};
+
+/*
+ * Persistent pool of worker threads for the full-frame image operations.
+ *
+ * The pool is sized to the number of cores, optionally capped by the
+ * "image processing threads" setting so that guiding does not compete with an
+ * imaging application running on the same machine. The threads are started on
+ * first use and stay parked between frames.
+ */
+class ParallelFor
+{
+public:
+    // Splits rows [0, rows) into bands and runs the task on the pool, with
+    // the calling thread taking part. Returns when all bands are done. Small
+    // jobs, and jobs submitted while the pool is busy, run on the calling
+    // thread.
+    static void Run(ParallelTask& task, int rows, int rowPixels);
+
+    // Maximum number of threads used for a job, including the calling
+    // thread. 0 means one per core.
+    static void SetMaxThreads(int maxThreads);
+    static int GetMaxThreads();
+
+    // The number of threads a job will actually use
+    static int GetThreadCount();
+
+    // Stops the worker threads; they are restarted if the pool is used again
+    static void Shutdown();
+};
+
+#endif
@@ -0,0 +1,219 @@
+/*
+ *  periodogram.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "periodogram.h"
+
+#include <algorithm>
+#include <math.h>
+
+#ifndef M_PI
+# define M_PI 3.14159265358979323846
+#endif
+
+Periodogram::Periodogram(double minPeriod, double maxPeriod, unsigned int numPeriods)
+    : m_acc(numPeriods)
+{
+    // log-spaced trial periods give the same relative resolution everywhere
+    double ratio = numPeriods > 1 ? pow(maxPeriod / minPeriod, 1.0 / (numPeriods - 1)) : 1.0;
+    double period = minPeriod;
+    for (unsigned int i = 0; i < numPeriods; i++)
+    {
+        m_acc[i].omega = 2.0 * M_PI / period;
+        period *= ratio;
+    }
+
+    Reset();
+}
+
+void Periodogram::Reset()
+{
+    for (std::vector<Accumulator>::iterator it = m_acc.begin(); it != m_acc.end(); ++it)
+    {
+        it->c = it->s = 0.0;
+        it->tc = it->ts = 0.0;
+        it->yc = it->ys = 0.0;
+        it->cc = it->ss = it->cs = 0.0;
+    }
+
+    m_count = 0;
+    m_sumT = m_sumTT = 0.0;
+    m_sumY = m_sumYY = m_sumYT = 0.0;
+    m_firstTime = m_lastTime = 0.0;
+}
+
+void Periodogram::AddSample(double time, double pos)
+{
+    if (m_count == 0)
+        m_firstTime = time;
+    else if (time <= m_lastTime)
+        return;
+
+    m_lastTime = time;
+
+    // times are taken relative to the first sample to keep the sums well conditioned
+    double t = time - m_firstTime;
+    double y = pos;
+
+    ++m_count;
+    m_sumT += t;
+    m_sumTT += t * t;
+    m_sumY += y;
+    m_sumYY += y * y;
+    m_sumYT += y * t;
+
+    for (std::vector<Accumulator>::iterator it = m_acc.begin(); it != m_acc.end(); ++it)
+    {
+        double c = cos(it->omega * t);
+        double s = sin(it->omega * t);
+        it->c += c;
+        it->s += s;
+        it->tc += t * c;
+        it->ts += t * s;
+        it->yc += y * c;
+        it->ys += y * s;
+        it->cc += c * c;
+        it->ss += s * s;
+        it->cs += c * s;
+    }
+}
+
+/*
+ * Power of the sinusoid at one trial period. The offset and drift terms are
+ * projected out of the sinusoid basis and the data, leaving a 2x2 least
+ * squares problem for the cos and sin coefficients.
+ */
+double Periodogram::Power(const Accumulator& a, double *amplitude) const
+{
+    *amplitude = 0.0;
+
+    // inverse of the 2x2 normal matrix of the drift basis [1, t]
+    double n = (double) m_count;
+    double det0 = n * m_sumTT - m_sumT * m_sumT;
+    if (det0 <= 0.0)
+        return 0.0;
+    double i11 = m_sumTT / det0, i12 = -m_sumT / det0, i22 = n / det0;
+
+    // drift basis against the data and against cos, sin
+    double b0 = i11 * m_sumY + i12 * m_sumYT;
+    double b1 = i12 * m_sumY + i22 * m_sumYT;
+    double rss0 = m_sumYY - (b0 * m_sumY + b1 * m_sumYT);
+    if (rss0 <= 0.0)
+        return 0.0;
+
+    double pc0 = i11 * a.c + i12 * a.tc, pc1 = i12 * a.c + i22 * a.tc;
+    double ps0 = i11 * a.s + i12 * a.ts, ps1 = i12 * a.s + i22 * a.ts;
+
+    double CC = a.cc - (pc0 * a.c + pc1 * a.tc);
+    double SS = a.ss - (ps0 * a.s + ps1 * a.ts);
+    double CS = a.cs - (pc0 * a.s + pc1 * a.ts);
+    double YC = a.yc - (pc0 * m_sumY + pc1 * m_sumYT);
+    double YS = a.ys - (ps0 * m_sumY + ps1 * m_sumYT);
+
+    double D = CC * SS - CS * CS;
+    if (D <= 1e-9 * n * n)
+        return 0.0;
+
+    // the fitted periodic term is A cos(wt) + B sin(wt)
+    double A = (YC * SS - YS * CS) / D;
+    double B = (YS * CC - YC * CS) / D;
+    *amplitude = sqrt(A * A + B * B);
+
+    return (A * YC + B * YS) / rss0;
+}
+
+void Periodogram::GetPeriods(std::vector<double> *periods) const
+{
+    periods->resize(m_acc.size());
+    for (unsigned int i = 0; i < m_acc.size(); i++)
+        (*periods)[i] = 2.0 * M_PI / m_acc[i].omega;
+}
+
+void Periodogram::GetPower(std::vector<double> *power) const
+{
+    power->assign(m_acc.size(), 0.0);
+    if (m_count < 5)
+        return;
+
+    for (unsigned int i = 0; i < m_acc.size(); i++)
+    {
+        double amplitude;
+        (*power)[i] = Power(m_acc[i], &amplitude);
+    }
+}
+
+static bool PeakStronger(const Periodogram::Peak& a, const Periodogram::Peak& b)
+{
+    return a.power > b.power;
+}
+
+std::vector<Periodogram::Peak> Periodogram::DominantPeriods(unsigned int maxPeaks) const
+{
+    std::vector<Peak> peaks;
+    unsigned int n = m_acc.size();
+    if (m_count < 5 || n < 3)
+        return peaks;
+
+    std::vector<double> power(n);
+    std::vector<double> amplitude(n);
+    for (unsigned int i = 0; i < n; i++)
+        power[i] = Power(m_acc[i], &amplitude[i]);
+
+    double span = TimeSpan();
+
+    for (unsigned int i = 1; i + 1 < n; i++)
+    {
+        if (power[i] <= power[i - 1] || power[i] < power[i + 1])
+            continue;
+
+        double period = 2.0 * M_PI / m_acc[i].omega;
+        if (period > span)
+            break;
+
+        // refine the location with a parabola through the three points, in log(period)
+        double denom = power[i - 1] - 2.0 * power[i] + power[i + 1];
+        double offset = denom < 0.0 ? 0.5 * (power[i - 1] - power[i + 1]) / denom : 0.0;
+        double logStep = log(m_acc[i - 1].omega / m_acc[i].omega);
+
+        Peak peak;
+        peak.period = period * exp(offset * logStep);
+        peak.power = power[i];
+        peak.amplitude = amplitude[i];
+        peaks.push_back(peak);
+    }
+
+    std::sort(peaks.begin(), peaks.end(), PeakStronger);
+    if (peaks.size() > maxPeaks)
+        peaks.resize(maxPeaks);
+
+    return peaks;
+}
@@ -0,0 +1,113 @@
+/*
+ *  periodogram.h
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef PERIODOGRAM_INCLUDED
+#define PERIODOGRAM_INCLUDED
+
+#include <vector>
+
+// Trial periods, in seconds, searched for the periodic error of a mount
+static const double PeriodogramMinPeriod = 60.0;
+static const double PeriodogramMaxPeriod = 1200.0;
+static const unsigned int PeriodogramResolution = 256;
+
+// Minimum fraction of the variance the dominant period has to explain
+static const double MinimumPeriodogramPower = 0.3;
+
+/*
+ * Streaming Lomb-Scargle periodogram, used to find the worm period of the
+ * mount from the guide history.
+ *
+ * Samples are star positions at irregular times (GuideStepInfo::time, in
+ * seconds). At each trial period the samples are fitted with an offset, a
+ * linear drift and a sinusoid, which is the generalized Lomb-Scargle model
+ * extended by a trend term so that the drift of an unguided or poorly
+ * guided mount does not leak into the long periods. The power is the
+ * fraction of the residual variance of the drift-only fit that the sinusoid
+ * explains.
+ *
+ * The trial periods are fixed and log-spaced, and for each of them only a
+ * handful of running sums are kept, so adding a sample is O(number of
+ * periods) and the memory use does not grow with the length of the history.
+ */
+class Periodogram
+{
+public:
+    struct Peak
+    {
+        double period;      // seconds
+        double power;       // normalized power, 0..1
+        double amplitude;   // peak amplitude of the periodic motion, same units as the positions
+    };
+
+private:
+    struct Accumulator
+    {
+        double omega;
+        double c, s;        // sum of cos, sin
+        double tc, ts;      // sum of t*cos, t*sin
+        double yc, ys;      // sum of y*cos, y*sin
+        double cc, ss, cs;  // sum of cos^2, sin^2, cos*sin
+    };
+
+    std::vector<Accumulator> m_acc;
+    unsigned int m_count;
+    double m_sumT;
+    double m_sumTT;
+    double m_sumY;
+    double m_sumYY;
+    double m_sumYT;
+    double m_firstTime;
+    double m_lastTime;
+
+    double Power(const Accumulator& a, double *amplitude) const;
+
+public:
+    Periodogram(double minPeriod, double maxPeriod, unsigned int numPeriods);
+
+    void Reset();
+    void AddSample(double time, double pos);
+
+    unsigned int SampleCount() const { return m_count; }
+    double TimeSpan() const { return m_count ? m_lastTime - m_firstTime : 0.0; }
+
+    // power at each trial period, in the order of GetPeriods()
+    void GetPeriods(std::vector<double> *periods) const;
+    void GetPower(std::vector<double> *power) const;
+
+    // local maxima of the power, strongest first, limited to periods that
+    // are covered by the sampled time span
+    std::vector<Peak> DominantPeriods(unsigned int maxPeaks) const;
+};
+
+#endif
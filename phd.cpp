@@ -123,6 +123,12 @@ bool PhdApp::OnInit()
     pConfig = new PhdConfig(_T("PHDGuidingV2"), m_instanceNumber);
 
     Debug.Init("debug", true);
+    Debug.StartWriter();
+
+#if wxUSE_ON_FATAL_EXCEPTION
+    // write out the buffered guide log if we crash
+    wxHandleFatalExceptions();
+#endif
 
     Debug.AddLine(wxString::Format("PHD2 version %s begins execution with:", FULLVER));
     Debug.AddLine(wxString::Format("   %s", wxVERSION_STRING));
@@ -189,9 +195,13 @@ int PhdApp::OnExit(void)
 
     PhdController::OnAppExit();
 
+    ParallelFor::Shutdown();
+
     Debug.RemoveOldFiles();
     GuideLog.RemoveOldFiles();
 
+    Debug.StopWriter();
+
     delete pConfig;
     pConfig = NULL;
 
@@ -201,6 +211,13 @@ int PhdApp::OnExit(void)
     return wxApp::OnExit();
 }
 
+void PhdApp::OnFatalException(void)
+{
+    // write out the debug lines still queued for the writer thread
+    Debug.Flush();
+    GuideLog.Flush();
+}
+
 void PhdApp::OnInitCmdLine(wxCmdLineParser& parser)
 {
     parser.SetDesc(cmdLineDesc);
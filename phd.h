@@ -63,6 +63,7 @@
 #include <wx/thread.h>
 #include <wx/utils.h>
 
+#include <deque>
 #include <map>
 #include <math.h>
 #include <stdarg.h>
@@ -145,6 +146,7 @@ WX_DEFINE_ARRAY_DOUBLE(double, ArrayOfDbl);
 #include "usImage.h"
 #include "point.h"
 #include "star.h"
+#include "guide_core.h"
 #include "circbuf.h"
 #include "guidinglog.h"
 #include "graph.h"
@@ -164,7 +166,10 @@ WX_DEFINE_ARRAY_DOUBLE(double, ArrayOfDbl);
 #include "scopes.h"
 #include "stepguiders.h"
 #include "rotators.h"
+#include "image_kernels.h"
 #include "image_math.h"
+#include "parallel_for.h"
+#include "trace.h"
 #include "testguide.h"
 #include "advanced_dialog.h"
 #include "gear_dialog.h"
@@ -207,6 +212,7 @@ public:
     void OnInitCmdLine(wxCmdLineParser& parser);
     bool OnCmdLineParsed(wxCmdLineParser & parser);
     virtual bool Yield(bool onlyIfNeeded=false);
+    void OnFatalException(void);
     wxString GetLocaleDir() const { return m_localeDir; }
 };
 
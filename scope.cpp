@@ -543,91 +543,100 @@ void Scope::AlertLimitReached(int duration, GuideAxis axis)
     }
 }
 
-Mount::MOVE_RESULT Scope::Move(GUIDE_DIRECTION direction, int duration, bool normalMove, MoveResultInfo *moveResult)
+// Applies the guide mode and the maximum durations to a normal move
+int Scope::LimitGuideDuration(GUIDE_DIRECTION direction, int duration, bool normalMove, bool *limitReached)
 {
-    MOVE_RESULT result = MOVE_OK;
-    bool limitReached = false;
+    *limitReached = false;
 
-    try
+    switch (direction)
     {
-        Debug.AddLine("Move(%d, %d, %d)", direction, duration, normalMove);
-
-        if (!m_guidingEnabled)
-        {
-            throw THROW_INFO("Guiding disabled");
-        }
+        case NORTH:
+        case SOUTH:
 
-        // Compute the actual guide durations
-
-        switch (direction)
-        {
-            case NORTH:
-            case SOUTH:
+            // Enforce dec guiding mode and max dec duration for normal moves
+            if (normalMove)
+            {
+                if ((m_decGuideMode == DEC_NONE) ||
+                    (direction == SOUTH && m_decGuideMode == DEC_NORTH) ||
+                    (direction == NORTH && m_decGuideMode == DEC_SOUTH))
+                {
+                    duration = 0;
+                    Debug.AddLine("duration set to 0 by GuideMode");
+                }
 
-                // Enforce dec guiding mode and max dec duration for normal moves
-                if (normalMove)
+                if (duration > m_maxDecDuration)
                 {
-                    if ((m_decGuideMode == DEC_NONE) ||
-                        (direction == SOUTH && m_decGuideMode == DEC_NORTH) ||
-                        (direction == NORTH && m_decGuideMode == DEC_SOUTH))
-                    {
-                        duration = 0;
-                        Debug.AddLine("duration set to 0 by GuideMode");
-                    }
+                    duration = m_maxDecDuration;
+                    Debug.AddLine("duration set to %d by maxDecDuration", duration);
+                    *limitReached = true;
+                }
 
-                    if (duration > m_maxDecDuration)
-                    {
-                        duration = m_maxDecDuration;
-                        Debug.AddLine("duration set to %d by maxDecDuration", duration);
-                        limitReached = true;
-                    }
+                if (*limitReached && direction == m_decLimitReachedDirection)
+                {
+                    if (++m_decLimitReachedCount >= LIMIT_REACHED_WARN_COUNT)
+                        AlertLimitReached(duration, GUIDE_DEC);
+                }
+                else
+                    m_decLimitReachedCount = 0;
 
-                    if (limitReached && direction == m_decLimitReachedDirection)
-                    {
-                        if (++m_decLimitReachedCount >= LIMIT_REACHED_WARN_COUNT)
-                            AlertLimitReached(duration, GUIDE_DEC);
-                    }
-                    else
-                        m_decLimitReachedCount = 0;
+                if (*limitReached)
+                    m_decLimitReachedDirection = direction;
+                else
+                    m_decLimitReachedDirection = NONE;
+            }
+            break;
+        case EAST:
+        case WEST:
 
-                    if (limitReached)
-                        m_decLimitReachedDirection = direction;
-                    else
-                        m_decLimitReachedDirection = NONE;
+            if (normalMove)
+            {
+                // enforce max RA duration for normal moves
+                if (duration > m_maxRaDuration)
+                {
+                    duration = m_maxRaDuration;
+                    Debug.AddLine("duration set to %d by maxRaDuration", duration);
+                    *limitReached = true;
                 }
-                break;
-            case EAST:
-            case WEST:
 
-                if (normalMove)
+                if (*limitReached && direction == m_raLimitReachedDirection)
                 {
-                    // enforce max RA duration for normal moves
-                    if (duration > m_maxRaDuration)
-                    {
-                        duration = m_maxRaDuration;
-                        Debug.AddLine("duration set to %d by maxRaDuration", duration);
-                        limitReached = true;
-                    }
+                    if (++m_raLimitReachedCount >= LIMIT_REACHED_WARN_COUNT)
+                        AlertLimitReached(duration, GUIDE_RA);
+                }
+                else
+                    m_raLimitReachedCount = 0;
 
-                    if (limitReached && direction == m_raLimitReachedDirection)
-                    {
-                        if (++m_raLimitReachedCount >= LIMIT_REACHED_WARN_COUNT)
-                            AlertLimitReached(duration, GUIDE_RA);
-                    }
-                    else
-                        m_raLimitReachedCount = 0;
+                if (*limitReached)
+                    m_raLimitReachedDirection = direction;
+                else
+                    m_raLimitReachedDirection = NONE;
+            }
+            break;
 
-                    if (limitReached)
-                        m_raLimitReachedDirection = direction;
-                    else
-                        m_raLimitReachedDirection = NONE;
-                }
-                break;
+        case NONE:
+            break;
+    }
 
-            case NONE:
-                break;
+    return duration;
+}
+
+Mount::MOVE_RESULT Scope::Move(GUIDE_DIRECTION direction, int duration, bool normalMove, MoveResultInfo *moveResult)
+{
+    MOVE_RESULT result = MOVE_OK;
+    bool limitReached = false;
+
+    try
+    {
+        Debug.AddLine("Move(%d, %d, %d)", direction, duration, normalMove);
+
+        if (!m_guidingEnabled)
+        {
+            throw THROW_INFO("Guiding disabled");
         }
 
+        // Compute the actual guide durations
+        duration = LimitGuideDuration(direction, duration, normalMove, &limitReached);
+
         // Actually do the guide
         assert(duration >= 0);
         if (duration > 0)
@@ -658,6 +667,74 @@ Mount::MOVE_RESULT Scope::Move(GUIDE_DIRECTION direction, int duration, bool nor
     return result;
 }
 
+Mount::MOVE_RESULT Scope::MoveBothAxes(GUIDE_DIRECTION xDirection, int xDuration, GUIDE_DIRECTION yDirection, int yDuration,
+    bool normalMove, MoveResultInfo *xMoveResult, MoveResultInfo *yMoveResult)
+{
+    MOVE_RESULT result = MOVE_OK;
+    bool xLimitReached = false;
+    bool yLimitReached = false;
+
+    try
+    {
+        Debug.AddLine("MoveBothAxes(%d, %d, %d, %d, %d)", xDirection, xDuration, yDirection, yDuration, normalMove);
+
+        if (!m_guidingEnabled)
+        {
+            throw THROW_INFO("Guiding disabled");
+        }
+
+        xDuration = LimitGuideDuration(xDirection, xDuration, normalMove, &xLimitReached);
+        yDuration = LimitGuideDuration(yDirection, yDuration, normalMove, &yLimitReached);
+
+        assert(xDuration >= 0 && yDuration >= 0);
+        if (xDuration > 0 || yDuration > 0)
+        {
+            result = GuideBothAxes(xDirection, xDuration, yDirection, yDuration);
+            if (result != MOVE_OK)
+            {
+                throw ERROR_INFO("guide failed");
+            }
+        }
+    }
+    catch (const wxString& Msg)
+    {
+        POSSIBLY_UNUSED(Msg);
+        if (result == MOVE_OK)
+            result = MOVE_ERROR;
+        xDuration = 0;
+        yDuration = 0;
+    }
+
+    Debug.AddLine(wxString::Format("MoveBothAxes returns status %d, amounts %d, %d", result, xDuration, yDuration));
+
+    xMoveResult->amountMoved = xDuration;
+    xMoveResult->limited = xLimitReached;
+    yMoveResult->amountMoved = yDuration;
+    yMoveResult->limited = yLimitReached;
+
+    return result;
+}
+
+// Subclasses that return true from CanMoveBothAxes() start the two pulses
+// together; this fallback just runs them one after the other
+Mount::MOVE_RESULT Scope::GuideBothAxes(GUIDE_DIRECTION raDirection, int raDurationMs,
+    GUIDE_DIRECTION decDirection, int decDurationMs)
+{
+    MOVE_RESULT result = MOVE_OK;
+
+    if (raDurationMs > 0)
+    {
+        result = Guide(raDirection, raDurationMs);
+    }
+
+    if (result == MOVE_OK && decDurationMs > 0)
+    {
+        result = Guide(decDirection, decDurationMs);
+    }
+
+    return result;
+}
+
 static wxString CalibrationWarningKey(Calibration_Issues etype)
 {
     wxString qual;
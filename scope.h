@@ -190,6 +190,9 @@ private:
     // functions with an implemenation in Scope that cannot be over-ridden
     // by a subclass
     MOVE_RESULT Move(GUIDE_DIRECTION direction, int durationMs, bool normalMove, MoveResultInfo *moveResultInfo);
+    MOVE_RESULT MoveBothAxes(GUIDE_DIRECTION xDirection, int xDurationMs, GUIDE_DIRECTION yDirection, int yDurationMs,
+        bool normalMove, MoveResultInfo *xMoveResultInfo, MoveResultInfo *yMoveResultInfo);
+    int LimitGuideDuration(GUIDE_DIRECTION direction, int durationMs, bool normalMove, bool *limitReached);
     MOVE_RESULT CalibrationMove(GUIDE_DIRECTION direction, int duration);
     int CalibrationMoveSize(void);
     int CalibrationTotDistance(void);
@@ -203,6 +206,11 @@ private:
 // these MUST be supplied by a subclass
 private:
     virtual MOVE_RESULT Guide(GUIDE_DIRECTION direction, int durationMs) = 0;
+
+// this must be supplied by a subclass that can move both axes at once
+private:
+    virtual MOVE_RESULT GuideBothAxes(GUIDE_DIRECTION raDirection, int raDurationMs,
+        GUIDE_DIRECTION decDirection, int decDurationMs);
 };
 
 inline bool Scope::IsStopGuidingWhenSlewingEnabled(void) const
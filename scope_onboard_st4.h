@@ -50,8 +50,11 @@ public:
     virtual bool Disconnect(void);
 
     virtual bool HasNonGuiMove(void);
+    virtual bool CanMoveBothAxes(void);
 
     virtual MOVE_RESULT Guide(GUIDE_DIRECTION direction, int duration);
+    virtual MOVE_RESULT GuideBothAxes(GUIDE_DIRECTION raDirection, int raDuration,
+        GUIDE_DIRECTION decDirection, int decDuration);
 };
 
 #endif // SCOPE_ONBOARD_ST4_H_INCLUDED
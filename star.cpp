@@ -81,6 +81,8 @@ void Star::SetError(FindResult error)
 
 bool Star::Find(const usImage *pImg, int searchRegion, int base_x, int base_y, FindMode mode)
 {
+    TraceScope trace(TRACE_STAR_FIND);
+
     FindResult Result = STAR_OK;
     double newX = base_x;
     double newY = base_y;
@@ -922,13 +922,13 @@ static void SuppressSlowBumpWarning(long)
     pConfig->Global.SetBoolean(SlowBumpWarningEnabledKey(), false);
 }
 
-Mount::MOVE_RESULT StepGuider::Move(const PHD_Point& cameraVectorEndpoint, bool normalMove)
+Mount::MOVE_RESULT StepGuider::Move(const PHD_Point& cameraVectorEndpoint, bool normalMove, const GuideStepFrame& frame)
 {
     MOVE_RESULT result = MOVE_OK;
 
     try
     {
-        MOVE_RESULT mountResult = Mount::Move(cameraVectorEndpoint, normalMove);
+        MOVE_RESULT mountResult = Mount::Move(cameraVectorEndpoint, normalMove, frame);
         if (mountResult != MOVE_OK)
             Debug.AddLine("StepGuider::Move: Mount::Move failed!");
 
@@ -1071,7 +1071,7 @@ Mount::MOVE_RESULT StepGuider::Move(const PHD_Point& cameraVectorEndpoint, bool
 
             Debug.AddLine("Scheduling Mount bump of (%.3f, %.3f)", thisBump.X, thisBump.Y);
 
-            pFrame->ScheduleSecondaryMove(pSecondaryMount, thisBump, false);
+            pFrame->ScheduleSecondaryMove(pSecondaryMount, thisBump, false, frame);
         }
     }
     catch (wxString Msg)
@@ -157,7 +157,7 @@ public:
     // functions with an implemenation in StepGuider that cannot be over-ridden
     // by a subclass
 private:
-    virtual MOVE_RESULT Move(const PHD_Point& vectorEndpoint, bool normalMove=true);
+    virtual MOVE_RESULT Move(const PHD_Point& vectorEndpoint, bool normalMove, const GuideStepFrame& frame);
     MOVE_RESULT Move(GUIDE_DIRECTION direction, int amount, bool normalMove, MoveResultInfo *moveResultInfo);
     MOVE_RESULT CalibrationMove(GUIDE_DIRECTION direction, int steps);
     int CalibrationMoveSize(void);
@@ -0,0 +1,165 @@
+/*
+ *  guidelog_binary_test.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Guide steps must survive the trip text -> binary -> text unchanged, and
+ * the reader must find records by time across blocks and sessions.
+ */
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "guidelog_binary.h"
+
+static const char *CsvLines[] =
+{
+    "1,2.051,\"Mount\",0.123,-0.456,0.200,-0.300,0.150,-0.250,120,W,80,N,,,12345,25.30,0\n",
+    "2,4.100,\"AO\",0.010,0.020,0.030,0.040,0.050,0.060,,,,,-3,2,12000,24.10,0\n",
+    "3,6.200,\"DROP\",,,,,,,,,,,,,5000,3.20,1,\"Star lost - low SNR\"\n",
+    // a star mass that a float would round
+    "4,8.300,\"Mount\",0.000,0.000,0.000,0.000,0.000,0.000,0,,0,,,,16777217,25.30,0\n",
+};
+
+class GuideLogBinaryTest : public ::testing::Test
+{
+public:
+    std::string fileName;
+
+    GuideLogBinaryTest()
+    {
+        // in the working directory, removed when the test is done
+        fileName = "guidelog_binary_test.glog";
+    }
+
+    ~GuideLogBinaryTest()
+    {
+        remove(fileName.c_str());
+    }
+};
+
+struct Collector
+{
+    std::vector<GuideLogRecord> records;
+    void operator()(const GuideLogRecord& rec) { records.push_back(rec); }
+};
+
+TEST_F(GuideLogBinaryTest, CsvRoundTrip)
+{
+    for (size_t i = 0; i < sizeof(CsvLines) / sizeof(CsvLines[0]); i++)
+    {
+        GuideLogRecord rec;
+        ASSERT_TRUE(GuideLogRecordFromCsv(CsvLines[i], &rec)) << CsvLines[i];
+        EXPECT_EQ(CsvLines[i], GuideLogRecordToCsv(rec));
+    }
+
+    GuideLogRecord rec;
+    EXPECT_FALSE(GuideLogRecordFromCsv(GuideLogCsvHeader(), &rec));
+    EXPECT_FALSE(GuideLogRecordFromCsv("INFO: DITHER by 1.000, 1.000, new lock pos = 1.000, 1.000\n", &rec));
+}
+
+TEST_F(GuideLogBinaryTest, WriteRead)
+{
+    const int count = 3 * GUIDELOG_BLOCK_RECORDS + 17;
+
+    GuideLogBinaryWriter writer;
+    ASSERT_FALSE(writer.Open(fileName.c_str()));
+
+    for (int i = 0; i < count; i++)
+    {
+        GuideLogRecord rec;
+        GuideLogRecordFromCsv(CsvLines[i % 4], &rec);
+        rec.frame = i + 1;
+        rec.time = i * 0.5;
+        // second session starts half way
+        rec.sessionStart = i < count / 2 ? 1000000.0 : 2000000.0;
+        ASSERT_FALSE(writer.Append(rec));
+
+        // a partially written file is readable
+        if (i == 10)
+        {
+            ASSERT_FALSE(writer.Flush());
+            GuideLogBinaryReader reader;
+            ASSERT_FALSE(reader.Open(fileName.c_str()));
+            ASSERT_EQ(1u, reader.BlockCount());
+            EXPECT_EQ(11u, reader.BlockHeader(0).count);
+        }
+    }
+    EXPECT_EQ((unsigned int) count, writer.RecordCount());
+    writer.Close();
+
+    GuideLogBinaryReader reader;
+    ASSERT_FALSE(reader.Open(fileName.c_str()));
+
+    Collector collector;
+    ASSERT_FALSE(reader.ForEach(collector));
+    ASSERT_EQ((size_t) count, collector.records.size());
+
+    for (int i = 0; i < count; i++)
+    {
+        const GuideLogRecord& rec = collector.records[i];
+        EXPECT_EQ(i + 1, rec.frame);
+        EXPECT_EQ(i * 0.5, rec.time);
+
+        std::string expected = CsvLines[i % 4];
+        std::string actual = GuideLogRecordToCsv(rec);
+        // everything after the frame number and time must match
+        EXPECT_EQ(expected.substr(expected.find('"')), actual.substr(actual.find('"')));
+    }
+
+    // a block never spans two sessions
+    for (unsigned int b = 0; b < reader.BlockCount(); b++)
+    {
+        const GuideLogBlockHeader& hdr = reader.BlockHeader(b);
+        EXPECT_EQ(hdr.firstFrame <= count / 2, hdr.lastFrame <= count / 2);
+    }
+
+    unsigned int blk, idx;
+    GuideLogRecord rec;
+
+    ASSERT_TRUE(reader.Seek(1000000.0 + 100.2, &blk, &idx));
+    GuideLogBlockRecord(*reader.Block(blk), idx, &rec);
+    EXPECT_EQ(202, rec.frame);      // time 100.5
+
+    ASSERT_TRUE(reader.Seek(2000000.0, &blk, &idx));
+    GuideLogBlockRecord(*reader.Block(blk), idx, &rec);
+    EXPECT_EQ(count / 2 + 1, rec.frame);
+
+    EXPECT_FALSE(reader.Seek(3000000.0, &blk, &idx));
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
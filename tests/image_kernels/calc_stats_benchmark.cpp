@@ -0,0 +1,180 @@
+/*
+ *  calc_stats_benchmark.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Measures the per-frame cost of the image statistics computed by
+ * usImage::CalcStats(), comparing the former approach (filter the whole
+ * frame into a freshly allocated buffer, then scan it) with the streaming
+ * Median3MinMax() and the vectorized PixelMinMax().
+ */
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+#include "image_kernels.h"
+
+typedef std::pair<int, int> FrameSize;
+
+class CalcStatsBenchmark : public ::testing::TestWithParam<FrameSize>
+{
+public:
+    int width;
+    int height;
+    std::vector<unsigned short> frame;
+
+    CalcStatsBenchmark()
+        : width(GetParam().first), height(GetParam().second), frame((size_t) width * height)
+    {
+        // noisy background with a few hot pixels
+        srand(1);
+        for (size_t i = 0; i < frame.size(); i++)
+            frame[i] = (unsigned short)(1000 + rand() % 200);
+        for (int i = 0; i < 100; i++)
+            frame[rand() % frame.size()] = 65535;
+    }
+};
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double ElapsedMicroseconds(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+// what CalcStats() did before: allocate, filter the whole frame, scan it
+static void AllocatingMedianMinMax(const unsigned short *src, int width, int height,
+    unsigned short *pmin, unsigned short *pmax)
+{
+    size_t n = (size_t) width * height;
+    unsigned short *filtered = new unsigned short[n];
+    for (int y = 0; y < height; y++)
+        Median3Row(filtered + (size_t) y * width, src, width, 0, 0, width, height, y);
+
+    unsigned short lo = 65535, hi = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (filtered[i] < lo) lo = filtered[i];
+        if (filtered[i] > hi) hi = filtered[i];
+    }
+    delete[] filtered;
+
+    *pmin = lo;
+    *pmax = hi;
+}
+
+TEST_P(CalcStatsBenchmark, perFrameCost)
+{
+    int frames = width * height >= 2048 * 2048 ? 3 : 10;
+    SimdLevel simd = GetSupportedSimdLevel();
+
+    double minmax_scalar_us = 0;
+    double minmax_simd_us = 0;
+    double median_allocating_us = 0;
+    double median_streaming_us = 0;
+    std::vector<unsigned short> scratch;
+
+    for (int i = 0; i < frames; i++)
+    {
+        unsigned short lo_scalar, hi_scalar, lo, hi;
+
+        SetSimdLevel(SIMD_NONE);
+        Clock::time_point start = Clock::now();
+        PixelMinMax(&frame[0], frame.size(), &lo_scalar, &hi_scalar);
+        minmax_scalar_us += ElapsedMicroseconds(start);
+
+        SetSimdLevel(simd);
+        start = Clock::now();
+        PixelMinMax(&frame[0], frame.size(), &lo, &hi);
+        minmax_simd_us += ElapsedMicroseconds(start);
+
+        EXPECT_EQ(lo_scalar, lo);
+        EXPECT_EQ(hi_scalar, hi);
+
+        start = Clock::now();
+        AllocatingMedianMinMax(&frame[0], width, height, &lo_scalar, &hi_scalar);
+        median_allocating_us += ElapsedMicroseconds(start);
+
+        start = Clock::now();
+        Median3MinMax(&frame[0], width, 0, 0, width, height, scratch, &lo, &hi);
+        median_streaming_us += ElapsedMicroseconds(start);
+
+        EXPECT_EQ(lo_scalar, lo);
+        EXPECT_EQ(hi_scalar, hi);
+    }
+
+    std::cout << width << "x" << height
+              << ": min/max scalar " << minmax_scalar_us / frames << " us"
+              << ", simd level " << simd << " " << minmax_simd_us / frames << " us"
+              << "; median min/max allocating " << median_allocating_us / frames << " us"
+              << ", streaming " << median_streaming_us / frames << " us"
+              << std::endl;
+
+    RecordProperty("minmax_scalar_us", static_cast<int>(minmax_scalar_us / frames));
+    RecordProperty("minmax_simd_us", static_cast<int>(minmax_simd_us / frames));
+    RecordProperty("median_allocating_us", static_cast<int>(median_allocating_us / frames));
+    RecordProperty("median_streaming_us", static_cast<int>(median_streaming_us / frames));
+}
+
+TEST_P(CalcStatsBenchmark, subframeMatchesCopiedSubframe)
+{
+    // a subframe is filtered as if it had been copied out of the frame
+    int rx = 17, ry = 9, rw = 101, rh = 67;
+    std::vector<unsigned short> copy((size_t) rw * rh);
+    for (int y = 0; y < rh; y++)
+        for (int x = 0; x < rw; x++)
+            copy[(size_t) y * rw + x] = frame[(size_t)(ry + y) * width + rx + x];
+
+    std::vector<unsigned short> scratch;
+    unsigned short lo, hi, lo_copy, hi_copy;
+    Median3MinMax(&frame[0], width, rx, ry, rw, rh, scratch, &lo, &hi);
+    AllocatingMedianMinMax(&copy[0], rw, rh, &lo_copy, &hi_copy);
+    EXPECT_EQ(lo_copy, lo);
+    EXPECT_EQ(hi_copy, hi);
+
+    RectMinMax(&frame[0], width, rx, ry, rw, rh, &lo, &hi);
+    PixelMinMax(&copy[0], copy.size(), &lo_copy, &hi_copy);
+    EXPECT_EQ(lo_copy, lo);
+    EXPECT_EQ(hi_copy, hi);
+}
+
+INSTANTIATE_TEST_CASE_P(FrameSizes, CalcStatsBenchmark,
+                        ::testing::Values(FrameSize(640, 480), FrameSize(1280, 960),
+                                          FrameSize(2048, 2048), FrameSize(4096, 4096)));
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
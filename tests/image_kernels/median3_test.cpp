@@ -0,0 +1,164 @@
+/*
+ *  median3_test.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * The vectorized 3x3 median must give exactly the same output as the scalar
+ * median9() code on every instruction set the CPU supports.
+ */
+
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <vector>
+#include "fitsio.h"
+#include "image_kernels.h"
+
+class Median3Test : public ::testing::Test
+{
+public:
+    ~Median3Test()
+    {
+        SetSimdLevel(GetSupportedSimdLevel());
+    }
+
+    static void RandomFrame(std::vector<unsigned short> *frame, int width, int height, int range)
+    {
+        frame->resize((size_t) width * height);
+        for (size_t i = 0; i < frame->size(); i++)
+            (*frame)[i] = (unsigned short)(((unsigned int) rand() * 65537u) % range);
+    }
+
+    static void Filter(std::vector<unsigned short> *dst, const std::vector<unsigned short>& src, int width,
+        int rx, int ry, int rw, int rh, SimdLevel level)
+    {
+        SetSimdLevel(level);
+        dst->assign(src.size(), 0);
+        for (int y = 0; y < rh; y++)
+            Median3Row(&(*dst)[(size_t)(ry + y) * width + rx], &src[0], width, rx, ry, rw, rh, y);
+    }
+
+    // compares every supported instruction set with the scalar code
+    static void ExpectBitExact(const std::vector<unsigned short>& frame, int width,
+        int rx, int ry, int rw, int rh)
+    {
+        std::vector<unsigned short> expected, actual;
+        Filter(&expected, frame, width, rx, ry, rw, rh, SIMD_NONE);
+
+        for (int level = SIMD_SSE2; level <= GetSupportedSimdLevel(); level++)
+        {
+            Filter(&actual, frame, width, rx, ry, rw, rh, (SimdLevel) level);
+            ASSERT_EQ(expected.size(), actual.size());
+            for (size_t i = 0; i < expected.size(); i++)
+            {
+                ASSERT_EQ(expected[i], actual[i]) << "simd level " << level << ", pixel " << i
+                    << ", rect " << rx << "," << ry << " " << rw << "x" << rh;
+            }
+        }
+    }
+};
+
+TEST_F(Median3Test, randomFrames)
+{
+    srand(42);
+    std::vector<unsigned short> frame;
+
+    for (int i = 0; i < 200; i++)
+    {
+        // odd sizes exercise the scalar pixels after the vectors, a small
+        // range of values exercises ties
+        int width = 2 + rand() % 100;
+        int height = 2 + rand() % 40;
+        RandomFrame(&frame, width, height, i % 2 ? 65536 : 4);
+        ExpectBitExact(frame, width, 0, 0, width, height);
+    }
+}
+
+TEST_F(Median3Test, randomSubframes)
+{
+    srand(7);
+    std::vector<unsigned short> frame;
+    int width = 257, height = 131;
+    RandomFrame(&frame, width, height, 65536);
+
+    for (int i = 0; i < 100; i++)
+    {
+        int rw = 2 + rand() % (width - 1);
+        int rh = 2 + rand() % (height - 1);
+        int rx = rand() % (width - rw + 1);
+        int ry = rand() % (height - rh + 1);
+        ExpectBitExact(frame, width, rx, ry, rw, rh);
+    }
+}
+
+TEST_F(Median3Test, extremeValues)
+{
+    // the SSE2 kernel biases the pixels, 0x7fff/0x8000 and the ends of the range must survive it
+    const unsigned short values[] = { 0, 1, 0x7fff, 0x8000, 0x8001, 65534, 65535 };
+    int const n = sizeof(values) / sizeof(values[0]);
+
+    srand(1);
+    int width = 67, height = 9;
+    std::vector<unsigned short> frame((size_t) width * height);
+    for (size_t i = 0; i < frame.size(); i++)
+        frame[i] = values[rand() % n];
+
+    ExpectBitExact(frame, width, 0, 0, width, height);
+}
+
+TEST_F(Median3Test, simulatorImage)
+{
+    fitsfile *fptr;
+    int status = 0;
+    ASSERT_EQ(0, fits_open_diskfile(&fptr, SIMIMAGE_PATH, READONLY, &status)) << SIMIMAGE_PATH;
+
+    long size[2];
+    int naxis = 0;
+    fits_get_img_dim(fptr, &naxis, &status);
+    fits_get_img_size(fptr, 2, size, &status);
+    ASSERT_EQ(2, naxis);
+
+    std::vector<unsigned short> frame((size_t) size[0] * size[1]);
+    long fpixel[] = { 1, 1, 1 };
+    fits_read_pix(fptr, TUSHORT, fpixel, (LONGLONG) frame.size(), NULL, &frame[0], NULL, &status);
+    fits_close_file(fptr, &status);
+    ASSERT_EQ(0, status);
+
+    int width = (int) size[0], height = (int) size[1];
+    ExpectBitExact(frame, width, 0, 0, width, height);
+    ExpectBitExact(frame, width, 101, 77, 250, 190);
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,218 @@
+/*
+ *  remove_defects_test.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*
+ * Defects are replaced with the median of their neighbors that are not
+ * defects themselves, inside the subframe only. The row index must reject
+ * defects outside the sensor, and adding defects one at a time must give
+ * the same index as building it from the whole list.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+#include "image_kernels.h"
+
+static const int W = 12;
+static const int H = 10;
+static const unsigned short BAD = 60000;
+
+class RemoveDefectsTest : public ::testing::Test
+{
+public:
+    std::vector<unsigned short> img;
+
+    RemoveDefectsTest() : img(W * H)
+    {
+        for (int i = 0; i < W * H; i++)
+            img[i] = (unsigned short)(1000 + (i * 37) % 101);
+    }
+
+    unsigned short& Pixel(int x, int y) { return img[y * W + x]; }
+
+    // median of the listed pixels, as the replacement computes it
+    unsigned short Median(const int (*pts)[2], int n)
+    {
+        std::vector<unsigned short> v;
+        for (int i = 0; i < n; i++)
+            v.push_back(Pixel(pts[i][0], pts[i][1]));
+        std::sort(v.begin(), v.end());
+        if (n & 1)
+            return v[n / 2];
+        return (unsigned short)(((unsigned int) v[n / 2 - 1] + (unsigned int) v[n / 2]) / 2);
+    }
+
+    static bool Contains(const std::vector<DefectPixel>& defects, const DefectPixel& pt)
+    {
+        for (size_t i = 0; i < defects.size(); i++)
+        {
+            if (defects[i].x == pt.x && defects[i].y == pt.y)
+                return true;
+        }
+        return false;
+    }
+
+    static void ExpectSameIndex(const DefectIndex& a, const DefectIndex& b)
+    {
+        ASSERT_EQ(a.size(), b.size());
+        DefectIndex::const_iterator ia = a.begin(), ib = b.begin();
+        for (; ia != a.end(); ++ia, ++ib)
+        {
+            EXPECT_EQ(ia->x, ib->x);
+            EXPECT_EQ(ia->y, ib->y);
+            EXPECT_EQ(a.NeighborMask(ia), b.NeighborMask(ib)) << "defect " << ia->x << "," << ia->y;
+        }
+        for (int y = -1; y <= H + 1; y++)
+        {
+            EXPECT_EQ(a.RowBegin(y) - a.begin(), b.RowBegin(y) - b.begin()) << "row " << y;
+            EXPECT_EQ(a.RowEnd(y) - a.begin(), b.RowEnd(y) - b.begin()) << "row " << y;
+        }
+    }
+};
+
+TEST_F(RemoveDefectsTest, neighbor_mask_replacement)
+{
+    // two adjacent defects: each is replaced from its 7 good neighbors
+    std::vector<DefectPixel> defects;
+    defects.push_back(DefectPixel(5, 4));
+    defects.push_back(DefectPixel(6, 4));
+    DefectIndex index;
+    index.SetSensorSize(W, H);
+    EXPECT_EQ(0u, index.Assign(defects));
+
+    Pixel(5, 4) = BAD;
+    Pixel(6, 4) = BAD;
+
+    static const int nbrs5[7][2] = { { 4, 3 }, { 5, 3 }, { 6, 3 }, { 4, 4 }, { 4, 5 }, { 5, 5 }, { 6, 5 } };
+    static const int nbrs6[7][2] = { { 5, 3 }, { 6, 3 }, { 7, 3 }, { 7, 4 }, { 5, 5 }, { 6, 5 }, { 7, 5 } };
+    unsigned short expected5 = Median(nbrs5, 7);
+    unsigned short expected6 = Median(nbrs6, 7);
+
+    RemoveDefectsRect(&img[0], W, index, 0, 0, W, H);
+
+    EXPECT_EQ(expected5, Pixel(5, 4));
+    EXPECT_EQ(expected6, Pixel(6, 4));
+}
+
+TEST_F(RemoveDefectsTest, only_defects_inside_the_subframe)
+{
+    std::vector<DefectPixel> defects;
+    defects.push_back(DefectPixel(1, 1));     // left of the subframe
+    defects.push_back(DefectPixel(3, 2));     // top left corner of the subframe
+    defects.push_back(DefectPixel(5, 5));     // inside
+    defects.push_back(DefectPixel(8, 5));     // right of the subframe
+    defects.push_back(DefectPixel(5, 8));     // below the subframe
+    DefectIndex index;
+    index.SetSensorSize(W, H);
+    index.Assign(defects);
+
+    for (size_t i = 0; i < defects.size(); i++)
+        Pixel(defects[i].x, defects[i].y) = BAD;
+
+    // subframe x 3..7, y 2..6; the pixels around it must not be used
+    for (int x = 2; x <= 8; x++)
+        Pixel(x, 1) = BAD - 1;
+    for (int y = 1; y <= 7; y++)
+        Pixel(2, y) = BAD - 1;
+
+    static const int corner[3][2] = { { 4, 2 }, { 3, 3 }, { 4, 3 } };
+    static const int inside[8][2] = { { 4, 4 }, { 5, 4 }, { 6, 4 }, { 4, 5 }, { 6, 5 }, { 4, 6 }, { 5, 6 }, { 6, 6 } };
+    unsigned short expectedCorner = Median(corner, 3);
+    unsigned short expectedInside = Median(inside, 8);
+
+    RemoveDefectsRect(&img[0], W, index, 3, 2, 5, 5);
+
+    EXPECT_EQ(expectedCorner, Pixel(3, 2));
+    EXPECT_EQ(expectedInside, Pixel(5, 5));
+    EXPECT_EQ(BAD, Pixel(1, 1));
+    EXPECT_EQ(BAD, Pixel(8, 5));
+    EXPECT_EQ(BAD, Pixel(5, 8));
+}
+
+TEST_F(RemoveDefectsTest, defects_outside_the_sensor_are_rejected)
+{
+    std::vector<DefectPixel> defects;
+    defects.push_back(DefectPixel(3, 3));
+    defects.push_back(DefectPixel(-1, 3));
+    defects.push_back(DefectPixel(W, 3));
+    defects.push_back(DefectPixel(3, H));
+    defects.push_back(DefectPixel(3, 2000000000));  // a corrupt map file
+
+    DefectIndex index;
+    index.SetSensorSize(W, H);
+    EXPECT_EQ(4u, index.Assign(defects));
+    EXPECT_EQ(1u, index.size());
+    EXPECT_TRUE(index.Find(3, 3));
+    EXPECT_TRUE(index.RowBegin(2000000000) == index.end());
+
+    EXPECT_FALSE(index.Insert(3, 2000000000));
+    EXPECT_FALSE(index.Insert(W, 0));
+    EXPECT_FALSE(index.Insert(3, 3));
+    EXPECT_TRUE(index.Insert(4, 3));
+    EXPECT_EQ(2u, index.size());
+
+    // without a sensor size, coordinates are still limited
+    DefectIndex unsized;
+    EXPECT_EQ(2u, unsized.Assign(defects));
+}
+
+TEST_F(RemoveDefectsTest, insert_matches_assign)
+{
+    srand(5);
+    std::vector<DefectPixel> defects;
+    DefectIndex inserted;
+    inserted.SetSensorSize(W, H);
+
+    // clusters, so that the neighbor masks change as defects are added
+    for (int i = 0; i < 40; i++)
+    {
+        DefectPixel pt(rand() % W, rand() % H);
+        bool added = inserted.Insert(pt.x, pt.y);
+        EXPECT_EQ(!Contains(defects, pt), added);
+        if (added)
+            defects.push_back(pt);
+
+        DefectIndex assigned;
+        assigned.SetSensorSize(W, H);
+        assigned.Assign(defects);
+        ExpectSameIndex(assigned, inserted);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
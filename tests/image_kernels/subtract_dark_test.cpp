@@ -0,0 +1,224 @@
+/*
+ *  subtract_dark_test.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * The single pass dark subtraction must match the two pass reference: the
+ * minimum of light - dark, then light - dark + offset clamped to 16 bits.
+ * Across frames, the pedestal must be raised before any pixel is clipped.
+ */
+
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <vector>
+#include "image_kernels.h"
+
+class SubtractDarkTest : public ::testing::Test
+{
+public:
+    ~SubtractDarkTest()
+    {
+        SetSimdLevel(GetSupportedSimdLevel());
+    }
+
+    static void RandomPixels(std::vector<unsigned short> *pixels, size_t n, int lo, int hi)
+    {
+        pixels->resize(n);
+        for (size_t i = 0; i < n; i++)
+            (*pixels)[i] = (unsigned short)(lo + ((unsigned int) rand() * 65537u) % (hi - lo + 1));
+    }
+
+    static void ExpectMatchesReference(const std::vector<unsigned short>& light, const std::vector<unsigned short>& dark,
+        unsigned short pedestal)
+    {
+        size_t const n = light.size();
+
+        int expectedMin = 65535;
+        std::vector<unsigned short> expected(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            int diff = (int) light[i] - (int) dark[i];
+            if (diff < expectedMin)
+                expectedMin = diff;
+            int val = diff + pedestal;
+            expected[i] = (unsigned short)(val < 0 ? 0 : val > 65535 ? 65535 : val);
+        }
+
+        for (int level = SIMD_NONE; level <= GetSupportedSimdLevel(); level++)
+        {
+            SetSimdLevel((SimdLevel) level);
+
+            EXPECT_EQ(expectedMin, DarkMinDiffRow(&light[0], &dark[0], n)) << "level " << level;
+
+            std::vector<unsigned short> actual(light);
+            EXPECT_EQ(expectedMin, SubtractDarkRow(&actual[0], &dark[0], n, pedestal)) << "level " << level;
+            for (size_t i = 0; i < n; i++)
+            {
+                ASSERT_EQ(expected[i], actual[i]) << "level " << level << " pixel " << i;
+            }
+        }
+    }
+};
+
+TEST_F(SubtractDarkTest, typical_frames)
+{
+    srand(1);
+    std::vector<unsigned short> light, dark;
+    // lengths that exercise the vector loops and the scalar tails
+    for (size_t n = 1; n < 100; n += 7)
+    {
+        RandomPixels(&light, n, 1000, 5000);
+        RandomPixels(&dark, n, 900, 1200);
+        ExpectMatchesReference(light, dark, 0);
+        ExpectMatchesReference(light, dark, 150);
+    }
+}
+
+TEST_F(SubtractDarkTest, dark_brighter_than_light)
+{
+    srand(2);
+    std::vector<unsigned short> light, dark;
+    RandomPixels(&light, 1021, 0, 2000);
+    RandomPixels(&dark, 1021, 1000, 3000);
+    ExpectMatchesReference(light, dark, 0);
+    ExpectMatchesReference(light, dark, 500);
+    ExpectMatchesReference(light, dark, 3000);
+}
+
+TEST_F(SubtractDarkTest, extreme_values)
+{
+    srand(3);
+    std::vector<unsigned short> light, dark;
+    RandomPixels(&light, 997, 0, 65535);
+    RandomPixels(&dark, 997, 0, 65535);
+    light[0] = 65535; dark[0] = 0;
+    light[1] = 0; dark[1] = 65535;
+    ExpectMatchesReference(light, dark, 0);
+    ExpectMatchesReference(light, dark, 1);
+    ExpectMatchesReference(light, dark, 65535);
+}
+
+// A frame subtracted in two bands, as SubtractPedestal() does on the worker
+// threads, raising the pedestal if it is too low for the frame
+static void SubtractFrame(std::vector<unsigned short> *light, const std::vector<unsigned short>& dark,
+    size_t stride, size_t width, size_t rows, unsigned short *pedestal)
+{
+    std::vector<unsigned char> deferred(rows);
+    size_t half = rows / 2;
+    int mindiff = SubtractDarkRows(&(*light)[0], &dark[0], stride, width, half, *pedestal, &deferred[0]);
+    int mindiff2 = SubtractDarkRows(&(*light)[half * stride], &dark[half * stride], stride, width, rows - half,
+        *pedestal, &deferred[half]);
+    if (mindiff2 < mindiff)
+        mindiff = mindiff2;
+
+    if (mindiff + (int) *pedestal < 0)
+    {
+        unsigned short newPedestal = DarkPedestal(mindiff);
+        FinishDarkRows(&(*light)[0], &dark[0], stride, width, rows, *pedestal, newPedestal, &deferred[0]);
+        *pedestal = newPedestal;
+    }
+}
+
+static void ExpectFrame(const std::vector<unsigned short>& light, const std::vector<unsigned short>& dark,
+    const std::vector<unsigned short>& actual, size_t stride, size_t width, size_t rows, unsigned short pedestal)
+{
+    for (size_t r = 0; r < rows; r++)
+    {
+        for (size_t x = 0; x < stride; x++)
+        {
+            size_t i = r * stride + x;
+            // pixels right of the subframe are left alone
+            int val = x < width ? (int) light[i] - (int) dark[i] + pedestal : light[i];
+            ASSERT_EQ((unsigned short)(val > 65535 ? 65535 : val), actual[i]) << "row " << r << " column " << x;
+        }
+    }
+}
+
+TEST_F(SubtractDarkTest, pedestal_for_offset)
+{
+    EXPECT_EQ(0, DarkPedestal(100));
+    EXPECT_EQ(0, DarkPedestal(0));
+    EXPECT_EQ(50, DarkPedestal(-40));
+    EXPECT_EQ(65535, DarkPedestal(-65535));
+}
+
+TEST_F(SubtractDarkTest, pedestal_raised_before_clipping)
+{
+    srand(4);
+    size_t const stride = 53, width = 47, rows = 12;
+    std::vector<unsigned short> light, dark;
+    RandomPixels(&dark, stride * rows, 900, 1200);
+    unsigned short pedestal = 0;
+
+    for (int level = SIMD_NONE; level <= GetSupportedSimdLevel(); level++)
+    {
+        SetSimdLevel((SimdLevel) level);
+        pedestal = 0;
+
+        // the light exceeds the dark everywhere: no pedestal
+        RandomPixels(&light, stride * rows, 1300, 5000);
+        std::vector<unsigned short> actual(light);
+        SubtractFrame(&actual, dark, stride, width, rows, &pedestal);
+        EXPECT_EQ(0, pedestal);
+        ExpectFrame(light, dark, actual, stride, width, rows, 0);
+
+        // the dark exceeds the light by 40 in the middle of the second band
+        // and by 30 in the first: no pixel may be clipped at zero
+        light[8 * stride + 5] = dark[8 * stride + 5] - 40;
+        light[2 * stride + 7] = dark[2 * stride + 7] - 30;
+        actual = light;
+        SubtractFrame(&actual, dark, stride, width, rows, &pedestal);
+        EXPECT_EQ(50, pedestal) << "level " << level;
+        ExpectFrame(light, dark, actual, stride, width, rows, 50);
+
+        // the next frame keeps the pedestal while it is high enough
+        light[8 * stride + 5] = dark[8 * stride + 5] - 45;
+        actual = light;
+        SubtractFrame(&actual, dark, stride, width, rows, &pedestal);
+        EXPECT_EQ(50, pedestal) << "level " << level;
+        ExpectFrame(light, dark, actual, stride, width, rows, 50);
+
+        // the rows written before the pedestal is raised saturate like the others
+        light[0] = 65535;
+        light[11 * stride + 3] = dark[11 * stride + 3] - 400;
+        actual = light;
+        SubtractFrame(&actual, dark, stride, width, rows, &pedestal);
+        EXPECT_EQ(500, pedestal) << "level " << level;
+        ExpectFrame(light, dark, actual, stride, width, rows, 500);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,401 @@
+/*
+ *  json_parser_fuzz_benchmark.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*
+ * Runs the JSON parser over a sample of event server client traffic
+ * (client_traffic.txt, one request per line as the clients send them).
+ *
+ * The fuzz test mutates the requests at random and checks that every one of
+ * them either parses to a consistent tree or fails cleanly; build with
+ * -fsanitize=address to catch reads past the end of the message. The
+ * benchmark compares a parser created per request with one parser whose
+ * blocks are reused, and counts how many of the non-integer values the former
+ * single precision conversion did not preserve.
+ */
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "json_parser.h"
+
+#ifndef CLIENT_TRAFFIC_PATH
+# define CLIENT_TRAFFIC_PATH "client_traffic.txt"
+#endif
+
+namespace former
+{
+    // the conversion used before double precision values
+    static float atof(const char *first, const char *last)
+    {
+        float sign = 1;
+        if (first != last && *first == '-')
+        {
+            sign = -1;
+            ++first;
+        }
+
+        float result = 0;
+        for (; first != last && *first >= '0' && *first <= '9'; ++first)
+            result = 10 * result + (*first - '0');
+
+        if (first != last && *first == '.')
+        {
+            ++first;
+            float inv_base = 0.1f;
+            for (; first != last && *first >= '0' && *first <= '9'; ++first)
+            {
+                result += (*first - '0') * inv_base;
+                inv_base *= 0.1f;
+            }
+        }
+
+        result *= sign;
+
+        bool exponent_negative = false;
+        int exponent = 0;
+        if (first != last && (*first == 'e' || *first == 'E'))
+        {
+            ++first;
+            if (*first == '-')
+            {
+                exponent_negative = true;
+                ++first;
+            }
+            else if (*first == '+')
+                ++first;
+            for (; first != last && *first >= '0' && *first <= '9'; ++first)
+                exponent = 10 * exponent + (*first - '0');
+        }
+
+        if (exponent)
+        {
+            float power_of_ten = 10;
+            for (; exponent > 1; exponent--)
+                power_of_ten *= 10;
+            if (exponent_negative)
+                result /= power_of_ten;
+            else
+                result *= power_of_ten;
+        }
+
+        return result;
+    }
+}
+
+static std::vector<std::string> LoadTraffic()
+{
+    std::vector<std::string> lines;
+    std::ifstream in(CLIENT_TRAFFIC_PATH, std::ios::binary);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+        if (!line.empty())
+            lines.push_back(line);
+    }
+    return lines;
+}
+
+// checks the links of a parsed tree, returns the number of values
+static unsigned int CheckTree(const json_value *v)
+{
+    unsigned int count = 1;
+
+    switch (v->type)
+    {
+    case JSON_STRING:
+        EXPECT_TRUE(v->string_value != 0);
+        break;
+    case JSON_OBJECT:
+    case JSON_ARRAY:
+        {
+            const json_value *last = 0;
+            for (const json_value *c = v->first_child; c; c = c->next_sibling)
+            {
+                EXPECT_EQ(v, c->parent);
+                if (v->type == JSON_OBJECT)
+                {
+                    EXPECT_TRUE(c->name != 0);
+                }
+                count += CheckTree(c);
+                last = c;
+            }
+            EXPECT_EQ(last, v->last_child);
+        }
+        break;
+    default:
+        break;
+    }
+
+    return count;
+}
+
+static void Mutate(std::string& s, std::mt19937& rng)
+{
+    static const char special[] = "{}[]\",:.-+eE0123456789\\tfnu \r\n";
+
+    unsigned int n = 1 + rng() % 4;
+    for (unsigned int i = 0; i < n && !s.empty(); i++)
+    {
+        size_t pos = rng() % s.size();
+        switch (rng() % 6)
+        {
+        case 0:
+            s[pos] = (char) (rng() % 256);
+            break;
+        case 1:
+            s[pos] = special[rng() % (sizeof(special) - 1)];
+            break;
+        case 2:
+            s.insert(pos, 1, special[rng() % (sizeof(special) - 1)]);
+            break;
+        case 3:
+            s.erase(pos, 1 + rng() % 8);
+            break;
+        case 4:
+            s.resize(pos);
+            break;
+        case 5:
+            {
+                size_t len = 1 + rng() % 16;
+                std::string slice(s, pos, len);
+                s.insert(rng() % s.size(), slice);
+            }
+            break;
+        }
+    }
+}
+
+TEST(JsonParserFuzzBenchmark, trafficParses)
+{
+    std::vector<std::string> traffic = LoadTraffic();
+    ASSERT_FALSE(traffic.empty()) << "cannot read " << CLIENT_TRAFFIC_PATH;
+
+    JsonParser parser;
+    for (size_t i = 0; i < traffic.size(); i++)
+    {
+        std::string text(traffic[i]);
+        ASSERT_TRUE(parser.Parse(&text[0])) << traffic[i] << ": " << parser.ErrorDesc();
+
+        const json_value *root = parser.Root();
+        EXPECT_TRUE(root->type == JSON_OBJECT || root->type == JSON_ARRAY) << traffic[i];
+        CheckTree(root);
+    }
+}
+
+TEST(JsonParserFuzzBenchmark, mutatedTraffic)
+{
+    enum { ITERATIONS = 200000 };
+
+    std::vector<std::string> traffic = LoadTraffic();
+    ASSERT_FALSE(traffic.empty()) << "cannot read " << CLIENT_TRAFFIC_PATH;
+
+    std::mt19937 rng(42);
+    JsonParser parser;
+    unsigned int parsed = 0;
+
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        std::string s(traffic[rng() % traffic.size()]);
+        Mutate(s, rng);
+
+        // exactly sized, so that the sanitizer sees any read past the end
+        char *text = new char[s.size() + 1];
+        memcpy(text, s.c_str(), s.size() + 1);
+
+        if (parser.Parse(text))
+        {
+            ++parsed;
+            CheckTree(parser.Root());
+        }
+        else
+        {
+            EXPECT_TRUE(parser.ErrorDesc() != 0);
+            EXPECT_TRUE(parser.ErrorPos() >= text && parser.ErrorPos() <= text + s.size());
+        }
+
+        if (i % 100 == 0)
+            parser.Reset();
+
+        delete[] text;
+
+        if (HasFailure())
+        {
+            std::cout << "failed on: " << s << std::endl;
+            break;
+        }
+    }
+
+    std::cout << ITERATIONS << " mutated requests, " << parsed << " parsed" << std::endl;
+}
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double ElapsedNanoseconds(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+// the non-integer number tokens of a request, in order
+static std::vector<std::string> FloatTokens(const std::string& text)
+{
+    std::vector<std::string> tokens;
+    bool in_string = false;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        char c = text[i];
+        if (in_string)
+        {
+            if (c == '\\')
+                ++i;
+            else if (c == '"')
+                in_string = false;
+        }
+        else if (c == '"')
+            in_string = true;
+        else if (c == '-' || (c >= '0' && c <= '9'))
+        {
+            size_t end = text.find_first_of(" \t\r\n,]}", i);
+            std::string token(text, i, end - i);
+            if (token.find_first_of(".eE") != std::string::npos)
+                tokens.push_back(token);
+            i = end - 1;
+        }
+    }
+    return tokens;
+}
+
+static void CollectFloats(const json_value *v, std::vector<double> *values)
+{
+    if (v->type == JSON_FLOAT)
+        values->push_back(v->float_value);
+    for (const json_value *c = v->first_child; c; c = c->next_sibling)
+        CollectFloats(c, values);
+}
+
+TEST(JsonParserFuzzBenchmark, floatPrecision)
+{
+    std::vector<std::string> traffic = LoadTraffic();
+    ASSERT_FALSE(traffic.empty()) << "cannot read " << CLIENT_TRAFFIC_PATH;
+
+    JsonParser parser;
+    unsigned int total = 0;
+    unsigned int former_errors = 0;
+
+    for (size_t i = 0; i < traffic.size(); i++)
+    {
+        std::vector<std::string> tokens = FloatTokens(traffic[i]);
+
+        std::string text(traffic[i]);
+        ASSERT_TRUE(parser.Parse(&text[0]));
+        std::vector<double> values;
+        CollectFloats(parser.Root(), &values);
+        ASSERT_EQ(tokens.size(), values.size()) << traffic[i];
+
+        for (size_t j = 0; j < tokens.size(); j++)
+        {
+            double expected = strtod(tokens[j].c_str(), 0);
+            EXPECT_EQ(expected, values[j]) << tokens[j];
+
+            const char *t = tokens[j].c_str();
+            if ((double) former::atof(t, t + tokens[j].size()) != expected)
+                ++former_errors;
+            ++total;
+        }
+    }
+
+    std::cout << total << " non-integer values, " << former_errors
+              << " changed by the former single precision conversion" << std::endl;
+}
+
+TEST(JsonParserFuzzBenchmark, perRequestCost)
+{
+    enum { PASSES = 2000 };
+
+    std::vector<std::string> traffic = LoadTraffic();
+    ASSERT_FALSE(traffic.empty()) << "cannot read " << CLIENT_TRAFFIC_PATH;
+
+    size_t bytes = 0;
+    for (size_t i = 0; i < traffic.size(); i++)
+        bytes += traffic[i].size();
+    double requests = (double) PASSES * traffic.size();
+
+    std::vector<char> buf;
+
+    Clock::time_point start = Clock::now();
+    for (int pass = 0; pass < PASSES; pass++)
+    {
+        for (size_t i = 0; i < traffic.size(); i++)
+        {
+            buf.assign(traffic[i].begin(), traffic[i].end());
+            buf.push_back(0);
+            JsonParser parser;
+            ASSERT_TRUE(parser.Parse(&buf[0]));
+        }
+    }
+    double fresh_ns = ElapsedNanoseconds(start) / requests;
+
+    JsonParser parser;
+    start = Clock::now();
+    for (int pass = 0; pass < PASSES; pass++)
+    {
+        for (size_t i = 0; i < traffic.size(); i++)
+        {
+            buf.assign(traffic[i].begin(), traffic[i].end());
+            buf.push_back(0);
+            ASSERT_TRUE(parser.Parse(&buf[0]));
+        }
+    }
+    double reused_ns = ElapsedNanoseconds(start) / requests;
+
+    std::cout << traffic.size() << " requests, " << bytes / traffic.size() << " bytes average"
+              << ": new parser " << fresh_ns << " ns, reused parser " << reused_ns << " ns"
+              << " (" << bytes * PASSES / (reused_ns * requests) * 1000.0 << " MB/s)" << std::endl;
+
+    RecordProperty("fresh_ns", static_cast<int>(fresh_ns));
+    RecordProperty("reused_ns", static_cast<int>(reused_ns));
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,235 @@
+/*
+ *  json_parser_test.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <gtest/gtest.h>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <locale.h>
+#include <random>
+#include <string>
+#include "json_parser.h"
+
+class JsonParserTest : public ::testing::Test
+{
+protected:
+    JsonParser m_parser;
+    std::string m_text;
+
+    // parses text, which the parser modifies in place, and returns the
+    // first element of the top level array
+    const json_value *ParseArray(const std::string& text)
+    {
+        m_text = text;
+        if (!m_parser.Parse(&m_text[0]))
+            return 0;
+        return m_parser.Root()->first_child;
+    }
+
+    bool Parses(const std::string& text)
+    {
+        m_text = text;
+        return m_parser.Parse(&m_text[0]);
+    }
+};
+
+TEST_F(JsonParserTest, integers)
+{
+    const json_value *v = ParseArray("[0,-0,42,-42,2147483648,9223372036854775807,-9223372036854775808]");
+    ASSERT_TRUE(v != 0);
+
+    long long expected[] = { 0, 0, 42, -42, 2147483648LL, LLONG_MAX, LLONG_MIN };
+    for (unsigned int i = 0; i < sizeof(expected) / sizeof(expected[0]); i++, v = v->next_sibling)
+    {
+        ASSERT_TRUE(v != 0);
+        EXPECT_EQ(JSON_INT, v->type);
+        EXPECT_EQ(expected[i], v->int_value);
+    }
+    EXPECT_TRUE(v == 0);
+}
+
+TEST_F(JsonParserTest, integerOverflow)
+{
+    const char *text[] = {
+        "9223372036854775808",
+        "-9223372036854775809",
+        "123456789012345678901234567890",
+    };
+
+    for (unsigned int i = 0; i < sizeof(text) / sizeof(text[0]); i++)
+    {
+        const json_value *v = ParseArray(std::string("[") + text[i] + "]");
+        ASSERT_TRUE(v != 0) << text[i];
+        EXPECT_EQ(JSON_FLOAT, v->type) << text[i];
+        EXPECT_EQ(strtod(text[i], 0), v->float_value) << text[i];
+    }
+}
+
+TEST_F(JsonParserTest, doublePrecision)
+{
+    const char *text[] = {
+        "0.1", "-0.5", "1023.2537841796875", "755.6820068359375", "0.30000000000000004",
+        "1.0000000000000002", "3.141592653589793", "0.000001", "123456.789",
+        "2.2250738585072014e-308", "4.9e-324", "1.7976931348623157e308", "9007199254740993.0",
+        "0.1000000000000000055511151231257827021181583404541015625",
+    };
+
+    for (unsigned int i = 0; i < sizeof(text) / sizeof(text[0]); i++)
+    {
+        const json_value *v = ParseArray(std::string("[") + text[i] + "]");
+        ASSERT_TRUE(v != 0) << text[i];
+        EXPECT_EQ(JSON_FLOAT, v->type) << text[i];
+        EXPECT_EQ(strtod(text[i], 0), v->float_value) << text[i];
+    }
+
+    // values as clients print them, at full and at short precision
+    std::mt19937_64 rng(1);
+    const char *formats[] = { "%.17g", "%.6g", "%.3f" };
+    for (int i = 0; i < 20000; i++)
+    {
+        unsigned long long bits = rng();
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        if (!std::isfinite(d))
+            continue;
+        if (i % 2)
+            d = std::fmod(d, 1e6);
+
+        for (unsigned int f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+        {
+            char buf[512];
+            snprintf(buf, sizeof(buf), formats[f], d);
+            const json_value *v = ParseArray(std::string("[") + buf + "]");
+            ASSERT_TRUE(v != 0) << buf;
+            if (v->type == JSON_INT)
+                EXPECT_EQ(strtod(buf, 0), (double) v->int_value) << buf;
+            else
+                EXPECT_EQ(strtod(buf, 0), v->float_value) << buf;
+        }
+    }
+}
+
+TEST_F(JsonParserTest, exponents)
+{
+    const char *text[] = {
+        "1e3", "1E3", "1e+3", "2.5e-3", "-4.0E+0", "6e1", "1e22", "1e23", "1e-22", "1e-23",
+        "0e99999999999", "1e400", "-1e400", "1e-400", "12345678901234567890e-10",
+    };
+
+    for (unsigned int i = 0; i < sizeof(text) / sizeof(text[0]); i++)
+    {
+        const json_value *v = ParseArray(std::string("[") + text[i] + "]");
+        ASSERT_TRUE(v != 0) << text[i];
+        EXPECT_EQ(JSON_FLOAT, v->type) << text[i];
+        EXPECT_EQ(strtod(text[i], 0), v->float_value) << text[i];
+    }
+}
+
+TEST_F(JsonParserTest, badNumbers)
+{
+    const char *text[] = {
+        "[-]", "[1e]", "[1e+]", "[1E-]", "[1.2.3]", "[01x]", "[1..2]", "[--1]", "[1-2]", "[1e5.5]",
+        "[1", "[-", "[1e",
+    };
+
+    for (unsigned int i = 0; i < sizeof(text) / sizeof(text[0]); i++)
+    {
+        EXPECT_FALSE(Parses(text[i])) << text[i];
+    }
+}
+
+TEST_F(JsonParserTest, locale)
+{
+    // the fallback conversion must not depend on the locale's decimal point
+    const char *locales[] = { "de_DE.UTF-8", "de_DE.utf8", "fr_FR.UTF-8", "German" };
+    const char *saved = setlocale(LC_NUMERIC, 0);
+    std::string prev(saved ? saved : "C");
+
+    bool found = false;
+    for (unsigned int i = 0; i < sizeof(locales) / sizeof(locales[0]) && !found; i++)
+        found = setlocale(LC_NUMERIC, locales[i]) != 0;
+
+    const json_value *v = ParseArray("[1.2345678901234567890123,2.5e-300,0.5]");
+    setlocale(LC_NUMERIC, prev.c_str());
+
+    if (!found)
+        std::cout << "no locale with a decimal comma, checked the C locale only" << std::endl;
+
+    ASSERT_TRUE(v != 0);
+    EXPECT_EQ(strtod("1.2345678901234567890123", 0), v->float_value);
+    EXPECT_EQ(strtod("2.5e-300", 0), v->next_sibling->float_value);
+    EXPECT_EQ(0.5, v->next_sibling->next_sibling->float_value);
+}
+
+TEST_F(JsonParserTest, resetKeepsBlocks)
+{
+    // a message that needs several blocks, but less than the allocator keeps
+    std::string big("[");
+    for (int i = 0; i < 1000; i++)
+    {
+        char buf[80];
+        snprintf(buf, sizeof(buf), "%s{\"id\":%d,\"x\":%d.25}", i ? "," : "", i, i);
+        big += buf;
+    }
+    big += "]";
+
+    ASSERT_TRUE(Parses(big));
+    const json_value *last = m_parser.Root()->last_child;
+
+    m_parser.Reset();
+    EXPECT_TRUE(m_parser.Root() == 0);
+
+    // the kept blocks are reused in the order they were allocated, so the
+    // same message lands at the same addresses
+    ASSERT_TRUE(Parses(big));
+    ASSERT_EQ(last, m_parser.Root()->last_child);
+    EXPECT_EQ(999, last->first_child->int_value);
+    EXPECT_EQ(999.25, last->last_child->float_value);
+
+    // a small message in between does not lose them
+    const json_value *v = ParseArray("[{\"method\":\"get_app_state\",\"id\":1}]");
+    ASSERT_TRUE(v != 0);
+    EXPECT_STREQ("get_app_state", v->first_child->string_value);
+
+    ASSERT_TRUE(Parses(big));
+    EXPECT_EQ(last, m_parser.Root()->last_child);
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,303 @@
+/*
+ *  json_writer_benchmark.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*
+ * Measures the cost of serializing a GuideStep notification, comparing the
+ * former event server helpers (a wxString per name and value, formatted with
+ * wxString::Format, escaped by copy, and converted to UTF-8 at the end) with
+ * JsonWriter. In unicode builds wxString is a wide string underneath, so the
+ * former path is reproduced here with std::wstring to keep the benchmark free
+ * of wxWidgets.
+ */
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cwchar>
+#include <iostream>
+#include <new>
+#include <stdlib.h>
+#include <string>
+#include "json_writer.h"
+
+static size_t s_allocations;
+
+void *operator new(size_t size)
+{
+    ++s_allocations;
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) throw()
+{
+    free(p);
+}
+
+namespace former
+{
+    typedef std::wstring String;
+
+    static String Format(const wchar_t *format, ...)
+    {
+        wchar_t buf[128];
+        va_list args;
+        va_start(args, format);
+        vswprintf(buf, sizeof(buf) / sizeof(buf[0]), format, args);
+        va_end(args);
+        return String(buf);
+    }
+
+    static void Replace(String& s, const String& from, const String& to)
+    {
+        for (size_t pos = 0; (pos = s.find(from, pos)) != String::npos; pos += to.size())
+            s.replace(pos, from.size(), to);
+    }
+
+    static String json_escape(const String& s)
+    {
+        String t(s);
+        Replace(t, L"\\", L"\\\\");
+        Replace(t, L"\"", L"\\\"");
+        return t;
+    }
+
+    static std::string ToUTF8(const String& s)
+    {
+        std::string out;
+        for (size_t i = 0; i < s.size(); i++)
+        {
+            unsigned int c = (unsigned int) s[i];
+            if (c < 0x80)
+                out += (char) c;
+            else if (c < 0x800)
+            {
+                out += (char)(0xc0 | (c >> 6));
+                out += (char)(0x80 | (c & 0x3f));
+            }
+            else
+            {
+                out += (char)(0xe0 | (c >> 12));
+                out += (char)(0x80 | ((c >> 6) & 0x3f));
+                out += (char)(0x80 | (c & 0x3f));
+            }
+        }
+        return out;
+    }
+
+    struct JObj
+    {
+        String m_s;
+        bool m_first;
+        JObj() : m_first(true) { m_s += L'{'; }
+        String str() { return m_s + L'}'; }
+    };
+
+    struct NV
+    {
+        String n;
+        String v;
+        NV(const String& n_, const String& v_) : n(n_), v(L'"' + json_escape(v_) + L'"') { }
+        NV(const String& n_, const wchar_t *v_) : n(n_), v(L'"' + json_escape(v_) + L'"') { }
+        NV(const String& n_, int v_) : n(n_), v(Format(L"%d", v_)) { }
+        NV(const String& n_, double v_, int prec) : n(n_), v(Format(L"%.*f", prec, v_)) { }
+    };
+
+    static JObj& operator<<(JObj& j, const NV& nv)
+    {
+        if (j.m_first)
+            j.m_first = false;
+        else
+            j.m_s += L',';
+        j.m_s += L'"' + nv.n + L"\":" + nv.v;
+        return j;
+    }
+}
+
+struct StepValues
+{
+    int frame;
+    double time;
+    double dx, dy;
+    double raRaw, decRaw;
+    double raGuide, decGuide;
+    int raDuration;
+    int decDuration;
+    double starMass;
+    double snr;
+    double avgDist;
+};
+
+static StepValues MakeStep(int i)
+{
+    StepValues s;
+    s.frame = i;
+    s.time = 2.0 * i + 0.123;
+    s.dx = 0.413 * ((i % 7) - 3);
+    s.dy = -0.271 * ((i % 5) - 2);
+    s.raRaw = s.dx * 0.9;
+    s.decRaw = s.dy * 1.1;
+    s.raGuide = s.raRaw * 0.7;
+    s.decGuide = s.decRaw * 0.7;
+    s.raDuration = 100 + i % 400;
+    s.decDuration = 50 + i % 200;
+    s.starMass = 12345.0 + i;
+    s.snr = 25.37;
+    s.avgDist = 0.42;
+    return s;
+}
+
+static std::string FormerGuideStep(const StepValues& s)
+{
+    using namespace former;
+
+    JObj ev;
+    ev << NV(L"Event", L"GuideStep")
+       << NV(L"Timestamp", 1430000000.0 + s.time, 3)
+       << NV(L"Host", L"observatory")
+       << NV(L"Inst", 1)
+       << NV(L"Frame", s.frame)
+       << NV(L"Time", s.time, 3)
+       << NV(L"Mount", L"On Camera")
+       << NV(L"dx", s.dx, 3)
+       << NV(L"dy", s.dy, 3)
+       << NV(L"RADistanceRaw", s.raRaw, 3)
+       << NV(L"DECDistanceRaw", s.decRaw, 3)
+       << NV(L"RADistanceGuide", s.raGuide, 3)
+       << NV(L"DECDistanceGuide", s.decGuide, 3)
+       << NV(L"RADuration", s.raDuration)
+       << NV(L"RADirection", L"East")
+       << NV(L"DECDuration", s.decDuration)
+       << NV(L"DECDirection", L"North")
+       << NV(L"StarMass", s.starMass, 0)
+       << NV(L"SNR", s.snr, 2)
+       << NV(L"AvgDist", s.avgDist, 2);
+
+    return ToUTF8(ev.str());
+}
+
+static void WriterGuideStep(JsonWriter& w, const StepValues& s)
+{
+    w.Reset();
+    w.BeginObject()
+        .Key("Event").String("GuideStep")
+        .Key("Timestamp").Fixed(1430000000.0 + s.time, 3)
+        .Key("Host").String("observatory")
+        .Key("Inst").Int(1)
+        .Key("Frame").Int(s.frame)
+        .Key("Time").Fixed(s.time, 3)
+        .Key("Mount").String("On Camera")
+        .Key("dx").Fixed(s.dx, 3)
+        .Key("dy").Fixed(s.dy, 3)
+        .Key("RADistanceRaw").Fixed(s.raRaw, 3)
+        .Key("DECDistanceRaw").Fixed(s.decRaw, 3)
+        .Key("RADistanceGuide").Fixed(s.raGuide, 3)
+        .Key("DECDistanceGuide").Fixed(s.decGuide, 3)
+        .Key("RADuration").Int(s.raDuration)
+        .Key("RADirection").String("East")
+        .Key("DECDuration").Int(s.decDuration)
+        .Key("DECDirection").String("North")
+        .Key("StarMass").Fixed(s.starMass, 0)
+        .Key("SNR").Fixed(s.snr, 2)
+        .Key("AvgDist").Fixed(s.avgDist, 2)
+     .EndObject();
+}
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double ElapsedNanoseconds(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+TEST(JsonWriterBenchmark, sameText)
+{
+    JsonWriter w;
+    for (int i = 0; i < 1000; i++)
+    {
+        StepValues s = MakeStep(i);
+        WriterGuideStep(w, s);
+        ASSERT_EQ(FormerGuideStep(s), w.Str());
+    }
+}
+
+TEST(JsonWriterBenchmark, perEventCost)
+{
+    enum { EVENTS = 100000 };
+
+    std::vector<StepValues> steps;
+    for (int i = 0; i < EVENTS; i++)
+        steps.push_back(MakeStep(i));
+
+    size_t bytes = 0;
+
+    s_allocations = 0;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < EVENTS; i++)
+        bytes += FormerGuideStep(steps[i]).size();
+    double former_ns = ElapsedNanoseconds(start) / EVENTS;
+    double former_allocs = (double) s_allocations / EVENTS;
+
+    JsonWriter w;
+    WriterGuideStep(w, steps[0]);
+
+    s_allocations = 0;
+    start = Clock::now();
+    for (int i = 0; i < EVENTS; i++)
+    {
+        WriterGuideStep(w, steps[i]);
+        bytes += w.Size();
+    }
+    double writer_ns = ElapsedNanoseconds(start) / EVENTS;
+    double writer_allocs = (double) s_allocations / EVENTS;
+
+    std::cout << "GuideStep: former " << former_ns << " ns, " << former_allocs << " allocations"
+              << "; JsonWriter " << writer_ns << " ns, " << writer_allocs << " allocations"
+              << " (" << bytes / (2 * EVENTS) << " bytes)" << std::endl;
+
+    RecordProperty("former_ns", static_cast<int>(former_ns));
+    RecordProperty("writer_ns", static_cast<int>(writer_ns));
+
+    // the writer reuses its buffer
+    EXPECT_EQ(0.0, writer_allocs);
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,191 @@
+/*
+ *  json_writer_test.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <gtest/gtest.h>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <locale.h>
+#include "json_writer.h"
+
+TEST(JsonWriterTest, structure)
+{
+    JsonWriter w;
+    w.BeginObject()
+        .Key("a").Int(1)
+        .Key("b").BeginArray().Int(2).Bool(true).Null().BeginObject().EndObject().EndArray()
+        .Key("c").BeginObject().Key("d").String("e").EndObject()
+        .Key("f").Raw("[1,2]")
+     .EndObject()
+     .EndLine();
+
+    EXPECT_EQ(std::string("{\"a\":1,\"b\":[2,true,null,{}],\"c\":{\"d\":\"e\"},\"f\":[1,2]}\r\n"), w.Str());
+
+    w.Reset();
+    w.BeginArray().EndArray();
+    EXPECT_EQ(std::string("[]"), w.Str());
+}
+
+TEST(JsonWriterTest, escapes)
+{
+    JsonWriter w;
+    const char s[] = "a\"b\\c\nd\re\tf\x01g\x1f h\xc3\xa9";
+    w.String(s, sizeof(s) - 1);
+    EXPECT_EQ(std::string("\"a\\\"b\\\\c\\nd\\re\\tf\\u0001g\\u001f h\xc3\xa9\""), w.Str());
+
+    w.Reset();
+    w.String("", 0);
+    EXPECT_EQ(std::string("\"\""), w.Str());
+}
+
+TEST(JsonWriterTest, integers)
+{
+    JsonWriter w;
+    w.BeginArray().Int(0).Int(-1).Int(1234567890).Int(LLONG_MAX).Int(LLONG_MIN).EndArray();
+    EXPECT_EQ(std::string("[0,-1,1234567890,9223372036854775807,-9223372036854775808]"), w.Str());
+}
+
+TEST(JsonWriterTest, fixedMatchesPrintf)
+{
+    srand(1);
+    for (int i = 0; i < 100000; i++)
+    {
+        int prec = i % 7;
+        double scale = pow(10.0, rand() % 12 - 4);
+        double v = ((double) rand() / RAND_MAX - 0.5) * scale;
+
+        // values right between two results may round either way
+        double scaled = fabs(v) * pow(10.0, prec);
+        if (fabs(scaled - floor(scaled) - 0.5) < 1e-6)
+            continue;
+
+        char expected[400];
+        snprintf(expected, sizeof(expected), "%.*f", prec, v);
+
+        std::string s;
+        JsonWriter::AppendFixed(s, v, prec);
+        ASSERT_EQ(std::string(expected), s) << "prec " << prec;
+    }
+}
+
+TEST(JsonWriterTest, fixedLargeAndSmall)
+{
+    std::string s;
+    JsonWriter::AppendFixed(s, 1e20, 2);
+    EXPECT_EQ(std::string("100000000000000000000.00"), s);
+
+    s.clear();
+    JsonWriter::AppendFixed(s, 0.0, 3);
+    EXPECT_EQ(std::string("0.000"), s);
+
+    s.clear();
+    JsonWriter::AppendFixed(s, 2.5, 0);
+    EXPECT_EQ(std::string("3"), s);
+
+    s.clear();
+    JsonWriter::AppendFixed(s, 1.0 / 3.0, 12);
+    EXPECT_EQ(std::string("0.333333333333"), s);
+}
+
+TEST(JsonWriterTest, doubleMatchesPrintf)
+{
+    const double values[] = { 0.0, 1.0, -3.0, 0.5, 1.0 / 3.0, 123456.0, 1234567.0, 1e-7, -2.5e10, 3.14159265 };
+
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+    {
+        char expected[32];
+        snprintf(expected, sizeof(expected), "%g", values[i]);
+
+        std::string s;
+        JsonWriter::AppendDouble(s, values[i]);
+        EXPECT_EQ(std::string(expected), s);
+    }
+}
+
+TEST(JsonWriterTest, nonFiniteIsNull)
+{
+    JsonWriter w;
+    w.BeginArray()
+        .Fixed(std::numeric_limits<double>::quiet_NaN(), 2)
+        .Double(std::numeric_limits<double>::infinity())
+        .Fixed(-std::numeric_limits<double>::infinity(), 0)
+     .EndArray();
+    EXPECT_EQ(std::string("[null,null,null]"), w.Str());
+}
+
+TEST(JsonWriterTest, decimalPointIgnoresLocale)
+{
+    const char *locales[] = { "de_DE.UTF-8", "de_DE", "fr_FR.UTF-8", "German" };
+
+    bool found = false;
+    for (size_t i = 0; i < sizeof(locales) / sizeof(locales[0]) && !found; i++)
+        found = setlocale(LC_NUMERIC, locales[i]) != 0;
+
+    if (!found)
+    {
+        std::cout << "no locale with a decimal comma, skipped" << std::endl;
+        return;
+    }
+
+    JsonWriter w;
+    w.BeginArray().Fixed(1.25, 2).Fixed(1e20 + 0.5, 1).Double(0.125).EndArray();
+
+    setlocale(LC_NUMERIC, "C");
+
+    EXPECT_EQ(std::string("[1.25,100000000000000000000.0,0.125]"), w.Str());
+}
+
+TEST(JsonWriterTest, resetKeepsBuffer)
+{
+    JsonWriter w;
+    for (int i = 0; i < 100; i++)
+        w.BeginObject().Key("k").String("some value").EndObject();
+
+    const char *data = w.Data();
+    w.Reset();
+    EXPECT_EQ(0u, w.Size());
+
+    w.BeginObject().Key("k").String("some value").EndObject();
+    EXPECT_EQ(data, w.Data());
+    EXPECT_EQ(std::string("{\"k\":\"some value\"}"), w.Str());
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,125 @@
+/*
+ *  periodogram_test.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*
+ * The periodogram must find the period and amplitude of a sinusoid sampled
+ * at irregular times on top of a drift, and must not report a period for
+ * drift and noise alone.
+ */
+
+#include <gtest/gtest.h>
+#include <math.h>
+#include "periodogram.h"
+
+static const double Pi = 3.14159265358979323846;
+
+// deterministic noise in [-1, 1)
+class Noise
+{
+    unsigned int m_state;
+public:
+    Noise() : m_state(12345) { }
+    double Next()
+    {
+        m_state = m_state * 1664525u + 1013904223u;
+        return (double) (m_state >> 8) / (double) (1u << 23) - 1.0;
+    }
+};
+
+class PeriodogramTest : public ::testing::Test
+{
+public:
+    Periodogram periodogram;
+    Noise noise;
+
+    PeriodogramTest()
+        : periodogram(PeriodogramMinPeriod, PeriodogramMaxPeriod, PeriodogramResolution)
+    {
+    }
+
+    // one hour of guide frames about two seconds apart
+    void AddSamples(double period, double amplitude, double drift, double noiseLevel)
+    {
+        double t = 1000.0;
+        while (t < 1000.0 + 3600.0)
+        {
+            double pos = drift * t + noiseLevel * noise.Next();
+            if (period > 0.0)
+                pos += amplitude * sin(2.0 * Pi * t / period + 0.7);
+            periodogram.AddSample(t, pos);
+            t += 2.0 + 0.5 * noise.Next();
+        }
+    }
+};
+
+TEST_F(PeriodogramTest, finds_sine_period_and_amplitude)
+{
+    AddSamples(480.0, 2.0, 0.003, 0.3);
+
+    std::vector<Periodogram::Peak> peaks = periodogram.DominantPeriods(3);
+    ASSERT_FALSE(peaks.empty());
+    EXPECT_NEAR(peaks[0].period, 480.0, 480.0 * 0.02);
+    EXPECT_NEAR(peaks[0].amplitude, 2.0, 2.0 * 0.05);
+    EXPECT_GT(peaks[0].power, MinimumPeriodogramPower);
+    for (unsigned int i = 1; i < peaks.size(); i++)
+        EXPECT_LT(peaks[i].power, peaks[0].power);
+}
+
+TEST_F(PeriodogramTest, no_peak_for_drift_and_noise)
+{
+    AddSamples(0.0, 0.0, 0.003, 0.3);
+
+    std::vector<Periodogram::Peak> peaks = periodogram.DominantPeriods(1);
+    EXPECT_TRUE(peaks.empty() || peaks[0].power < MinimumPeriodogramPower);
+}
+
+TEST_F(PeriodogramTest, reset_forgets_samples)
+{
+    AddSamples(480.0, 2.0, 0.0, 0.0);
+    periodogram.Reset();
+
+    EXPECT_EQ(0u, periodogram.SampleCount());
+    EXPECT_TRUE(periodogram.DominantPeriods(1).empty());
+
+    AddSamples(240.0, 1.0, 0.0, 0.0);
+    std::vector<Periodogram::Peak> peaks = periodogram.DominantPeriods(1);
+    ASSERT_FALSE(peaks.empty());
+    EXPECT_NEAR(peaks[0].period, 240.0, 240.0 * 0.02);
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,202 @@
+/*
+ *  guidelog_convert.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Converts between the guide step table of the text guide log and the binary
+ * guide log.
+ *
+ *   guidelog_convert PHD2_GuideLog_....txt out.glog
+ *   guidelog_convert PHD2_GuideLog_....glog out.txt
+ *
+ * Only the guide steps, dropped frames and the start time of each guiding
+ * session are carried over; calibration, settings and INFO lines are not
+ * part of the binary log.
+ */
+
+#include "guidelog_binary.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static bool IsBinaryLog(const char *fileName)
+{
+    FILE *fp = fopen(fileName, "rb");
+    if (!fp)
+        return false;
+    char magic[8];
+    bool ret = fread(magic, sizeof(magic), 1, fp) == 1 && memcmp(magic, "PHD2GLOG", sizeof(magic)) == 0;
+    fclose(fp);
+    return ret;
+}
+
+// "Guiding Begins at 2015-10-01 22:30:00", in local time
+static bool ParseGuidingBegins(const char *line, double *sessionStart)
+{
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(line, "Guiding Begins at %d-%d-%d %d:%d:%d",
+               &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6)
+    {
+        return false;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    *sessionStart = (double) mktime(&tm);
+    return true;
+}
+
+static int TextToBinary(const char *in, const char *out)
+{
+    FILE *fp = fopen(in, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "cannot open %s\n", in);
+        return 1;
+    }
+
+    GuideLogBinaryWriter writer;
+    if (writer.Open(out))
+    {
+        fprintf(stderr, "cannot create %s\n", out);
+        fclose(fp);
+        return 1;
+    }
+
+    double sessionStart = 0.0;
+    GuideLogRecord rec;
+    char line[4096];
+    bool err = false;
+
+    while (!err && fgets(line, sizeof(line), fp))
+    {
+        if (ParseGuidingBegins(line, &sessionStart))
+            continue;
+
+        if (!GuideLogRecordFromCsv(line, &rec))
+            continue;
+
+        rec.sessionStart = sessionStart;
+        err = writer.Append(rec);
+    }
+
+    fclose(fp);
+
+    err = writer.Flush() || err;
+    unsigned int count = writer.RecordCount();
+    writer.Close();
+
+    if (err)
+    {
+        fprintf(stderr, "error writing %s\n", out);
+        return 1;
+    }
+
+    printf("%u records\n", count);
+    return 0;
+}
+
+struct CsvWriter
+{
+    FILE *fp;
+    double sessionStart;
+    bool first;
+    unsigned int count;
+
+    void operator()(const GuideLogRecord& rec)
+    {
+        if (first || rec.sessionStart != sessionStart)
+        {
+            time_t t = (time_t) rec.sessionStart;
+            char buf[64];
+            strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&t));
+            fprintf(fp, "%sGuiding Begins at %s\n%s", first ? "" : "\n", buf, GuideLogCsvHeader());
+            sessionStart = rec.sessionStart;
+            first = false;
+        }
+
+        fputs(GuideLogRecordToCsv(rec).c_str(), fp);
+        ++count;
+    }
+};
+
+static int BinaryToText(const char *in, const char *out)
+{
+    GuideLogBinaryReader reader;
+    if (reader.Open(in))
+    {
+        fprintf(stderr, "cannot read %s\n", in);
+        return 1;
+    }
+
+    FILE *fp = fopen(out, "w");
+    if (!fp)
+    {
+        fprintf(stderr, "cannot create %s\n", out);
+        return 1;
+    }
+
+    CsvWriter writer;
+    writer.fp = fp;
+    writer.sessionStart = 0.0;
+    writer.first = true;
+    writer.count = 0;
+
+    bool err = reader.ForEach(writer);
+    err = fclose(fp) != 0 || err;
+
+    if (err)
+    {
+        fprintf(stderr, "error converting %s\n", in);
+        return 1;
+    }
+
+    printf("%u records\n", writer.count);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s INPUT OUTPUT\n"
+                "converts a text guide log to a binary guide log, or a binary one to text\n", argv[0]);
+        return 2;
+    }
+
+    if (IsBinaryLog(argv[1]))
+        return BinaryToText(argv[1], argv[2]);
+    else
+        return TextToBinary(argv[1], argv[2]);
+}
@@ -0,0 +1,249 @@
+/*
+ *  trace.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "phd.h"
+#include "trace.h"
+
+#include <wx/tls.h>
+#include <wx/ffile.h>
+
+#include <algorithm>
+#include <vector>
+
+// Entries kept per thread; a guide cycle records about a dozen, so this
+// covers several minutes of guiding at typical exposure times.
+static const unsigned int RING_SIZE = 4096;
+
+struct TraceEntry
+{
+    int stage;
+    wxLongLong start;
+    wxLongLong end;
+};
+
+struct TraceRing
+{
+    wxCriticalSection lock;     // only contended while exporting
+    unsigned long threadId;
+    bool inUse;                 // owned by a running thread
+    unsigned int next;
+    unsigned int count;
+    TraceEntry entries[RING_SIZE];
+
+    TraceRing(unsigned long id) : threadId(id), inUse(true), next(0), count(0) { }
+};
+
+volatile bool Trace::s_enabled = false;
+
+// std::chrono::steady_clock is not monotonic in MSVC 2013, wxStopWatch is
+static wxStopWatch s_clock;
+
+// the ring of a thread that has exited keeps its entries for an export until
+// a new thread takes it over, so the number of rings is bounded by the number
+// of threads running at once
+static wxCriticalSection s_ringsLock;
+static std::vector<TraceRing *> s_rings;
+
+static wxTLS_TYPE(TraceRing *) s_threadRing;
+
+static TraceRing *ThreadRing()
+{
+    TraceRing *ring = wxTLS_VALUE(s_threadRing);
+    if (!ring)
+    {
+        unsigned long id = wxThread::GetCurrentId();
+
+        wxCriticalSectionLocker ringsLock(s_ringsLock);
+
+        for (std::vector<TraceRing *>::const_iterator it = s_rings.begin(); it != s_rings.end(); ++it)
+        {
+            if (!(*it)->inUse)
+            {
+                ring = *it;
+                wxCriticalSectionLocker lock(ring->lock);
+                ring->threadId = id;
+                ring->inUse = true;
+                ring->next = 0;
+                ring->count = 0;
+                break;
+            }
+        }
+
+        if (!ring)
+        {
+            ring = new TraceRing(id);
+            s_rings.push_back(ring);
+        }
+
+        wxTLS_VALUE(s_threadRing) = ring;
+    }
+    return ring;
+}
+
+void Trace::Enable(bool enable)
+{
+    if (enable != s_enabled)
+        Debug.AddLine("Trace: %s", enable ? "enabled" : "disabled");
+    s_enabled = enable;
+}
+
+wxLongLong Trace::Now(void)
+{
+    return s_clock.TimeInMicro();
+}
+
+void Trace::Record(TraceStage stage, const wxLongLong& start, const wxLongLong& end)
+{
+    if (!s_enabled)
+        return;
+
+    TraceRing *ring = ThreadRing();
+    wxCriticalSectionLocker lock(ring->lock);
+
+    TraceEntry& entry = ring->entries[ring->next];
+    entry.stage = stage;
+    entry.start = start;
+    entry.end = end;
+
+    ring->next = (ring->next + 1) % RING_SIZE;
+    if (ring->count < RING_SIZE)
+        ++ring->count;
+}
+
+void Trace::ThreadExit(void)
+{
+    TraceRing *ring = wxTLS_VALUE(s_threadRing);
+    if (!ring)
+        return;
+
+    wxTLS_VALUE(s_threadRing) = 0;
+
+    wxCriticalSectionLocker ringsLock(s_ringsLock);
+    ring->inUse = false;
+}
+
+const char *Trace::StageName(TraceStage stage)
+{
+    switch (stage)
+    {
+    case TRACE_EXPOSE_REQUEST:      return "ExposeRequest";
+    case TRACE_CAPTURE:             return "Capture";
+    case TRACE_DARK_SUBTRACT:       return "DarkSubtract";
+    case TRACE_NOISE_REDUCTION:     return "NoiseReduction";
+    case TRACE_CALC_STATS:          return "CalcStats";
+    case TRACE_STAR_FIND:           return "StarFind";
+    case TRACE_GUIDE_ALGORITHM:     return "GuideAlgorithm";
+    case TRACE_GUIDE_PULSE:         return "GuidePulse";
+    default:                        return "Unknown";
+    }
+}
+
+// copies the entries of all rings, oldest first within each ring
+static void Snapshot(std::vector<std::pair<unsigned long, TraceEntry> >& out)
+{
+    wxCriticalSectionLocker ringsLock(s_ringsLock);
+
+    for (std::vector<TraceRing *>::const_iterator it = s_rings.begin(); it != s_rings.end(); ++it)
+    {
+        TraceRing *ring = *it;
+        wxCriticalSectionLocker lock(ring->lock);
+
+        unsigned int first = (ring->next + RING_SIZE - ring->count) % RING_SIZE;
+        for (unsigned int i = 0; i < ring->count; i++)
+            out.push_back(std::make_pair(ring->threadId, ring->entries[(first + i) % RING_SIZE]));
+    }
+}
+
+bool Trace::ExportChromeTrace(const wxString& fileName)
+{
+    std::vector<std::pair<unsigned long, TraceEntry> > entries;
+    Snapshot(entries);
+
+    wxFFile file(fileName, "w");
+    if (!file.IsOpened())
+    {
+        Debug.AddLine("Trace: could not create %s", fileName);
+        return true;
+    }
+
+    // complete events ("ph":"X") with microsecond timestamps
+    file.Write("{\"traceEvents\":[\n");
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const TraceEntry& entry = entries[i].second;
+        file.Write(wxString::Format("%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%s,\"dur\":%s}\n",
+            i > 0 ? "," : "", StageName(static_cast<TraceStage>(entry.stage)), entries[i].first,
+            entry.start.ToString(), (entry.end - entry.start).ToString()));
+    }
+    file.Write("],\"displayTimeUnit\":\"ms\"}\n");
+
+    bool err = !file.Close();
+
+    Debug.AddLine("Trace: wrote %u entries to %s", (unsigned int) entries.size(), fileName);
+
+    return err;
+}
+
+static double Percentile(const std::vector<double>& sorted, double p)
+{
+    size_t idx = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[idx];
+}
+
+void Trace::LogSummary(void)
+{
+    std::vector<std::pair<unsigned long, TraceEntry> > entries;
+    Snapshot(entries);
+
+    if (entries.empty())
+        return;
+
+    std::vector<double> durations[TRACE_STAGE_COUNT];
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const TraceEntry& entry = entries[i].second;
+        durations[entry.stage].push_back((entry.end - entry.start).ToDouble() / 1000.0);
+    }
+
+    for (int stage = 0; stage < TRACE_STAGE_COUNT; stage++)
+    {
+        std::vector<double>& d = durations[stage];
+        if (d.empty())
+            continue;
+
+        std::sort(d.begin(), d.end());
+        Debug.AddLine("Trace: %s n=%u ms p50=%.1f p90=%.1f p99=%.1f max=%.1f",
+            StageName(static_cast<TraceStage>(stage)), (unsigned int) d.size(),
+            Percentile(d, 0.5), Percentile(d, 0.9), Percentile(d, 0.99), d.back());
+    }
+}
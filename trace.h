@@ -0,0 +1,122 @@
+/*
+ *  trace.h
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2015 open-phd-guiding team
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef TRACE_INCLUDED
+#define TRACE_INCLUDED
+
+// the stages of a guide cycle that are timed
+enum TraceStage
+{
+    TRACE_EXPOSE_REQUEST,       // exposure request waiting for the worker thread
+    TRACE_CAPTURE,              // Camera::Capture, including the download
+    TRACE_DARK_SUBTRACT,        // dark frame and defect map
+    TRACE_NOISE_REDUCTION,
+    TRACE_CALC_STATS,
+    TRACE_STAR_FIND,
+    TRACE_GUIDE_ALGORITHM,      // guide algorithm result() for both axes
+    TRACE_GUIDE_PULSE,          // guide pulses, from the start of the first to the end of the last
+
+    TRACE_STAGE_COUNT
+};
+
+/*
+ * Lightweight tracing of the guide cycle.
+ *
+ * Each thread records {stage, start, end} into its own fixed size ring, so
+ * the most recent few thousand stages per thread are kept. The ring of a
+ * thread that has exited is kept for export until another thread takes it
+ * over. When tracing is
+ * disabled, recording a stage costs a test of a global flag.
+ *
+ * The rings can be exported as a Chrome trace-event file (load it in
+ * chrome://tracing) and summarized as percentiles in the debug log.
+ */
+class Trace
+{
+    static volatile bool s_enabled;
+
+public:
+    static void Enable(bool enable);
+    static bool IsEnabled(void);
+
+    // microseconds from a monotonic clock, unaffected by changes to the
+    // system time
+    static wxLongLong Now(void);
+
+    static void Record(TraceStage stage, const wxLongLong& start, const wxLongLong& end);
+
+    // called by a thread before it exits so that a later thread can reuse its ring
+    static void ThreadExit(void);
+
+    static const char *StageName(TraceStage stage);
+
+    // writes all rings to a Chrome trace-event JSON file, true on error
+    static bool ExportChromeTrace(const wxString& fileName);
+
+    // writes the duration percentiles of each stage to the debug log
+    static void LogSummary(void);
+};
+
+inline bool Trace::IsEnabled(void)
+{
+    return s_enabled;
+}
+
+// times the enclosing block
+class TraceScope
+{
+    int m_stage;
+    wxLongLong m_start;
+
+public:
+    TraceScope(TraceStage stage)
+    {
+        if (Trace::IsEnabled())
+        {
+            m_stage = stage;
+            m_start = Trace::Now();
+        }
+        else
+        {
+            m_stage = -1;
+        }
+    }
+
+    ~TraceScope()
+    {
+        if (m_stage >= 0)
+            Trace::Record(static_cast<TraceStage>(m_stage), m_start, Trace::Now());
+    }
+};
+
+#endif
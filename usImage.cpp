@@ -34,6 +34,153 @@
 
 #include "phd.h"
 #include "image_math.h"
+#include "image_kernels.h"
+
+// Number of idle frames kept by the pool. One frame is being captured while
+// the guider holds the previous one, so a few spares cover the frames that
+// are in flight between the worker thread and the main thread.
+static const unsigned int MAX_POOLED_IMAGES = 3;
+
+// Number of frames that may be out of the pool at once. Normal guiding needs
+// at most three (the guider's frame, the frame being processed and the next
+// exposure), so reaching this means frames are not being released, and
+// Acquire() refuses to allocate more rather than grow without limit.
+static const unsigned int MAX_ACQUIRED_IMAGES = 8;
+
+// Log the pool statistics every this many frames
+static const unsigned int POOL_STATS_INTERVAL = 500;
+
+struct ImagePoolState
+{
+    wxCriticalSection lock;
+    std::vector<usImage *> freeImages;
+    unsigned int acquired;
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int discarded;
+    unsigned int outstanding;
+    unsigned int refused;
+
+    ImagePoolState() : acquired(0), hits(0), misses(0), discarded(0), outstanding(0), refused(0) { }
+    ~ImagePoolState()
+    {
+        for (std::vector<usImage *>::iterator it = freeImages.begin(); it != freeImages.end(); ++it)
+            delete *it;
+    }
+};
+
+static ImagePoolState s_imagePool;
+
+usImage *usImagePool::Acquire()
+{
+    usImage *img = NULL;
+    bool refused = false;
+    bool logStats;
+
+    {
+        wxCriticalSectionLocker lock(s_imagePool.lock);
+
+        if (s_imagePool.outstanding >= MAX_ACQUIRED_IMAGES)
+        {
+            ++s_imagePool.refused;
+            refused = true;
+        }
+        else if (!s_imagePool.freeImages.empty())
+        {
+            img = s_imagePool.freeImages.back();
+            s_imagePool.freeImages.pop_back();
+            ++s_imagePool.hits;
+        }
+        else
+            ++s_imagePool.misses;
+
+        if (!refused)
+            ++s_imagePool.outstanding;
+
+        logStats = ++s_imagePool.acquired % POOL_STATS_INTERVAL == 0;
+    }
+
+    if (refused)
+    {
+        Debug.AddLine(wxString::Format("image pool: %u frames are out, refusing to allocate another", MAX_ACQUIRED_IMAGES));
+        LogStats();
+        return NULL;
+    }
+
+    if (img)
+    {
+        // keep the pixel buffer, Init() will reuse it if the size is unchanged
+        img->Subframe = wxRect(0, 0, 0, 0);
+        img->Min = img->Max = img->FiltMin = img->FiltMax = 0;
+        img->ImgStartTime = 0;
+        img->ImgExpDur = 0;
+        img->ImgStackCnt = 1;
+        img->ImgExpStartMillis = img->ImgExpEndMillis = 0;
+        img->ImgPulseOverlap = false;
+    }
+    else
+        img = new usImage();
+
+    if (logStats)
+        LogStats();
+
+    return img;
+}
+
+void usImagePool::Release(usImage *img)
+{
+    if (!img)
+        return;
+
+    {
+        wxCriticalSectionLocker lock(s_imagePool.lock);
+
+        if (s_imagePool.outstanding > 0)
+            --s_imagePool.outstanding;
+
+        if (img->ImageData && s_imagePool.freeImages.size() < MAX_POOLED_IMAGES)
+        {
+            s_imagePool.freeImages.push_back(img);
+            return;
+        }
+
+        ++s_imagePool.discarded;
+    }
+
+    delete img;
+}
+
+void usImagePool::Clear()
+{
+    std::vector<usImage *> images;
+
+    {
+        wxCriticalSectionLocker lock(s_imagePool.lock);
+        images.swap(s_imagePool.freeImages);
+    }
+
+    for (std::vector<usImage *>::iterator it = images.begin(); it != images.end(); ++it)
+        delete *it;
+}
+
+void usImagePool::LogStats()
+{
+    unsigned int acquired, hits, misses, discarded, pooled, outstanding, refused;
+
+    {
+        wxCriticalSectionLocker lock(s_imagePool.lock);
+        acquired = s_imagePool.acquired;
+        hits = s_imagePool.hits;
+        misses = s_imagePool.misses;
+        discarded = s_imagePool.discarded;
+        pooled = s_imagePool.freeImages.size();
+        outstanding = s_imagePool.outstanding;
+        refused = s_imagePool.refused;
+    }
+
+    Debug.AddLine(wxString::Format("image pool: acquired=%u hits=%u misses=%u discarded=%u pooled=%u out=%u refused=%u",
+        acquired, hits, misses, discarded, pooled, outstanding, refused));
+}
 
 bool usImage::Init(const wxSize& size)
 {
@@ -75,77 +222,24 @@ void usImage::SwapImageData(usImage& other)
 
 void usImage::CalcStats()
 {
+    TraceScope trace(TRACE_CALC_STATS);
+
     if (!ImageData || !NPixels)
         return;
 
-    Min = 65535; Max = 0;
-    FiltMin = 65535; FiltMax = 0;
-
-    if (Subframe.IsEmpty())
-    {
-        // full frame, no subframe
-
-        const unsigned short *src;
-
-        src = ImageData;
-        for (int i = 0; i < NPixels; i++)
-        {
-            int d = (int) *src++;
-            if (d < Min) Min = d;
-            if (d > Max) Max = d;
-        }
+    // This runs on every frame, so it neither allocates nor produces the
+    // filtered image: the median filter is evaluated one row at a time into
+    // a scratch row that is kept with the image.
+    wxRect rect = Subframe.IsEmpty() ? wxRect(Size) : Subframe;
 
-        unsigned short *tmpdata = new unsigned short[NPixels];
+    unsigned short lo, hi;
+    RectMinMax(ImageData, Size.GetWidth(), rect.x, rect.y, rect.width, rect.height, &lo, &hi);
+    Min = lo;
+    Max = hi;
 
-        Median3(tmpdata, ImageData, Size, wxRect(Size));
-
-        src = tmpdata;
-        for (int i = 0; i < NPixels; i++)
-        {
-            int d = (int) *src++;
-            if (d < FiltMin) FiltMin = d;
-            if (d > FiltMax) FiltMax = d;
-        }
-
-        delete[] tmpdata;
-    }
-    else
-    {
-        // Subframe
-
-        unsigned int pixcnt = Subframe.width * Subframe.height;
-        unsigned short *tmpdata = new unsigned short[pixcnt];
-
-        unsigned short *dst;
-
-        dst = tmpdata;
-        for (int y = 0; y < Subframe.height; y++)
-        {
-            const unsigned short *src = ImageData + Subframe.x + (Subframe.y + y) * Size.GetWidth();
-            for (int x = 0; x < Subframe.width; x++)
-            {
-               int d = (int) *src;
-               if (d < Min) Min = d;
-               if (d > Max) Max = d;
-               *dst++ = *src++;
-            }
-        }
-
-        dst = new unsigned short[pixcnt];
-
-        Median3(dst, tmpdata, Subframe.GetSize(), wxRect(Subframe.GetSize()));
-
-        const unsigned short *src = dst;
-        for (unsigned int i = 0; i < pixcnt; i++)
-        {
-            int d = (int) *src++;
-            if (d < FiltMin) FiltMin = d;
-            if (d > FiltMax) FiltMax = d;
-        }
-
-        delete[] dst;
-        delete[] tmpdata;
-    }
+    Median3MinMax(ImageData, Size.GetWidth(), rect.x, rect.y, rect.width, rect.height, m_medianRow, &lo, &hi);
+    FiltMin = lo;
+    FiltMax = hi;
 }
 
 bool usImage::CopyToImage(wxImage **rawimg, int blevel, int wlevel, double power)
@@ -48,6 +48,10 @@ public:
     time_t              ImgStartTime;
     int                 ImgExpDur;
     int                 ImgStackCnt;
+    wxLongLong          ImgExpStartMillis;  // wall clock (ms) when the exposure started
+    wxLongLong          ImgExpEndMillis;    // ... and ended, not counting the download
+    bool                ImgPulseOverlap;    // a guide pulse was running during the exposure
+    unsigned int        ImgFrameSeq;        // counts the frames captured, see WorkerThread::HandleExpose
 
     usImage() {
         Min = Max = FiltMin = FiltMax = 0;
@@ -56,6 +60,9 @@ public:
         ImgStartTime = 0;
         ImgExpDur = 0;
         ImgStackCnt = 1;
+        ImgExpStartMillis = ImgExpEndMillis = 0;
+        ImgPulseOverlap = false;
+        ImgFrameSeq = 0;
     }
     ~usImage() { delete[] ImageData; }
 
@@ -75,6 +82,9 @@ public:
     unsigned short&     Pixel(int x, int y) { return ImageData[y * Size.x + x]; }
     const unsigned short& Pixel(int x, int y) const { return ImageData[y * Size.x + x]; }
     void                Clear(void);
+
+private:
+    std::vector<unsigned short> m_medianRow; // scratch row for CalcStats
 };
 
 inline void usImage::Clear(void)
@@ -82,4 +92,17 @@ inline void usImage::Clear(void)
     memset(ImageData, 0, NPixels * sizeof(unsigned short));
 }
 
+// Recycles guide frames so that their pixel buffers are not freed and
+// re-allocated on every exposure. Images obtained from Acquire() must be
+// handed back with Release() instead of being deleted. Acquire() returns
+// NULL when too many frames are already out of the pool.
+class usImagePool
+{
+public:
+    static usImage *Acquire();
+    static void Release(usImage *img);
+    static void Clear();
+    static void LogStats();
+};
+
 #endif
@@ -35,10 +35,17 @@
 
 #include "phd.h"
 
+#include <atomic>
+
+// numbers the exposures in the order they are taken, by the primary and the
+// capture worker alike
+static std::atomic<unsigned int> s_frameSeq;
+
 WorkerThread::WorkerThread(MyFrame *pFrame)
     : wxThread(wxTHREAD_JOINABLE),
       m_interruptRequested(0),
-      m_killable(true)
+      m_killable(true),
+      m_queueCondition(m_queueMutex)
 {
     m_pFrame = pFrame;
     Debug.AddLine("WorkerThread constructor called");
@@ -49,28 +56,167 @@ WorkerThread::~WorkerThread(void)
     Debug.AddLine("WorkerThread destructor called");
 }
 
+const char *WorkerThread::RequestTypeName(int requestType)
+{
+    switch (requestType)
+    {
+        case REQUEST_TERMINATE: return "terminate";
+        case REQUEST_EXPOSE:    return "expose";
+        case REQUEST_MOVE:      return "move";
+        default:                return "none";
+    }
+}
+
+void WorkerThread::GetLatency(WorkerLatency *latency)
+{
+    wxMutexLocker lock(m_queueMutex);
+
+    for (int i = 0; i < REQUEST_TYPE_COUNT; i++)
+    {
+        latency[i] = m_latency[i];
+    }
+}
+
+// a normal guide step can be replaced by a newer one for the same mount
+static bool IsGuideStep(const MyFrame::PHD_MOVE_REQUEST& move)
+{
+    return !move.calibrationMove && move.normalMove;
+}
+
+// called with m_queueMutex held
+bool WorkerThread::Supersede(const WORKER_THREAD_REQUEST& message)
+{
+    if (message.request != REQUEST_MOVE || !IsGuideStep(message.args.move))
+        return false;
+
+    std::deque<QUEUED_REQUEST>& queue = m_queue[PRIORITY_HIGH];
+
+    for (std::deque<QUEUED_REQUEST>::iterator it = queue.begin(); it != queue.end(); ++it)
+    {
+        if (it->message.request == REQUEST_MOVE && IsGuideStep(it->message.args.move) &&
+            it->message.args.move.pMount == message.args.move.pMount)
+        {
+            Debug.AddLine(wxString::Format("worker thread: move (%.2f, %.2f) superseded by (%.2f, %.2f)",
+                it->message.args.move.vectorEndpoint.X, it->message.args.move.vectorEndpoint.Y,
+                message.args.move.vectorEndpoint.X, message.args.move.vectorEndpoint.Y));
+
+            MoveDroppedInfo info;
+            info.mount = it->message.args.move.pMount;
+            info.time = m_pFrame->TimeSinceGuidingStarted();
+            info.cameraOffset = it->message.args.move.vectorEndpoint;
+            info.supersededBy = message.args.move.vectorEndpoint;
+            m_pFrame->NotifyMoveDropped(info);
+
+            CompleteUnserved(it->message);
+            m_latency[REQUEST_MOVE].coalesced++;
+
+            // the newer step takes the place of the older one in the queue
+            it->message = message;
+            it->enqueueTime = Trace::Now();
+            return true;
+        }
+    }
+
+    return false;
+}
+
 void WorkerThread::EnqueueMessage(const WORKER_THREAD_REQUEST& message)
 {
-    wxMessageQueueError queueError;
+    wxMutexLocker lock(m_queueMutex);
+
+    if (Supersede(message))
+    {
+        return;
+    }
+
+    QUEUED_REQUEST request;
+    request.message = message;
+    request.enqueueTime = Trace::Now();
+
+    m_queue[message.request == REQUEST_EXPOSE ? PRIORITY_LOW : PRIORITY_HIGH].push_back(request);
+
+    m_queueCondition.Signal();
+}
+
+// waits up to timeoutMs for a request, the higher priority first
+bool WorkerThread::DequeueMessage(QUEUED_REQUEST *request, int timeoutMs)
+{
+    wxMutexLocker lock(m_queueMutex);
+
+    if (m_queue[PRIORITY_HIGH].empty() && m_queue[PRIORITY_LOW].empty())
+    {
+        m_queueCondition.WaitTimeout(timeoutMs);
+    }
 
-    if (message.request == REQUEST_EXPOSE)
+    for (int i = 0; i < PRIORITY_COUNT; i++)
     {
-        queueError = m_lowPriorityQueue.Post(message);
+        if (!m_queue[i].empty())
+        {
+            *request = m_queue[i].front();
+            m_queue[i].pop_front();
+            return true;
+        }
     }
-    else
+
+    return false;
+}
+
+// reports a request that was removed from the queue without being served, so
+// that the frame sees it complete
+void WorkerThread::CompleteUnserved(const WORKER_THREAD_REQUEST& message)
+{
+    switch (message.request)
     {
-        queueError = m_highPriorityQueue.Post(message);
+        case REQUEST_EXPOSE:
+            SendWorkerThreadExposeComplete(message.args.expose.pImage, true);
+            break;
+        case REQUEST_MOVE:
+            SendWorkerThreadMoveComplete(message.args.move.pMount, Mount::MOVE_OK);
+            break;
+        default:
+            break;
     }
+}
 
-    assert(queueError == wxMSGQUEUE_NO_ERROR);
+void WorkerThread::RecordLatency(const QUEUED_REQUEST& request, const wxLongLong& started)
+{
+    wxLongLong finished = Trace::Now();
+    double queueMs = (started - request.enqueueTime).ToDouble() / 1000.0;
+    double runMs = (finished - started).ToDouble() / 1000.0;
 
-    queueError = m_wakeupQueue.Post(true);
+    Debug.AddLine(wxString::Format("worker thread %s request: queued %.0f ms, served in %.0f ms",
+        RequestTypeName(request.message.request), queueMs, runMs));
 
-    assert(queueError == wxMSGQUEUE_NO_ERROR);
+    wxMutexLocker lock(m_queueMutex);
+
+    WorkerLatency& latency = m_latency[request.message.request];
+    latency.count++;
+    latency.totalQueueMs += queueMs;
+    latency.maxQueueMs = wxMax(latency.maxQueueMs, queueMs);
+    latency.totalRunMs += runMs;
+    latency.maxRunMs = wxMax(latency.maxRunMs, runMs);
 }
 
 /*************      Terminate      **************************/
 
+void WorkerThread::RequestStop(void)
+{
+    m_interruptRequested |= INT_STOP;
+
+    // exposures that have not started yet are cancelled
+    wxMutexLocker lock(m_queueMutex);
+
+    std::deque<QUEUED_REQUEST>& queue = m_queue[PRIORITY_LOW];
+
+    while (!queue.empty())
+    {
+        Debug.AddLine("worker thread: cancelling queued %s request", RequestTypeName(queue.front().message.request));
+        CompleteUnserved(queue.front().message);
+        m_latency[queue.front().message.request].cancelled++;
+        queue.pop_front();
+    }
+}
+
 void WorkerThread::EnqueueWorkerThreadTerminateRequest(void)
 {
     m_interruptRequested = INT_STOP | INT_TERMINATE;
@@ -140,6 +286,10 @@ bool WorkerThread::HandleExpose(MyFrame::EXPOSE_REQUEST *req)
             throw ERROR_INFO("Time lapse interrupted");
         }
 
+        req->pImage->ImgFrameSeq = ++s_frameSeq;
+
+        wxLongLong expStart = wxGetUTCTimeMillis();
+
         if (pCamera->HasNonGuiCapture())
         {
             Debug.Write(wxString::Format("Handling exposure in thread, d=%d o=%x r=(%d,%d,%d,%d)\n", req->exposureDuration,
@@ -147,6 +297,8 @@ bool WorkerThread::HandleExpose(MyFrame::EXPOSE_REQUEST *req)
 
             req->pImage->InitImgStartTime();
 
+            TraceScope trace(TRACE_CAPTURE);
+
             if (pCamera->Capture(req->exposureDuration, *req->pImage, req->options, req->subframe))
             {
                 throw ERROR_INFO("Capture failed");
@@ -157,6 +309,8 @@ bool WorkerThread::HandleExpose(MyFrame::EXPOSE_REQUEST *req)
             Debug.Write(wxString::Format("Handling exposure in myFrame, d=%d o=%x r=(%d,%d,%d,%d)\n", req->exposureDuration,
                                          req->options, req->subframe.x, req->subframe.y, req->subframe.width, req->subframe.height));
 
+            TraceScope trace(TRACE_CAPTURE);
+
             wxSemaphore semaphore;
             req->pSemaphore = &semaphore;
 
@@ -173,6 +327,14 @@ bool WorkerThread::HandleExpose(MyFrame::EXPOSE_REQUEST *req)
 
         Debug.AddLine("Exposure complete");
 
+        // the capture returns after the download, so the exposure ended at the
+        // requested duration or at the return, whichever came first
+        req->pImage->ImgExpStartMillis = expStart;
+        req->pImage->ImgExpEndMillis = wxMin(expStart + req->exposureDuration, wxGetUTCTimeMillis());
+        req->pImage->ImgPulseOverlap =
+            (pMount && pMount->PulseOverlaps(req->pImage->ImgExpStartMillis, req->pImage->ImgExpEndMillis)) ||
+            (pSecondaryMount && pSecondaryMount->PulseOverlaps(req->pImage->ImgExpStartMillis, req->pImage->ImgExpEndMillis));
+
         if (!bError)
         {
             switch (m_pFrame->GetNoiseReductionMethod())
@@ -188,6 +350,11 @@ bool WorkerThread::HandleExpose(MyFrame::EXPOSE_REQUEST *req)
             }
 
             req->pImage->CalcStats();
+
+            // ordinary guide steps are made right here, without waiting for
+            // the GUI thread to process the frame, unless the worker is stopping
+            if (!WorkerThread::StopRequested())
+                GuideCore::Step(req->pImage);
         }
     }
     catch (wxString Msg)
@@ -209,7 +376,8 @@ void WorkerThread::SendWorkerThreadExposeComplete(usImage *pImage, bool bError)
 
 /*************      Move       **************************/
 
-void WorkerThread::EnqueueWorkerThreadMoveRequest(Mount *pMount, const PHD_Point& vectorEndpoint, bool normalMove)
+void WorkerThread::EnqueueWorkerThreadMoveRequest(Mount *pMount, const PHD_Point& vectorEndpoint, bool normalMove,
+    const GuideStepFrame& frame, const usImage *pImage)
 {
     m_interruptRequested &= ~INT_STOP;
 
@@ -223,8 +391,15 @@ void WorkerThread::EnqueueWorkerThreadMoveRequest(Mount *pMount, const PHD_Point
     message.args.move.calibrationMove = false;
     message.args.move.vectorEndpoint  = vectorEndpoint;
     message.args.move.normalMove      = normalMove;
+    message.args.move.frame           = frame;
     message.args.move.pSemaphore      = NULL;
 
+    if (pImage)
+    {
+        message.args.move.frameStart  = pImage->ImgExpStartMillis;
+        message.args.move.frameEnd    = pImage->ImgExpEndMillis;
+    }
+
     EnqueueMessage(message);
 }
 
@@ -254,6 +429,22 @@ Mount::MOVE_RESULT WorkerThread::HandleMove(MyFrame::PHD_MOVE_REQUEST *pArgs)
 
     try
     {
+        if (!pArgs->calibrationMove && pArgs->frameStart != 0)
+        {
+            // a frame taken while earlier corrections were still running only
+            // shows part of them. They have all completed by now, so the mount
+            // is sent the error that remains once they took full effect.
+            PHD_Point unseen = pArgs->pMount->UnseenCorrection(pArgs->frameStart, pArgs->frameEnd);
+            PHD_Point unseenCamera;
+            if ((unseen.X != 0.0 || unseen.Y != 0.0) &&
+                !pArgs->pMount->TransformMountCoordinatesToCameraCoordinates(unseen, unseenCamera))
+            {
+                Debug.AddLine(wxString::Format("correction not seen by the frame (%.2f, %.2f)",
+                    unseenCamera.X, unseenCamera.Y));
+                pArgs->vectorEndpoint -= unseenCamera;
+            }
+        }
+
         if (pArgs->pMount->HasNonGuiMove())
         {
             Debug.AddLine(wxString::Format("Handling move in thread for %s dir=%d",
@@ -275,7 +466,7 @@ Mount::MOVE_RESULT WorkerThread::HandleMove(MyFrame::PHD_MOVE_REQUEST *pArgs)
                 Debug.AddLine(wxString::Format("endpoint = (%.2f, %.2f)",
                     pArgs->vectorEndpoint.X, pArgs->vectorEndpoint.Y));
 
-                result = pArgs->pMount->Move(pArgs->vectorEndpoint, pArgs->normalMove);
+                result = pArgs->pMount->Move(pArgs->vectorEndpoint, pArgs->normalMove, pArgs->frame);
                 if (result != Mount::MOVE_OK)
                 {
                     throw ERROR_INFO("Move failed");
@@ -344,23 +535,20 @@ wxThread::ExitCode WorkerThread::Entry()
 
     while (!bDone)
     {
-        WORKER_THREAD_REQUEST message;
-        bool dummy;
-        wxMessageQueueError queueError = m_wakeupQueue.Receive(dummy);
-
-        Debug.AddLine("Worker thread wakes up");
-
-        assert(queueError == wxMSGQUEUE_NO_ERROR);
+        enum { WAIT_MS = 1000 };
 
-        queueError = m_highPriorityQueue.ReceiveTimeout(0, message);
+        QUEUED_REQUEST request;
 
-        if (queueError == wxMSGQUEUE_TIMEOUT)
+        if (!DequeueMessage(&request, WAIT_MS))
         {
-            queueError = m_lowPriorityQueue.ReceiveTimeout(0, message);
-            assert(queueError != wxMSGQUEUE_TIMEOUT);
+            bDone |= TestDestroy();
+            continue;
         }
 
-        assert(queueError == wxMSGQUEUE_NO_ERROR);
+        Debug.AddLine("Worker thread wakes up");
+
+        WORKER_THREAD_REQUEST& message = request.message;
+        wxLongLong started = Trace::Now();
 
         switch(message.request)
         {
@@ -376,6 +564,7 @@ wxThread::ExitCode WorkerThread::Entry()
             case REQUEST_EXPOSE:
                 Debug.AddLine("worker thread servicing REQUEST_EXPOSE %d",
                     message.args.expose.exposureDuration);
+                Trace::Record(TRACE_EXPOSE_REQUEST, request.enqueueTime, started);
                 bError = HandleExpose(&message.args.expose);
                 SendWorkerThreadExposeComplete(message.args.expose.pImage, bError);
                 break;
@@ -392,10 +581,14 @@ wxThread::ExitCode WorkerThread::Entry()
                 break;
         }
 
+        RecordLatency(request, started);
+
         Debug.AddLine("worker thread done servicing request");
         bDone |= TestDestroy();
     }
 
+    Trace::ThreadExit();
+
     Debug.AddLine("WorkerThread::Entry() ends");
     Debug.Flush();
 
@@ -44,20 +44,47 @@ class MyFrame;
  * second mount, so that on systems with two mounts (probably an AO and a telescope), the
  * second mount can be moving while we image and guide with the first mount.
  *
- * The worker threads have three queues, one for move requests (higher priority)
- * and one for exposure requests (lower priority) and one "wakeup queue". The wx queue
- * routines do not have a way to wait on multiple queues, so there is no easy way
- * to implement the dual queue priority model without a third queue.
+ * With pipelined capture enabled a third worker thread, the capture thread,
+ * takes the exposures while guiding, so that the next exposure is already
+ * running while the primary thread sends the correction for the previous frame.
  *
- * When something is enqueued on either of the work queues, a dummy message is
- * also enqueued on the wakeup queue, which wakes the thread up.  It then finds
- * the work item by looking first on the high priority queue and then the low
- * priority queue.
+ * Each worker thread has a single request queue with two priorities: move and
+ * terminate requests are served before exposure requests. Both priorities are
+ * kept under one mutex, and the thread waits on a condition for either, so an
+ * enqueue takes one lock and a dequeue never polls.
  *
+ * A guide step that is still waiting in the queue when a newer guide step for
+ * the same mount arrives is superseded by it (coalesced), since the newer one
+ * was computed from a more recent frame. The dropped step is reported to the
+ * guide log and the event server. A step does not reach the guide algorithms
+ * until it is served, so the algorithms only see the steps actually made.
+ * Since steps can wait behind a slow mount, the part of the earlier
+ * corrections that the step's frame did not see is subtracted when the step
+ * is served rather than when it is computed. RequestStop() cancels exposures
+ * that have not started yet.
+ *
+ * The time each request spends waiting in the queue and being served is
+ * written to the debug log and kept per request type, see GetLatency().
  */
 
+// queue and service times of one type of worker thread request
+struct WorkerLatency
+{
+    unsigned int count;         // requests served
+    unsigned int coalesced;     // requests superseded before they started
+    unsigned int cancelled;     // requests cancelled before they started
+    double totalQueueMs;
+    double maxQueueMs;
+    double totalRunMs;
+    double maxRunMs;
+
+    WorkerLatency() : count(0), coalesced(0), cancelled(0), totalQueueMs(0.0), maxQueueMs(0.0),
+        totalRunMs(0.0), maxRunMs(0.0) { }
+};
+
 class WorkerThread : public wxThread
 {
+public:
     // types and routines for the server->worker message queue
     enum WORKER_REQUEST_TYPE
     {
@@ -65,8 +92,12 @@ class WorkerThread : public wxThread
         REQUEST_TERMINATE,
         REQUEST_EXPOSE,
         REQUEST_MOVE,
+
+        REQUEST_TYPE_COUNT
     };
 
+private:
+
     /*
     * a union containing all the possible argument types for thread work
     * requests
@@ -88,12 +119,28 @@ class WorkerThread : public wxThread
         WORKER_REQUEST_ARGS args;
     };
 
+    struct QUEUED_REQUEST
+    {
+        WORKER_THREAD_REQUEST message;
+        wxLongLong enqueueTime;     // Trace::Now() microseconds
+    };
+
+    enum QUEUE_PRIORITY
+    {
+        PRIORITY_HIGH,
+        PRIORITY_LOW,
+
+        PRIORITY_COUNT
+    };
+
     MyFrame *m_pFrame;
     volatile unsigned int m_interruptRequested;
     volatile bool m_killable;
-    wxMessageQueue<bool> m_wakeupQueue;
-    wxMessageQueue<WORKER_THREAD_REQUEST> m_highPriorityQueue;
-    wxMessageQueue<WORKER_THREAD_REQUEST> m_lowPriorityQueue;
+
+    wxMutex m_queueMutex;                               // protects the queues and the latency
+    wxCondition m_queueCondition;                       // signaled when a request is queued
+    std::deque<QUEUED_REQUEST> m_queue[PRIORITY_COUNT];
+    WorkerLatency m_latency[REQUEST_TYPE_COUNT];
 
 public:
 
@@ -112,6 +159,10 @@ public:
 
     static WorkerThread *This(void);
 
+    static const char *RequestTypeName(int requestType);
+    // latency by request type, REQUEST_TYPE_COUNT entries
+    void GetLatency(WorkerLatency *latency);
+
 private:
     wxThread::ExitCode Entry();
 
@@ -163,7 +214,8 @@ protected:
 
     /*************      Guide       **************************/
 public:
-    void EnqueueWorkerThreadMoveRequest(Mount *pMount, const PHD_Point& vectorEndpoint, bool normalMove);
+    void EnqueueWorkerThreadMoveRequest(Mount *pMount, const PHD_Point& vectorEndpoint, bool normalMove,
+        const GuideStepFrame& frame, const usImage *pImage = NULL);
     void EnqueueWorkerThreadMoveRequest(Mount *pMount, const GUIDE_DIRECTION direction, int duration);
 protected:
     Mount::MOVE_RESULT HandleMove(MyFrame::PHD_MOVE_REQUEST *pArgs);
@@ -171,13 +223,12 @@ protected:
     // in the frame class: void MyFrame::OnWorkerThreadGuideComplete(wxThreadEvent& event);
 
     void EnqueueMessage(const WORKER_THREAD_REQUEST& message);
+    bool DequeueMessage(QUEUED_REQUEST *request, int timeoutMs);
+    bool Supersede(const WORKER_THREAD_REQUEST& message);
+    void CompleteUnserved(const WORKER_THREAD_REQUEST& message);
+    void RecordLatency(const QUEUED_REQUEST& request, const wxLongLong& started);
 };
 
-inline void WorkerThread::RequestStop(void)
-{
-    m_interruptRequested |= INT_STOP;
-}
-
 inline WorkerThread *WorkerThread::This(void)
 {
     return static_cast<WorkerThread *>(wxThread::This());